@@ -39,6 +39,7 @@ but WITHOUT ANY WARRANTY of any kind.
 
 #include <dirent.h> // readdir
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/epoll.h>
 #include <sys/stat.h>
 #include <sys/time.h> // gettimeofday
@@ -49,6 +50,7 @@ but WITHOUT ANY WARRANTY of any kind.
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <random>
 #include <future>
@@ -68,6 +70,8 @@ struct Config {
   uint32_t totalReadWriteScale = 2000;
   uint32_t shortenFileSize = 0;
   bool newInstance = false;
+  bool syncAfterWrite = false;
+  bool registeredBuffers = false;
   std::vector<std::string> dirPrefix;
 
   int readConfig(const std::string &configFileName) {
@@ -93,6 +97,10 @@ struct Config {
                        " size by this much to test nonaliged reads")(
         "new_instance", value<bool>(&newInstance)->required(),
         "create files from scratch")(
+        "sync_after_write", value<bool>(&syncAfterWrite),
+        "open files without O_SYNC and sync each write asynchronously")(
+        "registered_buffers", value<bool>(&registeredBuffers),
+        "read into buffer regions registered with IOExecRegisterBuffer")(
         "mountpoint",
         value<std::vector<std::string>>(&dirPrefix)->required()->multitoken(),
         "ssd mount point");
@@ -239,8 +247,9 @@ struct FixedSizeFileManager {
     retFilenum = FilesCtr++;
     auto str = getFilename(retFilenum);
 
+    const int syncFlag = config.syncAfterWrite ? 0 : O_SYNC;
     handle = IOExecFileOpen(serviceHandle, str.c_str(), str.size(),
-                            O_DIRECT | O_RDWR | O_SYNC | O_CREAT);
+                            O_DIRECT | O_RDWR | syncFlag | O_CREAT);
 
     if (handle != nullptr) {
       std::unique_lock<std::mutex> lck(mutex);
@@ -323,6 +332,7 @@ class StatusExt;
 
 struct ThreadCtx {
   IOExecServiceHandle serviceHandle;
+  IOExecEventFdHandle evHandle{nullptr};
   uint32_t minFiles;
   uint32_t maxFiles;
   uint32_t maxBlocks;
@@ -338,12 +348,54 @@ struct ThreadCtx {
   gobjfs::os::ShutdownNotifier ioCompletionThreadShutdown;
 
   int writePercent{0}; // between 0 -100
+
+  // registered region carved into block_size read buffers
+  // reads use gMempool when all are in use
+  int32_t bufIndex{0};
+  char *region{nullptr};
+  std::mutex slotMutex;
+  std::vector<uint32_t> freeSlots;
+
+  int32_t registerBuffers(uint32_t numSlots) {
+    void *addr = nullptr;
+    bufIndex = IOExecRegisterBuffer(serviceHandle,
+                                    (size_t)numSlots * config.blockSize, &addr);
+    if (bufIndex < 0) {
+      LOG(ERROR) << "failed to register buffer region error=" << bufIndex;
+      return bufIndex;
+    }
+    region = static_cast<char *>(addr);
+    for (uint32_t slot = 0; slot < numSlots; slot++) {
+      freeSlots.push_back(slot);
+    }
+    return 0;
+  }
+
+  // @return false if no registered buffer is free
+  bool getSlot(gIOExecFragment &frag) {
+    std::unique_lock<std::mutex> lck(slotMutex);
+    if ((bufIndex <= 0) || freeSlots.empty()) {
+      return false;
+    }
+    frag.bufIndex = bufIndex;
+    frag.bufOffset = (size_t)freeSlots.back() * config.blockSize;
+    freeSlots.pop_back();
+    return true;
+  }
+
+  void putSlot(const gIOExecFragment &frag) {
+    std::unique_lock<std::mutex> lck(slotMutex);
+    freeSlots.push_back(frag.bufOffset / config.blockSize);
+  }
 };
 
+// reads in flight per thread which can use a registered buffer
+static constexpr uint32_t RegisteredSlots = 1024;
+
 static gobjfs::MempoolSPtr objpool;
 
 struct StatusExt {
-  enum OpType { Invalid, Read, Write, Delete, Freed };
+  enum OpType { Invalid, Read, Write, Delete, Sync, Freed };
 
   static void *operator new(size_t sz) { return objpool->Alloc(sz); }
 
@@ -352,6 +404,7 @@ struct StatusExt {
   bool isRead() const { return (op == Read); }
   bool isWrite() const { return (op == Write); }
   bool isDelete() const { return (op == Delete); }
+  bool isSync() const { return (op == Sync); }
 
   StatusExt() {
     op = Invalid;
@@ -413,7 +466,18 @@ static int wait_for_iocompletion(int epollfd, int efd, ThreadCtx *ctx) {
           {
             StatusExt *ext =
                 reinterpret_cast<StatusExt *>(iostatus.completionId);
-            if (ext->isWrite()) {
+            if (ext->isWrite() && config.syncAfterWrite &&
+                (iostatus.errorCode == 0)) {
+              // write is counted when its sync completes
+              ext->op = StatusExt::Sync;
+              int syncRet = IOExecFileSync(ext->handle, iostatus.completionId,
+                                           /*dataOnly*/ true, ctx->evHandle);
+              if (syncRet == 0) {
+                continue;
+              }
+              iostatus.errorCode = syncRet;
+            }
+            if (ext->isWrite() || ext->isSync()) {
               ctx->totalWriteLatency = ext->timer.elapsedMicroseconds();
               ctr++;
               // IOExecFileTruncate(ext->handle, ext->batch->array[0].size -
@@ -425,7 +489,8 @@ static int wait_for_iocompletion(int epollfd, int efd, ThreadCtx *ctx) {
             } else if (ext->isRead()) {
               if (config.doMemCheck) {
                 gIOExecFragment &frag = ext->batch->array[0];
-                char *buf = frag.addr;
+                char *buf = frag.bufIndex ? (ctx->region + frag.bufOffset)
+                                          : frag.addr;
                 const char expChar = 'a' + (ext->actualFilenum % 26);
                 bool failed = false;
                 uint32_t bufOffset = 0;
@@ -462,6 +527,9 @@ static int wait_for_iocompletion(int epollfd, int efd, ThreadCtx *ctx) {
 
             assert(ext->batch->count == 1);
             assert(ext->batch->array[0].completionId == iostatus.completionId);
+            if (ext->batch->array[0].bufIndex) {
+              ctx->putSlot(ext->batch->array[0]);
+            }
             gIOBatchFree(ext->batch);
 
             delete ext;
@@ -512,6 +580,7 @@ static void doRandomReadWrite(ThreadCtx *ctx) {
   }
 
   int efd = IOExecEventFdGetReadFd(evHandle);
+  ctx->evHandle = evHandle;
 
   {
     epoll_event event;
@@ -562,6 +631,9 @@ static void doRandomReadWrite(ThreadCtx *ctx) {
 
   uint32_t sleepTimeMicrosec = 1;
 
+  // readable when refused reads and writes can be retried
+  const int spaceFd = IOExecGetSpaceAvailableFd(ctx->serviceHandle);
+
   while (totalIO < ctx->perThreadIO) {
     IOExecFileHandle handle{nullptr};
 
@@ -652,8 +724,10 @@ static void doRandomReadWrite(ThreadCtx *ctx) {
         frag.offset = blockNum * config.blockSize;
         frag.size =
             config.blockSize - config.shortenFileSize; // TEST unaligned reads
-        frag.addr = (caddr_t)gMempool_alloc(frag.size);
-        assert(frag.addr != nullptr);
+        if (!ctx->getSlot(frag)) {
+          frag.addr = (caddr_t)gMempool_alloc(frag.size);
+          assert(frag.addr != nullptr);
+        }
       } else if (ext->isDelete()) {
         // do nothing
       } else {
@@ -676,7 +750,16 @@ static void doRandomReadWrite(ThreadCtx *ctx) {
         LOG(FATAL) << " Unknown opcode";
       }
 
-      if (ret == -EAGAIN) {
+      if ((ret == -EAGAIN) && !ext->isDelete() && (spaceFd >= 0)) {
+        // other threads may consume the signal, so poll with timeout
+        pollfd pfd{spaceFd, POLLIN, 0};
+        if (poll(&pfd, 1, /*msec*/ 1) == 1) {
+          uint64_t counter;
+          ssize_t readSize = read(spaceFd, &counter, sizeof(counter));
+          (void)readSize;
+        }
+        LOG_EVERY_N(WARNING, 1000) << "too fast, waited for space";
+      } else if (ret == -EAGAIN) {
         if (sleepTimeMicrosec < 10)
           sleepTimeMicrosec *= 2;
         usleep(sleepTimeMicrosec);
@@ -755,6 +838,9 @@ int main(int argc, char *argv[]) {
 
     ctx->minFiles = 0;
     ctx->maxFiles = config.maxFiles;
+    if (config.registeredBuffers) {
+      ctx->registerBuffers(RegisteredSlots);
+    }
     auto f = std::async(std::launch::async, doRandomReadWrite, ctx);
 
     futVec.emplace_back(std::move(f));
@@ -778,17 +864,36 @@ int main(int argc, char *argv[]) {
 
   endCpuStats -= startCpuStats;
 
+  // each IOExecutor runs on its own core; compare run_to_completion
+  // against the default on these
+  const int32_t numIOExec = IOExecGetNumExecutors(serviceHandle);
+  const int32_t numIOExecThreads = IOExecGetNumThreads(serviceHandle);
+  const uint64_t iopsPerCore = totalIOPs / std::max(numIOExec, 1);
+  const long numCtxSwitches =
+      endCpuStats.voluntaryCtxSwitch_ + endCpuStats.involuntaryCtxSwitch_;
+  // compare registered_buffers against the default on this
+  const uint64_t totalIO = (uint64_t)config.maxThr * config.perThreadIO;
+  const double cpuUsecPerIO =
+      (double)(endCpuStats.userTimeMicrosec() +
+               endCpuStats.systemTimeMicrosec()) /
+      std::max(totalIO, (uint64_t)1);
+
   {
     std::ostringstream s;
 
-    s << "num_ioexec=" << IOExecGetNumExecutors(serviceHandle)
+    s << "num_ioexec=" << numIOExec
+      << ":ioexec_threads=" << numIOExecThreads
       << ":num_threads=" << config.maxThr
       << ":write_perc=" << config.writePercent
       << ":write_scale=" << config.totalReadWriteScale << ":iops=" << totalIOPs
       << ":write_latency(usec)=" << totalWriteLatency
       << ":read_latency(usec)=" << totalReadLatency
       << ":delete_latency(usec)=" << totalDeleteLatency
-      << ":cpu_perc=" << endCpuStats.getCpuUtilization();
+      << ":cpu_perc=" << endCpuStats.getCpuUtilization()
+      << ":ctx_switches=" << numCtxSwitches
+      << ":iops_per_core=" << iopsPerCore
+      << ":registered_buffers=" << config.registeredBuffers
+      << ":cpu_usec_per_io=" << cpuUsecPerIO;
 
     LOG(INFO) << s.str();
 
@@ -805,7 +910,9 @@ int main(int argc, char *argv[]) {
       << IOExecGetNumExecutors(serviceHandle) << "," << config.maxThr << ","
       << totalIOPs << "," << totalWriteLatency.mean() << ","
       << totalReadLatency.mean() << "," << totalDeleteLatency.mean() << ","
-      << endCpuStats.getCpuUtilization();
+      << endCpuStats.getCpuUtilization() << "," << numIOExecThreads << ","
+      << numCtxSwitches << "," << iopsPerCore << ","
+      << config.registeredBuffers << "," << cpuUsecPerIO;
 
     std::cout << s.str() << std::endl;
   }
@@ -11,9 +11,24 @@ export GLOG_log_dir=/home/sandeep/glog_hist
 # by this script
 sed -i "s/new_instance=.*/new_instance=false/" ./benchioexec.conf
 
+# compare default threads against one run-to-completion thread per core
+# on each kernel backend, which starts each csv row
+# csv has ioexec thread count, context switches and iops per core
+# followed by registered_buffers and cpu usec per io
+for backend in libaio io_uring
+do
+for registered_buffers in false true
+do
+sed -i "s/registered_buffers=.*/registered_buffers=$registered_buffers/" ./benchioexec.conf
+for run_to_completion in false true
+do
 for ioexec in 1 2 4 8 16
 do
 	cp ./gioexecfile.conf.bak ./gioexecfile.conf
+	sed -i "/backend=/d" ./gioexecfile.conf
+	echo "backend=$backend" >> ./gioexecfile.conf
+	sed -i "/run_to_completion=/d" ./gioexecfile.conf
+	echo "run_to_completion=$run_to_completion" >> ./gioexecfile.conf
 	for ((lines = 0; lines < ioexec; lines ++))
 	do
 		echo "cpu_core=$lines" >> ./gioexecfile.conf
@@ -23,6 +38,9 @@ do
 		reader_threads=$(($per_core_reader * $ioexec))
 
     sed -i "s/max_threads=.*/max_threads=$reader_threads/" ./benchioexec.conf
-    ./BenchIOExecFile >> ./ioexecfile.csv
+    ./BenchIOExecFile | sed "s/^/$backend,/" >> ./ioexecfile.csv
 	done
 done
+done
+done
+done
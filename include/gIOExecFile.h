@@ -40,11 +40,22 @@ struct gIOExecFragment {
                               * In both cases, memory is freed on calling gIOBatchFree
                               */
   caddr_t addr;
+  // if nonzero, fragment is failed with -ETIMEDOUT unless done within
+  // timeoutMsec of submission.  Queued io is failed at the deadline;
+  // io in flight is cancelled if the kernel allows it
+  uint32_t timeoutMsec;
+  // if nonzero, io uses bufOffset onwards in the region returned by
+  // IOExecRegisterBuffer, and addr is ignored.  Offset must be
+  // aligned as addr would be, and gIOBatchFree does not free it
+  uint32_t bufIndex;
+  size_t bufOffset;
 };
 
 struct gIOBatch {
   void *opaque{nullptr};
   size_t count;
+  gIOPriority priority{GIO_PRIO_FOREGROUND}; // applies to all fragments
+  uint32_t tenant{0}; // whose limits apply, see IOExecSetTenantLimit
 
   // variable sized array of "count" items
   gIOExecFragment array[0];
@@ -67,7 +78,7 @@ struct gIOStatusBatch {
 };
 
 // Allocate an array of gIOStatusBatch
-gIOStatusBatch *gIOStatusBatchAlloc(int count);
+gIOStatusBatch *gIOStatusBatchAlloc(size_t count);
 
 // free array
 void gIOStatusBatchFree(gIOStatusBatch *ptr);
@@ -97,27 +108,144 @@ int32_t IOExecFileClose(IOExecFileHandle FileHandle);
 
 int32_t IOExecFileTruncate(IOExecFileHandle FileHandle, size_t newSize);
 
+// @return NUMA node of the executor which serves this file, which
+//   can be passed to gMempool_alloc_node for its buffers;
+//   negative if unknown
+int32_t IOExecFileGetNumaNode(IOExecFileHandle FileHandle);
+
 struct IOExecEventFdInt;
 typedef IOExecEventFdInt *IOExecEventFdHandle;
 
 IOExecEventFdHandle IOExecEventFdOpen(IOExecServiceHandle serviceHandle);
 
+/**
+ * completions are posted to a ring in shared memory instead of a pipe
+ * The read fd is an eventfd which becomes readable when completions
+ * are available; get them with IOExecEventFdReap, not read()
+ * @param numEntries max completions pending in the ring, at which
+ *   point io completion waits, as it does for a full pipe
+ */
+IOExecEventFdHandle IOExecEventFdOpenRing(IOExecServiceHandle serviceHandle,
+                                          size_t numEntries);
+
+/**
+ * completions are delivered by calling callback(completionId, errorCode,
+ * ctx) on the IOExecutor thread which finished the io, instead of
+ * through a pipe.  That is the completion thread, also for io
+ * cancelled or expired while queued and for reads served from
+ * read-ahead, except for ops which finish on the fdQueue thread:
+ *   - Open, Close, Delete and Put (Put closes its file there)
+ *   - non-aligned writes which grow the file, since the file is
+ *     truncated back to its size there
+ *   - non-aligned writes on an O_WRONLY fd whose last block is
+ *     inside the file, which fall back to pwrite there
+ * The callback holds up every other completion of the IOExecutor, so it
+ * must not block and must not submit io; hand off the work instead.
+ * Callbacks exceeding ioexec.callback_budget_usec are counted in the
+ * "numSlowCallbacks" stat.  The handle has no read fd
+ */
+IOExecEventFdHandle
+IOExecEventFdOpenCallback(IOExecServiceHandle serviceHandle,
+                          gIOCompletionCallback callback, void *ctx);
+
+/**
+ * A ring handle can be closed while io is outstanding; the ring
+ * is freed after its last job completes and those completions are dropped.
+ * A pipe or callback handle must not be closed until all io submitted
+ * on it has completed, since jobs write to the pipe or call the callback
+ */
 int32_t IOExecEventFdClose(IOExecEventFdHandle eventFdHandle);
 
 int IOExecEventFdGetReadFd(IOExecEventFdHandle eventFdPtr);
 
+/**
+ * get many completions at once, from either kind of handle
+ * call when the read fd is readable; for a pipe, blocks until at
+ * least one completion is available
+ * @param statusBatch allocated with gIOStatusBatchAlloc(maxCount)
+ * @return number of completions filled in statusBatch (also set in
+ *   statusBatch->count), else negative errno
+ */
+int32_t IOExecEventFdReap(IOExecEventFdHandle eventFdPtr,
+                          gIOStatusBatch *statusBatch, size_t maxCount);
+
 // hidden API to retrieve number of configured IOExecutors
 int32_t IOExecGetNumExecutors(IOExecServiceHandle serviceHandle);
 
+// hidden API to retrieve number of threads run by all IOExecutors
+int32_t IOExecGetNumThreads(IOExecServiceHandle serviceHandle);
+
+/**
+ * limit reads and writes of a tenant, which is set in gIOBatch
+ * Can be called any time; io over the limit is delayed, not failed
+ * @param iops requests per second, zero for no limit
+ * @param bytesPerSec zero for no limit; if both are zero, the
+ *   tenant is no longer limited
+ * @param burstMsec how much of the limit an idle tenant saves up
+ *   to use later as a burst
+ * @return 0 on success, else negative errno
+ */
+int32_t IOExecSetTenantLimit(IOExecServiceHandle serviceHandle,
+                             uint32_t tenant, uint64_t iops,
+                             uint64_t bytesPerSec, uint32_t burstMsec);
+
+/**
+ * allocate a buffer region up front, which fragments can then use by
+ * setting bufIndex and bufOffset.  The region is backed by huge pages
+ * where available and is faulted in here.  On the io_uring backend
+ * it is also registered as a fixed buffer, so that the kernel does
+ * not pin and unpin its pages for every io; that counts against
+ * RLIMIT_MEMLOCK.  Regions are freed when the service is destroyed.
+ * @param size rounded up to a multiple of 2MB
+ * @param addr set to the start of the region
+ * @return bufIndex of the region (nonzero), else negative errno
+ */
+int32_t IOExecRegisterBuffer(IOExecServiceHandle serviceHandle, size_t size,
+                             void **addr);
+
+/**
+ * eventfd which is incremented when io refused with -EAGAIN because
+ * queues were full can be retried.  Add it to the caller's event loop,
+ * read it when readable, then resubmit the refused batches.
+ * The fd belongs to the service; do not close it
+ * @return fd, else negative errno
+ */
+int IOExecGetSpaceAvailableFd(IOExecServiceHandle serviceHandle);
+
 // return the number of bytes filled in buffer
 int32_t IOExecGetStats(IOExecServiceHandle serviceHandle, char *buf,
                        int32_t len);
 
+/**
+ * change the fraction of io traced, which starts out as
+ * ioexec.trace_sample_rate
+ * @param sampleRate trace one in these many requests, zero disables
+ * @return 0 on success, else negative errno
+ */
+int32_t IOExecSetTraceSampleRate(IOExecServiceHandle serviceHandle,
+                                 uint32_t sampleRate);
+
+/**
+ * write stages of recently traced io of all IOExecutors to a file
+ * in Chrome trace event format; open it in chrome://tracing or
+ * ui.perfetto.dev.  Each IOExecutor appears as a process
+ * @return number of io written, else negative errno
+ */
+int32_t IOExecDumpTrace(IOExecServiceHandle serviceHandle,
+                        const char *fileName);
+
 /**
  * @param fileHandle file returned by IOExecFileOpen
  * @param pIOBatch batch containing offset, size and buffer to write
  * @param fd the pipe on which callback notification should be sent
  *           when job is completed
+ * @return 0 if all fragments were queued.  -EAGAIN if queues are
+ *   full, in which case none were; retry after the fd returned by
+ *   IOExecGetSpaceAvailableFd becomes readable
+ *   A fragment can still fail after the batch got its queue space,
+ *   on shutdown or memory exhaustion.  Its error is returned, and
+ *   fragments before it remain queued and send their completions
+ *   to eventFdHandle; it and the fragments after it send none
  */
 int32_t IOExecFileWrite(IOExecFileHandle fileHandle, const gIOBatch *pIOBatch,
                         IOExecEventFdHandle eventFdHandle);
@@ -127,6 +255,7 @@ int32_t IOExecFileWrite(IOExecFileHandle fileHandle, const gIOBatch *pIOBatch,
  * @param pIOBatch batch containing offset, size and buffer to read
  * @param fd the pipe on which callback notification should be sent
  *           when job is completed
+ * @return as for IOExecFileWrite
  */
 int32_t IOExecFileRead(IOExecFileHandle fileHandle, const gIOBatch *pIOBatch,
                        IOExecEventFdHandle eventFdHandle);
@@ -144,6 +273,65 @@ int32_t IOExecFileRead(IOExecServiceHandle serviceHandle, const char *fileName,
                        size_t fileNameLength, const gIOBatch *pIOBatch,
                        IOExecEventFdHandle eventFdHandle);
 
+/**
+ * hint that a range of the file will be read soon.  It is read
+ * into the read-ahead windows of the handle, at background priority,
+ * and reads inside it complete from memory without device io
+ * Only for O_DIRECT handles opened for reading, and only if
+ * ioexec.readahead_max_bytes is set.  Handles also prefetch on their
+ * own once reads turn sequential; see IOExecGetStats for hits
+ * Reads served from a window complete on the submitting thread
+ * @param offset,size range; at most 8 windows of it are prefetched
+ * @return 0 if prefetch was started or range is already held,
+ *   -EOPNOTSUPP if handle has no read-ahead, or was written to,
+ *   -ENOMEM if memory cap is reached, else negative errno
+ */
+int32_t IOExecFilePrefetch(IOExecFileHandle fileHandle, off_t offset,
+                           size_t size);
+
+/**
+ * file from which a fragment of IOExecFileReadMulti is read
+ * Give either fileHandle, or fileName if fileHandle is null
+ */
+struct gIOFileRef {
+  IOExecFileHandle fileHandle;
+  const char *fileName;
+  size_t fileNameLength;
+};
+
+/**
+ * read fragments of a batch from different files, such as the
+ * chunks of an erasure-coded object.  Fragments are grouped by
+ * the IOExecutor serving their file, and each group is queued
+ * and submitted together
+ * @param serviceHandle returned from ServiceInit
+ * @param files array of batch->count entries; files[i] is read
+ *   into batch->array[i].  Files given by name are opened with
+ *   O_DIRECT | O_RDONLY, through the fd cache if configured
+ * @param pIOBatch priority and tenant apply to all fragments
+ * @param eventFdHandle where completions are sent
+ * @return as for IOExecFileWrite; -EIO if a file could not be
+ *   opened, in which case no fragment was queued
+ */
+int32_t IOExecFileReadMulti(IOExecServiceHandle serviceHandle,
+                            const gIOFileRef *files, const gIOBatch *pIOBatch,
+                            IOExecEventFdHandle eventFdHandle);
+
+/**
+ * flush file to disk, as fsync() would, without blocking caller
+ * Covers writes whose completion was received before this call;
+ * writes still in flight may or may not be covered
+ * Syncs on the same file which are queued together are done with
+ * one kernel call, and each gets its own completion
+ * libaio backend needs kernel 4.18 or later
+ * @param fileHandle file returned by IOExecFileOpen
+ * @param completionId returned on the pipe when sync is done
+ * @param dataOnly flush only what fdatasync() would
+ * @param eventFdHandle where completion is sent
+ */
+int32_t IOExecFileSync(IOExecFileHandle fileHandle, gCompletionID completionId,
+                       bool dataOnly, IOExecEventFdHandle eventFdHandle);
+
 /**
  *
  */
@@ -154,6 +342,60 @@ int32_t IOExecFileDelete(IOExecServiceHandle serviceHandle,
 int32_t IOExecFileDeleteSync(IOExecServiceHandle serviceHandle,
                              const char *fileName);
 
+/**
+ * open a file without blocking caller on the file translator or
+ * open(); both run on a metadata worker of the IOExecutor
+ * @param flags as for IOExecFileOpen
+ * @param completionId returned on the pipe when open is done
+ * @param eventFdHandle where completion is sent
+ * @param fileHandle set to the new handle, which can be used for io
+ *   once completion arrives with errorCode 0.  Whether open failed
+ *   or not, the handle must be closed, and not before completion
+ * @return 0 on successful submit, else negative number
+ */
+int32_t IOExecFileOpenAsync(IOExecServiceHandle serviceHandle,
+                            const char *fileName, size_t fileNameLength,
+                            int32_t flags, gCompletionID completionId,
+                            IOExecEventFdHandle eventFdHandle,
+                            IOExecFileHandle *fileHandle);
+
+/**
+ * close a file on a metadata worker
+ * io on the handle must be complete.  On successful submit the
+ * handle is freed; else it is left open
+ * @return 0 on successful submit, -EBADF if handle has no open fd,
+ *   in which case use IOExecFileClose, else negative number
+ */
+int32_t IOExecFileCloseAsync(IOExecFileHandle fileHandle,
+                             gCompletionID completionId,
+                             IOExecEventFdHandle eventFdHandle);
+
+/**
+ * write a whole object with one submission: the file is opened on a
+ * metadata worker, written through the request queue like any write,
+ * and closed on the worker.  One completion with frag->completionId
+ * returns the first error
+ * @param flags passed to open(), such as O_WRONLY | O_CREAT | O_TRUNC
+ *   O_DIRECT needs aligned offset and buffer; size need not be aligned
+ * @param frag buffer to write at frag->offset; an empty fragment
+ *   only creates the file.  timeoutMsec is ignored
+ * @return 0 on successful submit, else negative number
+ */
+int32_t IOExecFilePut(IOExecServiceHandle serviceHandle, const char *fileName,
+                      size_t fileNameLength, int32_t flags,
+                      const gIOExecFragment *frag,
+                      IOExecEventFdHandle eventFdHandle);
+
+/**
+ * cancel pending reads and writes submitted with this completionId
+ * cancelled fragments complete on their pipe with -ECANCELED
+ * io already in flight completes normally if kernel cannot cancel it
+ * @return number of fragments cancelled, -ENOENT if none pending,
+ *   else error from kernel which could not cancel io in flight
+ */
+int32_t IOExecFileCancel(IOExecServiceHandle serviceHandle,
+                         gCompletionID completionId);
+
 // C API
 #ifdef __cplusplus
 #define EXTERNC extern "C"
@@ -205,6 +447,50 @@ EXTERNC {
   // @return 0 on successful submit, else negative number
   int32_t gobjfs_ioexecfile_file_read(handle_t, batch_t *, event_t evfd);
 
+  // @param handle returned from "service_init"
+  // @param file handle or name for each fragment of batch
+  // @param batch allocated by "batch_alloc"
+  // @param pipe handle returned from "event_fd_open"
+  // @return 0 on successful submit, else negative number
+  int32_t gobjfs_ioexecfile_file_read_multi(service_handle_t,
+                                            const gIOFileRef *, batch_t *,
+                                            event_t evfd);
+
+  // @param handle returned from "service_init"
+  // @param name of the file to open
+  // @param length of the file
+  // @param file flags as in unix (O_RDWR, O_CREAT, etc)
+  // @param completion id returned on pipe when open is done
+  // @param pipe on which completion id will be returned
+  // @param set to new file handle, to be closed even if open fails
+  // @return 0 on successful submit, else negative number
+  int32_t gobjfs_ioexecfile_file_open_async(service_handle_t, const char *,
+                                            size_t, int, completion_id_t,
+                                            event_t, handle_t *);
+
+  // @param handle returned from "file_open" or "file_open_async"
+  // @param completion id returned on pipe when close is done
+  // @param pipe on which completion id will be returned
+  // @return 0 on successful submit, after which handle is freed
+  int32_t gobjfs_ioexecfile_file_close_async(handle_t, completion_id_t,
+                                             event_t);
+
+  // @param handle returned from "service_init"
+  // @param name of the file to create or overwrite
+  // @param length of the file
+  // @param file flags as in unix (O_WRONLY, O_CREAT, etc)
+  // @param fragment to write, with completion id
+  // @param pipe on which completion id will be returned
+  // @return 0 on successful submit, else negative number
+  int32_t gobjfs_ioexecfile_file_put(service_handle_t, const char *, size_t,
+                                     int, const gIOExecFragment *, event_t);
+
+  // @param handle returned from "file_open"
+  // @param offset of range which will be read soon
+  // @param size of range
+  // @return 0 if prefetch was started, else negative number
+  int32_t gobjfs_ioexecfile_file_prefetch(handle_t, off_t, size_t);
+
   // @param handle returned from "file_open"
   // @param name of file to delete
   // @param completion id to be returned in callback
@@ -213,11 +499,23 @@ EXTERNC {
   int32_t gobjfs_ioexecfile_file_delete(service_handle_t, const char *,
                                         completion_id_t, event_t);
 
+  // @param handle returned from "file_open"
+  // @param completion id to be returned in callback
+  // @param if nonzero, do fdatasync instead of fsync
+  // @param pipe on which completion id will be returned
+  // @return 0 on successful submit, else negative number
+  int32_t gobjfs_ioexecfile_file_sync(handle_t, completion_id_t,
+                                      int data_only, event_t);
+
   // @param handle returned from "file_open"
   // @param new size for file
   // @return 0 on success, else negative number
   int32_t gobjfs_ioexecfile_file_truncate(handle_t, size_t new_size);
 
+  // @param handle returned from "file_open"
+  // @return NUMA node to pass to gMempool_alloc_node, negative if unknown
+  int32_t gobjfs_ioexecfile_file_get_numa_node(handle_t);
+
   // @param handle returned from "file_open"
   // @return 0 on successful close, else negative number
   int32_t gobjfs_ioexecfile_file_close(handle_t);
@@ -235,6 +533,25 @@ EXTERNC {
   //      for invalid handle, returns -1
   int gobjfs_ioexecfile_event_fd_get_read_fd(event_t);
 
+  // @param handle returned from "service_init"
+  // @param function called on io completion; must not block
+  // @param ctx passed to function
+  // @return handle to callback, else NULL ptr on error
+  event_t gobjfs_ioexecfile_event_callback_open(service_handle_t,
+                                                gIOCompletionCallback,
+                                                void *);
+
+  // @param handle returned from "service_init"
+  // @param max completions pending in ring
+  // @return handle to completion ring, else NULL ptr on error
+  event_t gobjfs_ioexecfile_event_ring_open(service_handle_t, size_t);
+
+  // @param handle returned from "event_fd_open" or "event_ring_open"
+  // @param batch allocated by gIOStatusBatchAlloc
+  // @param max completions to fill in batch
+  // @return number of completions filled, else negative number
+  int32_t gobjfs_ioexecfile_event_reap(event_t, gIOStatusBatch *, size_t);
+
   // @param number of fragments in batch
   // @return allocated batch, else NULL ptr on error
   batch_t *gobjfs_batch_alloc(int);
@@ -249,4 +566,35 @@ EXTERNC {
   //   negative number on error
   int32_t gobjfs_ioexecfile_service_getstats(service_handle_t, char *buffer,
                                              int32_t len);
+
+  // @param size of buffer region, rounded up to 2MB
+  // @param addr set to start of region
+  // @return index to set in fragment bufIndex, else negative number
+  int32_t gobjfs_ioexecfile_service_register_buffer(service_handle_t,
+                                                    size_t size,
+                                                    void **addr);
+
+  // @return eventfd signalled when io refused with -EAGAIN can be
+  //   retried, else negative number
+  int gobjfs_ioexecfile_service_get_space_fd(service_handle_t);
+
+  // @param tenant as set in batch
+  // @param iops, bytes_per_sec zero means no limit
+  // @param burst_msec how much unused limit can be saved for a burst
+  // @return 0 on success, else negative number
+  int32_t gobjfs_ioexecfile_service_set_tenant_limit(service_handle_t,
+                                                     uint32_t tenant,
+                                                     uint64_t iops,
+                                                     uint64_t bytes_per_sec,
+                                                     uint32_t burst_msec);
+
+  // @param sample_rate trace one in these many requests, zero disables
+  // @return 0 on success, else negative number
+  int32_t gobjfs_ioexecfile_service_set_trace_rate(service_handle_t,
+                                                   uint32_t sample_rate);
+
+  // @param file_name written with traced io in Chrome trace format
+  // @return number of io written, else negative number
+  int32_t gobjfs_ioexecfile_service_dump_trace(service_handle_t,
+                                               const char *file_name);
 }
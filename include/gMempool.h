@@ -27,6 +27,12 @@ int gMempool_init(size_t alignSize);
 
 void *gMempool_alloc(size_t sizeRequired);
 
+// allocate from memory of a NUMA node, such as the one returned by
+// IOExecFileGetNumaNode for the file which will use the buffer
+// @param node -1 means the node of the calling thread
+// buffer is released with gMempool_free
+void *gMempool_alloc_node(size_t sizeRequired, int node);
+
 void gMempool_free(void *memptr);
 
 // @returns  number of allocs and frees + bytes allocated
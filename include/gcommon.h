@@ -28,8 +28,20 @@ typedef uint32_t gOffset;
 typedef uint64_t gObjectID;
 typedef uint64_t gCompletionID;
 
+/* io priority class; IOExecutor serves the classes in weighted round robin */
+enum gIOPriority : uint8_t {
+  GIO_PRIO_FOREGROUND = 0, // latency sensitive user io
+  GIO_PRIO_BACKGROUND = 1, // rebuild and repair
+  GIO_PRIO_SCRUB = 2,      // verification
+  GIO_PRIO_COUNT = 3       // number of classes
+};
+
 struct gIOStatus {
   gCompletionID completionId;
   int32_t errorCode;
   int32_t reserved; // for consistent padding
 };
+
+/* called on io completion with the ctx given at registration */
+typedef void (*gIOCompletionCallback)(gCompletionID completionId,
+                                      int32_t errorCode, void *ctx);
@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "BatchController.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace gobjfs {
+
+// weight of new sample in moving averages
+static constexpr float NewSampleWeight = 0.25;
+
+void BatchController::init(uint32_t targetLatencyUsec,
+                           uint32_t maxBatchSize) {
+  targetLatencyUsec_ = targetLatencyUsec;
+  maxBatchSize_ = std::max(maxBatchSize, 1U);
+  batchSize_ = 1;
+  waitWindowUsec_ = 0;
+}
+
+void BatchController::recordCompletion(int64_t latencyNanosec) {
+  const int64_t oldAvg = completionLatencyNsec_;
+  const int64_t newAvg =
+      (oldAvg == 0) ? latencyNanosec
+                    : oldAvg + (latencyNanosec - oldAvg) * NewSampleWeight;
+  completionLatencyNsec_ = newAvg;
+}
+
+void BatchController::update() {
+  if (sinceUpdate_.elapsedMicroseconds() < UpdateIntervalUsec) {
+    return;
+  }
+  if (updating_.test_and_set(std::memory_order_acquire)) {
+    return;
+  }
+
+  const int64_t elapsedUsec = sinceUpdate_.elapsedMicroseconds();
+  if (elapsedUsec >= UpdateIntervalUsec) {
+    sinceUpdate_.reset();
+
+    const uint64_t numArrivals = numArrivals_;
+    const float newRate =
+        (float)(numArrivals - lastNumArrivals_) / (float)elapsedUsec;
+    lastNumArrivals_ = numArrivals;
+    arrivalsPerUsec_ += (newRate - arrivalsPerUsec_) * NewSampleWeight;
+
+    const int64_t completionLatencyUsec = completionLatencyNsec_ / 1000;
+    const int64_t waitWindowUsec =
+        std::max<int64_t>(targetLatencyUsec_ - completionLatencyUsec, 0);
+
+    const int64_t batchSize =
+        std::min<int64_t>(arrivalsPerUsec_ * waitWindowUsec, maxBatchSize_);
+
+    if (batchSize > 1) {
+      batchSize_ = batchSize;
+      waitWindowUsec_ = waitWindowUsec;
+    } else {
+      // not worth waiting
+      batchSize_ = 1;
+      waitWindowUsec_ = 0;
+    }
+
+    batchSizeStats_ = batchSize_;
+    waitWindowStats_ = waitWindowUsec_;
+  }
+
+  updating_.clear(std::memory_order_release);
+}
+
+std::string BatchController::getState() const {
+  std::ostringstream s;
+  // json format
+  s << "{\"batchSize\":" << batchSize_
+    << ",\"waitWindowUsec\":" << waitWindowUsec_
+    << ",\"arrivalsPerUsec\":" << arrivalsPerUsec_
+    << ",\"completionLatencyNsec\":" << completionLatencyNsec_
+    << ",\"batchSizeDecision\":" << batchSizeStats_
+    << ",\"waitWindowDecision\":" << waitWindowStats_ << "}";
+  return s.str();
+}
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <util/Stats.h>
+#include <util/Timer.h>
+
+namespace gobjfs {
+
+/**
+ * Decides how many requests the IOExecutor should accumulate before
+ * submitting them to the kernel, and how long the first of them may
+ * wait for the rest.
+ *
+ * A request may wait for whatever is left of the latency target after
+ * the measured completion latency :
+ *    waitWindow = targetLatency - completionLatency
+ * and the batch is the number of requests expected to arrive in
+ * that window at the measured arrival rate :
+ *    batchSize = arrivalRate * waitWindow   (at most maxBatchSize)
+ * At low load the batch is 1, so requests are submitted immediately.
+ */
+class BatchController {
+public:
+  // how often the decision is recomputed
+  static constexpr int64_t UpdateIntervalUsec = 1000;
+
+  void init(uint32_t targetLatencyUsec, uint32_t maxBatchSize);
+
+  // called for every request added to the queue (multi-thread)
+  void recordArrival() { numArrivals_.fetch_add(1, std::memory_order_relaxed); }
+
+  // called for every completed request (completion thread)
+  void recordCompletion(int64_t latencyNanosec);
+
+  // recompute decision if UpdateIntervalUsec has passed
+  // concurrent callers return without waiting
+  void update();
+
+  uint32_t batchSize() const { return batchSize_; }
+
+  int64_t waitWindowUsec() const { return waitWindowUsec_; }
+
+  std::string getState() const;
+
+private:
+  uint32_t targetLatencyUsec_{0};
+  uint32_t maxBatchSize_{1};
+
+  std::atomic<uint64_t> numArrivals_{0};
+  // moving average of completion latency
+  std::atomic<int64_t> completionLatencyNsec_{0};
+
+  // decision
+  std::atomic<uint32_t> batchSize_{1};
+  std::atomic<int64_t> waitWindowUsec_{0};
+
+  // state of update(), guarded by updating_
+  std::atomic_flag updating_ = ATOMIC_FLAG_INIT;
+  gobjfs::stats::Timer sinceUpdate_{true};
+  uint64_t lastNumArrivals_{0};
+  float arrivalsPerUsec_{0}; // moving average
+
+  // decisions taken, for tuning
+  gobjfs::stats::StatsCounter<int64_t> batchSizeStats_;
+  gobjfs::stats::StatsCounter<int64_t> waitWindowStats_;
+};
+}
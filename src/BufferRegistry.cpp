@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "BufferRegistry.h"
+
+#include <gobjfs_log.h>
+
+#include <errno.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace gobjfs {
+
+constexpr uint32_t BufferRegistry::MaxRegions;
+constexpr size_t BufferRegistry::RegionAlign;
+
+BufferRegistry::~BufferRegistry() {
+  const uint32_t numRegions = numRegions_;
+  for (uint32_t idx = 0; idx < numRegions; idx++) {
+    Region &region = regions_[idx];
+    if (munmap(region.addr_, region.size_) != 0) {
+      LOG(ERROR) << "failed to unmap buffer region=" << idx + 1
+                 << " errno=" << errno;
+    }
+  }
+}
+
+int32_t BufferRegistry::add(size_t size) {
+  std::unique_lock<std::mutex> lck(mutex_);
+
+  const uint32_t numRegions = numRegions_;
+  if (numRegions == MaxRegions) {
+    LOG(ERROR) << "cannot register more than " << MaxRegions
+               << " buffer regions";
+    return -ENOSPC;
+  }
+  if (size == 0) {
+    return -EINVAL;
+  }
+  size = ((size + RegionAlign - 1) / RegionAlign) * RegionAlign;
+
+  Region &region = regions_[numRegions];
+
+  // reserved huge pages are faulted in by MAP_POPULATE
+  void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                    -1, 0);
+  if (addr != MAP_FAILED) {
+    region.hugeTlb_ = true;
+  } else {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      int capture_errno = errno;
+      LOG(ERROR) << "failed to map buffer region of size=" << size
+                 << " errno=" << capture_errno;
+      return -capture_errno;
+    }
+    // advise before the pages are touched, so they can be huge
+    (void)madvise(addr, size, MADV_HUGEPAGE);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += pageSize) {
+      static_cast<volatile char *>(addr)[offset] = 0;
+    }
+    region.hugeTlb_ = false;
+  }
+  region.addr_ = static_cast<char *>(addr);
+  region.size_ = size;
+
+  numRegions_.store(numRegions + 1, std::memory_order_release);
+
+  LOG(INFO) << "buffer region=" << numRegions + 1 << " addr=" << addr
+            << " size=" << size << " hugeTlb=" << region.hugeTlb_;
+  return numRegions + 1;
+}
+
+std::string BufferRegistry::getState() const {
+  const uint32_t numRegions = numRegions_;
+  size_t totalSize = 0;
+  uint32_t numHugeTlb = 0;
+  for (uint32_t idx = 0; idx < numRegions; idx++) {
+    totalSize += regions_[idx].size_;
+    numHugeTlb += regions_[idx].hugeTlb_;
+  }
+
+  std::ostringstream s;
+  // json format
+  s << "{\"numRegions\":" << numRegions << ",\"totalSize\":" << totalSize
+    << ",\"numHugeTlb\":" << numHugeTlb << "}";
+  return s.str();
+}
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace gobjfs {
+
+/**
+ * Large buffer regions allocated up front, which fragments refer to
+ * by index and offset instead of by address.  A region is mapped
+ * with huge pages if the system has them reserved, else transparent
+ * huge pages are requested, and every page is faulted in at
+ * allocation, so that no io pays for a page fault.
+ *
+ * Regions are never freed before the registry, so that a resolved
+ * address stays valid without holding a lock.
+ * Index 0 is reserved to mean "not in a registered region".
+ */
+class BufferRegistry {
+public:
+  static constexpr uint32_t MaxRegions = 64;
+  // regions are rounded up to the huge page size
+  static constexpr size_t RegionAlign = (2 << 20);
+
+  struct Region {
+    char *addr_{nullptr};
+    size_t size_{0};
+    bool hugeTlb_{false}; // else transparent huge pages, if any
+  };
+
+  BufferRegistry() = default;
+
+  ~BufferRegistry();
+
+  /**
+   * allocate and pre-fault a region
+   * @return index of region (1 onwards), else negative errno
+   */
+  int32_t add(size_t size);
+
+  // @return region, nullptr if index is unknown
+  const Region *get(uint32_t index) const {
+    if ((index == 0) ||
+        (index > numRegions_.load(std::memory_order_acquire))) {
+      return nullptr;
+    }
+    return &regions_[index - 1];
+  }
+
+  /**
+   * @return address of [offset, offset + size) in region,
+   *   nullptr if index is unknown or range is outside region
+   */
+  char *resolve(uint32_t index, size_t offset, size_t size) const {
+    const Region *region = get(index);
+    if (!region || (offset > region->size_) ||
+        (size > region->size_ - offset)) {
+      return nullptr;
+    }
+    return region->addr_ + offset;
+  }
+
+  uint32_t size() const { return numRegions_; }
+
+  std::string getState() const;
+
+private:
+  std::mutex mutex_;
+  Region regions_[MaxRegions];
+  std::atomic<uint32_t> numRegions_{0};
+};
+}
@@ -0,0 +1,188 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include <CompletionRing.h>
+
+#include <gobjfs_log.h>
+
+#include <new>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace gobjfs {
+
+using gobjfs::os::FD_INVALID;
+
+int CompletionRing::init(size_t numEntries) {
+  size_t capacity = 2;
+  while (capacity < numEntries) {
+    capacity <<= 1;
+  }
+
+  int retcode = 0;
+
+  do {
+    mapSize_ = capacity * sizeof(Slot);
+    void *addr = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (addr == MAP_FAILED) {
+      retcode = -errno;
+      LOG(ERROR) << "failed to map ring of size=" << mapSize_
+                 << " errno=" << retcode;
+      mapSize_ = 0;
+      break;
+    }
+    slots_ = static_cast<Slot *>(addr);
+    mask_ = capacity - 1;
+
+    for (size_t idx = 0; idx < capacity; idx++) {
+      new (&slots_[idx].seq) std::atomic<uint64_t>(idx);
+    }
+
+    eventFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (eventFd_ < 0) {
+      retcode = -errno;
+      LOG(ERROR) << "failed to create eventfd errno=" << retcode;
+      eventFd_ = FD_INVALID;
+      break;
+    }
+
+    // consumer has nothing yet, so first completion rings doorbell
+    waiting_ = true;
+  } while (0);
+
+  return retcode;
+}
+
+CompletionRing::~CompletionRing() {
+  if (eventFd_ != FD_INVALID) {
+    ::close(eventFd_);
+  }
+  if (slots_) {
+    munmap(slots_, mapSize_);
+  }
+}
+
+void CompletionRing::acquire() {
+  refCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CompletionRing::release() {
+  if (refCount_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+void CompletionRing::close() {
+  closed_ = true;
+  release();
+}
+
+void CompletionRing::ringDoorbell() {
+  eventfd_t val = 1;
+  int ret = 0;
+  do {
+    ret = eventfd_write(eventFd_, val);
+  } while ((ret < 0) && (errno == EINTR));
+
+  if (ret < 0) {
+    LOG(ERROR) << "failed to ring doorbell=" << eventFd_ << " errno=" << errno;
+  }
+}
+
+void CompletionRing::push(const gIOStatus &status) {
+  if (closed_) {
+    return;
+  }
+
+  uint64_t pos = tail_.load(std::memory_order_relaxed);
+  Slot *slot = nullptr;
+
+  while (true) {
+    slot = &slots_[pos & mask_];
+    const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    const int64_t diff = (int64_t)seq - (int64_t)pos;
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // ring full; wait for consumer, same as a write to full pipe
+      if (closed_) {
+        return;
+      }
+      std::this_thread::yield();
+      pos = tail_.load(std::memory_order_relaxed);
+    } else {
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->status = status;
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  // publish before checking if consumer is waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_relaxed) && waiting_.exchange(false)) {
+    ringDoorbell();
+  }
+}
+
+size_t CompletionRing::pop(gIOStatus *array, size_t maxCount) {
+  size_t count = 0;
+
+  while (count < maxCount) {
+    Slot *slot = &slots_[head_ & mask_];
+    if (slot->seq.load(std::memory_order_acquire) != head_ + 1) {
+      break;
+    }
+    array[count++] = slot->status;
+    slot->seq.store(head_ + mask_ + 1, std::memory_order_release);
+    head_++;
+  }
+
+  return count;
+}
+
+size_t CompletionRing::reap(gIOStatus *array, size_t maxCount) {
+  size_t count = pop(array, maxCount);
+
+  if (count < maxCount) {
+    // ring looked empty; clear doorbell and ask for next one
+    eventfd_t val;
+    (void)eventfd_read(eventFd_, &val);
+
+    waiting_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // catch completions which were posted before producers saw waiting_
+    count += pop(array + count, maxCount - count);
+  }
+
+  if (count == maxCount) {
+    // more may be left; keep fd readable until they are reaped
+    ringDoorbell();
+  }
+
+  return count;
+}
+}
@@ -0,0 +1,112 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <gcommon.h>
+#include <util/lang_utils.h>
+#include <util/os_utils.h>
+
+namespace gobjfs {
+
+/**
+ * Ring of gIOStatus filled by IOExecutor threads and drained by one
+ * consumer, used instead of writing every completion into a pipe.
+ *
+ * Each slot carries a sequence number (bounded queue of D. Vyukov),
+ * so the completion and fdQueue threads of all IOExecutors
+ * can post without a lock.  The slots are in a shared mapping.
+ *
+ * The eventfd doorbell is only written when the consumer found
+ * the ring empty and is about to wait on it, so a busy consumer
+ * does not cost any syscall per completion.
+ *
+ * A ring allocated with new is refcounted : the consumer holds one
+ * reference and each job which will post to it holds another, so
+ * that it is only unmapped after the last pending job completed.
+ */
+class CompletionRing {
+public:
+  CompletionRing() = default;
+
+  ~CompletionRing();
+
+  GOBJFS_DISALLOW_COPY(CompletionRing);
+  GOBJFS_DISALLOW_MOVE(CompletionRing);
+
+  // @param numEntries rounded up to power of 2
+  // @return 0 on success, else negative errno
+  int init(size_t numEntries);
+
+  // producer side; waits for the consumer if ring is full
+  void push(const gIOStatus &status);
+
+  // consumer side
+  // @return number of statuses copied into array
+  size_t pop(gIOStatus *array, size_t maxCount);
+
+  // consumer side; clears doorbell and reaps
+  // doorbell is rung again for the next completion if ring was emptied,
+  // or left ringing if entries remain beyond maxCount
+  // @return number of statuses copied into array
+  size_t reap(gIOStatus *array, size_t maxCount);
+
+  // taken for each job which will post a completion
+  void acquire();
+
+  // deletes the ring when last reference is dropped
+  void release();
+
+  // consumer is gone; later completions are dropped
+  // and the consumer reference is released
+  void close();
+
+  // becomes readable when completions are available
+  int getReadFd() const { return eventFd_; }
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  void ringDoorbell();
+
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    gIOStatus status;
+  };
+
+  Slot *slots_{nullptr};
+  size_t mapSize_{0};
+  uint64_t mask_{0};
+
+  int eventFd_{gobjfs::os::FD_INVALID};
+
+  std::atomic<uint64_t> tail_{0};
+  // keep consumer counter off the cache line written by producers
+  char pad_[64];
+  uint64_t head_{0}; // only used by consumer
+  std::atomic<bool> waiting_{false}; // consumer wants doorbell
+
+  std::atomic<int32_t> refCount_{1}; // consumer reference
+  std::atomic<bool> closed_{false};
+};
+}
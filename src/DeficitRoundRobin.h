@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gobjfs {
+
+/**
+ * Picks the priority class which gives the next job to submit.
+ *
+ * Deficit round robin : when the turn passes to a class, the class
+ * gets credit for as many jobs as its weight, and keeps the turn
+ * until it has used the credit or has no more jobs.  A class without
+ * jobs loses its credit, so an idle class cannot save up a burst.
+ * With a backlog in every class, classes are served in the ratio of
+ * their weights, and a job which arrives in an idle class waits for
+ * at most the weights of the other classes.
+ *
+ * Only used by the thread which submits
+ */
+class DeficitRoundRobin {
+public:
+  // one weight per class, each at least 1
+  void init(const std::vector<uint32_t> &weights) {
+    weights_ = weights;
+    deficit_.assign(weights_.size(), 0);
+    current_ = 0;
+    deficit_[current_] = weights_[current_];
+  }
+
+  /**
+   * @param pop called with a class, returns true if it took a job
+   *   from that class
+   * @return class which gave the job, or -1 if every class was empty
+   */
+  template <typename PopFn> int32_t next(PopFn &&pop) {
+    const size_t numClasses = weights_.size();
+    // 2 passes suffice: in the first, every class gets credit
+    for (size_t numTried = 0; numTried < 2 * numClasses; numTried++) {
+      if (deficit_[current_] > 0) {
+        if (pop(current_)) {
+          deficit_[current_]--;
+          return current_;
+        }
+        deficit_[current_] = 0;
+      }
+      current_ = (current_ + 1) % numClasses;
+      deficit_[current_] += weights_[current_];
+    }
+    return -1;
+  }
+
+private:
+  std::vector<uint32_t> weights_;
+  std::vector<int64_t> deficit_;
+  size_t current_{0}; // class which has the turn
+};
+}
@@ -0,0 +1,221 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "FdCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <functional>
+#include <gobjfs_log.h>
+#include <sstream>
+#include <unistd.h>
+
+namespace gobjfs {
+
+static constexpr size_t FD_CACHE_MAX_SHARDS = 16;
+
+FdCache::FdCache(size_t capacity, int openFlags)
+    : capacity_(capacity), openFlags_(openFlags) {
+  size_t numShards = std::min(capacity, FD_CACHE_MAX_SHARDS);
+  if (numShards == 0) {
+    numShards = 1;
+  }
+  shardCapacity_ = (capacity + numShards - 1) / numShards;
+  for (size_t idx = 0; idx < numShards; idx++) {
+    shards_.emplace_back(new Shard);
+  }
+}
+
+FdCache::~FdCache() {
+  for (auto &shard : shards_) {
+    std::unique_lock<std::mutex> lck(shard->mutex_);
+    while (!shard->lru_.empty()) {
+      Entry *entry = shard->lru_.back();
+      removeFromCache(*shard, entry);
+      if (entry->refCount_ == 0) {
+        closeEntry(entry);
+      } else {
+        LOG(ERROR) << "file=" << entry->path_ << " still has "
+                   << entry->refCount_ << " users at shutdown";
+      }
+    }
+  }
+}
+
+FdCache::Shard &FdCache::getShard(const std::string &path) {
+  static std::hash<std::string> hasher;
+  return *shards_[hasher(path) % shards_.size()];
+}
+
+void FdCache::removeFromCache(Shard &shard, Entry *entry) {
+  shard.map_.erase(entry->path_);
+  shard.lru_.erase(entry->lruIter_);
+  entry->inCache_ = false;
+}
+
+void FdCache::closeEntry(Entry *entry) {
+  if (::close(entry->fd_) != 0) {
+    LOG(ERROR) << "failed to close fd=" << entry->fd_
+               << " of file=" << entry->path_ << " errno=" << errno;
+  }
+  delete entry;
+}
+
+FdCache::Entry *FdCache::acquire(const std::string &path) {
+  Shard &shard = getShard(path);
+
+  uint64_t generation = 0;
+  {
+    std::unique_lock<std::mutex> lck(shard.mutex_);
+    auto iter = shard.map_.find(path);
+    if (iter != shard.map_.end()) {
+      Entry *entry = iter->second;
+      entry->refCount_++;
+      shard.lru_.splice(shard.lru_.begin(), shard.lru_, entry->lruIter_);
+      shard.numHits_++;
+      return entry;
+    }
+    shard.numMisses_++;
+    generation = shard.generation_;
+  }
+
+  // open outside the lock, so that hits on the shard are not held up
+  int fd = ::open(path.c_str(), openFlags_);
+  if (fd < 0) {
+    int capture_errno = errno;
+    LOG(ERROR) << "failed to open file=" << path << " flags=" << openFlags_
+               << " errno=" << capture_errno;
+    errno = capture_errno;
+    return nullptr;
+  }
+
+  Entry *evicted = nullptr;
+  Entry *entry = nullptr;
+  {
+    std::unique_lock<std::mutex> lck(shard.mutex_);
+    auto iter = shard.map_.find(path);
+    if (iter != shard.map_.end()) {
+      // another thread opened it meanwhile
+      entry = iter->second;
+      entry->refCount_++;
+      shard.lru_.splice(shard.lru_.begin(), shard.lru_, entry->lruIter_);
+    } else {
+      entry = new Entry(path, fd, &shard);
+      entry->refCount_ = 1;
+      if ((shardCapacity_ != 0) && (generation == shard.generation_)) {
+        if (shard.map_.size() >= shardCapacity_) {
+          Entry *lruEntry = shard.lru_.back();
+          removeFromCache(shard, lruEntry);
+          shard.numEvictions_++;
+          if (lruEntry->refCount_ == 0) {
+            evicted = lruEntry;
+          }
+        }
+        shard.lru_.push_front(entry);
+        entry->lruIter_ = shard.lru_.begin();
+        shard.map_.emplace(path, entry);
+        entry->inCache_ = true;
+      }
+      fd = -1;
+    }
+  }
+
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  if (evicted) {
+    closeEntry(evicted);
+  }
+  return entry;
+}
+
+void FdCache::hold(Entry *entry) {
+  std::unique_lock<std::mutex> lck(entry->shard_->mutex_);
+  assert(entry->refCount_ > 0);
+  entry->refCount_++;
+}
+
+void FdCache::release(Entry *entry) {
+  bool doClose = false;
+  {
+    std::unique_lock<std::mutex> lck(entry->shard_->mutex_);
+    assert(entry->refCount_ > 0);
+    entry->refCount_--;
+    doClose = (entry->refCount_ == 0) && !entry->inCache_;
+  }
+  if (doClose) {
+    closeEntry(entry);
+  }
+}
+
+void FdCache::invalidate(const std::string &path) {
+  Shard &shard = getShard(path);
+
+  Entry *unused = nullptr;
+  {
+    std::unique_lock<std::mutex> lck(shard.mutex_);
+    shard.generation_++;
+    auto iter = shard.map_.find(path);
+    if (iter == shard.map_.end()) {
+      return;
+    }
+    Entry *entry = iter->second;
+    removeFromCache(shard, entry);
+    shard.numInvalidations_++;
+    // else closed by the last job using it
+    if (entry->refCount_ == 0) {
+      unused = entry;
+    }
+  }
+  if (unused) {
+    closeEntry(unused);
+  }
+}
+
+std::string FdCache::getState() const {
+  uint64_t numCached = 0;
+  uint64_t numHits = 0;
+  uint64_t numMisses = 0;
+  uint64_t numEvictions = 0;
+  uint64_t numInvalidations = 0;
+
+  for (auto &shard : shards_) {
+    std::unique_lock<std::mutex> lck(shard->mutex_);
+    numCached += shard->map_.size();
+    numHits += shard->numHits_;
+    numMisses += shard->numMisses_;
+    numEvictions += shard->numEvictions_;
+    numInvalidations += shard->numInvalidations_;
+  }
+
+  const uint64_t numLookups = numHits + numMisses;
+  const double hitRate =
+      numLookups ? (double)numHits / (double)numLookups : 0.0;
+
+  std::ostringstream s;
+  // json format
+  s << "{\"capacity\":" << capacity_ << ",\"numShards\":" << shards_.size()
+    << ",\"numCached\":" << numCached << ",\"numHits\":" << numHits
+    << ",\"numMisses\":" << numMisses << ",\"hitRate\":" << hitRate
+    << ",\"numEvictions\":" << numEvictions
+    << ",\"numInvalidations\":" << numInvalidations << "}";
+  return s.str();
+}
+}
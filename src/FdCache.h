@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gobjfs {
+
+/**
+ * Keeps files which are read by name open, so that each read
+ * does not pay for open() and close().  Paths are hashed into
+ * shards, each with its own lock and LRU list.
+ *
+ * An entry is refcounted by the jobs using its fd.  When an entry
+ * is evicted or invalidated while jobs are in flight, its fd stays
+ * open until the last of them releases it.
+ *
+ * A cache of capacity zero still hands out refcounted entries,
+ * but closes the fd as soon as the last user releases it.
+ */
+class FdCache {
+public:
+  struct Shard;
+
+  struct Entry {
+    std::string path_;
+    int fd_;
+    // guarded by shard mutex
+    uint32_t refCount_{0};
+    bool inCache_{false};
+    std::list<Entry *>::iterator lruIter_;
+    Shard *shard_;
+
+    Entry(const std::string &path, int fd, Shard *shard)
+        : path_(path), fd_(fd), shard_(shard) {}
+  };
+
+  struct Shard {
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry *> map_;
+    // most recently used at front
+    std::list<Entry *> lru_;
+    // bumped on invalidate, so that an fd opened before the file
+    // was deleted is not put in the cache after it
+    uint64_t generation_{0};
+
+    uint64_t numHits_{0};
+    uint64_t numMisses_{0};
+    uint64_t numEvictions_{0};
+    uint64_t numInvalidations_{0};
+  };
+
+  /**
+   * @param capacity max fds kept open across all shards
+   * @param openFlags flags with which files are opened
+   */
+  FdCache(size_t capacity, int openFlags);
+
+  ~FdCache();
+
+  /**
+   * get the fd of a translated path, opening it if not cached
+   * @return entry with a reference held for the caller,
+   *         nullptr if open failed, with errno set
+   */
+  Entry *acquire(const std::string &path);
+
+  // take another reference on an entry the caller already holds
+  static void hold(Entry *entry);
+
+  // drop a reference; fd is closed if entry is no longer cached
+  static void release(Entry *entry);
+
+  // drop path from cache, called after it is deleted
+  void invalidate(const std::string &path);
+
+  size_t capacity() const { return capacity_; }
+
+  std::string getState() const;
+
+private:
+  Shard &getShard(const std::string &path);
+
+  // caller must hold shard mutex
+  static void removeFromCache(Shard &shard, Entry *entry);
+
+  static void closeEntry(Entry *entry);
+
+  size_t capacity_;
+  size_t shardCapacity_;
+  int openFlags_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+}
@@ -0,0 +1,709 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "FilerCtx.h"
+
+#include <gobjfs_log.h>
+#include <util/Spinlock.h>
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sstream>
+#include <string.h>
+#include <sys/epoll.h>   // epoll_event
+#include <sys/eventfd.h> // EFD_NONBLOCK
+#include <sys/mman.h>    // mmap
+#include <sys/syscall.h> // __NR_io_uring_setup
+#include <unistd.h>
+
+namespace gobjfs {
+
+std::ostream &operator<<(std::ostream &os, IOBackend backend) {
+  switch (backend) {
+  case IOBackend::Aio:
+    os << "libaio";
+    break;
+  case IOBackend::Uring:
+    os << "io_uring";
+    break;
+  default:
+    os << "Unknown";
+    break;
+  }
+  return os;
+}
+
+std::istream &operator>>(std::istream &is, IOBackend &backend) {
+  std::string str;
+  is >> str;
+  if (str == "libaio") {
+    backend = IOBackend::Aio;
+  } else if (str == "io_uring") {
+    backend = IOBackend::Uring;
+  } else {
+    is.setstate(std::ios_base::failbit);
+  }
+  return is;
+}
+
+// ============
+
+FilerCtx::~FilerCtx() {
+  if (eventFD_ != FD_INVALID) {
+    int retcode = close(eventFD_);
+    if (retcode < 0) {
+      LOG(ERROR) << "Failed to close fd=" << eventFD_ << " errno=" << -errno;
+    }
+  }
+}
+
+int32_t FilerCtx::initEventFD(int epollFD) {
+  epollFD_ = epollFD;
+
+  int retcode = 0;
+
+  do {
+    retcode = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (retcode == -1) {
+      LOG(ERROR) << "Failed to create eventfd errno=" << -errno;
+      break;
+    }
+    eventFD_ = retcode;
+
+    epoll_event epollEvent;
+    bzero(&epollEvent, sizeof(epollEvent));
+
+    // since event.data is set to contain pointer to ctx,
+    // it will be returned by epoll_wait()
+    // this way, you can find FilerCtx from eventFD
+    epollEvent.data.ptr = (void *)this;
+
+    epollEvent.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
+    retcode = epoll_ctl(epollFD_, EPOLL_CTL_ADD, eventFD_, &epollEvent);
+    if (retcode != 0) {
+      LOG(ERROR) << "Failed to add epoll errno=" << -errno;
+      break;
+    }
+
+    LOG(INFO) << "epoll registered filer fd=" << eventFD_
+              << " with ptr=" << (void *)this;
+
+  } while (0);
+
+  return retcode;
+}
+
+std::string FilerCtx::getState() const {
+  std::ostringstream s;
+  // json format
+  s << "{\"backend\":\"" << backend()
+    << "\",\"numAvail\":" << numAvailable_
+    << ",\"queueDepth\":" << ioQueueDepth_
+    << ",\"numFixedIO\":" << numFixedIO_ << "}";
+  return s.str();
+}
+
+// ============
+
+class AioFilerCtx : public FilerCtx {
+  io_context_t ioCtx_;
+
+public:
+  AioFilerCtx() { bzero(&ioCtx_, sizeof(ioCtx_)); }
+
+  virtual ~AioFilerCtx();
+
+  virtual int32_t init(int32_t queueDepth, int epollFD) override;
+
+  virtual int32_t submit(iocb **cbArray, int32_t numCb) override;
+
+  virtual int32_t getEvents(io_event *events, int32_t maxEvents) override;
+
+  virtual int32_t cancel(iocb *cb) override;
+
+  virtual IOBackend backend() const override { return IOBackend::Aio; }
+};
+
+int32_t AioFilerCtx::init(int32_t queueDepth, int epollFD) {
+  ioQueueDepth_ = queueDepth;
+
+  int retcode = 0;
+
+  do {
+    retcode = io_queue_init(queueDepth, &ioCtx_);
+    if (retcode != 0) {
+      LOG(ERROR) << "Failed to init io queue errno=" << retcode;
+      break;
+    }
+    numAvailable_ = ioQueueDepth_;
+
+    retcode = initEventFD(epollFD);
+
+  } while (0);
+
+  return retcode;
+}
+
+AioFilerCtx::~AioFilerCtx() {
+  int retcode = io_queue_release(ioCtx_);
+  if (retcode < 0) {
+    LOG(ERROR) << "Failed to release ioctx errno=" << retcode;
+  }
+}
+
+int32_t AioFilerCtx::submit(iocb **cbArray, int32_t numCb) {
+  for (int32_t idx = 0; idx < numCb; idx++) {
+    io_set_eventfd(cbArray[idx], eventFD_);
+  }
+  return io_submit(ioCtx_, numCb, cbArray);
+}
+
+/**
+ * layout of the completion ring which the kernel maps into user space
+ * at the address returned as io_context_t (see fs/aio.c)
+ */
+struct AioRing {
+  unsigned id;
+  unsigned nr; // number of io_event in ring
+  unsigned head;
+  unsigned tail;
+
+  unsigned magic;
+  unsigned compat_features;
+  unsigned incompat_features;
+  unsigned header_length; // size of AioRing
+
+  io_event events[0];
+};
+
+static constexpr unsigned AIO_RING_MAGIC = 0xa10a10a1;
+
+/**
+ * reap events directly from the mmapped ring, which avoids the
+ * io_getevents syscall when polling for completions
+ * Safe only because the completion thread is the sole reaper
+ * @return number of events reaped, or -EOPNOTSUPP if ring layout
+ * is not recognized
+ */
+static int32_t aioRingGetEvents(io_context_t ioCtx, io_event *events,
+                                int32_t maxEvents) {
+  AioRing *ring = reinterpret_cast<AioRing *>(ioCtx);
+  if (!ring || (ring->magic != AIO_RING_MAGIC) ||
+      (ring->incompat_features != 0)) {
+    return -EOPNOTSUPP;
+  }
+
+  const unsigned nr = ring->nr;
+  unsigned head = ring->head;
+  const unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  int32_t numEventsGot = 0;
+  while ((head != tail) && (numEventsGot < maxEvents)) {
+    events[numEventsGot++] = ring->events[head];
+    head = (head + 1) % nr;
+  }
+
+  // event slots may be reused by kernel once head moves past them
+  __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+  return numEventsGot;
+}
+
+int32_t AioFilerCtx::getEvents(io_event *events, int32_t maxEvents) {
+  int32_t numEventsGot = aioRingGetEvents(ioCtx_, events, maxEvents);
+  if (numEventsGot != -EOPNOTSUPP) {
+    return numEventsGot;
+  }
+
+  // zero timeout makes io_getevents return without blocking
+  timespec noWait{0, 0};
+  do {
+    numEventsGot = io_getevents(ioCtx_, 0, maxEvents, events, &noWait);
+  } while (numEventsGot == -EINTR);
+  return numEventsGot;
+}
+
+int32_t AioFilerCtx::cancel(iocb *cb) {
+  io_event event;
+  int ret = io_cancel(ioCtx_, cb, &event);
+  // since linux 3.11, the io_event is always delivered through the
+  // ring, and -EINPROGRESS means cancellation was started
+  if ((ret == 0) || (ret == -EINPROGRESS)) {
+    return 0;
+  }
+  return ret;
+}
+
+// ============
+
+/**
+ * io_uring without liburing, using the raw syscalls
+ * Only one thread submits at a time (guarded by submitLock_)
+ * and only the IOExecutor completion thread reaps events
+ */
+class UringFilerCtx : public FilerCtx {
+  int ringFD_{FD_INVALID};
+
+  // submission ring
+  void *sqRingPtr_{nullptr};
+  size_t sqRingSize_{0};
+  unsigned *sqHead_{nullptr};
+  unsigned *sqTail_{nullptr};
+  unsigned *sqRingMask_{nullptr};
+  unsigned *sqArray_{nullptr};
+  io_uring_sqe *sqes_{nullptr};
+  size_t sqesSize_{0};
+  uint32_t sqEntries_{0};
+
+  // completion ring
+  void *cqRingPtr_{nullptr};
+  size_t cqRingSize_{0};
+  unsigned *cqHead_{nullptr};
+  unsigned *cqTail_{nullptr};
+  unsigned *cqRingMask_{nullptr};
+  io_uring_cqe *cqes_{nullptr};
+
+  gobjfs::os::Spinlock submitLock_;
+
+  // buffer regions registered with the ring, in slot order
+  // an entry of size zero could not be registered
+  struct FixedBuffer {
+    const char *addr_{nullptr};
+    size_t size_{0};
+  };
+  static constexpr uint32_t MaxFixedBuffers = 64;
+  FixedBuffer fixedBuffers_[MaxFixedBuffers];
+  std::atomic<uint32_t> numFixedBuffers_{0};
+  // sparse table of MaxFixedBuffers registered at init
+  bool haveFixedTable_{false};
+
+  // @return slot of region containing buffer, else -1
+  int32_t findFixedBuffer(const void *buf, size_t size) const;
+
+  // user_data of IORING_OP_ASYNC_CANCEL, whose cqe is not returned
+  // to the IOExecutor; the cancelled io posts its own cqe
+  static constexpr uint64_t CancelUserData = 0;
+
+  bool fillSqe(io_uring_sqe *sqe, const iocb *cb);
+
+public:
+  UringFilerCtx() {}
+
+  virtual ~UringFilerCtx();
+
+  virtual int32_t init(int32_t queueDepth, int epollFD) override;
+
+  virtual int32_t submit(iocb **cbArray, int32_t numCb) override;
+
+  virtual int32_t getEvents(io_event *events, int32_t maxEvents) override;
+
+  virtual int32_t cancel(iocb *cb) override;
+
+  virtual IOBackend backend() const override { return IOBackend::Uring; }
+
+  virtual int32_t registerBuffer(uint32_t slot, void *addr,
+                                 size_t size) override;
+};
+
+static inline int sys_io_uring_setup(unsigned entries, io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned toSubmit,
+                                     unsigned minComplete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                      nullptr, 0);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned opcode,
+                                        const void *arg, unsigned nrArgs) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+int32_t UringFilerCtx::init(int32_t queueDepth, int epollFD) {
+  ioQueueDepth_ = queueDepth;
+
+  int retcode = 0;
+
+  do {
+    io_uring_params params;
+    bzero(&params, sizeof(params));
+
+    retcode = sys_io_uring_setup(queueDepth, &params);
+    if (retcode < 0) {
+      retcode = -errno;
+      LOG(ERROR) << "Failed to setup io_uring errno=" << retcode;
+      break;
+    }
+    ringFD_ = retcode;
+    sqEntries_ = params.sq_entries;
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (singleMmap) {
+      sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRingPtr_ = mmap(0, sqRingSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFD_, IORING_OFF_SQ_RING);
+    if (sqRingPtr_ == MAP_FAILED) {
+      sqRingPtr_ = nullptr;
+      retcode = -errno;
+      LOG(ERROR) << "Failed to mmap sq ring errno=" << retcode;
+      break;
+    }
+
+    if (singleMmap) {
+      cqRingPtr_ = sqRingPtr_;
+    } else {
+      cqRingPtr_ = mmap(0, cqRingSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFD_, IORING_OFF_CQ_RING);
+      if (cqRingPtr_ == MAP_FAILED) {
+        cqRingPtr_ = nullptr;
+        retcode = -errno;
+        LOG(ERROR) << "Failed to mmap cq ring errno=" << retcode;
+        break;
+      }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqesPtr = mmap(0, sqesSize_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringFD_, IORING_OFF_SQES);
+    if (sqesPtr == MAP_FAILED) {
+      retcode = -errno;
+      LOG(ERROR) << "Failed to mmap sqes errno=" << retcode;
+      break;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqesPtr);
+
+    char *sqBase = static_cast<char *>(sqRingPtr_);
+    sqHead_ = reinterpret_cast<unsigned *>(sqBase + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sqBase + params.sq_off.tail);
+    sqRingMask_ =
+        reinterpret_cast<unsigned *>(sqBase + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sqBase + params.sq_off.array);
+
+    char *cqBase = static_cast<char *>(cqRingPtr_);
+    cqHead_ = reinterpret_cast<unsigned *>(cqBase + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cqBase + params.cq_off.tail);
+    cqRingMask_ =
+        reinterpret_cast<unsigned *>(cqBase + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cqBase + params.cq_off.cqes);
+
+    retcode = initEventFD(epollFD);
+    if (retcode != 0) {
+      break;
+    }
+
+    // kernel will signal the eventfd when completions are posted
+    retcode =
+        sys_io_uring_register(ringFD_, IORING_REGISTER_EVENTFD, &eventFD_, 1);
+    if (retcode != 0) {
+      retcode = -errno;
+      LOG(ERROR) << "Failed to register eventfd with io_uring errno="
+                 << retcode;
+      break;
+    }
+
+    numAvailable_ = ioQueueDepth_;
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+    // empty table, which registerBuffer fills one slot at a time
+    io_uring_rsrc_register rsrc;
+    bzero(&rsrc, sizeof(rsrc));
+    rsrc.nr = MaxFixedBuffers;
+    rsrc.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (sys_io_uring_register(ringFD_, IORING_REGISTER_BUFFERS2, &rsrc,
+                              sizeof(rsrc)) == 0) {
+      haveFixedTable_ = true;
+    } else {
+      // needs kernel 5.19; io from registered regions is then unfixed
+      LOG(INFO) << "io_uring fixed buffers not available errno=" << errno;
+    }
+#endif
+
+    LOG(INFO) << "io_uring fd=" << ringFD_ << " sq entries=" << sqEntries_
+              << " cq entries=" << params.cq_entries;
+
+  } while (0);
+
+  return retcode;
+}
+
+UringFilerCtx::~UringFilerCtx() {
+  if (sqes_) {
+    munmap(sqes_, sqesSize_);
+  }
+  if (cqRingPtr_ && (cqRingPtr_ != sqRingPtr_)) {
+    munmap(cqRingPtr_, cqRingSize_);
+  }
+  if (sqRingPtr_) {
+    munmap(sqRingPtr_, sqRingSize_);
+  }
+  if (ringFD_ != FD_INVALID) {
+    int retcode = close(ringFD_);
+    if (retcode < 0) {
+      LOG(ERROR) << "Failed to close io_uring fd=" << ringFD_
+                 << " errno=" << -errno;
+    }
+  }
+}
+
+int32_t UringFilerCtx::registerBuffer(uint32_t slot, void *addr,
+                                      size_t size) {
+  if (!haveFixedTable_ || (slot >= MaxFixedBuffers)) {
+    return -EOPNOTSUPP;
+  }
+  assert(slot == numFixedBuffers_);
+
+  int32_t ret = 0;
+#ifdef IORING_RSRC_REGISTER_SPARSE
+  iovec iov{addr, size};
+  io_uring_rsrc_update2 update;
+  bzero(&update, sizeof(update));
+  update.offset = slot;
+  update.data = reinterpret_cast<uint64_t>(&iov);
+  update.nr = 1;
+  // kernel pins the pages here, once, and charges them to memlock
+  ret = sys_io_uring_register(ringFD_, IORING_REGISTER_BUFFERS_UPDATE,
+                              &update, sizeof(update));
+  if (ret < 0) {
+    ret = -errno;
+    LOG(ERROR) << "failed to register buffer addr=" << addr
+               << " size=" << size << " with io_uring errno=" << ret;
+  } else {
+    fixedBuffers_[slot].addr_ = static_cast<const char *>(addr);
+    fixedBuffers_[slot].size_ = size;
+    ret = 0;
+  }
+#endif
+  // publish slot even if it failed, so later slots can be found
+  numFixedBuffers_.store(slot + 1, std::memory_order_release);
+  return ret;
+}
+
+int32_t UringFilerCtx::findFixedBuffer(const void *buf, size_t size) const {
+  const uint32_t numFixed = numFixedBuffers_.load(std::memory_order_acquire);
+  const char *start = static_cast<const char *>(buf);
+  for (uint32_t slot = 0; slot < numFixed; slot++) {
+    const FixedBuffer &fixed = fixedBuffers_[slot];
+    if ((start >= fixed.addr_) && (start < fixed.addr_ + fixed.size_) &&
+        (size <= (size_t)(fixed.addr_ + fixed.size_ - start))) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+bool UringFilerCtx::fillSqe(io_uring_sqe *sqe, const iocb *cb) {
+  bzero(sqe, sizeof(*sqe));
+
+  sqe->fd = cb->aio_fildes;
+  // completion thread expects the io_event.data to be iocb.data
+  sqe->user_data = reinterpret_cast<uint64_t>(cb->data);
+
+  int32_t fixedSlot = -1;
+
+  switch (cb->aio_lio_opcode) {
+  case IO_CMD_PREAD:
+  case IO_CMD_PWRITE:
+    fixedSlot = findFixedBuffer(cb->u.c.buf, cb->u.c.nbytes);
+    if (fixedSlot >= 0) {
+      sqe->opcode = (cb->aio_lio_opcode == IO_CMD_PREAD)
+                        ? IORING_OP_READ_FIXED
+                        : IORING_OP_WRITE_FIXED;
+      sqe->buf_index = fixedSlot;
+      numFixedIO_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      sqe->opcode = (cb->aio_lio_opcode == IO_CMD_PREAD) ? IORING_OP_READ
+                                                         : IORING_OP_WRITE;
+    }
+    sqe->addr = reinterpret_cast<uint64_t>(cb->u.c.buf);
+    sqe->len = cb->u.c.nbytes;
+    sqe->off = cb->u.c.offset;
+    break;
+  case IO_CMD_PREADV:
+    sqe->opcode = IORING_OP_READV;
+    sqe->addr = reinterpret_cast<uint64_t>(cb->u.v.vec);
+    sqe->len = cb->u.v.nr;
+    sqe->off = cb->u.v.offset;
+    break;
+  case IO_CMD_PWRITEV:
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->addr = reinterpret_cast<uint64_t>(cb->u.v.vec);
+    sqe->len = cb->u.v.nr;
+    sqe->off = cb->u.v.offset;
+    break;
+  case IO_CMD_FSYNC:
+    sqe->opcode = IORING_OP_FSYNC;
+    break;
+  case IO_CMD_FDSYNC:
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    break;
+  default:
+    LOG(ERROR) << "io_uring cannot translate iocb op="
+               << cb->aio_lio_opcode;
+    return false;
+  }
+  return true;
+}
+
+int32_t UringFilerCtx::submit(iocb **cbArray, int32_t numCb) {
+  std::lock_guard<gobjfs::os::Spinlock> lck(submitLock_);
+
+  const unsigned mask = *sqRingMask_;
+  const unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  const unsigned origTail = *sqTail_;
+  unsigned tail = origTail;
+
+  int32_t numFilled = 0;
+  for (; numFilled < numCb; numFilled++) {
+    if (tail - head >= sqEntries_) {
+      // sq ring full; submit what we have
+      break;
+    }
+    const unsigned index = tail & mask;
+    if (!fillSqe(&sqes_[index], cbArray[numFilled])) {
+      break;
+    }
+    sqArray_[index] = index;
+    tail++;
+  }
+
+  if (numFilled == 0) {
+    return -EINVAL;
+  }
+
+  // make sqe visible to kernel before tail
+  __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+
+  int ret = 0;
+  do {
+    ret = sys_io_uring_enter(ringFD_, numFilled, 0, 0);
+  } while ((ret < 0) && (errno == EINTR));
+
+  if (ret < 0) {
+    ret = -errno;
+  }
+
+  const int32_t numConsumed = (ret > 0) ? ret : 0;
+  if (numConsumed < numFilled) {
+    // kernel did not consume all sqes
+    // rewind tail so that caller can resubmit the rest
+    // this is safe since we are the only producer and SQPOLL is not used
+    __atomic_store_n(sqTail_, origTail + numConsumed, __ATOMIC_RELEASE);
+  }
+
+  if ((ret < 0) && (ret == -EBUSY)) {
+    // completion ring overflow; caller must retry
+    ret = -EAGAIN;
+  }
+  return ret;
+}
+
+int32_t UringFilerCtx::getEvents(io_event *events, int32_t maxEvents) {
+  const unsigned mask = *cqRingMask_;
+  unsigned head = *cqHead_;
+  const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+  int32_t numEventsGot = 0;
+  while ((head != tail) && (numEventsGot < maxEvents)) {
+    const io_uring_cqe &cqe = cqes_[head & mask];
+    if (cqe.user_data == CancelUserData) {
+      head++;
+      continue;
+    }
+    io_event &event = events[numEventsGot];
+    event.data = reinterpret_cast<void *>(cqe.user_data);
+    event.obj = nullptr;
+    // negative errno is returned in res, same as libaio
+    event.res = static_cast<long>(cqe.res);
+    event.res2 = 0;
+    numEventsGot++;
+    head++;
+  }
+
+  // let kernel reuse the cqe slots
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  return numEventsGot;
+}
+
+int32_t UringFilerCtx::cancel(iocb *cb) {
+  std::lock_guard<gobjfs::os::Spinlock> lck(submitLock_);
+
+  const unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  const unsigned tail = *sqTail_;
+  if (tail - head >= sqEntries_) {
+    return -EAGAIN;
+  }
+
+  const unsigned index = tail & *sqRingMask_;
+  io_uring_sqe *sqe = &sqes_[index];
+  bzero(sqe, sizeof(*sqe));
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  // io is identified by the user_data given in fillSqe
+  sqe->addr = reinterpret_cast<uint64_t>(cb->data);
+  sqe->user_data = CancelUserData;
+  sqArray_[index] = index;
+
+  __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+  int ret = 0;
+  do {
+    ret = sys_io_uring_enter(ringFD_, 1, 0, 0);
+  } while ((ret < 0) && (errno == EINTR));
+
+  if (ret != 1) {
+    ret = (ret < 0) ? -errno : -EAGAIN;
+    __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+    return ret;
+  }
+  return 0;
+}
+
+// ============
+
+FilerCtxUPtr FilerCtxFactory::create(IOBackend backend, int32_t queueDepth,
+                                     int epollFD) {
+  FilerCtxUPtr ctx;
+
+  if (backend == IOBackend::Uring) {
+    ctx.reset(new UringFilerCtx());
+    if (ctx->init(queueDepth, epollFD) != 0) {
+      // older kernels or seccomp profiles may not allow io_uring
+      LOG(ERROR) << "io_uring not available. falling back to libaio";
+      ctx.reset();
+      backend = IOBackend::Aio;
+    }
+  }
+
+  if (backend == IOBackend::Aio) {
+    ctx.reset(new AioFilerCtx());
+    if (ctx->init(queueDepth, epollFD) != 0) {
+      LOG(ERROR) << "failed to init libaio ctx";
+      ctx.reset();
+    }
+  }
+
+  return ctx;
+}
+}
@@ -0,0 +1,153 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <iostream>
+#include <libaio.h>
+#include <memory>
+#include <string>
+
+#include <util/lang_utils.h>
+#include <util/os_utils.h>
+
+namespace gobjfs {
+
+using gobjfs::os::FD_INVALID;
+
+/**
+ * kernel interface used to submit and reap async io
+ * selected with "ioexec.backend" in config file
+ */
+enum class IOBackend : int32_t {
+  Aio = 0,   // libaio : io_submit + io_getevents
+  Uring = 1, // io_uring : shared submission and completion rings
+  // STOP - ENSURE u add to the stream operators
+  // when you change this
+};
+
+std::ostream &operator<<(std::ostream &os, const IOBackend backend);
+
+// used by boost program_options to parse config
+std::istream &operator>>(std::istream &is, IOBackend &backend);
+
+/*
+ * FilerCtx:
+ *	- FilerCtx is an async io context wrapper
+ *	- Structure keeps track of parameters like
+ *		ioQueueDepth_ : queue depth of io_context at async layer
+ *		eventFD_			: eventfd to poll for async io
+ *completions
+ *		epollFD_			: Not used here. But set to
+ *global
+ *epollFD_
+ *
+ * Jobs are always described to the FilerCtx as libaio iocb.
+ * Backends other than libaio translate the iocb into their own format
+ * and return completions as io_event, so that IOExecutor does not
+ * need to know which kernel interface is in use.
+ */
+class FilerCtx {
+public:
+  int epollFD_ = FD_INVALID;
+  int eventFD_ = FD_INVALID;
+
+  int32_t ioQueueDepth_{0};
+  std::atomic<int32_t> numAvailable_{0};
+
+  // io submitted from a registered buffer region
+  std::atomic<uint64_t> numFixedIO_{0};
+
+public:
+  explicit FilerCtx() {}
+
+  virtual ~FilerCtx();
+
+  virtual int32_t init(int32_t queueDepth, int epollFD) = 0;
+
+  /**
+   * @param cbArray iocbs to submit; can be freed after return
+   * @return number of iocb accepted by kernel, else negative errno
+   */
+  virtual int32_t submit(iocb **cbArray, int32_t numCb) = 0;
+
+  /**
+   * reap completed io without blocking
+   * both backends read the completion ring mapped in user space,
+   * so this is cheap enough to call in a polling loop
+   * @return number of events filled, else negative errno
+   */
+  virtual int32_t getEvents(io_event *events, int32_t maxEvents) = 0;
+
+  /**
+   * ask kernel to cancel an iocb which was submitted earlier
+   * a cancelled io still completes through getEvents, with -ECANCELED
+   * Kernels cannot cancel io which already reached the device,
+   * in which case it completes normally
+   * @return 0 if cancel was requested, else negative errno
+   */
+  virtual int32_t cancel(iocb *cb) = 0;
+
+  virtual IOBackend backend() const = 0;
+
+  /**
+   * keep a buffer region pinned in the kernel, so that io within it
+   * does not pin and unpin its pages every time
+   * @param slot index of the region, from 0; regions are registered
+   *   one at a time, in increasing order of slot
+   * @return 0 on success, -EOPNOTSUPP if the backend cannot,
+   *   else negative errno
+   */
+  virtual int32_t registerBuffer(uint32_t slot, void *addr, size_t size) {
+    return -EOPNOTSUPP;
+  }
+
+  std::string getState() const;
+
+  bool isEmpty() const { return (numAvailable_ == 0); }
+
+  void incrementNumAvailable(int32_t count = 1) {
+    numAvailable_ += count;
+    assert(numAvailable_ <= ioQueueDepth_);
+  }
+  void decrementNumAvailable(int32_t count) {
+    numAvailable_ -= count;
+    assert(numAvailable_ >= 0);
+  }
+
+  GOBJFS_DISALLOW_COPY(FilerCtx);
+  GOBJFS_DISALLOW_MOVE(FilerCtx);
+
+protected:
+  // create eventfd which signals io completion
+  // and add it to the epoll set of the IOExecutor
+  int32_t initEventFD(int epollFD);
+};
+
+typedef std::unique_ptr<FilerCtx> FilerCtxUPtr;
+
+class FilerCtxFactory {
+public:
+  // @return initialized ctx, else nullptr on error
+  static FilerCtxUPtr create(IOBackend backend, int32_t queueDepth,
+                             int epollFD);
+};
+}
@@ -1,10 +1,15 @@
+#include <CompletionRing.h>
 #include <FilerJob.h>
+#include <algorithm>
 #include <gobjfs_log.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <util/os_utils.h>
 
 namespace gobjfs {
 
+using gobjfs::os::DirectIOSize;
 using gobjfs::os::FD_INVALID;
 using gobjfs::os::IsDirectIOAligned;
 using gobjfs::os::RoundToNext512;
@@ -29,6 +34,15 @@ std::ostream &operator<<(std::ostream &os, FileOp op) {
   case FileOp::NonAlignedWrite:
     os << "NonAlignedWrite";
     break;
+  case FileOp::Open:
+    os << "Open";
+    break;
+  case FileOp::Close:
+    os << "Close";
+    break;
+  case FileOp::Put:
+    os << "Put";
+    break;
   default:
     os << "Unknown";
     break;
@@ -36,12 +50,7 @@ std::ostream &operator<<(std::ostream &os, FileOp op) {
   return os;
 }
 
-FilerJob::FilerJob(const char *filename, FileOp op)
-    : op_(op), fileName_(filename) {
-  assert(waitTime() == 0);
-  assert(serviceTime() == 0);
-  assert(filename != nullptr);
-}
+FilerJob::FilerJob() {}
 
 FilerJob::FilerJob(const int fd, FileOp op) : op_(op), fd_(fd) {
   assert(waitTime() == 0);
@@ -49,16 +58,102 @@ FilerJob::FilerJob(const int fd, FileOp op) : op_(op), fd_(fd) {
   assert(fd != FD_INVALID);
 }
 
-FilerJob::~FilerJob() {}
+FilerJob::~FilerJob() {
+  releaseCompletionRing();
+  releaseTrace();
+  free(tailBuf_);
+}
+
+bool FilerJob::allocTailBuf() {
+  if (!tailBuf_) {
+    if (posix_memalign((void **)&tailBuf_, DirectIOSize, DirectIOSize) != 0) {
+      tailBuf_ = nullptr;
+      return false;
+    }
+  }
+  return true;
+}
+
+void FilerJob::patchTail(size_t readSize) {
+  const size_t alignedSz = alignedSize();
+  // short read means block extends past end of file
+  if (readSize < (size_t)DirectIOSize) {
+    memset(tailBuf_ + readSize, 0, DirectIOSize - readSize);
+  }
+  memcpy(tailBuf_, buffer_ + alignedSz, userSize_ - alignedSz);
+
+  const off_t tailOffset = offset_ + alignedSz;
+  const off_t newSize =
+      std::max(tailOffset + (off_t)readSize, offset_ + (off_t)userSize_);
+  truncateSize_ = (newSize < tailOffset + DirectIOSize) ? newSize : -1;
+}
 
 int32_t FilerJob::prepareCallblock(iocb *cb) {
+  // NonAlignedWrite is submitted once for each step
+  const bool isFirstSubmit = (this->op_ != FileOp::NonAlignedWrite) ||
+                             (this->rmwStep_ == RmwStep::ReadTail) ||
+                             (this->rmwStep_ == RmwStep::WriteZeroTail);
+
+  if (this->op_ == FileOp::Sync) {
+    for (FilerJob *job = this->mergeNext_; job; job = job->mergeNext_) {
+      job->setWaitTime();
+    }
+  } else if (this->mergeNext_) {
+    // buffers of merged jobs are described by iovec_, which must
+    // stay valid until io completes
+    iovec_.clear();
+    for (FilerJob *job = this; job; job = job->mergeNext_) {
+      iovec_.push_back({job->buffer_, job->size_});
+      if (job != this) {
+        job->setWaitTime();
+      }
+    }
+  }
+
   if (this->op_ == FileOp::Write) {
 
-    io_prep_pwrite(cb, this->fd_, this->buffer_, this->size_, this->offset_);
+    if (this->mergeNext_) {
+      io_prep_pwritev(cb, this->fd_, iovec_.data(), iovec_.size(),
+                      this->offset_);
+    } else {
+      io_prep_pwrite(cb, this->fd_, this->buffer_, this->size_,
+                     this->offset_);
+    }
 
   } else if (this->op_ == FileOp::Read) {
 
-    io_prep_pread(cb, this->fd_, this->buffer_, this->size_, this->offset_);
+    if (this->mergeNext_) {
+      io_prep_preadv(cb, this->fd_, iovec_.data(), iovec_.size(),
+                     this->offset_);
+    } else {
+      io_prep_pread(cb, this->fd_, this->buffer_, this->size_,
+                    this->offset_);
+    }
+
+  } else if (this->op_ == FileOp::NonAlignedWrite) {
+
+    const size_t alignedSz = alignedSize();
+    if (this->rmwStep_ == RmwStep::ReadTail) {
+      io_prep_pread(cb, this->fd_, this->tailBuf_, DirectIOSize,
+                    this->offset_ + alignedSz);
+    } else if (alignedSz) {
+      iovec_.clear();
+      iovec_.push_back({this->buffer_, alignedSz});
+      iovec_.push_back({this->tailBuf_, (size_t)DirectIOSize});
+      io_prep_pwritev(cb, this->fd_, iovec_.data(), iovec_.size(),
+                      this->offset_);
+    } else {
+      io_prep_pwrite(cb, this->fd_, this->tailBuf_, DirectIOSize,
+                     this->offset_);
+    }
+
+  } else if (this->op_ == FileOp::Sync) {
+
+    if (this->syncDataOnly_) {
+      io_prep_fdsync(cb, this->fd_);
+    } else {
+      io_prep_fsync(cb, this->fd_);
+    }
 
   } else {
 
@@ -66,11 +161,13 @@ int32_t FilerJob::prepareCallblock(iocb *cb) {
   }
 
   cb->data = this;
-  this->setWaitTime();
+  if (isFirstSubmit) {
+    this->setWaitTime();
+  }
 
   VLOG(1) << " job=" << (void *)this << " op=" << this->op_
           << " fd=" << this->fd_ << " offset=" << this->offset_
-          << " size=" << this->size_;
+          << " size=" << this->size_ << " numMerged=" << iovec_.size();
 
   return 0;
 }
@@ -78,7 +175,8 @@ int32_t FilerJob::prepareCallblock(iocb *cb) {
 bool FilerJob::isValid(std::ostringstream &ostr) {
   bool isValid = true;
 
-  if ((op_ != FileOp::Read) && (op_ != FileOp::Write)) {
+  if ((op_ != FileOp::Read) && (op_ != FileOp::Write) &&
+      (op_ != FileOp::Sync) && (op_ != FileOp::NonAlignedWrite)) {
     return isValid;
   }
 
@@ -86,15 +184,19 @@ bool FilerJob::isValid(std::ostringstream &ostr) {
     ostr << ":fd=" << fd_ << " has errno=" << errno;
     isValid = false;
   }
-  if (IsDirectIOAligned(offset_)) {
+  if (op_ == FileOp::Sync) {
+    return isValid;
+  }
+  if (!IsDirectIOAligned(offset_)) {
     ostr << ":offset=" << offset_ << " is not 512 aligned";
     isValid = false;
   }
-  if (IsDirectIOAligned((uint64_t)buffer_)) {
-    ostr << ":buffer=" << buffer_ << " is not 512 aligned";
+  if (!IsDirectIOAligned((uint64_t)buffer_)) {
+    ostr << ":buffer=" << (void *)buffer_ << " is not 512 aligned";
     isValid = false;
   }
-  if (IsDirectIOAligned(size_)) {
+  // NonAlignedWrite pads the tail to DirectIOSize itself
+  if ((op_ != FileOp::NonAlignedWrite) && !IsDirectIOAligned(size_)) {
     ostr << ":size=" << size_ << " is not 512 aligned";
     isValid = false;
   }
@@ -109,6 +211,69 @@ void FilerJob::setBuffer(off_t fileOffset, char *buffer, size_t size) {
   size_ = RoundToNext512(userSize_);
 }
 
+void FilerJob::reinit(const int fd, FileOp op) {
+  resetTimes();
+  op_ = op;
+  offset_ = 0;
+  size_ = 0;
+  userSize_ = 0;
+  retcode_ = -EDOM;
+  buffer_ = nullptr;
+  canBeFreed_ = false;
+  executor_ = nullptr;
+  fd_ = fd;
+  fdEntry_ = nullptr;
+  fileName_ = nullptr;
+  fileNameLength_ = 0;
+  completionFd_ = FD_INVALID;
+  releaseCompletionRing();
+  completionCallback_ = nullptr;
+  callbackCtx_ = nullptr;
+  completionId_ = 0;
+  priority_ = GIO_PRIO_FOREGROUND;
+  tenant_ = 0;
+  deadline_ = std::chrono::steady_clock::time_point();
+  state_ = JobState::Queued;
+  cancelCode_ = 0;
+  ctx_ = nullptr;
+  pendingNext_ = nullptr;
+  pendingPrev_ = nullptr;
+  syncDataOnly_ = false;
+  openFlags_ = 0;
+  openMode_ = 0;
+  openedFd_ = nullptr;
+  rmwStep_ = RmwStep::ReadTail;
+  putStep_ = PutStep::Open;
+  truncateSize_ = -1;
+  fdWriteCounted_ = false;
+  fdWriteNext_ = nullptr;
+  mergeNext_ = nullptr;
+  iovec_.clear();
+  releaseTrace();
+}
+
+void FilerJob::setCompletionRing(CompletionRing *ring) {
+  releaseCompletionRing();
+  if (ring) {
+    ring->acquire();
+    completionRing_ = ring;
+  }
+}
+
+void FilerJob::releaseCompletionRing() {
+  if (completionRing_) {
+    completionRing_->release();
+    completionRing_ = nullptr;
+  }
+}
+
+void FilerJob::setTimeout(uint32_t timeoutMsec) {
+  if (timeoutMsec) {
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(timeoutMsec);
+  }
+}
+
 void FilerJob::reset() {
   VLOG(2) << "FilerJob reset "
           << ":completionFd=" << completionFd_
@@ -118,7 +283,20 @@ void FilerJob::reset() {
   iostatus.completionId = completionId_;
   iostatus.errorCode = retcode_;
 
-  if (write(completionFd_, &iostatus, sizeof(iostatus)) != sizeof(iostatus)) {
+  // taken before completion is posted, after which job may be reused
+  JobTrace *trace = trace_;
+  trace_ = nullptr;
+  if (trace) {
+    trace->retcode_ = retcode_;
+  }
+
+  if (completionCallback_) {
+    completionCallback_(completionId_, retcode_, callbackCtx_);
+  } else if (completionRing_) {
+    completionRing_->push(iostatus);
+    releaseCompletionRing();
+  } else if (write(completionFd_, &iostatus, sizeof(iostatus)) !=
+             sizeof(iostatus)) {
     LOG(ERROR) << "For job=" << (void *)this
                << " Failed to signal IO status for "
                << " completionId: " << completionId_
@@ -126,5 +304,10 @@ void FilerJob::reset() {
   }
 
   setServiceTime();
+
+  if (trace) {
+    trace->stamp(TraceStage::Done);
+    trace->release();
+  }
 }
 }
@@ -1,15 +1,24 @@
 #pragma once
 
+#include <FdCache.h>
+#include <JobTracer.h>
 #include <Queueable.h>
+#include <atomic>
+#include <chrono>
 #include <gcommon.h>
 #include <libaio.h>
 #include <sstream>
 #include <string>
+#include <sys/uio.h>
 #include <util/os_utils.h>
+#include <vector>
 
 namespace gobjfs {
 
 class IOExecutor;
+class FilerCtx;
+class FilerJobPool;
+class CompletionRing;
 
 enum class FileOp : int32_t {
   Nop = 0,
@@ -18,12 +27,50 @@ enum class FileOp : int32_t {
   Sync = 3,
   Delete = 4,
   NonAlignedWrite = 5,
+  Open = 6,  // open fileName_, and store fd in openedFd_
+  Close = 7, // close fd_
+  Put = 8,   // open fileName_, pwrite buffer_ and close
   // STOP - ENSURE u add to the ostream operator
   // when you change this
 };
 
 std::ostream &operator<<(std::ostream &os, const FileOp op);
 
+/**
+ * steps of a NonAlignedWrite, which is a read-modify-write
+ * of the partial block at the end of the buffer
+ */
+enum class RmwStep : int32_t {
+  ReadTail = 0, // read the last block into tailBuf_
+  Write = 1,    // write aligned part of buffer_ and tailBuf_
+  Truncate = 2, // cut padding which went past end of file
+  PWrite = 3,   // fd cannot be read; plain pwrite of buffer_ instead
+  WriteZeroTail = 4, // fd cannot be read but last block is past end of
+                     // file; write it zero padded, like Write
+};
+
+/**
+ * steps of a Put, whose file is opened and closed on the fdQueue
+ * while the write in between goes through the request queue
+ */
+enum class PutStep : int32_t {
+  Open = 0,  // open the file
+  Write = 1, // write buffer_ as a Write or NonAlignedWrite
+  Close = 2, // close the file and send completion
+};
+
+/**
+ * ownership of a queued job, decided by compare-and-swap
+ * between the submitter and whoever cancels it
+ */
+enum class JobState : int32_t {
+  Queued = 0,    // in request queue of IOExecutor
+  Submitted = 1, // taken for submission to kernel
+  Aborting = 2,  // cancelled while queued; completion being sent
+  Aborted = 3,   // completion sent; dequeuer can free it
+  Dequeued = 4,  // dequeued before completion sent; completer frees it
+};
+
 /**
  * I/Os are issued as FilerJob. FilerJob contains device
  * to which I/O to be issued.
@@ -51,17 +98,84 @@ public:
 
   // Device/File Fd
   int fd_{gobjfs::os::FD_INVALID};
-  // can ioexecutor close fd after execution
-  bool closeFileHandle_{false};
-  // fileName set only in case of delete file
-  std::string fileName_;
+  // if set, fd_ is borrowed from FdCache and released after execution
+  FdCache::Entry *fdEntry_{nullptr};
+  // fileName set only in case of delete, open or put
+  // points to a PATH_MAX buffer owned by FilerJobPool
+  char *fileName_{nullptr};
+  // name may contain null bytes, as translator is given the length
+  size_t fileNameLength_{0};
   // Fd used to Notify on completion to application
   int completionFd_{gobjfs::os::FD_INVALID};
+  // if set, completion is posted here instead of completionFd_
+  // job holds a reference on it until completion is posted
+  CompletionRing *completionRing_{nullptr};
+  // if set, called on completion instead of posting it
+  gIOCompletionCallback completionCallback_{nullptr};
+  void *callbackCtx_{nullptr};
   // ID points to I/O
   gCompletionID completionId_{0};
+  // decides which request queue of IOExecutor is used
+  gIOPriority priority_{GIO_PRIO_FOREGROUND};
+  // QoS limits of this tenant apply to the job
+  uint32_t tenant_{0};
+
+  // job is failed with -ETIMEDOUT if not done by deadline
+  // default value means no deadline
+  std::chrono::steady_clock::time_point deadline_;
+
+  std::atomic<JobState> state_{JobState::Queued};
+  // error to return if kernel reports io as cancelled
+  // set when cancel of io in flight has been attempted
+  std::atomic<int> cancelCode_{0};
+
+  // kept in job because io_cancel needs the submitted iocb
+  iocb cb_;
+  // ctx to which cb_ is submitted
+  // null if job is part of a vectored io, which cannot be cancelled
+  std::atomic<FilerCtx *> ctx_{nullptr};
+  // jobs of the same pending bucket of IOExecutor, while registered;
+  // protected by the mutex of that bucket's shard
+  FilerJob *pendingNext_{nullptr};
+  FilerJob *pendingPrev_{nullptr};
+
+  // for Sync, flush only data as in fdatasync()
+  bool syncDataOnly_{false};
+
+  // for Open and Put, passed to open()
+  int openFlags_{0};
+  mode_t openMode_{0};
+  // for Open, set to new fd before completion is posted
+  int *openedFd_{nullptr};
+
+  // for NonAlignedWrite
+  RmwStep rmwStep_{RmwStep::ReadTail};
+  PutStep putStep_{PutStep::Open};
+  // DirectIOSize buffer, allocated on first use and kept with the job
+  char *tailBuf_{nullptr};
+  // size to which file is cut after write, if padding extended it
+  off_t truncateSize_{-1};
+  // for Write and NonAlignedWrite, counted in the writes in flight on
+  // fd_ until completion
+  bool fdWriteCounted_{false};
+  // next truncate or held write of the same fd;
+  // protected by IOExecutor::fdWritesMutex_
+  FilerJob *fdWriteNext_{nullptr};
+
+  // adjacent jobs submitted along with this one as a vectored io
+  // for Sync, jobs completed by the same kernel call
+  FilerJob *mergeNext_{nullptr};
+  std::vector<iovec> iovec_;
+
+  // pool to which job is returned after completion
+  FilerJobPool *pool_{nullptr};
+
+  // set if the job was sampled for tracing
+  JobTrace *trace_{nullptr};
 
 public:
-  FilerJob(const char *filename, FileOp op);
+  // used by FilerJobPool, which calls reinit() before handing it out
+  FilerJob();
 
   FilerJob(const int fd, FileOp op);
 
@@ -73,9 +187,108 @@ public:
   // check if job params are safe for async io
   bool isValid(std::ostringstream &ostr);
 
+  // if jobs are merged after this one, prepares a vectored io
   int32_t prepareCallblock(iocb *cb);
 
+  // can job be submitted in the same io, right after this one
+  // syncs are grouped with canJoinSync() instead
+  bool isAdjacent(const FilerJob *next) const {
+    return (next->op_ == op_) &&
+           ((op_ == FileOp::Read) || (op_ == FileOp::Write)) &&
+           (next->fd_ == fd_) && (offset_ + (off_t)size_ == next->offset_);
+  }
+
+  // ops run by fdQueue workers instead of the async io backend
+  bool isMetadataOp() const {
+    return (op_ == FileOp::Delete) || (op_ == FileOp::Open) ||
+           (op_ == FileOp::Close) || (op_ == FileOp::Put);
+  }
+
+  // part of buffer_ which can be written without read-modify-write
+  size_t alignedSize() const {
+    return userSize_ & ~((size_t)gobjfs::os::DirectIOSize - 1);
+  }
+
+  // @return false if tailBuf_ could not be allocated
+  bool allocTailBuf();
+
+  // copy end of buffer_ over the block read into tailBuf_, and
+  // decide if the file has to be truncated after the write
+  // @param readSize bytes of the block which existed in the file
+  void patchTail(size_t readSize);
+
+  // can this sync be completed by the kernel call of an earlier sync
+  // io which completed before either was submitted is covered by both
+  bool canJoinSync(const FilerJob *leader) const {
+    return (op_ == FileOp::Sync) && (leader->op_ == FileOp::Sync) &&
+           (leader->fd_ == fd_) &&
+           (!leader->syncDataOnly_ || syncDataOnly_);
+  }
+
+  // hides Queueable::setWaitTime to also mark dequeue in trace
+  void setWaitTime() {
+    Queueable::setWaitTime();
+    if (trace_) {
+      trace_->stamp(TraceStage::Dequeue);
+    }
+  }
+
+  // give up the trace of this job, so it can be published
+  void releaseTrace() {
+    if (trace_) {
+      trace_->release();
+      trace_ = nullptr;
+    }
+  }
+
   void setBuffer(off_t fileOffset, char *buffer, size_t size);
+
+  // restore default state so job can be reused, keeping pool_
+  // and the memory of iovec_
+  void reinit(const int fd, FileOp op);
+
+  // @param timeoutMsec relative to now; zero means no deadline
+  void setTimeout(uint32_t timeoutMsec);
+
+  // takes a reference on ring, dropped once completion is posted
+  void setCompletionRing(CompletionRing *ring);
+  void releaseCompletionRing();
+
+  bool hasDeadline() const {
+    return (deadline_ != std::chrono::steady_clock::time_point());
+  }
+
+  bool isExpired(std::chrono::steady_clock::time_point now) const {
+    return hasDeadline() && (now >= deadline_);
+  }
+
+  // take job from queue for submission
+  // @return false if job was aborted while queued
+  bool claim() {
+    JobState expected = JobState::Queued;
+    return state_.compare_exchange_strong(expected, JobState::Submitted);
+  }
+
+  // take job away from the submitter while it is still queued
+  // @return false if job was already taken for submission
+  bool abort() {
+    JobState expected = JobState::Queued;
+    return state_.compare_exchange_strong(expected, JobState::Aborting);
+  }
+
+  // hand an aborted job from the dequeuer to whoever completes it
+  // @return false if completion was already sent
+  bool dequeueAborted() {
+    JobState expected = JobState::Aborting;
+    return state_.compare_exchange_strong(expected, JobState::Dequeued);
+  }
+
+  // mark completion of an aborted job as sent
+  // @return false if job was dequeued meanwhile and must be freed by caller
+  bool finishAbort() {
+    JobState expected = JobState::Aborting;
+    return state_.compare_exchange_strong(expected, JobState::Aborted);
+  }
   void reset();
 };
 }
@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include <FilerJobPool.h>
+
+#include <gobjfs_log.h>
+#include <limits.h> // PATH_MAX
+#include <string.h>
+
+namespace gobjfs {
+
+using gobjfs::os::FD_INVALID;
+
+constexpr size_t FilerJobPool::MaxJobs;
+
+FilerJobPool::FilerJobPool(size_t numJobs)
+    : numJobs_(std::min(numJobs, MaxJobs)), slab_(new FilerJob[numJobs_]),
+      freeList_(numJobs_),
+      namePool_(MempoolFactory::createObjectMempool("filename", PATH_MAX)) {
+
+  for (size_t idx = 0; idx < numJobs_; idx++) {
+    slab_[idx].pool_ = this;
+    bool ret = freeList_.push(&slab_[idx]);
+    assert(ret == true);
+    (void)ret;
+  }
+}
+
+FilerJob *FilerJobPool::get() {
+  FilerJob *job = nullptr;
+  if (!freeList_.pop(job)) {
+    job = new FilerJob;
+    job->pool_ = this;
+  }
+  return job;
+}
+
+void FilerJobPool::put(FilerJob *job) {
+  if (job->fileName_) {
+    namePool_->Free(job->fileName_);
+    job->fileName_ = nullptr;
+  }
+
+  if (isFromSlab(job)) {
+    // cannot fail because queue can hold every job in slab
+    bool ret = freeList_.push(job);
+    assert(ret == true);
+    (void)ret;
+  } else {
+    delete job;
+  }
+}
+
+FilerJob *FilerJobPool::alloc(int fd, FileOp op) {
+  FilerJob *job = get();
+  job->reinit(fd, op);
+  return job;
+}
+
+FilerJob *FilerJobPool::alloc(const char *fileName, FileOp op) {
+  return alloc(fileName, strlen(fileName), op);
+}
+
+FilerJob *FilerJobPool::alloc(const char *fileName, size_t len, FileOp op) {
+  if (len >= PATH_MAX) {
+    LOG(ERROR) << "fileName of len=" << len << " exceeds " << PATH_MAX;
+    return nullptr;
+  }
+
+  FilerJob *job = get();
+  job->reinit(FD_INVALID, op);
+  job->fileName_ = static_cast<char *>(namePool_->Alloc(PATH_MAX));
+  if (job->fileName_ == nullptr) {
+    LOG(ERROR) << "failed to allocate fileName for job=" << (void *)job;
+    put(job);
+    return nullptr;
+  }
+  memcpy(job->fileName_, fileName, len);
+  job->fileName_[len] = '\0';
+  job->fileNameLength_ = len;
+  return job;
+}
+
+void FilerJobPool::release(FilerJob *job) {
+  // job which failed before completion must not keep ring mapped
+  job->releaseCompletionRing();
+  if (job->pool_) {
+    job->pool_->put(job);
+  } else {
+    delete job;
+  }
+}
+}
@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <boost/lockfree/queue.hpp>
+#include <memory>
+
+#include <FilerJob.h>
+#include <Mempool.h>
+
+namespace gobjfs {
+
+/**
+ * Recycles FilerJobs so that an io does not need a heap
+ * allocation in steady state.
+ * Jobs are carved out of a slab allocated at startup.  When all of
+ * them are in use, alloc falls back to the heap; such jobs are freed
+ * instead of recycled.
+ * Any thread can alloc or release a job
+ */
+class FilerJobPool {
+public:
+  // boost lockfree queue of fixed size indexes nodes with 16 bits
+  static constexpr size_t MaxJobs = 65534;
+
+  explicit FilerJobPool(size_t numJobs);
+
+  GOBJFS_DISALLOW_COPY(FilerJobPool);
+  GOBJFS_DISALLOW_MOVE(FilerJobPool);
+
+  FilerJob *alloc(int fd, FileOp op);
+
+  // copies fileName into buffer which is recycled along with job
+  // @return nullptr if fileName is too long
+  FilerJob *alloc(const char *fileName, FileOp op);
+  // for names which may contain null bytes
+  FilerJob *alloc(const char *fileName, size_t len, FileOp op);
+
+  // give job back to the pool it came from
+  // jobs which were not taken from a pool are deleted
+  static void release(FilerJob *job);
+
+  bool isFromSlab(const FilerJob *job) const {
+    return (job >= &slab_[0]) && (job < &slab_[numJobs_]);
+  }
+
+private:
+  FilerJob *get();
+
+  void put(FilerJob *job);
+
+  size_t numJobs_{0};
+  std::unique_ptr<FilerJob[]> slab_;
+  boost::lockfree::queue<FilerJob *, boost::lockfree::fixed_sized<true>>
+      freeList_;
+
+  // file names of delete jobs
+  MempoolSPtr namePool_;
+};
+}
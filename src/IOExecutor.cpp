@@ -20,10 +20,15 @@ but WITHOUT ANY WARRANTY of any kind.
 #include "FilerJob.h"
 #include <gcommon.h>
 
+#include <algorithm>
 #include <errno.h>
+#include <limits.h> // IOV_MAX
+#include <limits>
+#include <thread>
 #include <gobjfs_log.h>
 #include <sstream>     // open
 #include <sys/epoll.h> // epoll_event
+#include <sys/stat.h>  // fstat
 #include <util/os_utils.h>
 
 #include <sstream>       //
@@ -32,86 +37,46 @@ but WITHOUT ANY WARRANTY of any kind.
 
 using namespace gobjfs;
 using namespace gobjfs::stats;
+using gobjfs::os::DirectIOSize;
 using gobjfs::os::IsDirectIOAligned;
 
 #define EPOLL_MAXEVENT 10 // arbitrary number
+// runToCompletion mode : metadata ops run in one pass of the loop
+#define RUN_LOOP_MAX_FD_JOBS 8
 
 namespace gobjfs {
 
-FilerCtx::FilerCtx() {}
-
-int32_t FilerCtx::init(int32_t queueDepth, int epollFD) {
-  ioQueueDepth_ = queueDepth;
-  epollFD_ = epollFD;
-
-  int retcode = 0;
-
-  do {
-    bzero(&ioCtx_, sizeof(ioCtx_));
-    retcode = io_queue_init(queueDepth, &ioCtx_);
-    if (retcode != 0) {
-      LOG(ERROR) << "Failed to init io queue errno=" << -errno;
-      break;
-    }
-    numAvailable_ = ioQueueDepth_;
-
-    retcode = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-    if (retcode == -1) {
-      LOG(ERROR) << "Failed to create eventfd errno=" << -errno;
-      break;
-    }
-    eventFD_ = retcode;
-
-    epoll_event epollEvent;
-    bzero(&epollEvent, sizeof(epollEvent));
-
-    // since event.data is set to contain pointer to ctx,
-    // it will be returned by epoll_wait()
-    // this way, you can find FilerCtx from eventFD
-    epollEvent.data.ptr = (void *)this;
-
-    epollEvent.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
-    retcode = epoll_ctl(epollFD_, EPOLL_CTL_ADD, eventFD_, &epollEvent);
-    if (retcode != 0) {
-      LOG(ERROR) << "Failed to add epoll errno=" << -errno;
-      break;
-    }
-
-    LOG(INFO) << "epoll registered filer fd=" << eventFD_
-              << " with ptr=" << (void *)this;
-
-  } while (0);
-
-  return retcode;
+std::ostream &operator<<(std::ostream &os, CompletionMode mode) {
+  switch (mode) {
+  case CompletionMode::Interrupt:
+    os << "interrupt";
+    break;
+  case CompletionMode::Poll:
+    os << "poll";
+    break;
+  default:
+    os << "Unknown";
+    break;
+  }
+  return os;
 }
 
-FilerCtx::~FilerCtx() {
-  int retcode = 0;
-  assert(epollFD_ >= 0);
-
-  /* IOExecutor itself is being destroyed
-  int retcode = epoll_ctl(epollFD_, EPOLL_CTL_DEL, eventFD_, NULL);
-  VLOG(2) << "FilerCtx: epoll_ctl retcode: " << retcode << std::endl;
-  assert(retcode >= 0);
-  */
-  retcode = close(eventFD_);
-  if (retcode < 0) {
-    LOG(ERROR) << "Failed to close fd=" << eventFD_ << " errno=" << -errno;
-  }
-  retcode = io_queue_release(ioCtx_);
-  if (retcode < 0) {
-    LOG(ERROR) << "Failed to release ioctx errno=" << retcode;
+std::istream &operator>>(std::istream &is, CompletionMode &mode) {
+  std::string str;
+  is >> str;
+  if (str == "interrupt") {
+    mode = CompletionMode::Interrupt;
+  } else if (str == "poll") {
+    mode = CompletionMode::Poll;
+  } else {
+    is.setstate(std::ios_base::failbit);
   }
-  (void)retcode;
+  return is;
 }
 
-std::string FilerCtx::getState() const {
-  std::ostringstream s;
-  // json format
-  s << " \"ctx\":{\"numAvail\":" << numAvailable_
-    << ",\"queueDepth\":" << ioQueueDepth_ << "}";
-  return s.str();
-}
+// indexed by gIOPriority
+static const char *priorityName[GIO_PRIO_COUNT] = {"foreground", "background",
+                                                   "scrub"};
 
 // ============
 
@@ -129,11 +94,33 @@ void IOExecutor::Config::setDerivedParam() {
 }
 
 void IOExecutor::Config::print() const {
+  std::ostringstream weightStr;
+  for (size_t idx = 0; idx < priorityWeights_.size(); idx++) {
+    weightStr << ((idx == 0) ? "" : ",") << priorityWeights_[idx];
+  }
+
   LOG(INFO) << " \"queueDepth\":" << queueDepth_
             << ",\"maxRequestQueueSize\":" << maxRequestQueueSize_
             << ",\"maxFdQueueSize\":" << maxFdQueueSize_
-            << ",\"minSubmitSize\":" << minSubmitSize_
-            << ",\"noSubmitterThread\":" << noSubmitterThread_;
+            << ",\"targetLatencyUsec\":" << targetLatencyUsec_
+            << ",\"maxBatchSize\":" << maxBatchSize_
+            << ",\"noSubmitterThread\":" << noSubmitterThread_
+            << ",\"runToCompletion\":" << runToCompletion_
+            << ",\"backend\":\"" << backend_ << "\""
+            << ",\"numCtx\":" << numCtx_
+            << ",\"workStealing\":" << workStealing_
+            << ",\"priorityWeights\":[" << weightStr.str() << "]"
+            << ",\"completionMode\":\"" << completionMode_ << "\""
+            << ",\"pollSpinUsec\":" << pollSpinUsec_
+            << ",\"pollMaxSpinUsec\":" << pollMaxSpinUsec_
+            << ",\"maxMergeJobs\":" << maxMergeJobs_
+            << ",\"callbackBudgetUsec\":" << callbackBudgetUsec_
+            << ",\"numFdQueueThreads\":" << numFdQueueThreads_
+            << ",\"traceSampleRate\":" << traceSampleRate_
+            << ",\"traceRingSize\":" << traceRingSize_
+            << ",\"fdCacheSize\":" << fdCacheSize_
+            << ",\"readAheadWindow\":" << readAheadWindow_
+            << ",\"readAheadMaxBytes\":" << readAheadMaxBytes_;
 }
 
 namespace po = boost::program_options;
@@ -146,9 +133,49 @@ int IOExecutor::Config::addOptions(
   ioexecOptions.add_options()("ioexec.ctx_queue_depth",
                               po::value<uint32_t>(&queueDepth_),
                               "io depth of each context in IOExecutor")(
+      "ioexec.no_submitter_thread", po::value<bool>(&noSubmitterThread_),
+      "submit io in caller thread (default) instead of a submitter thread")(
+      "ioexec.run_to_completion", po::value<bool>(&runToCompletion_),
+      "one thread per executor submits, reaps and runs metadata ops")(
+      "ioexec.target_latency_usec", po::value<uint32_t>(&targetLatencyUsec_),
+      "latency within which requests may be held back to form a batch")(
+      "ioexec.max_batch_size", po::value<uint32_t>(&maxBatchSize_),
+      "max requests held back to form a batch")(
       "ioexec.cpu_core",
       po::value<std::vector<CoreId>>(&cpuCores_)->multitoken(),
-      "cpu cores dedicated to IO");
+      "cpu cores dedicated to IO")(
+      "ioexec.backend", po::value<IOBackend>(&backend_),
+      "kernel async io interface : libaio (default) or io_uring")(
+      "ioexec.num_ctx", po::value<uint32_t>(&numCtx_),
+      "number of io contexts in each IOExecutor")(
+      "ioexec.work_stealing", po::value<bool>(&workStealing_),
+      "idle IOExecutor submits queued reads of overloaded IOExecutor")(
+      "ioexec.priority_weight",
+      po::value<std::vector<uint32_t>>(&priorityWeights_)->multitoken(),
+      "weights of foreground, background and scrub io")(
+      "ioexec.completion_mode", po::value<CompletionMode>(&completionMode_),
+      "wait for completions : interrupt (default) or poll")(
+      "ioexec.poll_spin_usec", po::value<uint32_t>(&pollSpinUsec_),
+      "in poll mode, usec to spin after last completion before sleeping")(
+      "ioexec.poll_max_spin_usec", po::value<uint32_t>(&pollMaxSpinUsec_),
+      "in poll mode, max usec of one spin before checking timers")(
+      "ioexec.max_merge_jobs", po::value<uint32_t>(&maxMergeJobs_),
+      "max adjacent requests merged into one vectored io")(
+      "ioexec.callback_budget_usec",
+      po::value<uint32_t>(&callbackBudgetUsec_),
+      "completion callbacks taking longer are counted as slow")(
+      "ioexec.fdqueue_threads", po::value<uint32_t>(&numFdQueueThreads_),
+      "threads per IOExecutor which run deletes and non-aligned writes")(
+      "ioexec.trace_sample_rate", po::value<uint32_t>(&traceSampleRate_),
+      "trace one in these many jobs; 0 (default) disables tracing")(
+      "ioexec.trace_ring_size", po::value<uint32_t>(&traceRingSize_),
+      "number of most recent job traces kept for dump")(
+      "ioexec.fd_cache_size", po::value<uint32_t>(&fdCacheSize_),
+      "fds kept open for reads by file name; 0 (default) disables cache")(
+      "ioexec.readahead_window", po::value<uint32_t>(&readAheadWindow_),
+      "bytes prefetched at a time for O_DIRECT handles read sequentially")(
+      "ioexec.readahead_max_bytes", po::value<uint64_t>(&readAheadMaxBytes_),
+      "prefetched data held across handles; 0 (default) disables readahead");
 
   desc.add(ioexecOptions);
 
@@ -157,46 +184,43 @@ int IOExecutor::Config::addOptions(
 
 // ================
 
+void IOExecutor::Statistics::OpStats::update(FilerJob *job, bool countBytes) {
+  numOps_++;
+  if (countBytes) {
+    assert(job->size_);
+    numBytes_ += job->size_;
+  }
+  waitTime_ = job->waitTime();
+  serviceTime_ = job->serviceTime();
+  waitHist_ = job->waitTime();
+  serviceHist_ = job->serviceTime();
+
+  assert(job->priority_ < GIO_PRIO_COUNT);
+  ClassStats &classStats = class_[job->priority_];
+  classStats.numOps_++;
+  classStats.waitHist_ = job->waitTime();
+  classStats.serviceHist_ = job->serviceTime();
+}
+
 void IOExecutor::Statistics::incrementOps(FilerJob *job) {
 
   if (job->op_ == FileOp::Write) {
-
-    assert(job->size_);
-    write_.numOps_++;
-    write_.numBytes_ += job->size_;
-    write_.waitTime_ = job->waitTime();
-    write_.serviceTime_ = job->serviceTime();
-    write_.waitHist_ = job->waitTime();
-    write_.serviceHist_ = job->serviceTime();
-
+    write_.update(job, true);
   } else if (job->op_ == FileOp::NonAlignedWrite) {
-
-    assert(job->size_);
-    nonAlignedWrite_.numOps_++;
-    nonAlignedWrite_.numBytes_ += job->size_;
-    nonAlignedWrite_.waitTime_ = job->waitTime();
-    nonAlignedWrite_.serviceTime_ = job->serviceTime();
-    nonAlignedWrite_.waitHist_ = job->waitTime();
-    nonAlignedWrite_.serviceHist_ = job->serviceTime();
-
+    nonAlignedWrite_.update(job, true);
   } else if (job->op_ == FileOp::Read) {
-
-    assert(job->size_);
-    read_.numOps_++;
-    read_.numBytes_ += job->size_;
-    read_.waitTime_ = job->waitTime();
-    read_.serviceTime_ = job->serviceTime();
-    read_.waitHist_ = job->waitTime();
-    read_.serviceHist_ = job->serviceTime();
-
+    read_.update(job, true);
   } else if (job->op_ == FileOp::Delete) {
-
-    delete_.numOps_++;
     // delete_.numBytes_ += job->size_; not increment
-    delete_.waitTime_ = job->waitTime();
-    delete_.serviceTime_ = job->serviceTime();
-    delete_.waitHist_ = job->waitTime();
-    delete_.serviceHist_ = job->serviceTime();
+    delete_.update(job, false);
+  } else if (job->op_ == FileOp::Sync) {
+    sync_.update(job, false);
+  } else if (job->op_ == FileOp::Open) {
+    open_.update(job, false);
+  } else if (job->op_ == FileOp::Close) {
+    close_.update(job, false);
+  } else if (job->op_ == FileOp::Put) {
+    put_.update(job, true);
   }
 
   numCompleted_++;
@@ -205,11 +229,15 @@ void IOExecutor::Statistics::incrementOps(FilerJob *job) {
 void IOExecutor::Statistics::print() const {
   LOG(INFO) << "\"completionThread\":" << completionThread_.ToString();
   LOG(INFO) << "\"submitterThread\":" << submitterThread_.ToString();
-  LOG(INFO) << "\"fdQueueThread\":" << submitterThread_.ToString();
 
   LOG(INFO) << getState();
 
-  if ((numSubmitted_ != numQueued_) || (numSubmitted_ != numCompleted_)) {
+  // jobs merged into another job's io are not submitted on their own
+  const uint64_t numJobsSubmitted = numSubmitted_ + numMerged_ +
+                                    numSyncGrouped_ + numServed_ +
+                                    numAbortedQueued_;
+  if ((numJobsSubmitted != numQueued_) ||
+      (numJobsSubmitted != numCompleted_)) {
     LOG(ERROR) << "NOTE discrepancy in IOExecutor stats "
                   "between numQueued, numSubmitted and numCompleted";
   }
@@ -223,13 +251,36 @@ std::string IOExecutor::Statistics::getState() const {
     << "\"write\":" << write_.getState()
     << ",\"nonAlignedWrite\":" << nonAlignedWrite_.getState()
     << ",\"read\":" << read_.getState() << ",\"delete\":" << delete_.getState()
+    << ",\"sync\":" << sync_.getState()
+    << ",\"open\":" << open_.getState() << ",\"close\":" << close_.getState()
+    << ",\"put\":" << put_.getState()
     << ",\"numQueued\":" << numQueued_ << ",\"numSubmitted\":" << numSubmitted_
     << ",\"numCompleted\":" << numCompleted_
+    << ",\"numStolen\":" << numStolen_
+    << ",\"numStolenFrom\":" << numStolenFrom_
+    << ",\"numTimedOut\":" << numTimedOut_
+    << ",\"numCancelled\":" << numCancelled_
+    << ",\"numThrottled\":" << numThrottled_
+    << ",\"numRefused\":" << numRefused_
+    << ",\"numSpaceSignalled\":" << numSpaceSignalled_
+    << ",\"numSlowCallbacks\":" << numSlowCallbacks_
+    << ",\"numJobAllocs\":" << numJobAllocs_
+    << ",\"numSubmitHandoffs\":" << numSubmitHandoffs_
     << ",\"maxRequestQueueSize\":" << maxRequestQueueSize_
     << ",\"maxFdQueueSize\":" << maxFdQueueSize_
     << ",\"idleLoop\":" << idleLoop_
     << ",\"numProcessedInLoop\":" << numProcessedInLoop_
+    << ",\"batchSize\":" << batchSize_
+    << ",\"batchSizeHist\":" << batchSizeHist_
+    << ",\"batchWaitTime\":" << batchWaitTime_
     << ",\"numCompletionEvents\":" << numCompletionEvents_
+    << ",\"spinTime\":" << spinTime_ << ",\"sleepTime\":" << sleepTime_
+    << ",\"numSleeps\":" << numSleeps_
+    << ",\"numSpinReaped\":" << numSpinReaped_
+    << ",\"numMerged\":" << numMerged_
+    << ",\"numSyncGrouped\":" << numSyncGrouped_
+    << ",\"numServed\":" << numServed_
+    << ",\"numAbortedQueued\":" << numAbortedQueued_
     << ",\"requestQueueLow1\":" << requestQueueLow1_
     << ",\"requestQueueLow2\":" << requestQueueLow2_
     << ",\"requestQueueFull\":" << requestQueueFull_ << "}}";
@@ -244,7 +295,16 @@ std::string IOExecutor::Statistics::OpStats::getState() const {
   s << " {\"numOps\":" << numOps_ << ",\"numBytes\":" << numBytes_
     << ",\"waitTime\":" << waitTime_ << ",\"waitHist\":" << waitHist_
     << ",\"serviceTime\":" << serviceTime_
-    << ",\"serviceHist\":" << serviceHist_ << "}";
+    << ",\"serviceHist\":" << serviceHist_ << ",\"class\":{";
+
+  for (size_t idx = 0; idx < GIO_PRIO_COUNT; idx++) {
+    const ClassStats &classStats = class_[idx];
+    s << ((idx == 0) ? "" : ",") << "\"" << priorityName[idx] << "\":"
+      << "{\"numOps\":" << classStats.numOps_
+      << ",\"waitHist\":" << classStats.waitHist_
+      << ",\"serviceHist\":" << classStats.serviceHist_ << "}";
+  }
+  s << "}}";
 
   return s.str();
 }
@@ -253,36 +313,99 @@ std::string IOExecutor::Statistics::OpStats::getState() const {
 
 IOExecutor::IOExecutor(const std::string &name, CoreId core,
                        const Config &config)
-    : Executor(name, core), config_(config), requestQueue_(config.queueDepth_),
-      fdQueue_(0) {
+    : Executor(name, core), config_(config) {
+  // every class gets a weight, and no class is starved completely
+  config_.priorityWeights_.resize(GIO_PRIO_COUNT, 1);
+  for (auto &weight : config_.priorityWeights_) {
+    weight = std::max(weight, 1U);
+  }
+
+  config_.maxMergeJobs_ =
+      std::min<uint32_t>(std::max(config_.maxMergeJobs_, 1U), IOV_MAX);
+
+  if (config_.runToCompletion_) {
+    // completion thread does the work of all other threads
+    // one fdQueue keeps metadata ops on a file in order
+    config_.noSubmitterThread_ = true;
+    config_.numFdQueueThreads_ = 1;
+  }
+
   config_.print();
 
+  // allocate queues, job pool and io ctx from memory local
+  // to the core, so the threads bound to it dont go cross-node
+  numaNode_ = gobjfs::os::NumaNodeOfCore(core);
+  gobjfs::os::ScopedMemoryNode memNode(numaNode_);
+
+  for (size_t idx = 0; idx < GIO_PRIO_COUNT; idx++) {
+    requestQueue_.emplace_back(new PriorityQueue(config_.queueDepth_));
+  }
+  drr_.init(config_.priorityWeights_);
+
   epollFD_ = epoll_create1(0);
   assert(epollFD_ >= 0);
 
-  ctx_.init(config_.queueDepth_, epollFD_);
+  if (config_.numCtx_ == 0) {
+    config_.numCtx_ = 1;
+  }
+
+  for (uint32_t idx = 0; idx < config_.numCtx_; idx++) {
+    auto ctx = FilerCtxFactory::create(config_.backend_, config_.queueDepth_,
+                                       epollFD_);
+    if (!ctx) {
+      throw std::runtime_error("failed to create io ctx for " + name);
+    }
+    ctxVec_.push_back(std::move(ctx));
+  }
 
-  ctxCond_.init(config_.queueDepth_, /*fd*/ 0);
-  fdQueueCond_.init(0, /*fd*/ 0);
+  ctxCredits_ = config_.queueDepth_ * config_.numCtx_;
+  tracer_.init(config_.traceSampleRate_, config_.traceRingSize_, core,
+               name);
+  // request queue per priority, ctx and fdQueue
+  jobPool_.reset(new FilerJobPool(config_.queueDepth_ *
+                                  (GIO_PRIO_COUNT + config_.numCtx_ + 1)));
+  batchCtrl_.init(config_.targetLatencyUsec_,
+                  std::min(config_.maxBatchSize_, config_.queueDepth_));
+  config_.numFdQueueThreads_ = std::max(config_.numFdQueueThreads_, 1U);
+  for (uint32_t idx = 0; idx < config_.numFdQueueThreads_; idx++) {
+    fdQueueWorkers_.emplace_back(new FdQueueWorker);
+    fdQueueWorkers_.back()->cond_.init(0, /*fd*/ 0);
+  }
 
   completionThreadShutdown_.init(epollFD_);
+  if (config_.runToCompletion_) {
+    runLoopWakeup_.init(epollFD_);
+  }
+  deadlineTimer_.init(epollFD_, 0, 0);
+  handoverReady_.init(epollFD_);
+  armedDeadline_ = std::chrono::steady_clock::time_point::max();
+  throttleTimer_.init(epollFD_, 0, 0);
+  armedThrottle_ = std::chrono::steady_clock::time_point::max();
 
   state_ = State::RUNNING;
 
   if (config_.noSubmitterThread_) {
     periodicTimer_.init(epollFD_, 5 /*timer every n sec*/, 0);
+    batchTimer_.init(epollFD_, 0, 0);
   } else {
     submitterThread_ = std::thread(std::bind(&IOExecutor::execute, this));
   }
 
   try {
-    fdQueueThread_ = std::thread(std::bind(&IOExecutor::ProcessFdQueue, this));
+    for (auto &worker : fdQueueWorkers_) {
+      if (config_.runToCompletion_) {
+        break;
+      }
+      worker->thread_ = std::thread(
+          std::bind(&IOExecutor::ProcessFdQueue, this, worker.get()));
+    }
 
     completionThread_ =
         std::thread(std::bind(&IOExecutor::ProcessCompletions, this));
 
     LOG(INFO) << "IOExecutor started " << name_
-              << ":ioexecutor=" << (void *)this << ":core=" << core_;
+              << ":ioexecutor=" << (void *)this << ":core=" << core_
+              << ":numaNode=" << numaNode_;
   } catch (const std::exception &e) {
     LOG(ERROR) << "Unable to start threads. Exception=" << e.what();
     state_ = State::NOT_STARTED;
@@ -295,6 +418,39 @@ IOExecutor::~IOExecutor() {
   }
 }
 
+uint32_t IOExecutor::getNumThreads() const {
+  if (config_.runToCompletion_) {
+    return 1;
+  }
+  // completion thread, fdQueue threads and maybe a submitter thread
+  return 1 + fdQueueWorkers_.size() + (config_.noSubmitterThread_ ? 0 : 1);
+}
+
+FilerJob *IOExecutor::allocJob(int fd, FileOp op) {
+  FilerJob *job = jobPool_->alloc(fd, op);
+  if (!jobPool_->isFromSlab(job)) {
+    stats_.numJobAllocs_++;
+  }
+  return job;
+}
+
+FilerJob *IOExecutor::allocJob(const char *fileName, FileOp op) {
+  FilerJob *job = jobPool_->alloc(fileName, op);
+  if (job && !jobPool_->isFromSlab(job)) {
+    stats_.numJobAllocs_++;
+  }
+  return job;
+}
+
+FilerJob *IOExecutor::allocJob(const char *fileName, size_t len,
+                               FileOp op) {
+  FilerJob *job = jobPool_->alloc(fileName, len, op);
+  if (job && !jobPool_->isFromSlab(job)) {
+    stats_.numJobAllocs_++;
+  }
+  return job;
+}
+
 void IOExecutor::execute() {
   if (core_ > CoreIdInvalid) {
     gobjfs::os::BindThreadToCore(core_);
@@ -304,18 +460,18 @@ void IOExecutor::execute() {
   LOG(INFO) << "IOExecutor started " << name_ << ":ioexecutor=" << (void *)this
             << ":core=" << core_ << ":submitter threadid=" << gettid();
 
-  minSubmitSize_ = config_.minSubmitSize_;
-
   while (state_ != NO_MORE_INTAKE) {
     int32_t numProcessedInLoop = 0;
 
-    if (requestQueueSize_ >= (int32_t)minSubmitSize_) {
+    batchCtrl_.update();
+
+    if (isBatchReady()) {
+      WaitForFreeCtx();
       numProcessedInLoop += ProcessRequestQueue();
-      minSubmitSize_ = config_.minSubmitSize_;
-    } else {
-      // gradually reduce barrier to entry for new requests
-      if (minSubmitSize_ > 1)
-        minSubmitSize_ /= 2;
+    }
+
+    if ((numProcessedInLoop == 0) && config_.workStealing_) {
+      numProcessedInLoop += StealFromSiblings();
     }
 
     stats_.numProcessedInLoop_ = numProcessedInLoop;
@@ -323,18 +479,14 @@ void IOExecutor::execute() {
     // if no work done in this round, save some CPU
     if (numProcessedInLoop == 0) {
       stats_.idleLoop_++;
-      // sleep if no ctx and no requests for 5 consecutive loops
       {
         // if no work, lets wait
-        if ((requestQueueSize_ < (int32_t)minSubmitSize_) &&
-            (fdQueueSize_ == 0)) {
+        if (!isBatchReady() && (fdQueueSize_ == 0)) {
           std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
-          int32_t sleepTime = 1;
+          int64_t sleepTime = 1;
 
-          while ((requestQueueSize_ < (int32_t)minSubmitSize_) &&
-                 (fdQueueSize_ == 0) && (state_ == RUNNING)) {
-            if (minSubmitSize_ > 1)
-              minSubmitSize_ /= 2;
+          while (!isBatchReady() && (fdQueueSize_ == 0) &&
+                 (state_ == RUNNING)) {
 
             submitterWaitingForNewRequests_ = true;
             if (sleepTime == 1) {
@@ -342,20 +494,34 @@ void IOExecutor::execute() {
             } else {
               stats_.requestQueueLow2_++;
             }
+            int64_t waitTime = sleepTime;
+            if (batchWaiting_) {
+              // wake up when the partial batch has to be submitted
+              waitTime = std::max<int64_t>(
+                  batchCtrl_.waitWindowUsec() -
+                      batchWaitTimer_.elapsedMicroseconds(),
+                  1);
+            }
             submitterCond_.cond_.wait_for(lck,
-                                          std::chrono::microseconds(sleepTime));
+                                          std::chrono::microseconds(waitTime));
             if (sleepTime < 1000)
               sleepTime *= 10;
             LOG_EVERY_N(INFO, 1000) // log every 10 sec or so
                 << "waiting with requestQueueSize=" << requestQueueSize_
                 << ":fdQueueSize=" << fdQueueSize_
                 << ":idleloop=" << stats_.idleLoop_
-                << ":minSubmitSize=" << minSubmitSize_
+                << ":batchSize=" << batchCtrl_.batchSize()
                 << ":numReads=" << stats_.read_.numOps_
                 << ":numWrites=" << stats_.write_.numOps_
                 << ":numNonAlignedWrites=" << stats_.nonAlignedWrite_.numOps_
                 << ":state=" << state_;
             submitterWaitingForNewRequests_ = false;
+
+            batchCtrl_.update();
+
+            if (config_.workStealing_ && StealFromSiblings()) {
+              break;
+            }
           }
         }
       }
@@ -368,9 +534,11 @@ void IOExecutor::execute() {
 void IOExecutor::stop() {
   state_ = State::NO_MORE_INTAKE;
 
+  // jobs held back by QoS limits are done without further delay
+  ReleaseThrottledJobs();
+
   if (!config_.noSubmitterThread_) {
     submitterCond_.wakeup();
-    ctxCond_.wakeup();
     try {
       submitterThread_.join();
     } catch (const std::exception &e) {
@@ -378,14 +546,26 @@ void IOExecutor::stop() {
     }
   }
 
-  fdQueueCond_.wakeup();
-  try {
-    fdQueueThread_.join();
-  } catch (const std::exception &e) {
-    LOG(ERROR) << "Failed to join fdQueueThread. Exception=" << e.what();
+  // ops queued after this are run by completion thread,
+  // see RunRemainingFdJobs
+  for (auto &worker : fdQueueWorkers_) {
+    if (!worker->thread_.joinable()) {
+      // runToCompletion mode
+      continue;
+    }
+    worker->cond_.wakeup();
+    try {
+      worker->thread_.join();
+    } catch (const std::exception &e) {
+      LOG(ERROR) << "Failed to join fdQueueThread. Exception=" << e.what();
+    }
+    LOG(INFO) << "\"fdQueueThread\":" << worker->cpuStats_.ToString();
   }
 
   state_ = State::FINAL_SHUTDOWN;
+  // blocked callers are rejected once they wake up
+  WakeupSpaceWaiters();
+  fdQueueHasSpace_.wakeup();
 
   completionThreadShutdown_.send();
   try {
@@ -402,48 +582,300 @@ void IOExecutor::stop() {
 }
 
 int32_t IOExecutor::ProcessRequestQueue() {
-  int32_t numToSubmit = 0;
+  int32_t numSubmitted = 0;
 
-  iocb *post_iocb[ctx_.ioQueueDepth_];
-  // post_iocb can be freed after io_submit()
+  // fill the least loaded ctx first, and move on to the next one
+  // only if jobs remain after it is full
+  while (requestQueueSize_ > 0) {
+    FilerCtx *ctxPtr = LeastLoadedCtx();
+    if (ctxPtr->isEmpty()) {
+      break;
+    }
+    const int32_t numSubmittedToCtx = SubmitToCtx(ctxPtr);
+    if (numSubmittedToCtx == 0) {
+      break;
+    }
+    numSubmitted += numSubmittedToCtx;
+  }
 
-  // as per linux source code, io_submit() makes
-  // a copy of iocb [using copy_from_user() in fs/aio.c]
-  // that is why we can allocate iocb array on stack
-  // and free it after io_submit
-  iocb cbVec[ctx_.ioQueueDepth_];
+  if (numSubmitted) {
+    // queue limits are per priority class; let any blocked
+    // submitTask recheck its own class
+    WakeupSpaceWaiters();
+    SignalIfQueueDrained();
 
-  ctxCond_.pause();  // dummy increment to check if ctx available
-  ctxCond_.wakeup(); // undo decrement
+    if (batchWaiting_.exchange(false)) {
+      stats_.batchWaitTime_ = batchWaitTimer_.elapsedMicroseconds();
+    }
+  }
 
-  while (!ctx_.isEmpty()) {
-    const bool gotJob = requestQueue_.consume_one([&](FilerJob *job) {
-      iocb *cb = &cbVec[numToSubmit];
+  return numSubmitted;
+}
 
-      job->prepareCallblock(cb);
+/**
+ * noSubmitterThread mode : callers queue their requests, and the one
+ * which sets the submitting flag submits requests of all callers in
+ * one batch.  The others return right away instead of waiting for
+ * a lock; their requests are picked up when the flag holder checks
+ * the queue again after letting go of the flag.
+ * @return false if another thread was submitting
+ */
+bool IOExecutor::TrySubmitQueued() {
+  while (true) {
+    if (submitting_.exchange(true)) {
+      stats_.numSubmitHandoffs_++;
+      return false;
+    }
+    const int32_t numSubmitted = ProcessRequestQueue();
+    submitting_ = false;
 
-      io_set_eventfd(cb, ctx_.eventFD_);
-      post_iocb[numToSubmit] = cb;
+    if ((requestQueueSize_ == 0) || (ctxCredits_ <= 0)) {
+      // if io slots ran out, completion thread submits the rest
+      // once it frees some, see NotifySubmitterIfCtxFree
+      break;
+    }
+    if ((numSubmitted == 0) || !isBatchReady()) {
+      ArmBatchTimer();
+      break;
+    }
+  }
+  return true;
+}
+
+// completion thread : submit requests left in queue at shutdown
+void IOExecutor::SubmitRemaining() {
+  // a caller may still be in the middle of submitting
+  while (submitting_.exchange(true)) {
+    std::this_thread::yield();
+  }
+  ProcessRequestQueue();
+  submitting_ = false;
+}
+
+// submitter thread : sleep until completion thread frees io slots
+void IOExecutor::WaitForFreeCtx() {
+  if (ctxCredits_ > 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
+  submitterWaitingForFreeCtx_ = true;
+  while ((ctxCredits_ <= 0) && (state_ == RUNNING)) {
+    submitterCond_.cond_.wait(lck);
+  }
+  submitterWaitingForFreeCtx_ = false;
+}
+
+void IOExecutor::WakeupSpaceWaiters() {
+  if (numWaitingForSpace_) {
+    requestQueueHasSpace_.wakeup();
+  }
+}
+
+/**
+ * decide if queued requests should be submitted now, or held back
+ * until enough have arrived to fill the batch chosen by BatchController
+ */
+bool IOExecutor::isBatchReady() {
+  const int32_t queueSize = requestQueueSize_;
+  if (queueSize == 0) {
+    return false;
+  }
+  if ((queueSize >= (int32_t)batchCtrl_.batchSize()) ||
+      (state_ != RUNNING)) {
+    return true;
+  }
+  bool wasWaiting = false;
+  if (batchWaiting_.compare_exchange_strong(wasWaiting, true)) {
+    // first request of a partial batch; start the window
+    batchWaitTimer_.reset();
+    return (batchCtrl_.waitWindowUsec() == 0);
+  }
+  return (batchWaitTimer_.elapsedMicroseconds() >=
+          batchCtrl_.waitWindowUsec());
+}
+
+// noSubmitterThread mode : completion thread submits the partial batch
+// if no caller fills it within the window
+void IOExecutor::ArmBatchTimer() {
+  if (!batchTimerArmed_.exchange(true)) {
+    int64_t timeoutUsec = batchCtrl_.waitWindowUsec() -
+                          batchWaitTimer_.elapsedMicroseconds();
+    if (timeoutUsec <= 0) {
+      // window is over but ctx was full; retry after io completes
+      timeoutUsec = BatchController::UpdateIntervalUsec / 10;
+    }
+    batchTimer_.arm(timeoutUsec);
+  }
+}
+
+FilerCtx *IOExecutor::LeastLoadedCtx() const {
+  FilerCtx *bestCtx = ctxVec_[0].get();
+  for (size_t idx = 1; idx < ctxVec_.size(); idx++) {
+    if (ctxVec_[idx]->numAvailable_ > bestCtx->numAvailable_) {
+      bestCtx = ctxVec_[idx].get();
+    }
+  }
+  return bestCtx;
+}
+
+/**
+ * move jobs from request queue into the ctx until it is full
+ * @return number of jobs submitted to kernel
+ */
+int32_t IOExecutor::SubmitToCtx(FilerCtx *ctxPtr) {
+  int32_t numToSubmit = 0;
+
+  iocb *post_iocb[ctxPtr->ioQueueDepth_];
+  // post_iocb can be freed after io_submit()
+
+  // the iocb itself is kept in the FilerJob, because io_cancel()
+  // identifies the io by the iocb address given to io_submit()
+  FilerJob *ioJobs[ctxPtr->ioQueueDepth_];
 
-    });
+  FilerJob *job = nullptr;
+  // last job merged into the latest io, and number of jobs in that io
+  FilerJob *lastJob = nullptr;
+  uint32_t numInLastIo = 0;
+
+  while (!ctxPtr->isEmpty()) {
+    const bool gotJob = NextJob(job);
 
     if (gotJob) {
-      numToSubmit++;
-      ctx_.decrementNumAvailable(1);
-      ctxCond_.pause();
       int32_t num = requestQueueSize_--;
       assert(num >= 0);
       (void)num;
+
+      // fragments of a batch are queued one after another, so it
+      // suffices to check if job continues where the latest io ends
+      const bool merge = lastJob && (numInLastIo < config_.maxMergeJobs_) &&
+                         lastJob->isAdjacent(job);
+
+      // group commit : sync which finds another sync for its fd in
+      // this batch is completed by the same kernel call
+      FilerJob *syncLeader = nullptr;
+      if (!merge && (job->op_ == FileOp::Sync)) {
+        for (int32_t idx = 0; idx < numToSubmit; idx++) {
+          if (job->canJoinSync(ioJobs[idx])) {
+            syncLeader = ioJobs[idx];
+            break;
+          }
+        }
+      }
+
+      if (!ClaimJob(job)) {
+        // job was cancelled or expired while queued
+        continue;
+      }
+
+      if (merge) {
+        lastJob->mergeNext_ = job;
+        lastJob = job;
+        numInLastIo++;
+        stats_.numMerged_++;
+        continue;
+      }
+
+      if (syncLeader) {
+        // order within a group does not matter
+        job->mergeNext_ = syncLeader->mergeNext_;
+        syncLeader->mergeNext_ = job;
+        stats_.numSyncGrouped_++;
+        continue;
+      }
+
+      ioJobs[numToSubmit] = job;
+      lastJob = job;
+      numInLastIo = 1;
+
+      numToSubmit++;
+      TakeCtxSlot(ctxPtr);
     } else {
       break;
     }
   }
 
+  for (int32_t idx = 0; idx < numToSubmit; idx++) {
+    FilerJob *ioJob = ioJobs[idx];
+    iocb *cb = &ioJob->cb_;
+    ioJob->prepareCallblock(cb);
+    post_iocb[idx] = cb;
+    // a job which is part of a vectored io cannot be cancelled alone
+    // nor can a read-modify-write, whose iocb changes between steps.
+    // ctx is published once the iocb is ready; until then
+    // CancelInflightJob returns -EBUSY
+    if (!ioJob->mergeNext_ && (ioJob->op_ != FileOp::NonAlignedWrite)) {
+      ioJob->ctx_ = ctxPtr;
+    }
+  }
+
+  return SubmitIocbs(ctxPtr, post_iocb, numToSubmit);
+}
+
+/**
+ * pick next job across priority classes, see DeficitRoundRobin
+ * @return true if job found
+ */
+bool IOExecutor::NextJob(FilerJob *&job) {
+  return drr_.next([this, &job](size_t priority) {
+    return PopJob(*requestQueue_[priority], job);
+  }) >= 0;
+}
+
+// take the next job of one class
+bool IOExecutor::PopJob(PriorityQueue &queue, FilerJob *&job) {
+  bool gotJob = false;
+  if (!config_.workStealing_) {
+    gotJob = queue.jobQueue_.pop(job);
+  } else {
+    // alternate between reads and other jobs, so that a flood
+    // of one does not hold up the other
+    queue.readTurn_ = !queue.readTurn_;
+    gotJob = (queue.readTurn_ && queue.readQueue_.pop(job)) ||
+             queue.jobQueue_.pop(job) ||
+             (!queue.readTurn_ && queue.readQueue_.pop(job));
+    if (gotJob && (job->op_ == FileOp::Read)) {
+      queue.readSize_--;
+      readQueueSize_--;
+    }
+  }
+  if (gotJob) {
+    queue.size_--;
+  }
+  return gotJob;
+}
+
+/**
+ * submit iocbs to ctx, for which slots have already been reserved
+ * jobs which cannot be submitted are completed with error
+ * @return number of jobs submitted to kernel
+ */
+int32_t IOExecutor::SubmitIocbs(FilerCtx *ctxPtr, iocb **post_iocb,
+                                int32_t numToSubmit) {
   int32_t numRemaining = numToSubmit;
 
   if (numToSubmit) {
+    stats_.batchSize_ = numToSubmit;
+    stats_.batchSizeHist_ = numToSubmit;
+
     VLOG(1) << "to submit num io=" << numToSubmit;
 
+    // jobs can complete and be freed before io_submit returns
+    // so hold on to their traces to stamp them afterwards
+    std::vector<JobTrace *> traces;
+    if (tracer_.isEnabled()) {
+      for (int32_t idx = 0; idx < numToSubmit; idx++) {
+        FilerJob *job =
+            post_iocb[idx] ? static_cast<FilerJob *>(post_iocb[idx]->data)
+                           : nullptr;
+        for (; job; job = job->mergeNext_) {
+          if (job->trace_) {
+            job->trace_->hold();
+            traces.push_back(job->trace_);
+          }
+        }
+      }
+    }
+
     // how many times do we try to resubmit io
     int32_t numTries = 5;
 
@@ -451,8 +883,8 @@ int32_t IOExecutor::ProcessRequestQueue() {
 
       assert(numRemaining > 0);
 
-      int iosubmitRetcode = io_submit(ctx_.ioCtx_, numRemaining,
-                                      &post_iocb[numToSubmit - numRemaining]);
+      int iosubmitRetcode = ctxPtr->submit(
+          &post_iocb[numToSubmit - numRemaining], numRemaining);
 
       /*
        * if errcode < 0
@@ -487,8 +919,8 @@ int32_t IOExecutor::ProcessRequestQueue() {
             if (job) {
               bool isValidRet = job->isValid(ostr);
               (void)isValidRet; // ignore
-              job->retcode_ = iosubmitRetcode;
-              doPostProcessingOfJob(job);
+              // also fails jobs merged into this io
+              ProcessMergedCallback(job, iosubmitRetcode);
             } else {
               LOG(ERROR) << "found cb data to be null for cb=" << (void *)cb;
             }
@@ -499,8 +931,7 @@ int32_t IOExecutor::ProcessRequestQueue() {
                    << " got errno=" << iosubmitRetcode
                    << " with errors=" << ostr.str();
 
-        ctx_.incrementNumAvailable(numRemaining);
-        ctxCond_.wakeup(numRemaining);
+        ReturnCtxSlots(ctxPtr, numRemaining);
         break;
 
       } else {
@@ -515,8 +946,7 @@ int32_t IOExecutor::ProcessRequestQueue() {
                        << " out of " << numRemaining + numSubmitted
                        << " total size " << numToSubmit;
 
-          ctx_.incrementNumAvailable(numSubmitted);
-          ctxCond_.wakeup(numSubmitted);
+          ReturnCtxSlots(ctxPtr, numSubmitted);
         } else {
           assert(numRemaining == 0);
           // we are done here
@@ -533,196 +963,1042 @@ int32_t IOExecutor::ProcessRequestQueue() {
         iocb *cb = post_iocb[idx];
         FilerJob *job = static_cast<FilerJob *>(cb->data);
         if (job) {
-          job->retcode_ = -EINVAL;
-          doPostProcessingOfJob(job);
+          ProcessMergedCallback(job, -EINVAL);
         } else {
           LOG(ERROR) << "found cb data to be null for cb=" << (void *)cb;
         }
       }
 
-      ctx_.incrementNumAvailable(numRemaining);
-      ctxCond_.wakeup(numRemaining);
+      ReturnCtxSlots(ctxPtr, numRemaining);
 
       LOG(ERROR) << "only able to submit " << numRemaining << " out of "
                  << numToSubmit;
     }
 
-    if (requestQueueSize_ < (int32_t)config_.maxRequestQueueSize_) {
-      requestQueueHasSpace_.wakeup();
+    if (!traces.empty()) {
+      const int64_t nowNsec = JobTrace::nowNsec();
+      for (auto trace : traces) {
+        trace->stamp(TraceStage::Submitted, nowNsec);
+        trace->release();
+      }
     }
   }
 
   return (numToSubmit - numRemaining);
 }
 
-int32_t IOExecutor::ProcessFdQueue() {
-  if (core_ > CoreIdInvalid) {
-    gobjfs::os::BindThreadToCore(core_);
+void IOExecutor::setSiblings(const std::vector<IOExecutor *> &siblings) {
+  siblings_.clear();
+  for (auto sibling : siblings) {
+    if (sibling != this) {
+      siblings_.push_back(sibling);
+    }
   }
+}
 
-  LOG(INFO) << "IOExecutor started " << name_ << ":ioexecutor=" << (void *)this
-            << ":core=" << core_ << ":fdQueue threadid=" << gettid();
+// has queued reads but no free ctx slot to submit them
+bool IOExecutor::isOverloaded() const {
+  return (state_ == RUNNING) && (readQueueSize_ > 0) &&
+         LeastLoadedCtx()->isEmpty();
+}
 
-  uint32_t numConsumed = 0;
+/**
+ * take queued reads from an overloaded sibling and submit them
+ * on our own ctx.  Their completions are processed by our completion
+ * thread, so the job accounting moves over to this IOExecutor
+ * Caller must ensure no other thread is submitting on this IOExecutor
+ * @return number of jobs submitted to kernel
+ */
+int32_t IOExecutor::StealRequests(IOExecutor *victim) {
+  if ((state_ != RUNNING) || !victim->isOverloaded()) {
+    return 0;
+  }
 
-  while (state_ != NO_MORE_INTAKE) {
-    fdQueueCond_.pause();
+  FilerCtx *ctxPtr = LeastLoadedCtx();
 
-    bool gotJob = fdQueue_.consume_one([&](FilerJob *job) {
+  // take only half, so that executors do not steal back and forth
+  const int32_t maxToSteal = std::min<int32_t>(
+      ctxPtr->numAvailable_, (victim->readQueueSize_ + 1) / 2);
 
-      if (job->op_ == FileOp::Delete) {
-        job->setWaitTime();
-        stats_.numSubmitted_++;
-        int retcode = ::unlink(job->fileName_.c_str());
-        job->retcode_ = (retcode == 0) ? 0 : -errno;
-        if (retcode != 0) {
-          LOG(ERROR) << "delete file=" << job->fileName_
-                     << " failed errno=" << job->retcode_;
-        }
-      } else if (job->op_ == FileOp::NonAlignedWrite) {
-        job->setWaitTime();
-        stats_.numSubmitted_++;
-        ssize_t writeSz =
-            ::pwrite(job->fd_, job->buffer_, job->userSize_, job->offset_);
-        if (writeSz != job->userSize_) {
-          job->retcode_ = -errno;
-          LOG(ERROR) << "op=" << job->op_ << " failed for job=" << (void *)job
-                     << " errno=" << job->retcode_;
-        } else {
-          job->retcode_ = 0;
-        }
-      } else {
-        LOG(ERROR) << "unknown op=" << job->op_ << " for job=" << (void *)job;
-        job->retcode_ = -EINVAL;
+  int32_t numToSubmit = 0;
+  iocb *post_iocb[ctxPtr->ioQueueDepth_];
+
+  // higher priority classes are stolen first
+  for (auto &queue : victim->requestQueue_) {
+    FilerJob *job = nullptr;
+    while ((numToSubmit < maxToSteal) && queue->readQueue_.pop(job)) {
+      queue->readSize_--;
+      queue->size_--;
+      victim->readQueueSize_--;
+      int32_t num = victim->requestQueueSize_--;
+      assert(num >= 0);
+      (void)num;
+
+      if (!victim->ClaimJob(job)) {
+        continue;
       }
 
-      doPostProcessingOfJob(job);
-    });
+      // increment here before decrement in victim, so that
+      // neither completion thread sees all jobs done too early
+      stats_.numQueued_++;
+      job->executor_ = this;
+      victim->UnregisterJob(job);
+      RegisterJob(job);
 
-    if (gotJob) {
-      numConsumed++;
-    } else {
-      break;
-    }
+      iocb *cb = &job->cb_;
+      job->prepareCallblock(cb);
+      post_iocb[numToSubmit] = cb;
+      job->ctx_ = ctxPtr;
 
-    fdQueueSize_--;
-    if (fdQueueSize_ >= (int32_t)config_.maxRequestQueueSize_) {
-      fdQueueHasSpace_.wakeup();
+      numToSubmit++;
+      TakeCtxSlot(ctxPtr);
+      victim->stats_.numQueued_--;
     }
   }
 
-  stats_.fdQueueThread_.getThreadStats();
-  return 0;
-}
-
-int IOExecutor::submitTask(FilerJob *job, bool blocking) {
-  int ret = 0;
+  if (numToSubmit) {
+    stats_.numStolen_ += numToSubmit;
+    victim->stats_.numStolenFrom_ += numToSubmit;
+    victim->WakeupSpaceWaiters();
+  }
 
-  do {
+  return SubmitIocbs(ctxPtr, post_iocb, numToSubmit);
+}
 
-    if (state_ != RUNNING) {
-      // signal to caller that no more jobs
-      LOG(ERROR) << "shutting down. rejecting job=" << (void *)job;
-      ret = -EAGAIN;
+// called by submitter thread when it has no work of its own
+int32_t IOExecutor::StealFromSiblings() {
+  int32_t numStolen = 0;
+  for (auto sibling : siblings_) {
+    if (LeastLoadedCtx()->isEmpty()) {
       break;
     }
+    numStolen += StealRequests(sibling);
+  }
+  return numStolen;
+}
 
-    if (!IsDirectIOAligned(job->userSize_)) {
-      if (job->op_ == FileOp::Write) {
-        job->op_ = FileOp::NonAlignedWrite;
-        blocking = true;
-      } else if (job->op_ == FileOp::Read) {
-        // short reads work with O_DIRECT
+/**
+ * in noSubmitterThread mode, there is no thread in an idle sibling
+ * which could steal, so the overloaded IOExecutor asks an idle sibling
+ * to take its queued reads, holding the submitting flag of the sibling
+ */
+void IOExecutor::OfferToSiblings() {
+  for (auto sibling : siblings_) {
+    if (!isOverloaded()) {
+      break;
+    }
+    if ((sibling->requestQueueSize_ != 0) ||
+        sibling->LeastLoadedCtx()->isEmpty()) {
+      // sibling is busy enough
+      continue;
+    }
+    if (!sibling->submitting_.exchange(true)) {
+      sibling->StealRequests(this);
+      sibling->submitting_ = false;
+      // callers of sibling which found the flag taken meanwhile
+      if (sibling->requestQueueSize_ != 0) {
+        sibling->TrySubmitQueued();
       }
     }
+  }
+}
 
-    if ((job->op_ == FileOp::Delete) || (job->op_ == FileOp::Sync) ||
-        (job->op_ == FileOp::NonAlignedWrite)) {
+IOExecutor::FdQueueWorker &IOExecutor::FdQueueWorkerFor(const FilerJob *job) {
+  size_t key = 0;
+  if (job->fileName_) {
+    // FNV-1a of name, since delete has no fd
+    key = 14695981039346656037ULL;
+    for (const char *c = job->fileName_; *c; c++) {
+      key = (key ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+  } else {
+    key = job->fd_;
+  }
+  return *fdQueueWorkers_[key % fdQueueWorkers_.size()];
+}
 
-      if (fdQueueSize_ > (int32_t)config_.maxRequestQueueSize_) {
-        if (!blocking) {
-          LOG(ERROR) << "FD Queue full.  rejecting nonblocking job="
-                     << (void *)job;
-          ret = job->retcode_ = -EAGAIN;
-          break;
-        } else {
-          stats_.requestQueueFull_++;
-          fdQueueHasSpace_.pause();
-        }
+int32_t IOExecutor::ProcessFdQueue(FdQueueWorker *worker) {
+  if (core_ > CoreIdInvalid) {
+    gobjfs::os::BindThreadToCore(core_);
+  }
+
+  LOG(INFO) << "IOExecutor started " << name_ << ":ioexecutor=" << (void *)this
+            << ":core=" << core_ << ":fdQueue threadid=" << gettid();
+
+  uint32_t numConsumed = 0;
+
+  while (state_ != NO_MORE_INTAKE) {
+    worker->cond_.pause();
+
+    if (RunFdQueueJob(worker)) {
+      numConsumed++;
+    } else {
+      break;
+    }
+  }
+
+  worker->cpuStats_.getThreadStats();
+  return 0;
+}
+
+int IOExecutor::OpenFileOfJob(FilerJob *job) {
+  char absFileName[PATH_MAX];
+  const char *path = job->fileName_;
+  if (fileTranslator_) {
+    const int translateRet =
+        fileTranslator_(job->fileName_, job->fileNameLength_, absFileName);
+    if (translateRet < 0) {
+      LOG(ERROR) << "file translation failed (" << translateRet
+                 << ") for job=" << (void *)job;
+      return -EINVAL;
+    }
+    path = absFileName;
+  }
+  int fd = ::open(path, job->openFlags_, job->openMode_);
+  if (fd < 0) {
+    fd = -errno;
+    LOG(ERROR) << "op=" << job->op_ << " failed to open file=" << path
+               << " flags=" << job->openFlags_ << " errno=" << fd;
+  }
+  return fd;
+}
+
+// run one metadata op from the queue of the worker
+// @return false if queue was empty
+bool IOExecutor::RunFdQueueJob(FdQueueWorker *worker) {
+  const int32_t queueSize = worker->size_;
+
+  bool gotJob = worker->queue_.consume_one([&](FilerJob *job) {
+
+    gobjfs::stats::Timer serviceTimer(true);
+    // false if job continues in request queue
+    bool isDone = true;
+
+    if (job->op_ == FileOp::Delete) {
+      job->setWaitTime();
+      stats_.numSubmitted_++;
+      int retcode = ::unlink(job->fileName_);
+      job->retcode_ = (retcode == 0) ? 0 : -errno;
+      if (retcode != 0) {
+        LOG(ERROR) << "delete file=" << job->fileName_
+                   << " failed errno=" << job->retcode_;
+      } else if (fdCache_) {
+        fdCache_->invalidate(job->fileName_);
+      }
+    } else if (job->op_ == FileOp::Open) {
+      job->setWaitTime();
+      stats_.numSubmitted_++;
+      const int fd = OpenFileOfJob(job);
+      if (fd >= 0) {
+        // handle is read by caller only after completion is posted
+        *job->openedFd_ = fd;
+      }
+      job->retcode_ = (fd >= 0) ? 0 : fd;
+    } else if (job->op_ == FileOp::Close) {
+      job->setWaitTime();
+      stats_.numSubmitted_++;
+      int retcode = ::close(job->fd_);
+      job->retcode_ = (retcode == 0) ? 0 : -errno;
+      if (retcode != 0) {
+        LOG(ERROR) << "close fd=" << job->fd_
+                   << " failed errno=" << job->retcode_;
+      }
+      job->fd_ = FD_INVALID;
+    } else if ((job->op_ == FileOp::Put) &&
+               (job->putStep_ == PutStep::Open)) {
+      job->setWaitTime();
+      const int fd = OpenFileOfJob(job);
+      if (fd < 0) {
+        job->retcode_ = fd;
+      } else if (job->userSize_) {
+        // write goes through request queue, and comes back to close
+        // it is counted as submitted when its io is
+        job->fd_ = fd;
+        isDone = false;
+      } else {
+        job->retcode_ = 0;
+        if (::close(fd) != 0) {
+          job->retcode_ = -errno;
+          LOG(ERROR) << "op=" << job->op_ << " failed to close for job="
+                     << (void *)job << " errno=" << job->retcode_;
+        }
+      }
+      if (isDone) {
+        stats_.numSubmitted_++;
+      }
+    } else if (job->op_ == FileOp::Put) {
+      // write of the Put is done; keep its error over that of close
+      assert(job->putStep_ == PutStep::Close);
+      if (!job->waitTime()) {
+        // write failed before it was submitted
+        job->setWaitTime();
+      }
+      if ((::close(job->fd_) != 0) && (job->retcode_ == 0)) {
+        job->retcode_ = -errno;
+        LOG(ERROR) << "op=" << job->op_ << " failed to close for job="
+                   << (void *)job << " errno=" << job->retcode_;
+      }
+      job->fd_ = FD_INVALID;
+    } else if ((job->op_ == FileOp::NonAlignedWrite) &&
+               (job->rmwStep_ == RmwStep::PWrite)) {
+      // works only if fd was opened without O_DIRECT
+      job->setWaitTime();
+      stats_.numSubmitted_++;
+      ssize_t writeSz =
+          ::pwrite(job->fd_, job->buffer_, job->userSize_, job->offset_);
+      if (writeSz != (ssize_t)job->userSize_) {
+        job->retcode_ = -errno;
+        LOG(ERROR) << "op=" << job->op_ << " failed for job=" << (void *)job
+                   << " errno=" << job->retcode_;
+      } else {
+        job->retcode_ = 0;
+      }
+    } else if ((job->op_ == FileOp::NonAlignedWrite) &&
+               (job->rmwStep_ == RmwStep::Truncate)) {
+      // padded write done by completion thread; cut the padding
+      // unless file was extended further by a write which completed
+      // before this one was queued.  No write to the fd is in flight
+      // now, see QueueTruncate
+      const off_t paddedSize =
+          job->offset_ + job->alignedSize() + DirectIOSize;
+      struct stat statBuf;
+      int retcode = ::fstat(job->fd_, &statBuf);
+      if ((retcode == 0) && (statBuf.st_size <= paddedSize)) {
+        retcode = ::ftruncate(job->fd_, job->truncateSize_);
+      }
+      job->retcode_ = (retcode == 0) ? 0 : -errno;
+      if (retcode != 0) {
+        LOG(ERROR) << "op=" << job->op_ << " failed for job=" << (void *)job
+                   << " truncateSize=" << job->truncateSize_
+                   << " errno=" << job->retcode_;
+      }
+    } else {
+      LOG(ERROR) << "unknown op=" << job->op_ << " for job=" << (void *)job;
+      job->retcode_ = -EINVAL;
+    }
+
+    worker->serviceHist_ = std::max<int64_t>(
+        serviceTimer.elapsedNanoseconds(), 1);
+    worker->queueSizeHist_ = std::max<int32_t>(queueSize, 1);
+
+    if (isDone) {
+      doPostProcessingOfJob(job);
+    } else {
+      SubmitPutWrite(job);
+    }
+  });
+
+  if (!gotJob) {
+    return false;
+  }
+
+  worker->size_--;
+  fdQueueSize_--;
+  if (fdQueueSize_ >= (int32_t)config_.maxRequestQueueSize_) {
+    fdQueueHasSpace_.wakeup();
+  }
+  return true;
+}
+
+std::string IOExecutor::FdQueueWorker::getState() const {
+  std::ostringstream s;
+
+  s << "{\"queueSize\":" << size_ << ",\"queueSizeHist\":" << queueSizeHist_
+    << ",\"serviceHist\":" << serviceHist_ << "}";
+  return s.str();
+}
+
+void IOExecutor::PushToFdQueue(FilerJob *job) {
+  stats_.maxFdQueueSize_ = ++fdQueueSize_;
+
+  FdQueueWorker &worker = FdQueueWorkerFor(job);
+  worker.size_++;
+
+  bool pushReturn = false;
+  do {
+    pushReturn = worker.queue_.push(job);
+    if (pushReturn == false) {
+      LOG_EVERY_N(WARNING, 10) << "push into fdQueue failing";
+    }
+  } while (pushReturn == false);
+  if (config_.runToCompletion_) {
+    WakeupRunLoop();
+  } else {
+    worker.cond_.wakeup();
+  }
+}
+
+int IOExecutor::submitTask(FilerJob *job, bool blocking, bool moreToFollow,
+                           bool isReserved) {
+  int ret = 0;
+  // job may be freed by the time reservation is given back
+  const gIOPriority priority = job->priority_;
+
+  do {
+
+    if (state_ != RUNNING) {
+      // signal to caller that no more jobs
+      LOG(ERROR) << "shutting down. rejecting job=" << (void *)job;
+      ret = -EAGAIN;
+      break;
+    }
+
+    // short reads work with O_DIRECT
+    if (!IsDirectIOAligned(job->userSize_) && (job->op_ == FileOp::Write)) {
+      // read-modify-write of the last block, see ProcessNonAlignedWrite
+      ret = PrepareNonAlignedWrite(job);
+      if (ret != 0) {
+        break;
+      }
+      if (job->rmwStep_ == RmwStep::PWrite) {
+        blocking = true;
+      }
+    }
+
+    if (job->isMetadataOp() || (job->rmwStep_ == RmwStep::PWrite)) {
+
+      if (fdQueueSize_ > (int32_t)config_.maxRequestQueueSize_) {
+        if (!blocking) {
+          LOG(ERROR) << "FD Queue full.  rejecting nonblocking job="
+                     << (void *)job;
+          ret = job->retcode_ = -EAGAIN;
+          break;
+        } else {
+          stats_.requestQueueFull_++;
+          fdQueueHasSpace_.pause();
+          if (state_ != RUNNING) {
+            // woken up by stop
+            LOG(ERROR) << "shutting down. rejecting job=" << (void *)job;
+            ret = -EAGAIN;
+            break;
+          }
+        }
       }
 
       // increment size before push, to prevent race conditions
       job->setSubmitTime();
+      StartTrace(job);
       job->executor_ = this;
       stats_.numQueued_++;
 
-      stats_.maxFdQueueSize_ = ++fdQueueSize_;
-
-      bool pushReturn = false;
-      do {
-        pushReturn = fdQueue_.push(job);
-        if (pushReturn == false) {
-          LOG_EVERY_N(WARNING, 10) << "push into fdQueue failing";
-        }
-      } while (pushReturn == false);
-      fdQueueCond_.wakeup();
+      if ((job->rmwStep_ == RmwStep::PWrite) && !AdmitWrite(job)) {
+        break;
+      }
+      PushToFdQueue(job);
       break;
     }
 
-    else if ((job->op_ == FileOp::Write) || (job->op_ == FileOp::Read)) {
+    else if ((job->op_ == FileOp::Write) || (job->op_ == FileOp::Read) ||
+             (job->op_ == FileOp::Sync) ||
+             (job->op_ == FileOp::NonAlignedWrite)) {
+
+      // syncs belong to no tenant
+      if (qos_ && (job->op_ != FileOp::Sync) &&
+          qos_->isLimited(job->tenant_)) {
+        ret = ThrottleIfOverLimit(job, blocking, isReserved);
+        if (ret < 0) {
+          job->retcode_ = ret;
+          break;
+        } else if (ret > 0) {
+          // completion thread queues it when tenant has tokens
+          ret = 0;
+          break;
+        }
+      }
+
+      // each class has its own limit, so that a flood of
+      // background requests cannot block foreground requests
+      PriorityQueue &queue = *requestQueue_.at(job->priority_);
 
-      if (requestQueueSize_ > (int32_t)config_.maxRequestQueueSize_) {
+      if (!isReserved && (queue.size_ + queue.reserved_ >
+                          (int32_t)config_.maxRequestQueueSize_)) {
         if (!blocking) {
           LOG(ERROR) << "Async Queue full.  rejecting nonblocking job="
                      << (void *)job;
           ret = job->retcode_ = -EAGAIN;
+          RefuseForQueueFull();
           break;
         } else {
           stats_.requestQueueFull_++;
-          requestQueueHasSpace_.pause();
+          numWaitingForSpace_++;
+          requestQueueHasSpace_.pauseIf([this, &queue]() {
+            return (queue.size_ + queue.reserved_ <=
+                    (int32_t)config_.maxRequestQueueSize_) ||
+                   (state_ != RUNNING);
+          });
+          numWaitingForSpace_--;
+          if (state_ != RUNNING) {
+            // woken up by stop
+            LOG(ERROR) << "shutting down. rejecting job=" << (void *)job;
+            ret = -EAGAIN;
+            break;
+          }
         }
       }
 
-      // set FilerJob variables and increment queue size,
-      // before pushing into queue
+      // set FilerJob variables before pushing into queue
       // otherwise asserts fail because completion thread
       // also changes FilerJob
-      stats_.maxRequestQueueSize_ = ++requestQueueSize_;
       job->setSubmitTime();
+      StartTrace(job);
       job->executor_ = this;
       stats_.numQueued_++;
+      // register before push, since job can complete right after push
+      RegisterJob(job);
 
-      bool pushReturn = false;
-      do {
-        pushReturn = requestQueue_.push(job);
-        if (pushReturn == false) {
-          LOG_EVERY_N(WARNING, 10) << "push into requestQueue failing";
-        }
-      } while (pushReturn == false);
+      const bool isRead = (job->op_ == FileOp::Read);
+      PushToRequestQueue(job);
+      ScheduleSubmission(isRead, moreToFollow);
+    } else {
+      LOG(ERROR) << "bad op=" << job->op_;
+      ret = -EAGAIN;
+    }
+  } while (0);
 
-      // if context is free & num jobs > min, wakeup
+  if ((ret != 0) && isReserved && (state_ == RUNNING)) {
+    // earlier jobs of the caller's batch were queued with moreToFollow
+    // and wait for this one; submit them without it
+    ScheduleSubmission(/*isRead*/ false, /*moreToFollow*/ false);
+  }
 
-      if (config_.noSubmitterThread_) {
-        if (requestQueueSize_ >= (int32_t)minSubmitSize_) {
-          std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
-          if (requestQueueSize_ >= (int32_t)minSubmitSize_)
-            ProcessRequestQueue();
+  if (isReserved) {
+    unreserveSpace(priority, 1);
+  }
+
+  return ret;
+}
+
+/**
+ * convert a Write whose size is not aligned to NonAlignedWrite
+ * and pick its first step, see ProcessNonAlignedWrite
+ * @return 0 or negative errno
+ */
+int32_t IOExecutor::PrepareNonAlignedWrite(FilerJob *job) {
+  job->op_ = FileOp::NonAlignedWrite;
+  const int flags = fcntl(job->fd_, F_GETFL);
+  const bool canReadTail =
+      (flags == -1) || ((flags & O_ACCMODE) != O_WRONLY);
+  struct stat statBuf;
+  // tail of an object being written has no old data to keep
+  const bool tailPastEof =
+      !canReadTail && (::fstat(job->fd_, &statBuf) == 0) &&
+      (statBuf.st_size <= job->offset_ + (off_t)job->userSize_);
+  if (!canReadTail && !tailPastEof) {
+    // cannot read the last block; use pwrite on fdQueue
+    // which only works if fd was opened without O_DIRECT
+    job->rmwStep_ = RmwStep::PWrite;
+  } else if (!job->allocTailBuf()) {
+    LOG(ERROR) << "failed to allocate tail buffer for job=" << (void *)job;
+    return job->retcode_ = -ENOMEM;
+  } else if (tailPastEof) {
+    // zero pad the last block instead of reading it
+    job->patchTail(0);
+    job->rmwStep_ = RmwStep::WriteZeroTail;
+  }
+  return 0;
+}
+
+// get a job which was pushed to request queue submitted
+void IOExecutor::ScheduleSubmission(bool isRead, bool moreToFollow) {
+  // if context is free & num jobs > min, wakeup
+
+  if (config_.runToCompletion_) {
+    // run loop submits it, along with requests of other callers
+    WakeupRunLoop();
+  } else if (moreToFollow) {
+    // caller submits the rest of its batch right after this
+    // timer only matters if that fails
+    if (config_.noSubmitterThread_) {
+      ArmBatchTimer();
+    }
+  } else if (config_.noSubmitterThread_) {
+    if (config_.workStealing_ && isRead && isOverloaded()) {
+      OfferToSiblings();
+    }
+    batchCtrl_.update();
+    if (isBatchReady()) {
+      TrySubmitQueued();
+    } else {
+      ArmBatchTimer();
+    }
+  } else {
+    WakeupSubmitter();
+  }
+}
+
+/**
+ * run by fdQueue worker once the file of a Put is open
+ * The write goes through the request queue like any other, but
+ * was already counted and admitted when the Put was queued
+ * It is not registered, since a cancelled write would leave
+ * the file open; doPostProcessingOfJob sends it back to close the file
+ */
+void IOExecutor::SubmitPutWrite(FilerJob *job) {
+  job->op_ = FileOp::Write;
+  job->putStep_ = PutStep::Write;
+  // time spent opening the file is not part of the write
+  job->resetTimes();
+  job->setSubmitTime();
+
+  if (!IsDirectIOAligned(job->userSize_) &&
+      (PrepareNonAlignedWrite(job) != 0)) {
+    // write is never submitted, so count the Put here
+    stats_.numSubmitted_++;
+    doPostProcessingOfJob(job);
+    return;
+  }
+  if (job->rmwStep_ == RmwStep::PWrite) {
+    if (AdmitWrite(job)) {
+      PushToFdQueue(job);
+    }
+    return;
+  }
+  PushToRequestQueue(job);
+  ScheduleSubmission(/*isRead*/ false, /*moreToFollow*/ false);
+}
+
+int32_t IOExecutor::reserveSpace(gIOPriority priority, uint32_t tenant,
+                                 int32_t count) {
+  PriorityQueue &queue = *requestQueue_.at(priority);
+
+  if (qos_ && qos_->isLimited(tenant)) {
+    std::unique_lock<std::mutex> lck(throttleMutex_);
+    auto iter = throttledJobs_.find(tenant);
+    if ((iter != throttledJobs_.end()) &&
+        (iter->second.size() + count > config_.maxRequestQueueSize_)) {
+      stats_.numRefused_++;
+      tenantsWantingSpace_.insert(tenant);
+      return -EAGAIN;
+    }
+  }
+
+  int32_t reserved = queue.reserved_;
+  do {
+    const int32_t used = queue.size_ + reserved;
+    // an empty queue takes a batch of any size
+    if (used && (used + count > (int32_t)config_.maxRequestQueueSize_)) {
+      RefuseForQueueFull();
+      return -EAGAIN;
+    }
+  } while (
+      !queue.reserved_.compare_exchange_weak(reserved, reserved + count));
+
+  return 0;
+}
+
+void IOExecutor::unreserveSpace(gIOPriority priority, int32_t count) {
+  requestQueue_.at(priority)->reserved_ -= count;
+}
+
+void IOExecutor::RefuseForQueueFull() {
+  stats_.numRefused_++;
+  queueSpaceWanted_ = true;
+  // queue may have drained before the flag was set
+  SignalIfQueueDrained();
+}
+
+void IOExecutor::SignalIfQueueDrained() {
+  if (queueSpaceWanted_ && (requestQueueSize_ <= spaceLowWatermark()) &&
+      queueSpaceWanted_.exchange(false)) {
+    SignalSpaceAvailable();
+  }
+}
+
+void IOExecutor::SignalSpaceAvailable() {
+  stats_.numSpaceSignalled_++;
+  if (spaceAvailableFd_ == FD_INVALID) {
+    return;
+  }
+  const uint64_t count = 1;
+  ssize_t ret = write(spaceAvailableFd_, &count, sizeof(count));
+  if (ret != sizeof(count)) {
+    LOG(ERROR) << "failed to signal space fd=" << spaceAvailableFd_
+               << " errno=" << errno;
+  }
+}
+
+// caller must have registered the job
+void IOExecutor::PushToRequestQueue(FilerJob *job) {
+  const bool isWrite =
+      (job->op_ == FileOp::Write) || (job->op_ == FileOp::NonAlignedWrite);
+  if (isWrite && !AdmitWrite(job)) {
+    return;
+  }
+  PushToPriorityQueue(job);
+}
+
+void IOExecutor::PushToPriorityQueue(FilerJob *job) {
+  PriorityQueue &queue = *requestQueue_.at(job->priority_);
+
+  // increment queue size before push, so it never goes negative
+  stats_.maxRequestQueueSize_ = ++requestQueueSize_;
+  batchCtrl_.recordArrival();
+
+  queue.size_++;
+  // reads are split off only when they may be stolen
+  const bool isRead = config_.workStealing_ && (job->op_ == FileOp::Read);
+  if (isRead) {
+    queue.readSize_++;
+    readQueueSize_++;
+  }
+
+  bool pushReturn = false;
+  do {
+    pushReturn =
+        isRead ? queue.readQueue_.push(job) : queue.jobQueue_.push(job);
+    if (pushReturn == false) {
+      LOG_EVERY_N(WARNING, 10) << "push into requestQueue failing";
+    }
+  } while (pushReturn == false);
+}
+
+void IOExecutor::WakeupSubmitter() {
+  if (submitterWaitingForNewRequests_) {
+    std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
+    if (submitterWaitingForNewRequests_) {
+      submitterCond_.cond_.notify_one();
+    }
+  }
+}
+
+/**
+ * hold back job if its tenant is over the QoS limit, or has jobs
+ * held back already, since those must go first
+ * @return 0 if job can be queued now, 1 if it was held back,
+ *   else negative errno
+ */
+int32_t IOExecutor::ThrottleIfOverLimit(FilerJob *job, bool blocking,
+                                        bool isReserved) {
+  std::unique_lock<std::mutex> lck(throttleMutex_);
+
+  int64_t waitUsec = 0;
+  while (true) {
+    auto iter = throttledJobs_.find(job->tenant_);
+    if (iter == throttledJobs_.end()) {
+      waitUsec = qos_->admit(job->tenant_, job->userSize_);
+      if (waitUsec == 0) {
+        return 0;
+      }
+      break;
+    }
+    if (isReserved ||
+        (iter->second.size() < config_.maxRequestQueueSize_)) {
+      // timer is already armed for the jobs ahead
+      break;
+    }
+    if (!blocking) {
+      LOG(ERROR) << "tenant=" << job->tenant_
+                 << " backlog full.  rejecting nonblocking job="
+                 << (void *)job;
+      stats_.numRefused_++;
+      tenantsWantingSpace_.insert(job->tenant_);
+      return -EAGAIN;
+    }
+    stats_.requestQueueFull_++;
+    throttleHasSpace_.wait(lck);
+    if (state_ != RUNNING) {
+      // woken up by stop
+      return -EAGAIN;
+    }
+  }
+
+  job->setSubmitTime();
+  StartTrace(job);
+  job->executor_ = this;
+  stats_.numQueued_++;
+  stats_.numThrottled_++;
+  // registered right away, so that it can be cancelled or expire
+  RegisterJob(job);
+
+  const auto now = std::chrono::steady_clock::now();
+  throttledJobs_[job->tenant_].push_back(ThrottledJob{job, now});
+
+  const auto releaseTime = now + std::chrono::microseconds(waitUsec);
+  if (waitUsec && (releaseTime < armedThrottle_)) {
+    armedThrottle_ = releaseTime;
+    throttleTimer_.arm(waitUsec);
+  }
+  return 1;
+}
+
+/**
+ * run by completion thread when throttleTimer_ fires
+ * move jobs of tenants which have tokens again to the request queue,
+ * as long as their priority class has room, and rearm timer for the
+ * rest.  At shutdown, all jobs are moved
+ */
+void IOExecutor::ReleaseThrottledJobs() {
+  std::vector<FilerJob *> releasedJobs;
+  bool signalSpace = false;
+  // jobs released into each class, which are not yet in queue.size_
+  int32_t numReleased[GIO_PRIO_COUNT] = {0};
+
+  {
+    std::unique_lock<std::mutex> lck(throttleMutex_);
+    const auto now = std::chrono::steady_clock::now();
+    int64_t nextWaitUsec = std::numeric_limits<int64_t>::max();
+
+    for (auto iter = throttledJobs_.begin(); iter != throttledJobs_.end();) {
+      auto &backlog = iter->second;
+      while (!backlog.empty()) {
+        const ThrottledJob &elem = backlog.front();
+        const gIOPriority priority = elem.job_->priority_;
+        PriorityQueue &queue = *requestQueue_.at(priority);
+        // same limit as submitTask; retry once the queue has drained
+        if ((state_ == RUNNING) &&
+            (queue.size_ + queue.reserved_ + numReleased[priority] >
+             (int32_t)config_.maxRequestQueueSize_)) {
+          nextWaitUsec =
+              std::min<int64_t>(nextWaitUsec, config_.targetLatencyUsec_);
+          break;
         }
-      } else {
-        if (submitterWaitingForNewRequests_) {
-          std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
-          if (submitterWaitingForNewRequests_) {
-            submitterCond_.cond_.notify_one();
+        // cancelled or expired jobs are not charged; they are freed
+        // by the thread which takes them out of the request queue
+        if ((state_ == RUNNING) && (elem.job_->state_ == JobState::Queued)) {
+          const int64_t waitUsec =
+              qos_->admit(iter->first, elem.job_->userSize_, now);
+          if (waitUsec) {
+            nextWaitUsec = std::min(nextWaitUsec, waitUsec);
+            break;
           }
+          qos_->recordDelay(
+              iter->first,
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  now - elem.since_).count());
         }
+        releasedJobs.push_back(elem.job_);
+        numReleased[priority]++;
+        backlog.pop_front();
       }
-    } else {
-      LOG(ERROR) << "bad op=" << job->op_;
-      ret = -EAGAIN;
+      if ((backlog.size() <= (size_t)spaceLowWatermark()) &&
+          tenantsWantingSpace_.erase(iter->first)) {
+        signalSpace = true;
+      }
+      iter = backlog.empty() ? throttledJobs_.erase(iter) : ++iter;
     }
-  } while (0);
 
-  return ret;
+    armedThrottle_ = std::chrono::steady_clock::time_point::max();
+    if (nextWaitUsec != std::numeric_limits<int64_t>::max()) {
+      armedThrottle_ = now + std::chrono::microseconds(nextWaitUsec);
+      throttleTimer_.arm(nextWaitUsec);
+    }
+    if (releasedJobs.size()) {
+      throttleHasSpace_.notify_all();
+    }
+  }
+
+  if (signalSpace) {
+    SignalSpaceAvailable();
+  }
+  if (releasedJobs.empty()) {
+    return;
+  }
+  for (auto job : releasedJobs) {
+    PushToRequestQueue(job);
+  }
+  ScheduleReleasedJobs();
+}
+
+// get jobs which other threads released into request queue submitted
+void IOExecutor::ScheduleReleasedJobs() {
+  if (config_.noSubmitterThread_) {
+    // completion thread must not wait for submitterCond_ mutex
+    ArmBatchTimer();
+  } else {
+    WakeupSubmitter();
+  }
+}
+
+void IOExecutor::FdJobList::push(FilerJob *job) {
+  job->fdWriteNext_ = nullptr;
+  if (tail_) {
+    tail_->fdWriteNext_ = job;
+  } else {
+    head_ = job;
+  }
+  tail_ = job;
+  size_++;
+}
+
+FilerJob *IOExecutor::FdJobList::pop() {
+  FilerJob *job = head_;
+  head_ = job->fdWriteNext_;
+  if (!head_) {
+    tail_ = nullptr;
+  }
+  job->fdWriteNext_ = nullptr;
+  size_--;
+  return job;
+}
+
+FilerJob *IOExecutor::FdJobList::takeAll() {
+  FilerJob *jobs = head_;
+  head_ = tail_ = nullptr;
+  size_ = 0;
+  return jobs;
+}
+
+// a write whose padded last block may extend the file
+static bool MayPadTail(const FilerJob *job) {
+  return (job->op_ == FileOp::NonAlignedWrite) &&
+         (job->rmwStep_ != RmwStep::PWrite);
+}
+
+// caller must hold fdWritesMutex_
+void IOExecutor::CountWrite(FdWrites &fdWrites, FilerJob *job) {
+  fdWrites.numWrites_++;
+  job->fdWriteCounted_ = true;
+  if (MayPadTail(job)) {
+    numPaddedWrites_++;
+  }
+}
+
+/**
+ * caller must hold fdWritesMutex_
+ * @return truncate which can run now that only truncates are in flight
+ */
+FilerJob *IOExecutor::StartNextTruncate(FdWrites &fdWrites) {
+  if (fdWrites.truncating_ || fdWrites.truncates_.empty() ||
+      (fdWrites.numWrites_ != fdWrites.truncates_.size_)) {
+    return nullptr;
+  }
+  fdWrites.truncating_ = fdWrites.truncates_.pop();
+  return fdWrites.truncating_;
+}
+
+/**
+ * count a write in the writes in flight on its fd, unless a truncate
+ * of the fd is waiting or running, in which case it is held until
+ * the truncate is done.  Jobs cancelled or expired while queued are
+ * not counted, since their completion may have been sent already.
+ * No truncate can be waiting while numPaddedWrites_ is zero, so
+ * aligned writes take no lock then.  The count is raised before
+ * numPaddedWrites_ is read, so that a truncate deciding to start
+ * either sees the write or the write sees the truncate
+ */
+bool IOExecutor::AdmitWrite(FilerJob *job) {
+  if (job->state_ != JobState::Queued) {
+    return true;
+  }
+  FdWrites &fdWrites = FdWritesOf(job->fd_);
+  const bool mayPad = MayPadTail(job);
+  if (!mayPad) {
+    fdWrites.numWrites_++;
+    if (numPaddedWrites_ == 0) {
+      job->fdWriteCounted_ = true;
+      return true;
+    }
+  }
+
+  FilerJob *nextTruncate = nullptr;
+  {
+    std::unique_lock<std::mutex> lck(fdWritesMutex_);
+    if (!fdWrites.truncating_ && fdWrites.truncates_.empty()) {
+      if (mayPad) {
+        CountWrite(fdWrites, job);
+      } else {
+        job->fdWriteCounted_ = true;
+      }
+      return true;
+    }
+    fdWrites.heldWrites_.push(job);
+    if (!mayPad) {
+      fdWrites.numWrites_--;
+      // truncate may have waited for the count just taken back
+      nextTruncate = StartNextTruncate(fdWrites);
+    }
+  }
+  if (nextTruncate) {
+    PushToFdQueue(nextTruncate);
+  }
+  return false;
+}
+
+/**
+ * called once a write has completed, or was cancelled while queued
+ * Starts the next truncate of the fd once only truncates are left,
+ * and releases the held writes once no truncate is left
+ */
+void IOExecutor::FinishWrite(FilerJob *job) {
+  if (!job->fdWriteCounted_) {
+    return;
+  }
+  job->fdWriteCounted_ = false;
+  FdWrites &fdWrites = FdWritesOf(job->fd_);
+  const bool mayPad = MayPadTail(job);
+  if (!mayPad) {
+    fdWrites.numWrites_--;
+    if (numPaddedWrites_ == 0) {
+      return;
+    }
+  }
+
+  FilerJob *nextTruncate = nullptr;
+  FilerJob *releasedJobs = nullptr;
+  {
+    std::unique_lock<std::mutex> lck(fdWritesMutex_);
+    if (mayPad) {
+      fdWrites.numWrites_--;
+      numPaddedWrites_--;
+      if (fdWrites.truncating_ == job) {
+        fdWrites.truncating_ = nullptr;
+      }
+    }
+    nextTruncate = StartNextTruncate(fdWrites);
+    if (!fdWrites.truncating_ && fdWrites.truncates_.empty()) {
+      releasedJobs = fdWrites.heldWrites_.takeAll();
+      for (FilerJob *heldJob = releasedJobs; heldJob;
+           heldJob = heldJob->fdWriteNext_) {
+        if (heldJob->state_ == JobState::Queued) {
+          CountWrite(fdWrites, heldJob);
+        }
+      }
+    }
+  }
+  if (nextTruncate) {
+    PushToFdQueue(nextTruncate);
+  }
+  PushReleasedWrites(releasedJobs);
+}
+
+/**
+ * run by completion thread once the padded write of a non-aligned
+ * write which grew the file is done.  The truncate waits until the
+ * other writes in flight on its fd are done
+ */
+void IOExecutor::QueueTruncate(FilerJob *job) {
+  FilerJob *nextTruncate = nullptr;
+  {
+    std::unique_lock<std::mutex> lck(fdWritesMutex_);
+    FdWrites &fdWrites = FdWritesOf(job->fd_);
+    assert(job->fdWriteCounted_);
+    fdWrites.truncates_.push(job);
+    // truncates of earlier writes may be waiting for this one
+    nextTruncate = StartNextTruncate(fdWrites);
+  }
+  if (nextTruncate) {
+    PushToFdQueue(nextTruncate);
+  }
+}
+
+// @param jobs linked through fdWriteNext_
+void IOExecutor::PushReleasedWrites(FilerJob *jobs) {
+  bool toRequestQueue = false;
+  while (jobs) {
+    FilerJob *job = jobs;
+    jobs = job->fdWriteNext_;
+    job->fdWriteNext_ = nullptr;
+    if (job->rmwStep_ == RmwStep::PWrite) {
+      PushToFdQueue(job);
+    } else {
+      // cancelled jobs too, which the submitter frees when it finds them
+      PushToPriorityQueue(job);
+      toRequestQueue = true;
+    }
+  }
+  if (toRequestQueue) {
+    ScheduleReleasedJobs();
+  }
 }
 
 /**
@@ -742,25 +2018,60 @@ void IOExecutor::ProcessCompletions() {
   epoll_event readyEpollEvents[EPOLL_MAXEVENT];
 
   while (1) {
-    if ((state_ == FINAL_SHUTDOWN) &&
-        (stats_.numQueued_ == stats_.numCompleted_)) {
-      // all outstanding IO done. now its safe to exit
-      break;
+    if (state_ == FINAL_SHUTDOWN) {
+      if (!config_.runToCompletion_) {
+        RunRemainingFdJobs();
+      }
+      if (stats_.numQueued_ == stats_.numCompleted_) {
+        // all outstanding IO done. now its safe to exit
+        break;
+      }
     }
 
     bzero(readyEpollEvents, sizeof(epoll_event) * EPOLL_MAXEVENT);
 
+    int epollTimeoutMsec = -1;
+    if (config_.runToCompletion_) {
+      wakeNsec_ = 0;
+      if (RunQueuedWork() || hasQueuedWork()) {
+        // check timers and ctx events without sleeping
+        epollTimeoutMsec = 0;
+      }
+    } else if (config_.completionMode_ == CompletionMode::Poll) {
+      wakeNsec_ = 0;
+      // nothing can complete while no io is in flight, so do not
+      // burn the spin on a timer or shutdown wakeup
+      if (hasIoInFlight()) {
+        PollCompletions();
+      }
+      if ((state_ == FINAL_SHUTDOWN) && (fdQueueSize_ > 0)) {
+        // reaped io queued ops which are run at the top of the loop
+        epollTimeoutMsec = 0;
+      }
+    }
+
     int numEpollEvents = 0;
 
+    Timer sleepTimer(true);
     do {
-      numEpollEvents =
-          epoll_wait(epollFD_, readyEpollEvents, EPOLL_MAXEVENT, -1);
+      numEpollEvents = epoll_wait(epollFD_, readyEpollEvents, EPOLL_MAXEVENT,
+                                  epollTimeoutMsec);
     } while (numEpollEvents < 0 && ((errno == EINTR) || (errno == EAGAIN)));
+    if (epollTimeoutMsec != 0) {
+      stats_.sleepTime_ += sleepTimer.elapsedMicroseconds();
+      stats_.numSleeps_++;
+    }
+    runLoopSleeping_ = false;
+    wakeNsec_ = tracer_.isEnabled() ? JobTrace::nowNsec() : 0;
 
     if (numEpollEvents < 0) {
       LOG(ERROR) << "completions thread got epoll_wait error=" << errno;
       continue;
     }
+    if (numEpollEvents == 0) {
+      // run loop found nothing new
+      continue;
+    }
 
     assert(numEpollEvents > 0); // should not happen
     stats_.numCompletionEvents_ += numEpollEvents;
@@ -784,8 +2095,7 @@ void IOExecutor::ProcessCompletions() {
         // signal was sent to wakeup thread
         if (state_ == State::FINAL_SHUTDOWN) {
           // process jobs stuck in request queue
-          std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
-          ProcessRequestQueue();
+          SubmitRemaining();
         }
 
       } else if (thisEvent.data.ptr == &periodicTimer_) {
@@ -797,73 +2107,78 @@ void IOExecutor::ProcessCompletions() {
           periodicTimer_.recv();
           if (state_ == State::FINAL_SHUTDOWN) {
             // process jobs stuck in request queue
-            std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
-            ProcessRequestQueue();
+            SubmitRemaining();
           }
         } else {
           LOG(FATAL) << "how did we receive this event?";
         }
 
-      } else if (thisEvent.data.ptr == &ctx_) {
+      } else if (thisEvent.data.ptr == &batchTimer_) {
+
+        batchTimer_.recv();
+        batchTimerArmed_ = false;
+        if (requestQueueSize_ > 0) {
+          if (ctxCredits_ > 0) {
+            // submit the partial batch, unless a caller already is
+            TrySubmitQueued();
+          } else {
+            // completion of inflight io will make room
+            ArmBatchTimer();
+          }
+        }
+
+      } else if (thisEvent.data.ptr == &runLoopWakeup_) {
 
-        // find out how many io events are actually available in the eventfd
-        FilerCtx *ctxPtr = reinterpret_cast<FilerCtx *>(thisEvent.data.ptr);
-        assert(ctxPtr);
-        int64_t numEvents = 0;
+        // work is picked up at the top of the loop
+        uint64_t counter;
+        runLoopWakeup_.recv(counter);
 
-        ssize_t ret = read(ctxPtr->eventFD_, &numEvents, sizeof(numEvents));
+      } else if (thisEvent.data.ptr == &deadlineTimer_) {
 
-        assert(ret == sizeof(numEvents));
-        assert(numEvents > 0 && numEvents <= ctxPtr->ioQueueDepth_);
-        {
-          // process all available io events from the firing io context
-          io_event readyIOEvents[numEvents];
-          bzero(readyIOEvents, sizeof(io_event) * numEvents);
+        deadlineTimer_.recv();
+        ExpireJobs();
 
-          VLOG(1) << "filerctx=" << ctxPtr << " has events=" << numEvents;
+      } else if (thisEvent.data.ptr == &handoverReady_) {
 
-          assert(ctxPtr == &ctx_);
+        uint64_t counter;
+        handoverReady_.recv(counter);
+        CompleteHandedOverJobs();
 
-          int32_t numProcessedEvents = 0;
-          while (numProcessedEvents < numEvents) {
+      } else if (thisEvent.data.ptr == &throttleTimer_) {
 
-            int numEventsGot = 0;
-            do {
-              numEventsGot = io_getevents(
-                  ctxPtr->ioCtx_, 1, (numEvents - numProcessedEvents),
-                  &readyIOEvents[numProcessedEvents], nullptr);
-            } while ((numEventsGot == -EINTR) || (numEventsGot == -EAGAIN));
+        throttleTimer_.recv();
+        ReleaseThrottledJobs();
 
-            if (numEventsGot >= 0) {
-              numProcessedEvents += numEventsGot;
-            } else {
-              LOG(ERROR) << "getevents error=" << errno;
-            }
-          }
+      } else if (isCtx(thisEvent.data.ptr)) {
 
-          // process the bottom half on all completed jobs in the io context
-          ret = ProcessCallbacks(readyIOEvents, numEvents);
-          if (ret != 0) {
-            // TODO: handle errors
-            assert(false);
-          }
+        FilerCtx *ctxPtr = reinterpret_cast<FilerCtx *>(thisEvent.data.ptr);
+        assert(ctxPtr);
+
+        // reset the eventfd counter.  The count is not used to decide how
+        // many events to reap, because io_uring may signal once for
+        // multiple completions
+        int64_t numSignalled = 0;
+        ssize_t ret = read(ctxPtr->eventFD_, &numSignalled,
+                           sizeof(numSignalled));
+        if (ret != sizeof(numSignalled)) {
+          // spurious wakeup; events already reaped
+          continue;
         }
 
+        // process all available io events from the firing io context
+        ReapCompletions(ctxPtr);
+
       } else {
         LOG(ERROR) << "got unknown event with ptr="
                    << static_cast<void *>(thisEvent.data.ptr);
       }
     }
 
-    if (submitterWaitingForFreeCtx_) {
-      std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
-      if (submitterWaitingForFreeCtx_ && (!ctx_.isEmpty())) {
-        submitterCond_.cond_.notify_one();
-      }
-    }
+    NotifySubmitterIfCtxFree();
   }
 
   completionThreadShutdown_.destroy();
+  handoverReady_.destroy();
 
   stats_.completionThread_.getThreadStats();
 
@@ -877,7 +2192,228 @@ void IOExecutor::ProcessCompletions() {
   // google::FlushLogFiles(0); TODO logging
 }
 
-int32_t IOExecutor::ProcessCallbacks(io_event *events, int32_t numEvents) {
+/**
+ * completion thread : fdQueue workers are joined before FINAL_SHUTDOWN,
+ * but io still in flight queues more metadata ops, such as the truncate
+ * of a padded write or the close of a Put.  Run those here, as the run
+ * loop of runToCompletion mode does.  Writes of Puts opened here, or by
+ * a worker after the submitter thread was joined, are submitted too
+ */
+void IOExecutor::RunRemainingFdJobs() {
+  do {
+    for (auto &worker : fdQueueWorkers_) {
+      while (RunFdQueueJob(worker.get())) {
+      }
+    }
+    if (requestQueueSize_ > 0) {
+      // failed submits may queue more closes
+      SubmitRemaining();
+    }
+  } while (fdQueueSize_ > 0);
+}
+
+/**
+ * runToCompletion mode : one pass of the loop in which the completion
+ * thread does the work of the whole executor on its core - reap
+ * completions, submit queued requests and run metadata ops
+ * @return amount of work done
+ */
+int32_t IOExecutor::RunQueuedWork() {
+  int32_t numDone = 0;
+
+  // reap first, so that freed io slots are used in this pass
+  for (auto &ctx : ctxVec_) {
+    if (ctx->numAvailable_ < ctx->ioQueueDepth_) {
+      const int32_t ret = ReapCompletions(ctx.get());
+      if (ret > 0) {
+        numDone += ret;
+      }
+    }
+  }
+
+  batchCtrl_.update();
+  if ((ctxCredits_ > 0) && isBatchReady()) {
+    // callers only queue, so this is the one thread which submits
+    numDone += ProcessRequestQueue();
+  }
+
+  int32_t numFdJobs = 0;
+  for (auto &worker : fdQueueWorkers_) {
+    // a burst of deletes must not hold up io for long
+    while ((numFdJobs < RUN_LOOP_MAX_FD_JOBS) &&
+           RunFdQueueJob(worker.get())) {
+      numFdJobs++;
+    }
+  }
+  numDone += numFdJobs;
+
+  if ((numDone == 0) && config_.workStealing_) {
+    numDone += StealFromSiblings();
+  }
+
+  return numDone;
+}
+
+/**
+ * runToCompletion mode : called before the loop sleeps in epoll
+ * sleeping flag is set before the queues are checked, so that a
+ * caller which queues a request after the check will wake the loop
+ */
+bool IOExecutor::hasQueuedWork() {
+  runLoopSleeping_ = true;
+
+  bool hasWork = (fdQueueSize_ > 0);
+  if (!hasWork && (requestQueueSize_ > 0) && (ctxCredits_ > 0)) {
+    hasWork = isBatchReady();
+    if (!hasWork) {
+      // partial batch is submitted when its window ends
+      ArmBatchTimer();
+    }
+  }
+  // if all io slots are taken, completion of io wakes up the loop
+
+  if (hasWork) {
+    runLoopSleeping_ = false;
+  }
+  return hasWork;
+}
+
+void IOExecutor::WakeupRunLoop() {
+  if (runLoopSleeping_ && runLoopSleeping_.exchange(false)) {
+    runLoopWakeup_.send();
+  }
+}
+
+/**
+ * reap all completed io from the ctx and run their callbacks
+ * @return number of completions reaped, else negative errno
+ */
+int32_t IOExecutor::ReapCompletions(FilerCtx *ctxPtr) {
+  const int32_t maxEvents = ctxPtr->ioQueueDepth_;
+  io_event readyIOEvents[maxEvents];
+
+  int32_t numReaped = 0;
+  int32_t numEventsGot = 0;
+  do {
+    numEventsGot = ctxPtr->getEvents(readyIOEvents, maxEvents);
+    if (numEventsGot < 0) {
+      LOG(ERROR) << "getevents error=" << numEventsGot;
+      return numEventsGot;
+    }
+    if (tracer_.isEnabled()) {
+      reapNsec_ = JobTrace::nowNsec();
+    }
+
+    VLOG(1) << "filerctx=" << ctxPtr << " has events=" << numEventsGot;
+
+    // process the bottom half on all completed jobs in the io context
+    int ret = ProcessCallbacks(ctxPtr, readyIOEvents, numEventsGot);
+    if (ret != 0) {
+      // TODO: handle errors
+      assert(false);
+    }
+    numReaped += numEventsGot;
+    // a full array means more events may be pending
+  } while (numEventsGot == maxEvents);
+
+  return numReaped;
+}
+
+/**
+ * Poll mode: spin on the completion ring until no io has completed
+ * for pollSpinUsec, so that back-to-back io do not pay for an
+ * eventfd wakeup.  Returns before the caller sleeps in epoll_wait.
+ * @return number of completions reaped
+ */
+bool IOExecutor::hasIoInFlight() const {
+  for (auto &ctx : ctxVec_) {
+    if (ctx->numAvailable_ < ctx->ioQueueDepth_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int32_t IOExecutor::PollCompletions() {
+  int32_t numReaped = 0;
+  int32_t numReapedAfterReset = 0;
+
+  // under steady io the ring is never idle for pollSpinUsec_, so
+  // return to epoll_wait regularly, where timers and shutdown are seen
+  const int64_t maxSpinUsec =
+      std::max(config_.pollSpinUsec_, config_.pollMaxSpinUsec_);
+  Timer spinTimer(true);
+
+  do {
+    Timer idleTimer(true);
+    while ((idleTimer.elapsedMicroseconds() < config_.pollSpinUsec_) &&
+           (spinTimer.elapsedMicroseconds() < maxSpinUsec) &&
+           (state_ != FINAL_SHUTDOWN)) {
+      for (auto &ctx : ctxVec_) {
+        int32_t ret = ReapCompletions(ctx.get());
+        if (ret > 0) {
+          numReaped += ret;
+          NotifySubmitterIfCtxFree();
+          idleTimer.reset();
+        }
+      }
+    }
+
+    // reset the eventfd before going to sleep, then check the ring
+    // once more so that an io which completed in between is not missed
+    numReapedAfterReset = 0;
+    for (auto &ctx : ctxVec_) {
+      int64_t numSignalled = 0;
+      ssize_t readRet =
+          read(ctx->eventFD_, &numSignalled, sizeof(numSignalled));
+      (void)readRet; // EAGAIN if nothing signalled
+
+      int32_t ret = ReapCompletions(ctx.get());
+      if (ret > 0) {
+        numReapedAfterReset += ret;
+      }
+    }
+    if (numReapedAfterReset) {
+      numReaped += numReapedAfterReset;
+      NotifySubmitterIfCtxFree();
+    }
+  } while (numReapedAfterReset && (state_ != FINAL_SHUTDOWN) &&
+           (spinTimer.elapsedMicroseconds() < maxSpinUsec));
+
+  stats_.spinTime_ += spinTimer.elapsedMicroseconds();
+  stats_.numSpinReaped_ += numReaped;
+
+  return numReaped;
+}
+
+void IOExecutor::NotifySubmitterIfCtxFree() {
+  if (config_.runToCompletion_) {
+    // run loop submits at the top of its next pass
+    return;
+  } else if (config_.noSubmitterThread_) {
+    // callers do not wait for io slots, so submit what they left
+    if ((requestQueueSize_ > 0) && (ctxCredits_ > 0) && isBatchReady()) {
+      TrySubmitQueued();
+    }
+  } else if (submitterWaitingForFreeCtx_) {
+    std::unique_lock<std::mutex> lck(submitterCond_.mutex_);
+    if (submitterWaitingForFreeCtx_ && (ctxCredits_ > 0)) {
+      submitterCond_.cond_.notify_one();
+    }
+  }
+}
+
+bool IOExecutor::isCtx(const void *ptr) const {
+  for (auto &ctx : ctxVec_) {
+    if (ptr == ctx.get()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int32_t IOExecutor::ProcessCallbacks(FilerCtx *ctxPtr, io_event *events,
+                                     int32_t numEvents) {
   int32_t error = 0;
 
   for (int32_t idx = 0; idx < numEvents; ++idx) {
@@ -888,7 +2424,33 @@ int32_t IOExecutor::ProcessCallbacks(io_event *events, int32_t numEvents) {
     // io_event.data = the iocb.data that was set during io_submit()
     FilerJob *job = reinterpret_cast<FilerJob *>(events[idx].data);
 
-    if ((ssize_t)events[idx].res < 0) {
+    if (tracer_.isEnabled()) {
+      StampReaped(job);
+    }
+
+    if (job->op_ == FileOp::NonAlignedWrite) {
+      if (!ProcessNonAlignedWrite(ctxPtr, job, events[idx].res)) {
+        ReturnCtxSlots(ctxPtr);
+      }
+      continue;
+    }
+
+    if (job->mergeNext_) {
+      ProcessMergedCallback(job, events[idx].res);
+      ReturnCtxSlots(ctxPtr);
+      continue;
+    }
+
+    const int cancelCode = job->cancelCode_;
+    if (((ssize_t)events[idx].res == -ECANCELED) && cancelCode) {
+      // cancelled by cancelTask or deadline expiry
+      job->retcode_ = cancelCode;
+      if (cancelCode == -ETIMEDOUT) {
+        stats_.numTimedOut_++;
+      } else {
+        stats_.numCancelled_++;
+      }
+    } else if ((ssize_t)events[idx].res < 0) {
       job->retcode_ = events[idx].res;
       LOG(ERROR) << "IOerror for job=" << (void *)job << ":fd=" << job->fd_
                  << ":op=" << job->op_ << ":size=" << job->size_
@@ -907,33 +2469,538 @@ int32_t IOExecutor::ProcessCallbacks(io_event *events, int32_t numEvents) {
     }
 
     doPostProcessingOfJob(job);
-    ctx_.incrementNumAvailable();
-    ctxCond_.wakeup();
+    ReturnCtxSlots(ctxPtr);
   }
 
   return error;
 }
 
+void IOExecutor::StartTrace(FilerJob *job) {
+  if (job->trace_) {
+    return;
+  }
+  JobTrace *trace = tracer_.sample();
+  if (trace) {
+    trace->op_ = (int32_t)job->op_;
+    trace->completionId_ = job->completionId_;
+    trace->offset_ = job->offset_;
+    trace->size_ = job->userSize_;
+    trace->stamp(TraceStage::Submit);
+    job->trace_ = trace;
+  }
+}
+
+// stamp the traced jobs of a reaped io, including merged jobs
+void IOExecutor::StampReaped(FilerJob *job) {
+  // while polling, completions are noticed when they are reaped
+  const int64_t wakeNsec = wakeNsec_ ? wakeNsec_ : reapNsec_;
+  for (; job; job = job->mergeNext_) {
+    if (job->trace_) {
+      job->trace_->stamp(TraceStage::Wakeup, wakeNsec);
+      job->trace_->stamp(TraceStage::Reaped, reapNsec_);
+    }
+  }
+}
+
+/**
+ * split result of a vectored io among the jobs merged into it
+ * each job succeeds if the io covered its buffer, same as a single job
+ * can also be used to fail a job which was not merged
+ */
+void IOExecutor::ProcessMergedCallback(FilerJob *job, ssize_t res) {
+  if ((res < 0) && job->mergeNext_) {
+    LOG(ERROR) << "IOerror for merged job=" << (void *)job
+               << ":fd=" << job->fd_ << ":op=" << job->op_
+               << ":numMerged=" << job->iovec_.size()
+               << ":offset=" << job->offset_ << ":error=" << res;
+  }
+
+  ssize_t jobStart = 0; // offset of job within the vectored io
+  while (job) {
+    FilerJob *next = job->mergeNext_;
+    job->mergeNext_ = nullptr;
+
+    if (res < 0) {
+      job->retcode_ = res;
+    } else {
+      const ssize_t covered = std::min<ssize_t>(
+          std::max<ssize_t>(res - jobStart, 0), job->size_);
+      job->retcode_ = (covered >= (ssize_t)job->userSize_) ? 0 : -EIO;
+    }
+    jobStart += job->size_;
+
+    doPostProcessingOfJob(job);
+    job = next;
+  }
+}
+
+/**
+ * write whose size is not DirectIOSize aligned takes these steps
+ * 1) read the block containing the end of buffer into tailBuf_
+ * 2) copy the end of buffer over it, and write aligned part of buffer
+ *    followed by tailBuf_ as one io
+ * 3) if that extended the file, truncate it on the fdQueue once no
+ *    other write to the fd is in flight, see QueueTruncate
+ * Steps 1 and 2 use the same ctx slot
+ * If fd cannot be read and the last block is past end of file,
+ * step 1 is skipped and the block is zero padded (WriteZeroTail)
+ * Concurrent writes to the same block are not serialized
+ * @return true if job still holds its slot in ctx
+ */
+bool IOExecutor::ProcessNonAlignedWrite(FilerCtx *ctxPtr, FilerJob *job,
+                                        ssize_t res) {
+  if (res < 0) {
+    job->retcode_ = res;
+    LOG(ERROR) << "IOerror for job=" << (void *)job << ":fd=" << job->fd_
+               << ":op=" << job->op_ << ":step=" << (int)job->rmwStep_
+               << ":offset=" << job->offset_ << ":error=" << res;
+    doPostProcessingOfJob(job);
+    return false;
+  }
+
+  if (job->rmwStep_ == RmwStep::ReadTail) {
+    job->patchTail(res);
+    job->rmwStep_ = RmwStep::Write;
+    iocb *cb = &job->cb_;
+    job->prepareCallblock(cb);
+    int32_t ret = 0;
+    // how many times do we try to resubmit io
+    int32_t numTries = 5;
+    do {
+      ret = ctxPtr->submit(&cb, 1);
+    } while ((ret == -EINTR || ret == -EAGAIN || ret == 0) && --numTries);
+    if (ret == 1) {
+      return true;
+    }
+    job->retcode_ = (ret < 0) ? ret : -EAGAIN;
+    LOG(ERROR) << "failed to submit write for job=" << (void *)job
+               << " errno=" << job->retcode_;
+  } else if (res != (ssize_t)(job->alignedSize() + DirectIOSize)) {
+    job->retcode_ = -EIO;
+    LOG(ERROR) << "partial write for job=" << (void *)job
+               << ":fd=" << job->fd_ << ":op=" << job->op_
+               << ":actual size=" << res << ":offset=" << job->offset_;
+  } else if (job->truncateSize_ >= 0) {
+    job->rmwStep_ = RmwStep::Truncate;
+    QueueTruncate(job);
+    return false;
+  } else {
+    job->retcode_ = 0;
+  }
+
+  doPostProcessingOfJob(job);
+  return false;
+}
+
 int32_t IOExecutor::doPostProcessingOfJob(FilerJob *job) {
-  job->reset();
+  if ((job->op_ == FileOp::Write) || (job->op_ == FileOp::NonAlignedWrite)) {
+    FinishWrite(job);
+  }
+  if (job->putStep_ == PutStep::Write) {
+    // file of a Put is closed on fdQueue before completion is sent
+    job->putStep_ = PutStep::Close;
+    job->op_ = FileOp::Put;
+    PushToFdQueue(job);
+    return 0;
+  }
+
+  const bool isReadWrite =
+      (job->op_ == FileOp::Read) || (job->op_ == FileOp::Write);
+  // job went through request queue; a NonAlignedWrite may finish
+  // on the fdQueue after that
+  const bool isQueued = isReadWrite || (job->op_ == FileOp::Sync) ||
+                        (job->op_ == FileOp::NonAlignedWrite);
+  // these stats are also updated by fdQueue workers
+  const bool lockStats =
+      job->isMetadataOp() || (job->op_ == FileOp::NonAlignedWrite);
+  if (isQueued) {
+    // unregister before reset, after which caller may reuse completionId
+    UnregisterJob(job);
+  }
+  ResetJob(job);
+  if (isReadWrite) {
+    batchCtrl_.recordCompletion(job->serviceTime());
+  }
   // incrementOps() has to be done after reset() because
   // reset() sets serviceTime , which is used by stats
-  stats_.incrementOps(job);
-  if (job->closeFileHandle_) {
-    close(job->fd_);
+  if (lockStats) {
+    std::lock_guard<std::mutex> lck(fdQueueStatsMutex_);
+    stats_.incrementOps(job);
+  } else {
+    stats_.incrementOps(job);
+  }
+  if (job->fdEntry_) {
+    FdCache::release(job->fdEntry_);
+  }
+  if (job->canBeFreed_) {
+    FilerJobPool::release(job);
+  }
+  return 0;
+}
+
+// send completion of job
+void IOExecutor::ResetJob(FilerJob *job) {
+  if (job->completionCallback_) {
+    // callback runs on this thread, and delays every job behind it
+    gobjfs::stats::Timer callbackTimer(true);
+    job->reset();
+    if (callbackTimer.elapsedMicroseconds() >
+        (int64_t)config_.callbackBudgetUsec_) {
+      stats_.numSlowCallbacks_++;
+    }
+  } else {
+    job->reset();
+  }
+}
+
+// =====================
+
+void IOExecutor::RegisterJob(FilerJob *job) {
+  PendingShard &shard = PendingShardOf(job->completionId_);
+  {
+    std::unique_lock<std::mutex> lck(shard.mutex_);
+    FilerJob *&bucket = shard.bucketOf(job->completionId_);
+    job->pendingPrev_ = nullptr;
+    job->pendingNext_ = bucket;
+    if (bucket) {
+      bucket->pendingPrev_ = job;
+    }
+    bucket = job;
+    if (!job->hasDeadline()) {
+      return;
+    }
+    shard.deadlines_.emplace(job->deadline_, job);
+  }
+  ArmDeadlineTimer(job->deadline_);
+}
+
+void IOExecutor::UnregisterJob(FilerJob *job) {
+  PendingShard &shard = PendingShardOf(job->completionId_);
+  std::unique_lock<std::mutex> lck(shard.mutex_);
+  ErasePendingJob(shard, job);
+}
+
+void IOExecutor::ErasePendingJob(PendingShard &shard, FilerJob *job) {
+  FilerJob *&bucket = shard.bucketOf(job->completionId_);
+  if (job->pendingPrev_) {
+    job->pendingPrev_->pendingNext_ = job->pendingNext_;
+  } else if (bucket == job) {
+    bucket = job->pendingNext_;
+  } else {
+    // not registered, such as the write of a Put
+    return;
+  }
+  if (job->pendingNext_) {
+    job->pendingNext_->pendingPrev_ = job->pendingPrev_;
+  }
+  job->pendingNext_ = job->pendingPrev_ = nullptr;
+  if (!job->hasDeadline()) {
+    return;
+  }
+  auto deadlineRange = shard.deadlines_.equal_range(job->deadline_);
+  for (auto iter = deadlineRange.first; iter != deadlineRange.second;
+       ++iter) {
+    if (iter->second == job) {
+      shard.deadlines_.erase(iter);
+      break;
+    }
+  }
+}
+
+// arm deadlineTimer_ unless it already fires earlier
+void IOExecutor::ArmDeadlineTimer(
+    std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lck(deadlineMutex_);
+  if (deadline >= armedDeadline_) {
+    return;
+  }
+  armedDeadline_ = deadline;
+  auto timeoutUsec = std::chrono::duration_cast<std::chrono::microseconds>(
+                         deadline - std::chrono::steady_clock::now())
+                         .count();
+  deadlineTimer_.arm(timeoutUsec);
+}
+
+/**
+ * called by the thread which took job out of request queue
+ * @return true if job can be submitted, false if job was
+ * cancelled or expired while queued, in which case it is freed
+ * here or by the completion thread once its completion is sent
+ */
+bool IOExecutor::ClaimJob(FilerJob *job) {
+  if (job->isExpired(std::chrono::steady_clock::now())) {
+    std::vector<FilerJob *> expiredJobs;
+    {
+      PendingShard &shard = PendingShardOf(job->completionId_);
+      std::unique_lock<std::mutex> lck(shard.mutex_);
+      if (job->abort()) {
+        ErasePendingJob(shard, job);
+        expiredJobs.push_back(job);
+      }
+    }
+    QueueAbortedJobs(expiredJobs, -ETIMEDOUT);
+  }
+
+  if (job->claim()) {
+    return true;
   }
+
+  // completion thread frees it after sending its completion
+  if (job->dequeueAborted()) {
+    return false;
+  }
+  assert(job->state_ == JobState::Aborted);
   if (job->canBeFreed_) {
-    delete job;
+    FilerJobPool::release(job);
+  }
+  return false;
+}
+
+/**
+ * send completion for a job which was aborted while queued.
+ * run by completion thread only, since it updates stats without lock.
+ * The job stays in the request queue until the submitter
+ * dequeues and frees it, unless it was dequeued already
+ */
+void IOExecutor::CompleteAbortedJob(FilerJob *job, int errcode) {
+  if ((job->op_ == FileOp::Write) || (job->op_ == FileOp::NonAlignedWrite)) {
+    FinishWrite(job);
+  }
+  job->retcode_ = errcode;
+  job->setWaitTime();
+  job->reset();
+  stats_.incrementOps(job);
+  stats_.numAbortedQueued_++;
+  if (errcode == -ETIMEDOUT) {
+    stats_.numTimedOut_++;
+  } else {
+    stats_.numCancelled_++;
+  }
+  if (job->fdEntry_) {
+    FdCache::release(job->fdEntry_);
   }
+  if (!job->finishAbort()) {
+    assert(job->state_ == JobState::Dequeued);
+    if (job->canBeFreed_) {
+      FilerJobPool::release(job);
+    }
+  }
+}
+
+/**
+ * called by threads other than the completion thread
+ * to hand over jobs which they aborted
+ */
+void IOExecutor::QueueAbortedJobs(const std::vector<FilerJob *> &jobs,
+                                  int errcode) {
+  if (jobs.empty()) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lck(handoverMutex_);
+    for (auto job : jobs) {
+      abortedJobs_.emplace_back(job, errcode);
+    }
+  }
+  handoverReady_.send();
+}
+
+void IOExecutor::CompleteHandedOverJobs() {
+  std::vector<std::pair<FilerJob *, int>> abortedJobs;
+  std::vector<std::pair<FilerJob *, int>> servedJobs;
+  {
+    std::unique_lock<std::mutex> lck(handoverMutex_);
+    abortedJobs.swap(abortedJobs_);
+    servedJobs.swap(servedJobs_);
+  }
+  for (auto &entry : abortedJobs) {
+    CompleteAbortedJob(entry.first, entry.second);
+  }
+  for (auto &entry : servedJobs) {
+    FilerJob *job = entry.first;
+    job->retcode_ = entry.second;
+    job->setWaitTime();
+    // unregister before reset, after which caller may reuse completionId
+    UnregisterJob(job);
+    ResetJob(job);
+    stats_.incrementOps(job);
+    stats_.numServed_++;
+    if (job->canBeFreed_) {
+      FilerJobPool::release(job);
+    }
+  }
+}
+
+int32_t IOExecutor::registerServedJob(FilerJob *job) {
+  if (state_ != RUNNING) {
+    return -EAGAIN;
+  }
+  job->setSubmitTime();
+  StartTrace(job);
+  job->executor_ = this;
+  stats_.numQueued_++;
+  RegisterJob(job);
   return 0;
 }
 
+void IOExecutor::completeServedJob(FilerJob *job, int retcode) {
+  {
+    std::unique_lock<std::mutex> lck(handoverMutex_);
+    servedJobs_.emplace_back(job, retcode);
+  }
+  handoverReady_.send();
+}
+
+void IOExecutor::requeueServedJob(FilerJob *job) {
+  if (state_ != RUNNING) {
+    // as submitTask does on shutdown
+    if (ClaimJob(job)) {
+      completeServedJob(job, -EAGAIN);
+    }
+    return;
+  }
+  PushToRequestQueue(job);
+  ScheduleSubmission(/*isRead*/ true, /*moreToFollow*/ false);
+}
+
+/**
+ * caller must hold mutex_ of the PendingShard of job, which keeps
+ * job from being freed
+ * @return 0 if kernel was asked to cancel, else negative errno
+ */
+int32_t IOExecutor::CancelInflightJob(FilerJob *job, int errcode) {
+  FilerCtx *ctxPtr = job->ctx_;
+  if (!ctxPtr) {
+    // part of a vectored io with other jobs, or not yet submitted
+    return -EBUSY;
+  }
+  if (job->cancelCode_) {
+    // already tried
+    return -EALREADY;
+  }
+  // set before cancel, since the cancelled io may complete right away
+  job->cancelCode_ = errcode;
+  int32_t ret = ctxPtr->cancel(&job->cb_);
+  if (ret != 0) {
+    VLOG(1) << "kernel could not cancel job=" << (void *)job
+            << " error=" << ret;
+    // io may not have reached the kernel yet; let a later cancel retry
+    job->cancelCode_ = 0;
+  }
+  return ret;
+}
+
+int32_t IOExecutor::cancelTask(gCompletionID completionId) {
+  std::vector<FilerJob *> abortedJobs;
+  int32_t numCancelled = 0;
+  int32_t ret = -ENOENT;
+
+  {
+    PendingShard &shard = PendingShardOf(completionId);
+    std::unique_lock<std::mutex> lck(shard.mutex_);
+    for (FilerJob *job = shard.bucketOf(completionId); job;
+         job = job->pendingNext_) {
+      if (job->completionId_ != completionId) {
+        continue;
+      }
+      if (job->abort()) {
+        abortedJobs.push_back(job);
+        continue;
+      }
+      ret = CancelInflightJob(job, -ECANCELED);
+      if (ret == 0) {
+        numCancelled++;
+      }
+    }
+    for (auto job : abortedJobs) {
+      ErasePendingJob(shard, job);
+    }
+  }
+
+  // completion is sent later by completion thread
+  QueueAbortedJobs(abortedJobs, -ECANCELED);
+  numCancelled += abortedJobs.size();
+
+  return numCancelled ? numCancelled : ret;
+}
+
+/**
+ * run by completion thread when deadlineTimer_ fires
+ * fail expired jobs which are still queued, ask kernel to
+ * cancel expired jobs in flight, and rearm timer for the next deadline
+ */
+void IOExecutor::ExpireJobs() {
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<FilerJob *> expiredJobs;
+  auto nextDeadline = std::chrono::steady_clock::time_point::max();
+
+  {
+    // timer has fired; jobs registered from here on rearm it
+    std::unique_lock<std::mutex> lck(deadlineMutex_);
+    armedDeadline_ = std::chrono::steady_clock::time_point::max();
+  }
+
+  for (auto &shard : pendingShards_) {
+    std::unique_lock<std::mutex> lck(shard.mutex_);
+    // only the expired prefix of each shard is visited
+    auto iter = shard.deadlines_.begin();
+    while ((iter != shard.deadlines_.end()) && (iter->first <= now)) {
+      auto current = iter++;
+      FilerJob *job = current->second;
+      if (job->abort()) {
+        expiredJobs.push_back(job);
+        ErasePendingJob(shard, job);
+        continue;
+      }
+      // kernel is asked once; libaio cannot cancel io on files or
+      // block devices, and asking again on every fire would repeat
+      // a failing syscall for each job stuck on the device.  Jobs
+      // not yet submitted (-EBUSY) are tried again
+      if ((job->state_ == JobState::Submitted) &&
+          (CancelInflightJob(job, -ETIMEDOUT) != -EBUSY)) {
+        shard.deadlines_.erase(current);
+      }
+    }
+    if (iter != shard.deadlines_.end()) {
+      nextDeadline = std::min(nextDeadline, iter->first);
+    }
+  }
+
+  if (nextDeadline != std::chrono::steady_clock::time_point::max()) {
+    ArmDeadlineTimer(nextDeadline);
+  }
+
+  for (auto job : expiredJobs) {
+    CompleteAbortedJob(job, -ETIMEDOUT);
+  }
+}
+
+int32_t IOExecutor::registerBuffer(uint32_t slot, void *addr, size_t size) {
+  int32_t numRegistered = 0;
+  for (auto &ctx : ctxVec_) {
+    if (ctx->registerBuffer(slot, addr, size) == 0) {
+      numRegistered++;
+    }
+  }
+  return numRegistered;
+}
+
 std::string IOExecutor::getState() const {
   std::ostringstream s;
 
-  s << "{\"core\":" << core_ << ",\"fdqueueSize\":" << fdQueueSize_
-    << ",\"requestQueue\":" << requestQueueSize_ << "," << ctx_.getState()
-    << "," << stats_.getState() << "}" << std::endl;
+  s << "{\"core\":" << core_ << ",\"numaNode\":" << numaNode_
+    << ",\"numThreads\":" << getNumThreads()
+    << ",\"fdqueueSize\":" << fdQueueSize_
+    << ",\"requestQueue\":" << requestQueueSize_ << ",\"fdQueue\":[";
+  for (size_t idx = 0; idx < fdQueueWorkers_.size(); idx++) {
+    s << ((idx == 0) ? "" : ",") << fdQueueWorkers_[idx]->getState();
+  }
+  s << "],\"ctx\":[";
+  for (size_t idx = 0; idx < ctxVec_.size(); idx++) {
+    s << ((idx == 0) ? "" : ",") << ctxVec_[idx]->getState();
+  }
+  s << "],\"batch\":" << batchCtrl_.getState() << ","
+    << stats_.getState() << "}" << std::endl;
 
   return s.str();
 }
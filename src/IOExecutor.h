@@ -18,14 +18,30 @@ but WITHOUT ANY WARRANTY of any kind.
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <boost/lockfree/queue.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <libaio.h>
+#include <map>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <BatchController.h>
+#include <DeficitRoundRobin.h>
 #include <Executor.h>
-#include <IOExecutor.h>
+#include <FdCache.h>
+#include <FilerCtx.h>
+#include <FilerJobPool.h>
+#include <JobTracer.h>
+#include <TenantQos.h>
+#include <gcommon.h>
 
 #include <util/ConditionWrapper.h>
 #include <util/SemaphoreWrapper.h>
@@ -55,50 +71,21 @@ using gobjfs::os::SemaphoreWrapper;
 using gobjfs::os::FD_INVALID;
 using gobjfs::os::CpuStats;
 
-/*
- * FilerCtx:
- *	- FilerCtx is an async io context wrapper
- *	- Structure keeps track of parameters like
- *		ioQueueDepth_ : queue depth of io_context at async layer
- *		eventFD_			: eventfd to poll for async io
- *completions
- *		epollFD_			: Not used here. But set to
- *global
- *epollFD_
+/**
+ * how the IOExecutor completion thread waits for io completions
+ * selected with "ioexec.completion_mode" in config file
  */
-class FilerCtx {
-public:
-  io_context_t ioCtx_;
-
-  int epollFD_ = FD_INVALID;
-  int eventFD_ = FD_INVALID;
-
-  int32_t ioQueueDepth_;
-  std::atomic<int32_t> numAvailable_{0};
-
-public:
-  explicit FilerCtx();
-
-  int32_t init(int32_t queueDepth, int epollFD);
-
-  ~FilerCtx();
-
-  std::string getState() const;
+enum class CompletionMode : int32_t {
+  Interrupt = 0, // sleep in epoll_wait until ctx eventfd fires
+  Poll = 1, // spin on completion ring, then fall back to epoll_wait
+  // STOP - ENSURE u add to the stream operators
+  // when you change this
+};
 
-  bool isEmpty() const { return (numAvailable_ == 0); }
+std::ostream &operator<<(std::ostream &os, const CompletionMode mode);
 
-  void incrementNumAvailable(int32_t count = 1) {
-    numAvailable_ += count;
-    assert(numAvailable_ <= ioQueueDepth_);
-  }
-  void decrementNumAvailable(int32_t count) {
-    numAvailable_ -= count;
-    assert(numAvailable_ >= 0);
-  }
-
-  GOBJFS_DISALLOW_COPY(FilerCtx);
-  GOBJFS_DISALLOW_MOVE(FilerCtx);
-};
+// used by boost program_options to parse config
+std::istream &operator>>(std::istream &is, CompletionMode &mode);
 
 class IOExecutor : public Executor {
 public:
@@ -107,19 +94,73 @@ public:
   public:
     bool noSubmitterThread_{true};
 
+    // one thread per executor submits, reaps and runs metadata ops
+    // callers only queue requests; implies noSubmitterThread
+    bool runToCompletion_{false};
+
     std::vector<CoreId> cpuCores_;
 
     uint32_t queueDepth_ = 200;
     // 200 is good default for NVME SSDs
     // if we run on other disks, lets abstract this out
 
-    uint32_t minSubmitSize_ = 16;
+    // requests may wait in queue to be submitted in a batch, as long as
+    // queue wait + completion latency stays within targetLatencyUsec
+    uint32_t targetLatencyUsec_ = 200;
+    uint32_t maxBatchSize_ = 16;
 
     // maxRequestQueueSize need not be more than io contexts available
     uint32_t maxRequestQueueSize_;
 
     uint32_t maxFdQueueSize_;
 
+    IOBackend backend_{IOBackend::Aio};
+
+    // number of io contexts per IOExecutor, each of queueDepth
+    // more than one ctx allows numCtx * queueDepth io in flight
+    uint32_t numCtx_ = 1;
+
+    // let an idle IOExecutor submit queued reads of an overloaded sibling
+    bool workStealing_{false};
+
+    // relative share of submissions for each gIOPriority class
+    // when all classes have queued requests
+    std::vector<uint32_t> priorityWeights_{16, 4, 1};
+
+    CompletionMode completionMode_{CompletionMode::Interrupt};
+
+    // in Poll mode, completion thread keeps spinning for this long
+    // after the last reaped completion before it goes to sleep
+    uint32_t pollSpinUsec_ = 50;
+    // in Poll mode, completion thread returns to epoll_wait after
+    // spinning this long even if io keeps completing, so that timers
+    // and shutdown are seen; pollSpinUsec_ if that is larger
+    uint32_t pollMaxSpinUsec_ = 1000;
+
+    // max queued jobs at adjacent offsets of a file which are
+    // submitted as one vectored io; 1 disables merging
+    uint32_t maxMergeJobs_ = 16;
+
+    // completion callbacks which take longer are counted as slow
+    uint32_t callbackBudgetUsec_ = 50;
+
+    // threads which run deletes and non-aligned writes
+    uint32_t numFdQueueThreads_ = 1;
+
+    // trace one in these many jobs; zero disables tracing
+    uint32_t traceSampleRate_ = 0;
+    // number of most recent job traces kept
+    uint32_t traceRingSize_ = 4096;
+
+    // fds kept open by the service for reads by file name
+    // zero opens and closes the file on every read
+    uint32_t fdCacheSize_ = 0;
+
+    // bytes prefetched at a time for handles read sequentially
+    uint32_t readAheadWindow_ = 1 << 20;
+    // prefetched data held across all handles; zero disables read-ahead
+    uint64_t readAheadMaxBytes_ = 0;
+
     void setDerivedParam();
 
     explicit Config(); // use defaults
@@ -143,6 +184,28 @@ public:
     std::atomic<uint64_t> numSubmitted_{0}; // multi-thread writers
     std::atomic<uint64_t> numCompleted_{0}; // multi-thread writers
 
+    std::atomic<uint64_t> numStolen_{0};     // jobs taken from siblings
+    std::atomic<uint64_t> numStolenFrom_{0}; // jobs taken by siblings
+
+    std::atomic<uint64_t> numTimedOut_{0};  // failed with -ETIMEDOUT
+    std::atomic<uint64_t> numCancelled_{0}; // failed with -ECANCELED
+    // jobs held back because tenant was over its QoS limit
+    std::atomic<uint64_t> numThrottled_{0};
+    // submissions refused with -EAGAIN, and the times
+    // space fd was signalled after that
+    std::atomic<uint64_t> numRefused_{0};
+    std::atomic<uint64_t> numSpaceSignalled_{0};
+
+    // completion callbacks which exceeded callbackBudgetUsec
+    std::atomic<uint64_t> numSlowCallbacks_{0};
+
+    // jobs allocated from heap because job pool was empty
+    std::atomic<uint64_t> numJobAllocs_{0};
+
+    // noSubmitterThread mode : times a caller found another thread
+    // submitting, and left its requests to be submitted by that one
+    std::atomic<uint64_t> numSubmitHandoffs_{0};
+
     // updated by completionThread
     struct OpStats {
       gobjfs::stats::StatsCounter<int64_t> waitTime_;
@@ -154,6 +217,16 @@ public:
       uint32_t numOps_ = 0;
       uint32_t numBytes_ = 0;
 
+      // wait and service time broken out by gIOPriority
+      struct ClassStats {
+        gobjfs::stats::Histogram<int64_t> waitHist_;
+        gobjfs::stats::Histogram<int64_t> serviceHist_;
+        uint32_t numOps_ = 0;
+      };
+      ClassStats class_[GIO_PRIO_COUNT];
+
+      void update(FilerJob *job, bool countBytes);
+
       std::string getState() const;
     };
 
@@ -162,22 +235,48 @@ public:
     OpStats nonAlignedWrite_;
     OpStats read_;
     OpStats delete_;
+    OpStats sync_;
+    OpStats open_;
+    OpStats close_;
+    OpStats put_;
 
     gobjfs::stats::MaxValue<uint32_t> maxRequestQueueSize_;
     gobjfs::stats::MaxValue<uint32_t> maxFdQueueSize_;
 
     gobjfs::stats::StatsCounter<int64_t> numProcessedInLoop_;
 
+    // size of batch submitted to ctx
+    gobjfs::stats::StatsCounter<int64_t> batchSize_;
+    gobjfs::stats::Histogram<int64_t> batchSizeHist_;
+    // usec which first request in a batch waited for the rest
+    gobjfs::stats::StatsCounter<int64_t> batchWaitTime_;
+
     uint32_t idleLoop_ = 0;
     uint32_t numCompletionEvents_ = 0;
 
+    // time spent by completion thread polling the completion ring
+    // vs sleeping in epoll_wait (microseconds)
+    uint64_t spinTime_ = 0;
+    uint64_t sleepTime_ = 0;
+    uint32_t numSleeps_ = 0;
+    // completions found while spinning, which avoided a wakeup
+    uint32_t numSpinReaped_ = 0;
+
+    // jobs submitted as part of another job's vectored io
+    uint64_t numMerged_ = 0;
+    // syncs completed by the kernel call of another sync
+    uint64_t numSyncGrouped_ = 0;
+    // reads served from read-ahead windows without device io
+    uint64_t numServed_ = 0;
+    // jobs cancelled or expired before they were submitted
+    uint64_t numAbortedQueued_ = 0;
+
     uint32_t requestQueueLow1_ = 0;
     uint32_t requestQueueLow2_ = 0;
     uint32_t requestQueueFull_ = 0;
 
     CpuStats completionThread_;
     CpuStats submitterThread_;
-    CpuStats fdQueueThread_;
 
     void incrementOps(FilerJob *job);
 
@@ -197,7 +296,96 @@ public:
   GOBJFS_DISALLOW_COPY(IOExecutor);
   GOBJFS_DISALLOW_MOVE(IOExecutor); // dont move executing obj
 
-  int32_t submitTask(FilerJob *job, bool blockIfQueueFull);
+  // job is returned to the pool after completion, or by
+  // FilerJobPool::release if it could not be submitted
+  FilerJob *allocJob(int fd, FileOp op);
+  FilerJob *allocJob(const char *fileName, FileOp op);
+  FilerJob *allocJob(const char *fileName, size_t len, FileOp op);
+
+  // @param moreToFollow caller is about to submit more jobs, so let
+  //   them queue up and be submitted (and merged) together
+  // @param isReserved job uses space taken earlier with reserveSpace,
+  //   so it is not refused for lack of space
+  int32_t submitTask(FilerJob *job, bool blockIfQueueFull,
+                     bool moreToFollow = false, bool isReserved = false);
+
+  /**
+   * take space for count jobs in request queue of a class (and in the
+   * backlog of a limited tenant) so that a batch is queued entirely
+   * or not at all.  Each reserved job must be passed to submitTask
+   * with isReserved, or given back with unreserveSpace
+   * @return 0 on success, -EAGAIN if there is not enough space, in
+   *   which case space fd is signalled once the queue drains
+   */
+  int32_t reserveSpace(gIOPriority priority, uint32_t tenant,
+                       int32_t count);
+  void unreserveSpace(gIOPriority priority, int32_t count);
+
+  // eventfd incremented when a refused submitter can retry
+  void setSpaceAvailableFd(int fd) { spaceAvailableFd_ = fd; }
+
+  /**
+   * fail read/write jobs with this completionId with -ECANCELED
+   * Queued jobs complete immediately.  For jobs in flight, kernel
+   * is asked to cancel; if it cannot, job completes normally later
+   * @return number of jobs cancelled, -ENOENT if none were pending,
+   *   else error from FilerCtx::cancel
+   */
+  int32_t cancelTask(gCompletionID completionId);
+
+  /**
+   * read-ahead serves some reads from memory instead of the device.
+   * Such a job is registered and counted like a queued job, so that
+   * it can be cancelled or expire until claimServedJob takes it
+   * @return 0, else -EAGAIN if executor is shutting down
+   */
+  int32_t registerServedJob(FilerJob *job);
+  // @return false if job was cancelled or expired, see ClaimJob
+  bool claimServedJob(FilerJob *job) { return ClaimJob(job); }
+  // completion thread sends the completion of a claimed served job
+  void completeServedJob(FilerJob *job, int retcode);
+  // submit an unclaimed served job to the device after all
+  void requeueServedJob(FilerJob *job);
+
+  // other executors in the same service, used for work stealing
+  void setSiblings(const std::vector<IOExecutor *> &siblings);
+
+  // per-tenant limits shared by the executors of a service
+  // must be set before jobs are submitted
+  void setTenantQos(TenantQos *qos) { qos_ = qos; }
+
+  // fds of files read by name, which deletes have to invalidate
+  void setFdCache(FdCache *fdCache) { fdCache_ = fdCache; }
+
+  // converts name of Open and Put jobs to a path, with the same
+  // contract as FileTranslatorFunc; name is used as is if not set
+  typedef std::function<int(const char *, size_t, char *)> FileTranslator;
+  void setFileTranslator(FileTranslator translator) {
+    fileTranslator_ = std::move(translator);
+  }
+
+  /**
+   * register a buffer region with each io context
+   * @return number of contexts whose backend keeps it pinned
+   */
+  int32_t registerBuffer(uint32_t slot, void *addr, size_t size);
+
+  // NUMA node of the core, whose memory the executor uses
+  int32_t getNumaNode() const { return numaNode_; }
+
+  // threads started by the executor, all bound to its core
+  uint32_t getNumThreads() const;
+
+  // @param sampleRate trace one in these many jobs, zero disables
+  void setTraceSampleRate(uint32_t sampleRate) {
+    tracer_.setSampleRate(sampleRate);
+  }
+
+  // recent job traces as comma-separated Chrome trace events
+  // @return number of jobs written
+  size_t getTraceEvents(std::ostream &os) const {
+    return tracer_.getTraceEvents(os);
+  }
 
   virtual void stop();
 
@@ -207,15 +395,98 @@ private:
   virtual void execute();
 
   int32_t ProcessRequestQueue();
-  int32_t ProcessFdQueue();
+  bool TrySubmitQueued();
+  void SubmitRemaining();
+  void WaitForFreeCtx();
+  void WakeupSpaceWaiters();
+
+  void TakeCtxSlot(FilerCtx *ctxPtr) {
+    ctxPtr->decrementNumAvailable(1);
+    ctxCredits_--;
+  }
+  void ReturnCtxSlots(FilerCtx *ctxPtr, int32_t count = 1) {
+    ctxPtr->incrementNumAvailable(count);
+    ctxCredits_ += count;
+  }
+  bool isBatchReady();
+  void ArmBatchTimer();
+  int32_t SubmitToCtx(FilerCtx *ctxPtr);
+  bool NextJob(FilerJob *&job);
+  int32_t SubmitIocbs(FilerCtx *ctxPtr, iocb **post_iocb, int32_t numToSubmit);
+  FilerCtx *LeastLoadedCtx() const;
+  struct FdQueueWorker;
+  int32_t ProcessFdQueue(FdQueueWorker *worker);
+  bool RunFdQueueJob(FdQueueWorker *worker);
+  FdQueueWorker &FdQueueWorkerFor(const FilerJob *job);
+  // @return fd, else negative errno
+  int OpenFileOfJob(FilerJob *job);
+  void PushToFdQueue(FilerJob *job);
+  void PushToRequestQueue(FilerJob *job);
+  void PushToPriorityQueue(FilerJob *job);
+  // @return false if write is held until truncate of its fd is done
+  bool AdmitWrite(FilerJob *job);
+  void FinishWrite(FilerJob *job);
+  void QueueTruncate(FilerJob *job);
+  void PushReleasedWrites(FilerJob *jobs);
+  void ScheduleReleasedJobs();
+  int32_t PrepareNonAlignedWrite(FilerJob *job);
+  void ScheduleSubmission(bool isRead, bool moreToFollow);
+  void SubmitPutWrite(FilerJob *job);
+  void WakeupSubmitter();
+
+  int32_t ThrottleIfOverLimit(FilerJob *job, bool blocking, bool isReserved);
+  void ReleaseThrottledJobs();
+
+  int32_t spaceLowWatermark() const {
+    return config_.maxRequestQueueSize_ / 2;
+  }
+  void RefuseForQueueFull();
+  void SignalIfQueueDrained();
+  void SignalSpaceAvailable();
+
+  bool isOverloaded() const;
+  int32_t StealRequests(IOExecutor *victim);
+  int32_t StealFromSiblings();
+  void OfferToSiblings();
 
   void ProcessCompletions();
-  int32_t ProcessCallbacks(io_event *events, int32_t n_events);
+  void RunRemainingFdJobs();
+  int32_t RunQueuedWork();
+  bool hasQueuedWork();
+  void WakeupRunLoop();
+  int32_t ReapCompletions(FilerCtx *ctxPtr);
+  int32_t PollCompletions();
+  bool hasIoInFlight() const;
+  void NotifySubmitterIfCtxFree();
+  bool isCtx(const void *ptr) const;
+  int32_t ProcessCallbacks(FilerCtx *ctxPtr, io_event *events,
+                           int32_t n_events);
+  void StartTrace(FilerJob *job);
+  void StampReaped(FilerJob *job);
+  void ProcessMergedCallback(FilerJob *job, ssize_t res);
+  bool ProcessNonAlignedWrite(FilerCtx *ctxPtr, FilerJob *job, ssize_t res);
   int32_t doPostProcessingOfJob(FilerJob *job);
 
+  void RegisterJob(FilerJob *job);
+  void UnregisterJob(FilerJob *job);
+  bool ClaimJob(FilerJob *job);
+  void CompleteAbortedJob(FilerJob *job, int errcode);
+  void QueueAbortedJobs(const std::vector<FilerJob *> &jobs, int errcode);
+  void CompleteHandedOverJobs();
+  void ResetJob(FilerJob *job);
+  int32_t CancelInflightJob(FilerJob *job, int errcode);
+  void ExpireJobs();
+  void ArmDeadlineTimer(std::chrono::steady_clock::time_point deadline);
+
   std::thread submitterThread_;
   ConditionWrapper submitterCond_;
-  SemaphoreWrapper ctxCond_; // signals if ctx available
+  // free io slots across all ctx; taken by the submitting thread,
+  // returned by the completion thread
+  std::atomic<int32_t> ctxCredits_{0};
+
+  // noSubmitterThread mode : set by the caller thread which is
+  // submitting queued requests on behalf of all callers
+  std::atomic<bool> submitting_{false};
 
   // set when submitterThread waits for new requests
   std::atomic<bool> submitterWaitingForNewRequests_{false};
@@ -223,32 +494,206 @@ private:
   // set when submitterThread waits for free io_context
   std::atomic<bool> submitterWaitingForFreeCtx_{false};
 
-  uint32_t minSubmitSize_{1};
+  BatchController batchCtrl_;
+  // set while queued requests are waiting for batch to fill
+  std::atomic<bool> batchWaiting_{false};
+  gobjfs::stats::Timer batchWaitTimer_;
+  // noSubmitterThread mode : submits a partial batch when window expires
+  TimerNotifier batchTimer_;
+  std::atomic<bool> batchTimerArmed_{false};
 
   std::thread completionThread_;
   ShutdownNotifier completionThreadShutdown_;
   // writing to this fd causes completionThread_ to exit
   //
+
+  // runToCompletion mode : completionThread_ is the only thread
+  // callers wake it up through this fd if it is sleeping in epoll
+  ShutdownNotifier runLoopWakeup_;
+  std::atomic<bool> runLoopSleeping_{false};
   TimerNotifier periodicTimer_;
 
-  // Requests added by submitTask
-  boost::lockfree::queue<FilerJob *> requestQueue_;
+  /**
+   * Requests of one gIOPriority class added by submitTask
+   * With work stealing, reads are kept in a separate queue because
+   * only reads can be stolen by a sibling, while writes to a file must
+   * be submitted in order.  Otherwise all jobs are in jobQueue_
+   */
+  struct PriorityQueue {
+    boost::lockfree::queue<FilerJob *> jobQueue_;
+    boost::lockfree::queue<FilerJob *> readQueue_;
+    std::atomic<int32_t> size_{0}; // includes readSize_
+    std::atomic<int32_t> readSize_{0};
+    // taken by reserveSpace, not yet used by submitTask
+    std::atomic<int32_t> reserved_{0};
+    // which of the two queues is tried first by the next pop,
+    // so that neither starves the other; only used by submitting thread
+    bool readTurn_{false};
+
+    explicit PriorityQueue(size_t capacity)
+        : jobQueue_(capacity), readQueue_(capacity) {}
+  };
+
+  bool PopJob(PriorityQueue &queue, FilerJob *&job);
+
+  std::vector<std::unique_ptr<PriorityQueue>> requestQueue_;
+  DeficitRoundRobin drr_; // class served next by NextJob
+
   ConditionWrapper requestQueueHasSpace_;
-  std::atomic<int32_t> requestQueueSize_{0};
+  // blocking callers waiting on requestQueueHasSpace_
+  std::atomic<int32_t> numWaitingForSpace_{0};
+  // totals across all priority classes
+  std::atomic<int32_t> requestQueueSize_{0}; // includes readQueueSize_
+  std::atomic<int32_t> readQueueSize_{0};
+
+  std::vector<IOExecutor *> siblings_;
+
+  // read/write jobs which are queued or in flight, so that they can
+  // be cancelled by completionId or failed when deadline expires.
+  // Sharded by completionId, so that submitters and the completion
+  // thread do not all contend on one lock
+  static constexpr size_t PendingShardCount = 16;
+  static constexpr size_t PendingBucketCount = 64;
+  struct PendingShard {
+    std::mutex mutex_;
+    // jobs hashed by completionId, linked through
+    // FilerJob::pendingNext_, so that registering does not allocate
+    FilerJob *buckets_[PendingBucketCount] = {};
+    // jobs which have a deadline, earliest first
+    std::multimap<std::chrono::steady_clock::time_point, FilerJob *>
+        deadlines_;
+
+    FilerJob *&bucketOf(gCompletionID completionId) {
+      return buckets_[(completionId / PendingShardCount) %
+                      PendingBucketCount];
+    }
+  };
+  std::array<PendingShard, PendingShardCount> pendingShards_;
+  PendingShard &PendingShardOf(gCompletionID completionId) {
+    return pendingShards_[completionId % PendingShardCount];
+  }
+  // caller must hold shard.mutex_
+  void ErasePendingJob(PendingShard &shard, FilerJob *job);
+  // time at which deadlineTimer_ will fire
+  std::mutex deadlineMutex_;
+  std::chrono::steady_clock::time_point armedDeadline_;
+  // completion thread fails jobs whose deadline expired
+  TimerNotifier deadlineTimer_;
+
+  // jobs aborted, or served from read-ahead, by other threads, with
+  // their errcode; completion thread sends their completion so that
+  // stats and callbacks are only touched by it
+  std::mutex handoverMutex_;
+  std::vector<std::pair<FilerJob *, int>> abortedJobs_;
+  std::vector<std::pair<FilerJob *, int>> servedJobs_;
+  ShutdownNotifier handoverReady_;
+
+  // writes in flight on each fd.  The padding of a non-aligned write
+  // is cut only when no other write is in flight on its fd, and
+  // writes arriving meanwhile are held until it is cut, so that the
+  // truncate cannot cut off a write which ends past it.
+  // fds share a slot when they hash to it, which only delays them.
+  // A write just counts itself in numWrites_; fdWritesMutex_ is taken
+  // only while numPaddedWrites_ says a truncate may be coming
+  struct FdJobList {
+    // linked through FilerJob::fdWriteNext_
+    FilerJob *head_{nullptr};
+    FilerJob *tail_{nullptr};
+    int32_t size_{0};
+
+    bool empty() const { return head_ == nullptr; }
+    void push(FilerJob *job);
+    FilerJob *pop();
+    // @return jobs in the list, linked through fdWriteNext_
+    FilerJob *takeAll();
+  };
+  struct FdWrites {
+    std::atomic<int32_t> numWrites_{0};
+    // truncate on fdQueue, and those waiting for numWrites_ to drain;
+    // protected by fdWritesMutex_
+    FilerJob *truncating_{nullptr};
+    FdJobList truncates_;
+    FdJobList heldWrites_;
+  };
+  static constexpr size_t FdWritesSlotCount = 256;
+  std::array<FdWrites, FdWritesSlotCount> fdWrites_;
+  FdWrites &FdWritesOf(int fd) {
+    return fdWrites_[(uint32_t)fd % FdWritesSlotCount];
+  }
+  // caller must hold fdWritesMutex_
+  void CountWrite(FdWrites &fdWrites, FilerJob *job);
+  FilerJob *StartNextTruncate(FdWrites &fdWrites);
+  // non-aligned writes counted in numWrites_, whose padding may
+  // have to be cut
+  std::atomic<int32_t> numPaddedWrites_{0};
+  std::mutex fdWritesMutex_;
+
+  TenantQos *qos_{nullptr};
+  FdCache *fdCache_{nullptr};
+  FileTranslator fileTranslator_;
+  // jobs of tenants over their limit, in submission order per tenant
+  // they stay registered in pendingShards_ so they can be cancelled
+  struct ThrottledJob {
+    FilerJob *job_;
+    std::chrono::steady_clock::time_point since_;
+  };
+  std::mutex throttleMutex_;
+  std::unordered_map<uint32_t, std::deque<ThrottledJob>> throttledJobs_;
+  // signalled when jobs leave throttledJobs_; uses throttleMutex_
+  std::condition_variable throttleHasSpace_;
+  // time at which throttleTimer_ will fire; protected by throttleMutex_
+  std::chrono::steady_clock::time_point armedThrottle_;
+  // completion thread moves jobs to request queue when it fires
+  TimerNotifier throttleTimer_;
+
+  // refused submitters are told through this fd when to retry
+  int spaceAvailableFd_{FD_INVALID};
+  // set when a job was refused because request queue was full
+  std::atomic<bool> queueSpaceWanted_{false};
+  // tenants refused because backlog was full; uses throttleMutex_
+  std::unordered_set<uint32_t> tenantsWantingSpace_;
 
   // for metadata ops (create, delete, sync)
-  std::thread fdQueueThread_;
+  // run synchronously on a pool of threads, each with its own queue
+  // ops on a file always go to the same thread, and complete in order
+  struct FdQueueWorker {
+    std::thread thread_;
+    SemaphoreWrapper cond_; // signals if queue_ has new elem
+    boost::lockfree::queue<FilerJob *> queue_{0};
+    std::atomic<int32_t> size_{0};
+
+    // updated by the worker thread
+    gobjfs::stats::Histogram<int64_t> queueSizeHist_; // seen at dequeue
+    gobjfs::stats::Histogram<int64_t> serviceHist_;   // nanosec in syscall
+    CpuStats cpuStats_;
+
+    std::string getState() const;
+  };
+  std::vector<std::unique_ptr<FdQueueWorker>> fdQueueWorkers_;
+  // stats of metadata ops and nonAlignedWrite_ are updated by every worker
+  // and, for nonAlignedWrite_, by completion thread
+  std::mutex fdQueueStatsMutex_;
+
   ConditionWrapper fdQueueHasSpace_;
-  SemaphoreWrapper fdQueueCond_; // signals if fdQueue has new elem
-  boost::lockfree::queue<FilerJob *> fdQueue_;
-  std::atomic<int32_t> fdQueueSize_{0};
+  std::atomic<int32_t> fdQueueSize_{0}; // across all workers
   // size variables are kept as "signed" to catch
   // increment/decrement errors
 
   // fd on which completion thread waits
   int epollFD_ = FD_INVALID;
 
-  FilerCtx ctx_;
+  int32_t numaNode_{gobjfs::os::NumaNodeInvalid};
+
+  JobTracer tracer_;
+  // set by completion thread when it wakes up and after getevents
+  // used only if tracing is enabled
+  int64_t wakeNsec_{0};
+  int64_t reapNsec_{0};
+
+  std::vector<FilerCtxUPtr> ctxVec_;
+
+  // enough jobs for full request queues and ctx
+  std::unique_ptr<FilerJobPool> jobPool_;
 };
 
 typedef std::shared_ptr<IOExecutor> IOExecutorSPtr;
@@ -0,0 +1,172 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "JobTracer.h"
+#include "FilerJob.h"
+
+#include <gobjfs_log.h>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+namespace gobjfs {
+
+void JobTrace::release() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    tracer_->publish(*this);
+    delete this;
+  }
+}
+
+void JobTracer::init(uint32_t sampleRate, size_t ringSize, int32_t pid,
+                     const std::string &name) {
+  ringSize_ = ringSize ? ringSize : 1;
+  ring_.reset(new Slot[ringSize_]);
+  pid_ = pid;
+  name_ = name;
+  sampleRate_ = sampleRate;
+}
+
+void JobTracer::publish(const JobTrace &trace) {
+  if (!ring_) {
+    return;
+  }
+  const uint64_t idx = writeIdx_.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = ring_[idx % ringSize_];
+
+  // if two writers wrapped onto the same slot, last one wins
+  const uint64_t seq = slot.seq_.load(std::memory_order_relaxed);
+  slot.seq_.store(seq | 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  Record &r = slot.record_;
+  r.op_ = trace.op_;
+  r.completionId_ = trace.completionId_;
+  r.offset_ = trace.offset_;
+  r.size_ = trace.size_;
+  r.retcode_ = trace.retcode_;
+  for (int i = 0; i < (int)TraceStage::Count; i++) {
+    r.stamps_[i] = trace.stamps_[i];
+  }
+
+  slot.seq_.store((seq | 1) + 1, std::memory_order_release);
+}
+
+// name of interval which ends at a stage
+static const char *intervalName(int stage) {
+  switch ((TraceStage)stage) {
+  case TraceStage::Dequeue:
+    return "queued";
+  case TraceStage::Submitted:
+    return "io_submit";
+  case TraceStage::Wakeup:
+    return "device";
+  case TraceStage::Reaped:
+    return "reap";
+  case TraceStage::Done:
+    return "complete";
+  default:
+    return "unknown";
+  }
+}
+
+size_t JobTracer::getTraceEvents(std::ostream &os) const {
+  if (!ring_) {
+    return 0;
+  }
+
+  // json format, with timestamps in microseconds
+  os << std::fixed << std::setprecision(3);
+  os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid_
+     << ",\"args\":{\"name\":\"" << name_ << "\"}}";
+
+  const uint64_t end = writeIdx_.load(std::memory_order_acquire);
+  const uint64_t begin = (end > ringSize_) ? (end - ringSize_) : 0;
+
+  size_t numTraces = 0;
+  for (uint64_t idx = begin; idx < end; idx++) {
+    const Slot &slot = ring_[idx % ringSize_];
+
+    const uint64_t seq = slot.seq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      continue;
+    }
+    Record r = slot.record_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq_.load(std::memory_order_relaxed) != seq) {
+      // overwritten while being copied
+      continue;
+    }
+
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < (int)TraceStage::Count; i++) {
+      if (r.stamps_[i]) {
+        first = (first == -1) ? i : first;
+        last = i;
+      }
+    }
+    if (first == -1) {
+      continue;
+    }
+
+    std::ostringstream op;
+    op << (FileOp)r.op_;
+    const std::string common = ",\"cat\":\"job\",\"id\":\"" +
+                               std::to_string(pid_) + "-" +
+                               std::to_string(idx) +
+                               "\",\"pid\":" + std::to_string(pid_) +
+                               ",\"tid\":" + std::to_string(pid_);
+
+    os << ",{\"name\":\"" << op.str() << "\",\"ph\":\"b\"" << common
+       << ",\"ts\":" << r.stamps_[first] / 1000.0
+       << ",\"args\":{\"completionId\":" << r.completionId_
+       << ",\"offset\":" << r.offset_ << ",\"size\":" << r.size_
+       << ",\"retcode\":" << r.retcode_ << "}}";
+
+    // a job can complete before the submitter stamps it after
+    // io_submit; drop any stamp later than a following stage
+    int64_t nextStamp = r.stamps_[last];
+    for (int i = last - 1; i > first; i--) {
+      if (r.stamps_[i] > nextStamp) {
+        r.stamps_[i] = 0;
+      } else if (r.stamps_[i]) {
+        nextStamp = r.stamps_[i];
+      }
+    }
+
+    int prev = first;
+    for (int i = first + 1; i <= last; i++) {
+      if (!r.stamps_[i]) {
+        continue;
+      }
+      os << ",{\"name\":\"" << intervalName(i) << "\",\"ph\":\"b\""
+         << common << ",\"ts\":" << r.stamps_[prev] / 1000.0 << "}";
+      os << ",{\"name\":\"" << intervalName(i) << "\",\"ph\":\"e\""
+         << common << ",\"ts\":" << r.stamps_[i] / 1000.0 << "}";
+      prev = i;
+    }
+
+    os << ",{\"name\":\"" << op.str() << "\",\"ph\":\"e\"" << common
+       << ",\"ts\":" << r.stamps_[last] / 1000.0 << "}";
+    numTraces++;
+  }
+  return numTraces;
+}
+}
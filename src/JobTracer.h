@@ -0,0 +1,145 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+#include <gcommon.h>
+
+namespace gobjfs {
+
+class JobTracer;
+
+// points in the life of a FilerJob which are timestamped
+enum class TraceStage : int32_t {
+  Submit = 0,    // submitTask called
+  Dequeue = 1,   // taken from queue for submission or execution
+  Submitted = 2, // io_submit returned
+  Wakeup = 3,    // completion thread woke up from epoll or poll
+  Reaped = 4,    // io_getevents returned it
+  Done = 5,      // completion written to pipe, ring or callback
+  Count = 6,
+};
+
+/**
+ * timestamps of one sampled job, written by whichever thread is
+ * handling the job at each stage.  The job holds one reference,
+ * and the submitter holds another across io_submit, since the job
+ * can complete before io_submit returns.  Last one to let go
+ * publishes the trace to the ring of its JobTracer
+ */
+struct JobTrace {
+  JobTracer *tracer_;
+  std::atomic<int32_t> refs_{1};
+
+  int32_t op_{0}; // FileOp
+  gCompletionID completionId_{0};
+  off_t offset_{0};
+  size_t size_{0};
+  int32_t retcode_{0};
+  int64_t stamps_[(int)TraceStage::Count] = {0};
+
+  explicit JobTrace(JobTracer *tracer) : tracer_(tracer) {}
+
+  static int64_t nowNsec() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void stamp(TraceStage stage, int64_t nsec = nowNsec()) {
+    stamps_[(int)stage] = nsec;
+  }
+
+  void hold() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+  void release();
+};
+
+/**
+ * Samples one in every sampleRate jobs of an IOExecutor for tracing,
+ * and keeps the most recent traces in a ring which overwrites the
+ * oldest.  Writers and readers of the ring do not lock; each slot
+ * has a sequence number which tells a reader if the slot changed
+ * while it was being copied.
+ * The ring is dumped in Chrome trace event format, which can be
+ * loaded in chrome://tracing or ui.perfetto.dev
+ */
+class JobTracer {
+public:
+  // @param sampleRate trace one in these many jobs, zero disables
+  // @param pid process id shown in trace, such as the cpu core
+  void init(uint32_t sampleRate, size_t ringSize, int32_t pid,
+            const std::string &name);
+
+  void setSampleRate(uint32_t sampleRate) { sampleRate_ = sampleRate; }
+
+  bool isEnabled() const { return sampleRate_ != 0; }
+
+  // @return trace for a job which has been sampled, else nullptr
+  JobTrace *sample() {
+    const uint32_t rate = sampleRate_;
+    if (rate == 0 || ((numJobs_++ % rate) != 0)) {
+      return nullptr;
+    }
+    return new JobTrace(this);
+  }
+
+  void publish(const JobTrace &trace);
+
+  // events of traces in ring, without enclosing brackets
+  // @return number of traces written
+  size_t getTraceEvents(std::ostream &os) const;
+
+  uint64_t numPublished() const { return writeIdx_; }
+
+private:
+  struct Record {
+    int32_t op_;
+    gCompletionID completionId_;
+    off_t offset_;
+    size_t size_;
+    int32_t retcode_;
+    int64_t stamps_[(int)TraceStage::Count];
+  };
+
+  struct Slot {
+    // odd while being written
+    std::atomic<uint64_t> seq_{0};
+    Record record_;
+  };
+
+  std::atomic<uint32_t> sampleRate_{0};
+  std::atomic<uint64_t> numJobs_{0};
+
+  std::unique_ptr<Slot[]> ring_;
+  size_t ringSize_{0};
+  std::atomic<uint64_t> writeIdx_{0};
+
+  int32_t pid_{0};
+  std::string name_;
+};
+}
@@ -19,10 +19,17 @@ but WITHOUT ANY WARRANTY of any kind.
 #include "Mempool.h"
 
 #include <boost/lockfree/queue.hpp>
+#include <algorithm>
 #include <cassert> // numeric_limits
+#include <gobjfs_log.h>
 #include <limits>  // numeric_limits
+#include <map>
+#include <mutex>
 #include <sstream> // ostringstream
+#include <sys/mman.h>
+#include <unordered_map>
 #include <util/os_utils.h>
+#include <vector>
 
 namespace gobjfs {
 
@@ -78,6 +85,191 @@ std::string AlignedMempool::GetStats() const {
   return os.str();
 }
 
+// ==================================
+
+// arenas are reserved, not committed; pages are faulted in on use
+static constexpr size_t NodeArenaSize = 64 << 20;
+// a pool can grow to this many arenas, i.e. 64 GiB of buffers
+static constexpr size_t MaxNodeArenas = 1024;
+// one in so many allocations is checked for the node of its memory,
+// since asking the kernel costs a syscall
+static constexpr uint64_t CrossNodeSampleRate = 64;
+
+/**
+ * aligned buffers from memory of one NUMA node
+ * Buffers are carved out of anonymous arenas which are bound to the
+ * node once, when mapped.  Binding whole private mappings does not
+ * split them, and a buffer never shares a page with memory of another
+ * pool.  Freed buffers are kept for reuse by allocations of the same
+ * size; arenas are unmapped only when the pool is destroyed.
+ */
+class NodeMempool : public Mempool {
+private:
+  struct Arena {
+    char *base_{nullptr};
+    size_t size_{0};
+    size_t used_{0};
+  };
+
+  const size_t alignSize_;
+  const int32_t node_;
+  const size_t pageSize_;
+
+  mutable std::mutex mutex_;
+  // append-only; an arena is filled in before numArenas_ covers it,
+  // so that Owns can read the table without taking mutex_
+  Arena arenas_[MaxNodeArenas];
+  std::atomic<size_t> numArenas_{0};
+  // size of each buffer in use
+  std::unordered_map<void *, size_t> allocated_;
+  std::map<size_t, std::vector<void *>> freeBuffers_;
+
+  void *Carve(size_t size);
+
+public:
+  NodeMempool(size_t alignSize, int32_t node);
+
+  ~NodeMempool();
+
+  virtual void *Alloc(size_t size) override;
+
+  virtual void Free(void *ptr) override;
+
+  virtual bool Owns(const void *ptr) const override;
+
+  virtual size_t allocSize() override { return alignSize_; }
+
+  virtual std::string GetStats() const override;
+};
+
+NodeMempool::NodeMempool(size_t alignSize, int32_t node)
+    : alignSize_(alignSize), node_(node), pageSize_(sysconf(_SC_PAGESIZE)) {}
+
+NodeMempool::~NodeMempool() {
+  for (size_t idx = 0; idx < numArenas_; idx++) {
+    munmap(arenas_[idx].base_, arenas_[idx].size_);
+  }
+}
+
+// caller must hold mutex_
+void *NodeMempool::Carve(size_t size) {
+  const auto alignUp = [](size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+  };
+
+  const size_t numArenas = numArenas_.load(std::memory_order_relaxed);
+  if (numArenas) {
+    Arena &arena = arenas_[numArenas - 1];
+    const uintptr_t start = alignUp((uintptr_t)arena.base_ + arena.used_,
+                                    alignSize_);
+    if (start + size <= (uintptr_t)arena.base_ + arena.size_) {
+      arena.used_ = start + size - (uintptr_t)arena.base_;
+      return (void *)start;
+    }
+  }
+
+  if (numArenas == MaxNodeArenas) {
+    LOG(ERROR) << "no more arenas for node=" << node_;
+    return nullptr;
+  }
+  Arena &arena = arenas_[numArenas];
+  arena.size_ =
+      alignUp(std::max(NodeArenaSize, size + alignSize_), pageSize_);
+  void *addr = mmap(nullptr, arena.size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (addr == MAP_FAILED) {
+    LOG(ERROR) << "failed to map arena of size=" << arena.size_
+               << " for node=" << node_ << " errno=" << -errno;
+    return nullptr;
+  }
+  int32_t ret = gobjfs::os::BindMemoryToNode(addr, arena.size_, node_);
+  if (ret != 0) {
+    // pages land where they are first touched; seen in cross node stats
+    LOG(WARNING) << "failed to bind arena to node=" << node_
+                 << " errno=" << ret;
+  }
+  arena.base_ = (char *)addr;
+  const uintptr_t start = alignUp((uintptr_t)arena.base_, alignSize_);
+  arena.used_ = start + size - (uintptr_t)arena.base_;
+  numArenas_.store(numArenas + 1, std::memory_order_release);
+  return (void *)start;
+}
+
+void *NodeMempool::Alloc(size_t size) {
+  // rounded, so that a freed buffer fits any request of its size
+  const size_t bufferSize = (size + alignSize_ - 1) / alignSize_ * alignSize_;
+  void *buffer = nullptr;
+  {
+    std::unique_lock<std::mutex> lck(mutex_);
+    auto iter = freeBuffers_.find(bufferSize);
+    if ((iter != freeBuffers_.end()) && !iter->second.empty()) {
+      buffer = iter->second.back();
+      iter->second.pop_back();
+      stats_.numReused_++;
+    } else {
+      buffer = Carve(bufferSize);
+    }
+    if (buffer) {
+      allocated_[buffer] = bufferSize;
+    }
+  }
+
+  if (buffer == nullptr) {
+    stats_.numFailedAllocCalls_++;
+    return nullptr;
+  }
+  const uint64_t numAllocs = stats_.numAllocCalls_++;
+  stats_.bytesAllocated_ += size;
+
+  // the node is preferred, not required, so pages come from another
+  // node when it is out of memory.  Asking for the node faults in the
+  // first page, which stands for the buffer.  Only a sample is asked
+  if ((numAllocs % CrossNodeSampleRate) == 0) {
+    const int32_t actualNode = gobjfs::os::NumaNodeOfAddress(buffer);
+    if ((actualNode >= 0) && (actualNode != node_)) {
+      stats_.numCrossNodeAllocs_++;
+    }
+  }
+  return buffer;
+}
+
+void NodeMempool::Free(void *ptr) {
+  std::unique_lock<std::mutex> lck(mutex_);
+  auto iter = allocated_.find(ptr);
+  if (iter == allocated_.end()) {
+    LOG(ERROR) << "buffer=" << ptr << " not allocated from node=" << node_;
+    return;
+  }
+  freeBuffers_[iter->second].push_back(ptr);
+  allocated_.erase(iter);
+  stats_.numFreeCalls_++;
+}
+
+bool NodeMempool::Owns(const void *ptr) const {
+  // base_ and size_ of an arena do not change once it is published
+  const size_t numArenas = numArenas_.load(std::memory_order_acquire);
+  for (size_t idx = 0; idx < numArenas; idx++) {
+    const Arena &arena = arenas_[idx];
+    if ((ptr >= arena.base_) && (ptr < arena.base_ + arena.size_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string NodeMempool::GetStats() const {
+  std::ostringstream os;
+  os << "for nodemempool thisptr=" << (void *)this
+     << ":bytes alloc=" << stats_.bytesAllocated_
+     << ":num alloc=" << stats_.numAllocCalls_
+     << ":num failed=" << stats_.numFailedAllocCalls_
+     << ":num reused=" << stats_.numReused_
+     << ":num free=" << stats_.numFreeCalls_ << ":node=" << node_
+     << ":num cross node=" << stats_.numCrossNodeAllocs_
+     << ":cross node sample rate=" << CrossNodeSampleRate << std::endl;
+  return os.str();
+}
+
 // =======================
 
 class ObjectMempool : public Mempool {
@@ -128,7 +320,11 @@ public:
 // =================================
 // add std::forward args
 MempoolSPtr MempoolFactory::createAlignedMempool(const std::string &name,
-                                                 const size_t size) {
+                                                 const size_t size,
+                                                 int32_t node) {
+  if (node != gobjfs::os::NumaNodeInvalid) {
+    return std::make_shared<NodeMempool>(size, node);
+  }
   return std::make_shared<AlignedMempool>(size);
 }
 
@@ -22,6 +22,8 @@ but WITHOUT ANY WARRANTY of any kind.
 #include <memory> // shared_ptr
 #include <string>
 
+#include <util/os_utils.h>
+
 namespace gobjfs {
 
 class Mempool {
@@ -32,6 +34,8 @@ protected:
     std::atomic<uint64_t> numFailedAllocCalls_{0};
     std::atomic<uint64_t> numFreeCalls_{0};
     std::atomic<uint64_t> numReused_{0};
+    // sampled allocations found on another node than that of the pool
+    std::atomic<uint64_t> numCrossNodeAllocs_{0};
   } stats_;
 
 public:
@@ -39,6 +43,10 @@ public:
 
   virtual void Free(void *ptr) = 0;
 
+  // @return true if ptr is in memory which the pool manages itself,
+  //   rather than memory from the heap, which any pool can free
+  virtual bool Owns(const void *ptr) const { return false; }
+
   virtual std::string GetStats() const = 0;
 
   virtual size_t allocSize() = 0;
@@ -50,8 +58,11 @@ typedef std::shared_ptr<Mempool> MempoolSPtr;
 
 class MempoolFactory {
 public:
-  static MempoolSPtr createAlignedMempool(const std::string &name,
-                                          const size_t alignSize);
+  // @param node NUMA node from which memory is taken, if not
+  //   NumaNodeInvalid.  Such a pool keeps its memory until destroyed
+  static MempoolSPtr
+  createAlignedMempool(const std::string &name, const size_t alignSize,
+                       int32_t node = gobjfs::os::NumaNodeInvalid);
 
   static MempoolSPtr createObjectMempool(const std::string &name,
                                          const size_t objSize);
@@ -51,6 +51,9 @@ public:
   int64_t waitTime() const { return waitTime_; }
   int64_t serviceTime() const { return serviceTime_; }
 
+  // before the object is queued again
+  void resetTimes() { waitTime_ = serviceTime_ = 0; }
+
   void setSubmitTime() {
     timer_.reset();
     assert(waitTime_ == 0);
@@ -0,0 +1,354 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "ReadAhead.h"
+
+#include <FilerJob.h>
+#include <FilerJobPool.h>
+#include <IOExecutor.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <gobjfs_log.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/os_utils.h>
+
+namespace gobjfs {
+
+using gobjfs::os::DirectIOSize;
+using gobjfs::os::RoundToNext512;
+
+ReadAheadPool::ReadAheadPool(size_t windowSize, size_t maxBytes)
+    : windowSize_(RoundToNext512(windowSize)), maxBytes_(maxBytes) {}
+
+char *ReadAheadPool::allocBuffer(size_t size) {
+  size_t inUse = bytesInUse_.load();
+  do {
+    if (inUse + size > maxBytes_) {
+      numOverCap_++;
+      return nullptr;
+    }
+  } while (!bytesInUse_.compare_exchange_weak(inUse, inUse + size));
+
+  char *buffer = nullptr;
+  if (posix_memalign((void **)&buffer, DirectIOSize, size) != 0) {
+    bytesInUse_ -= size;
+    return nullptr;
+  }
+  return buffer;
+}
+
+void ReadAheadPool::freeBuffer(char *buffer, size_t size) {
+  free(buffer);
+  bytesInUse_ -= size;
+}
+
+std::string ReadAheadPool::getState() const {
+  std::ostringstream s;
+  // json format
+  s << "{\"windowSize\":" << windowSize_ << ",\"maxBytes\":" << maxBytes_
+    << ",\"bytesInUse\":" << bytesInUse_
+    << ",\"numPrefetches\":" << numPrefetches_
+    << ",\"prefetchBytes\":" << prefetchBytes_
+    << ",\"numFailed\":" << numFailed_ << ",\"numOverCap\":" << numOverCap_
+    << ",\"numHits\":" << numHits_ << ",\"numWaits\":" << numWaits_
+    << ",\"hitBytes\":" << hitBytes_ << ",\"wastedBytes\":" << wastedBytes_
+    << "}";
+  return s.str();
+}
+
+// =====================
+
+ReadAheadStream::ReadAheadStream(ReadAheadPool *pool, IOExecutor *executor)
+    : pool_(pool), executor_(executor) {}
+
+ReadAheadStream::~ReadAheadStream() {
+  // windows in flight hold a reference, so none are left
+  for (Window *window : windows_) {
+    assert(!window->inflight_);
+    freeWindow(window);
+  }
+  if (prefetchFd_ >= 0) {
+    ::close(prefetchFd_);
+  }
+}
+
+ReadAheadStream::Window *ReadAheadStream::findWindow(off_t offset,
+                                                     size_t size) const {
+  for (Window *window : windows_) {
+    if (window->covers(offset, size)) {
+      return window;
+    }
+  }
+  return nullptr;
+}
+
+bool ReadAheadStream::serve(FilerJob *job) {
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    Window *window = findWindow(job->offset_, job->userSize_);
+    if (!window) {
+      return false;
+    }
+    // counted, and cancellable, like a read sent to the device
+    if (executor_->registerServedJob(job) != 0) {
+      return false;
+    }
+    if (window->inflight_) {
+      window->waiters_.push_back(job);
+      return true;
+    }
+    if (!executor_->claimServedJob(job)) {
+      // already expired
+      return true;
+    }
+    memcpy(job->buffer_, window->buffer_ + (job->offset_ - window->offset_),
+           job->userSize_);
+    window->usedBytes_ += job->userSize_;
+  }
+  pool_->numHits_++;
+  pool_->hitBytes_ += job->userSize_;
+  // callback runs on completion thread, never inside the read call
+  executor_->completeServedJob(job, 0);
+  return true;
+}
+
+bool ReadAheadStream::addWindow(off_t offset, size_t size,
+                                std::vector<Window *> &toIssue) {
+  const size_t bufSize = RoundToNext512(size);
+  char *buffer = pool_->allocBuffer(bufSize);
+  if (!buffer) {
+    return false;
+  }
+  if (windows_.size() >= MaxWindows) {
+    dropWindow(windows_.front());
+  }
+
+  Window *window = new Window;
+  window->offset_ = offset;
+  window->size_ = size;
+  window->bufSize_ = bufSize;
+  window->buffer_ = buffer;
+  window->stream_ = shared_from_this();
+  windows_.push_back(window);
+  toIssue.push_back(window);
+  return true;
+}
+
+int32_t ReadAheadStream::fillRange(int fd, off_t start, off_t end,
+                                   size_t chunkSize,
+                                   std::vector<Window *> &toIssue) {
+  if (prefetchFd_ < 0) {
+    prefetchFd_ = ::dup(fd);
+    if (prefetchFd_ < 0) {
+      LOG(ERROR) << "failed to dup fd=" << fd << " errno=" << errno;
+      return -errno;
+    }
+  }
+
+  struct stat statBuf;
+  if (::fstat(prefetchFd_, &statBuf) != 0) {
+    LOG(ERROR) << "failed to stat fd=" << prefetchFd_ << " errno=" << errno;
+    return -errno;
+  }
+  end = std::min<off_t>(end, statBuf.st_size);
+
+  int32_t numAdded = 0;
+  start &= ~((off_t)DirectIOSize - 1);
+  while (start < end) {
+    const Window *held = findWindow(start, 1);
+    if (held) {
+      start = held->offset_ + held->size_;
+      continue;
+    }
+    // stop short of the next window, so windows do not overlap
+    off_t chunkEnd = std::min<off_t>(start + chunkSize, end);
+    for (Window *window : windows_) {
+      if ((window->offset_ > start) && (window->offset_ < chunkEnd)) {
+        chunkEnd = window->offset_;
+      }
+    }
+    if (!addWindow(start, chunkEnd - start, toIssue)) {
+      return numAdded ? numAdded : -ENOMEM;
+    }
+    numAdded++;
+    start = chunkEnd;
+  }
+  return numAdded;
+}
+
+void ReadAheadStream::onRead(int fd, off_t offset, size_t size,
+                             std::vector<Window *> &toIssue) {
+  std::lock_guard<std::mutex> lck(mutex_);
+
+  if (offset == nextOffset_) {
+    numSequential_ = std::min(numSequential_ + 1, SequentialThreshold);
+  } else {
+    numSequential_ = 0;
+  }
+  nextOffset_ = offset + size;
+
+  const size_t windowSize = pool_->windowSize();
+  if ((numSequential_ < SequentialThreshold) || (windowSize == 0) ||
+      disabled_) {
+    return;
+  }
+
+  // scan has moved past these windows
+  for (auto iter = windows_.begin(); iter != windows_.end();) {
+    Window *window = *iter++;
+    if (window->offset_ + (off_t)window->size_ <= offset) {
+      dropWindow(window);
+    }
+  }
+
+  fillRange(fd, nextOffset_, nextOffset_ + WindowsAhead * windowSize,
+            windowSize, toIssue);
+}
+
+int32_t ReadAheadStream::prefetch(int fd, off_t offset, size_t size,
+                                  std::vector<Window *> &toIssue) {
+  std::lock_guard<std::mutex> lck(mutex_);
+  if (disabled_) {
+    return -EOPNOTSUPP;
+  }
+
+  // without a window size, hint is read as one window
+  const size_t chunkSize = pool_->windowSize() ? pool_->windowSize() : size;
+  const off_t end = offset + std::min(size, MaxWindows * chunkSize);
+  const int32_t ret = fillRange(fd, offset, end, chunkSize, toIssue);
+  return std::min(ret, 0);
+}
+
+void ReadAheadStream::invalidate(off_t offset, size_t size) {
+  std::lock_guard<std::mutex> lck(mutex_);
+  for (auto iter = windows_.begin(); iter != windows_.end();) {
+    Window *window = *iter++;
+    const bool endsAfter = (window->offset_ + (off_t)window->size_ > offset);
+    const bool startsBefore = (window->offset_ < offset) ||
+                              ((size_t)(window->offset_ - offset) < size);
+    if (endsAfter && startsBefore) {
+      dropWindow(window);
+    }
+  }
+}
+
+void ReadAheadStream::disable() {
+  std::lock_guard<std::mutex> lck(mutex_);
+  disabled_ = true;
+  while (!windows_.empty()) {
+    dropWindow(windows_.front());
+  }
+}
+
+void ReadAheadStream::dropWindow(Window *window) {
+  windows_.remove(window);
+  if (window->inflight_) {
+    window->dropped_ = true;
+  } else {
+    freeWindow(window);
+  }
+}
+
+void ReadAheadStream::freeWindow(Window *window) {
+  if (window->usedBytes_ < window->size_) {
+    pool_->wastedBytes_ += window->size_ - window->usedBytes_;
+  }
+  pool_->freeBuffer(window->buffer_, window->bufSize_);
+  delete window;
+}
+
+void ReadAheadStream::issue(std::vector<Window *> &windows,
+                            uint32_t tenant) {
+  for (Window *window : windows) {
+    FilerJob *job = executor_->allocJob(prefetchFd_, FileOp::Read);
+    job->setBuffer(window->offset_, window->buffer_, window->size_);
+    job->priority_ = GIO_PRIO_BACKGROUND;
+    job->tenant_ = tenant;
+    job->completionCallback_ = &ReadAheadStream::prefetchDone;
+    job->callbackCtx_ = window;
+    job->canBeFreed_ = true; // free job after completion
+
+    pool_->numPrefetches_++;
+    pool_->prefetchBytes_ += window->size_;
+    int retcode = executor_->submitTask(job, /*blocking*/ false);
+    if (retcode != 0) {
+      FilerJobPool::release(job); // if not submitted
+      prefetchDone(0, retcode, window);
+    }
+  }
+  windows.clear();
+}
+
+void ReadAheadStream::prefetchDone(gCompletionID completionId, int retcode,
+                                   void *ctx) {
+  (void)completionId;
+  Window *window = static_cast<Window *>(ctx);
+  // stream may go away when window lets go of it
+  std::shared_ptr<ReadAheadStream> stream = std::move(window->stream_);
+  stream->finishWindow(window, retcode);
+}
+
+void ReadAheadStream::finishWindow(Window *window, int retcode) {
+  std::vector<FilerJob *> waiters;
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    window->inflight_ = false;
+    waiters.swap(window->waiters_);
+    if (retcode == 0) {
+      // reads parked before a write dropped the window were
+      // concurrent with it, so they can take this data
+      auto iter = std::remove_if(waiters.begin(), waiters.end(),
+                                 [this](FilerJob *job) {
+                                   // cancelled or expired while parked
+                                   return !executor_->claimServedJob(job);
+                                 });
+      waiters.erase(iter, waiters.end());
+      for (FilerJob *job : waiters) {
+        memcpy(job->buffer_,
+               window->buffer_ + (job->offset_ - window->offset_),
+               job->userSize_);
+        window->usedBytes_ += job->userSize_;
+        pool_->hitBytes_ += job->userSize_;
+      }
+      pool_->numWaits_ += waiters.size();
+    } else {
+      pool_->numFailed_++;
+    }
+    if (window->dropped_) {
+      freeWindow(window);
+    } else if (retcode != 0) {
+      dropWindow(window);
+    }
+  }
+
+  for (FilerJob *job : waiters) {
+    if (retcode == 0) {
+      executor_->completeServedJob(job, 0);
+    } else {
+      // read it from the device after all
+      executor_->requeueServedJob(job);
+    }
+  }
+}
+}
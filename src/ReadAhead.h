@@ -0,0 +1,209 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include <gcommon.h>
+#include <util/lang_utils.h>
+
+namespace gobjfs {
+
+class FilerJob;
+class IOExecutor;
+
+/**
+ * memory cap and stats shared by the read-ahead streams of a service
+ */
+class ReadAheadPool {
+public:
+  /**
+   * @param windowSize bytes prefetched at a time once a stream turns
+   *   sequential; zero leaves only explicit prefetch hints
+   * @param maxBytes cap on prefetched data held by all streams
+   */
+  ReadAheadPool(size_t windowSize, size_t maxBytes);
+
+  GOBJFS_DISALLOW_COPY(ReadAheadPool);
+  GOBJFS_DISALLOW_MOVE(ReadAheadPool);
+
+  size_t windowSize() const { return windowSize_; }
+  size_t maxBytes() const { return maxBytes_; }
+
+  // @return DirectIOSize aligned buffer, nullptr if cap is reached
+  char *allocBuffer(size_t size);
+
+  void freeBuffer(char *buffer, size_t size);
+
+  std::string getState() const;
+
+  std::atomic<uint64_t> numPrefetches_{0};
+  std::atomic<uint64_t> prefetchBytes_{0};
+  // io error, or prefetch could not be submitted
+  std::atomic<uint64_t> numFailed_{0};
+  // windows not prefetched because cap was reached
+  std::atomic<uint64_t> numOverCap_{0};
+  // reads copied from a window which had arrived
+  std::atomic<uint64_t> numHits_{0};
+  // reads completed when the window they waited on arrived
+  std::atomic<uint64_t> numWaits_{0};
+  std::atomic<uint64_t> hitBytes_{0};
+  // prefetched bytes which no read was served from
+  std::atomic<uint64_t> wastedBytes_{0};
+
+private:
+  const size_t windowSize_;
+  const size_t maxBytes_;
+  std::atomic<size_t> bytesInUse_{0};
+};
+
+/**
+ * read-ahead state of one file handle.  After a few reads in a row
+ * which start where the previous one ended, windows past the last
+ * read are prefetched at background priority.  A read inside a
+ * window is copied from it, or completes when the window arrives if
+ * it is still being read.
+ *
+ * Prefetches use a dup of the handle's fd, which stays open until
+ * the last of them is done, so the handle can be closed any time.
+ * A write through the handle turns read-ahead off for good, since
+ * a window read while the write is in flight could be stale.
+ * Writes through other handles are not seen.
+ */
+class ReadAheadStream
+    : public std::enable_shared_from_this<ReadAheadStream> {
+public:
+  // reads in a row after which a stream is sequential
+  static constexpr uint32_t SequentialThreshold = 2;
+  // windows kept ahead of a sequential reader
+  static constexpr uint32_t WindowsAhead = 2;
+  // oldest window is dropped to make room for a new one
+  static constexpr size_t MaxWindows = 8;
+
+  struct Window {
+    off_t offset_{0};
+    size_t size_{0};    // bytes of file covered
+    size_t bufSize_{0}; // size_ rounded up for O_DIRECT
+    char *buffer_{nullptr};
+    bool inflight_{true};
+    // dropped while in flight; freed when its io is done
+    bool dropped_{false};
+    size_t usedBytes_{0};
+    // reads waiting for the window to arrive
+    std::vector<FilerJob *> waiters_;
+    // keeps stream alive while io is in flight
+    std::shared_ptr<ReadAheadStream> stream_;
+
+    bool covers(off_t offset, size_t size) const {
+      return (offset >= offset_) &&
+             (offset + (off_t)size <= offset_ + (off_t)size_);
+    }
+  };
+
+  /**
+   * @param executor which reads the windows; it must serve the
+   *   handle, since reads waiting on a window are resubmitted to it
+   */
+  ReadAheadStream(ReadAheadPool *pool, IOExecutor *executor);
+
+  ~ReadAheadStream();
+
+  GOBJFS_DISALLOW_COPY(ReadAheadStream);
+  GOBJFS_DISALLOW_MOVE(ReadAheadStream);
+
+  /**
+   * complete a read job from a window, or park it on a window in
+   * flight.  Job must have been allocated for a batch fragment.
+   * Either way it is registered with the executor, whose completion
+   * thread sends its completion
+   * @return false if job has to be submitted as usual
+   */
+  bool serve(FilerJob *job);
+
+  /**
+   * note a read, and prefetch further if stream is sequential
+   * @param fd of the handle
+   * @param toIssue gets windows to be read with issue()
+   */
+  void onRead(int fd, off_t offset, size_t size,
+              std::vector<Window *> &toIssue);
+
+  /**
+   * prefetch the part of a range not already held
+   * @param toIssue gets windows to be read with issue()
+   * @return 0, else -ENOMEM if cap was reached before any window,
+   *   -EOPNOTSUPP if disabled, or errno of dup or fstat
+   */
+  int32_t prefetch(int fd, off_t offset, size_t size,
+                   std::vector<Window *> &toIssue);
+
+  // drop windows overlapping range, such as one cut by truncate
+  void invalidate(off_t offset, size_t size);
+
+  // drop all windows and prefetch no more
+  void disable();
+
+  bool isDisabled() const { return disabled_; }
+
+  /**
+   * submit reads of windows returned by onRead or prefetch
+   * call without holding locks, since a failed window completes
+   * the reads parked on it right away
+   * @param tenant whose limits apply to the prefetch
+   */
+  void issue(std::vector<Window *> &windows, uint32_t tenant);
+
+  // completion callback of prefetch jobs, with Window as ctx
+  static void prefetchDone(gCompletionID completionId, int retcode,
+                           void *ctx);
+
+private:
+  // caller must hold mutex_
+  Window *findWindow(off_t offset, size_t size) const;
+  // @return false if cap was reached
+  bool addWindow(off_t offset, size_t size, std::vector<Window *> &toIssue);
+  // prefetch [start, end) in windows of chunkSize, skipping held parts
+  // @return number of windows added, else negative errno if a window
+  //   was needed and none could be added
+  int32_t fillRange(int fd, off_t start, off_t end, size_t chunkSize,
+                   std::vector<Window *> &toIssue);
+  void dropWindow(Window *window);
+  void freeWindow(Window *window);
+  void finishWindow(Window *window, int retcode);
+
+  ReadAheadPool *pool_;
+  IOExecutor *executor_;
+
+  std::mutex mutex_;
+  std::list<Window *> windows_;
+  // end of last read; -1 before first read
+  off_t nextOffset_{-1};
+  uint32_t numSequential_{0};
+  int prefetchFd_{-1};
+  std::atomic<bool> disabled_{false};
+};
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "TenantQos.h"
+
+#include <algorithm>
+#include <gobjfs_log.h>
+#include <sstream>
+
+namespace gobjfs {
+
+void TenantQos::TokenBucket::setRate(uint64_t perSec, uint32_t burstMsec) {
+  tokensPerUsec_ = (double)perSec / 1000000;
+  capacity_ = tokensPerUsec_ * burstMsec * 1000;
+  // debt is kept, unused tokens beyond the new burst are not
+  tokens_ = std::min(tokens_, capacity_);
+}
+
+void TenantQos::TokenBucket::refill(int64_t elapsedUsec) {
+  tokens_ = std::min(tokens_ + tokensPerUsec_ * elapsedUsec, capacity_);
+}
+
+int64_t TenantQos::TokenBucket::waitUsec() const {
+  if ((tokensPerUsec_ == 0) || (tokens_ >= 0)) {
+    return 0;
+  }
+  // round up, so that the bucket is out of debt by then
+  return (int64_t)(-tokens_ / tokensPerUsec_) + 1;
+}
+
+int32_t TenantQos::setLimit(uint32_t tenant, uint64_t iops,
+                            uint64_t bytesPerSec, uint32_t burstMsec) {
+  std::unique_lock<std::mutex> lck(mutex_);
+
+  if ((iops == 0) && (bytesPerSec == 0)) {
+    tenants_.erase(tenant);
+  } else {
+    auto iter = tenants_.find(tenant);
+    const bool isNew = (iter == tenants_.end());
+    Tenant &t = tenants_[tenant];
+    t.iops_.setRate(iops, burstMsec);
+    t.bytes_.setRate(bytesPerSec, burstMsec);
+    if (isNew) {
+      // new tenant can burst right away
+      t.iops_.tokens_ = t.iops_.capacity_;
+      t.bytes_.tokens_ = t.bytes_.capacity_;
+      t.lastRefill_ = Clock::now();
+    }
+  }
+  numTenants_ = tenants_.size();
+
+  LOG(INFO) << "tenant=" << tenant << " limits set to iops=" << iops
+            << ":bytesPerSec=" << bytesPerSec << ":burstMsec=" << burstMsec;
+  return 0;
+}
+
+bool TenantQos::isLimited(uint32_t tenant) const {
+  if (numTenants_ == 0) {
+    return false;
+  }
+  std::unique_lock<std::mutex> lck(mutex_);
+  return (tenants_.find(tenant) != tenants_.end());
+}
+
+int64_t TenantQos::admit(uint32_t tenant, size_t bytes,
+                         Clock::time_point now) {
+  if (numTenants_ == 0) {
+    return 0;
+  }
+
+  std::unique_lock<std::mutex> lck(mutex_);
+
+  auto iter = tenants_.find(tenant);
+  if (iter == tenants_.end()) {
+    return 0;
+  }
+  Tenant &t = iter->second;
+
+  if (now > t.lastRefill_) {
+    const int64_t elapsedUsec =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            now - t.lastRefill_).count();
+    t.iops_.refill(elapsedUsec);
+    t.bytes_.refill(elapsedUsec);
+    t.lastRefill_ += std::chrono::microseconds(elapsedUsec);
+  }
+
+  const int64_t waitUsec = std::max(t.iops_.waitUsec(), t.bytes_.waitUsec());
+  if (waitUsec) {
+    return waitUsec;
+  }
+
+  if (t.iops_.tokensPerUsec_ != 0) {
+    t.iops_.tokens_ -= 1;
+  }
+  if (t.bytes_.tokensPerUsec_ != 0) {
+    t.bytes_.tokens_ -= bytes;
+  }
+  t.numAdmitted_++;
+  t.bytesAdmitted_ += bytes;
+  return 0;
+}
+
+void TenantQos::recordDelay(uint32_t tenant, int64_t delayUsec) {
+  std::unique_lock<std::mutex> lck(mutex_);
+
+  auto iter = tenants_.find(tenant);
+  if (iter != tenants_.end()) {
+    iter->second.numDelayed_++;
+    iter->second.delayUsec_ = delayUsec;
+  }
+}
+
+std::string TenantQos::getState() const {
+  std::unique_lock<std::mutex> lck(mutex_);
+
+  std::ostringstream s;
+  // json format
+  s << "{\"tenants\":[";
+  bool first = true;
+  for (auto &elem : tenants_) {
+    const Tenant &t = elem.second;
+    s << (first ? "" : ",") << "{\"tenant\":" << elem.first
+      << ",\"iopsLimit\":" << (uint64_t)(t.iops_.tokensPerUsec_ * 1000000)
+      << ",\"bytesPerSecLimit\":"
+      << (uint64_t)(t.bytes_.tokensPerUsec_ * 1000000)
+      << ",\"numAdmitted\":" << t.numAdmitted_
+      << ",\"bytesAdmitted\":" << t.bytesAdmitted_
+      << ",\"numDelayed\":" << t.numDelayed_
+      << ",\"delayUsec\":" << t.delayUsec_ << "}";
+    first = false;
+  }
+  s << "]}";
+  return s.str();
+}
+}
@@ -0,0 +1,104 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <util/Stats.h>
+
+namespace gobjfs {
+
+/**
+ * Per-tenant limits on IOPS and bandwidth, shared by all IOExecutors
+ * of a service.  Each limited tenant has a token bucket for requests
+ * and one for bytes, refilled at the configured rate and holding at
+ * most burstMsec worth of tokens, which an idle tenant can later use
+ * as a burst.
+ *
+ * A request is admitted as long as neither bucket is in debt, and
+ * then charged in full.  This lets a request larger than the burst
+ * through, and delays the next one until the debt is repaid.
+ * Tenants without limits are always admitted.
+ */
+class TenantQos {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * set, change or remove limits of tenant at runtime
+   * @param iops requests per second, zero means unlimited
+   * @param bytesPerSec zero means unlimited
+   * @param burstMsec tokens which can accumulate, in msec of rate
+   * @return 0 on success, else negative errno
+   */
+  int32_t setLimit(uint32_t tenant, uint64_t iops, uint64_t bytesPerSec,
+                   uint32_t burstMsec);
+
+  bool isLimited(uint32_t tenant) const;
+
+  /**
+   * charge a request to the tenant if it is within limits
+   * @return 0 if admitted, else usec after which it may be admitted
+   */
+  int64_t admit(uint32_t tenant, size_t bytes, Clock::time_point now);
+
+  int64_t admit(uint32_t tenant, size_t bytes) {
+    return admit(tenant, bytes, Clock::now());
+  }
+
+  // record how long a request waited before it was admitted
+  void recordDelay(uint32_t tenant, int64_t delayUsec);
+
+  std::string getState() const;
+
+private:
+  struct TokenBucket {
+    double tokensPerUsec_{0}; // zero means unlimited
+    double capacity_{0};
+    double tokens_{0};
+
+    void setRate(uint64_t perSec, uint32_t burstMsec);
+    void refill(int64_t elapsedUsec);
+    // @return usec until bucket is out of debt
+    int64_t waitUsec() const;
+  };
+
+  struct Tenant {
+    TokenBucket iops_;
+    TokenBucket bytes_;
+    Clock::time_point lastRefill_;
+
+    uint64_t numAdmitted_{0};
+    uint64_t bytesAdmitted_{0};
+    uint64_t numDelayed_{0};
+    gobjfs::stats::StatsCounter<int64_t> delayUsec_;
+  };
+
+  mutable std::mutex mutex_;
+  std::unordered_map<uint32_t, Tenant> tenants_;
+  // avoids the mutex when no tenant is limited
+  std::atomic<uint32_t> numTenants_{0};
+};
+}
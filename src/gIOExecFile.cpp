@@ -16,27 +16,39 @@ Open vStorage is distributed in the hope that it will be useful,
 but WITHOUT ANY WARRANTY of any kind.
 */
 
+#include <BufferRegistry.h>
+#include <CompletionRing.h>
+#include <FdCache.h>
 #include <FilerJob.h>
+#include <FilerJobPool.h>
 #include <IOExecutor.h>
 #include <Mempool.h>
+#include <ReadAhead.h>
 #include <gIOExecFile.h>
 #include <gMempool.h>
 #include <gobjfs_log.h>
 #include <util/os_utils.h>
 #include <gparse.h>
 
+#include <algorithm>
+#include <fstream>
 #include <mutex>
 #include <fcntl.h>
 #include <linux/limits.h> // PATH_MAX
+#include <sys/eventfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <boost/version.hpp>
 #include <iomanip>
+#include <vector>
 
+using gobjfs::CompletionRing;
 using gobjfs::IOExecutor;
 using gobjfs::FilerJob;
+using gobjfs::FilerJobPool;
 using gobjfs::FileOp;
 using gobjfs::os::IsDirectIOAligned;
+using gobjfs::os::RoundToNext512;
 
 
 std::string string_to_hex(const std::string& in) {
@@ -69,6 +81,8 @@ gIOBatch *gIOBatchAlloc(size_t count) {
   ptr = (gIOBatch *)malloc(allocSize);
 
   ptr->count = count;
+  ptr->priority = GIO_PRIO_FOREGROUND;
+  ptr->tenant = 0;
 
   for (size_t idx = 0; idx < ptr->count; idx++) {
     gIOExecFragment &frag = ptr->array[idx];
@@ -76,6 +90,9 @@ gIOBatch *gIOBatchAlloc(size_t count) {
     frag.size = 0;
     frag.addr = nullptr;
     frag.completionId = 0;
+    frag.timeoutMsec = 0;
+    frag.bufIndex = 0;
+    frag.bufOffset = 0;
   }
 
   return ptr;
@@ -92,7 +109,10 @@ void gIOBatchFree(gIOBatch *ptr) {
     assert(IsDirectIOAligned(frag.offset));
     assert(frag.completionId != 0);
 
-    gMempool_free(frag.addr);
+    // registered regions belong to the service
+    if (frag.bufIndex == 0) {
+      gMempool_free(frag.addr);
+    }
   }
   // only if ptr fits the objpool allocSize
   // objpool->Free(ptr);
@@ -103,7 +123,11 @@ void gIOBatchFree(gIOBatch *ptr) {
 
 gIOStatusBatch *gIOStatusBatchAlloc(size_t count) {
   const size_t allocSize = sizeof(gIOStatusBatch) + (count * sizeof(gIOStatus));
-  return (gIOStatusBatch *)malloc(allocSize);
+  gIOStatusBatch *ptr = (gIOStatusBatch *)malloc(allocSize);
+  if (ptr) {
+    ptr->count = count;
+  }
+  return ptr;
 }
 
 void gIOStatusBatchFree(gIOStatusBatch *ptr) { free(ptr); }
@@ -113,6 +137,12 @@ void gIOStatusBatchFree(gIOStatusBatch *ptr) { free(ptr); }
 /* internal representation of ServiceHandle */
 struct IOExecServiceInt {
   IOExecutor::Config ioConfig;
+  // declared before ioexecVec, which uses them until destroyed
+  std::unique_ptr<gobjfs::FdCache> fdCache;
+  std::unique_ptr<gobjfs::ReadAheadPool> readAheadPool;
+  gobjfs::BufferRegistry bufferRegistry;
+  // regions are registered with executors in index order
+  std::mutex bufferMutex;
   std::vector<std::shared_ptr<IOExecutor>> ioexecVec;
 
   FileTranslatorFunc fileTranslatorFunc;
@@ -120,6 +150,17 @@ struct IOExecServiceInt {
   gobjfs::stats::StatsCounter<int64_t> fileTranslatorStats_;
   gobjfs::stats::Histogram<int64_t> fileTranslatorHist_;
 
+  gobjfs::TenantQos tenantQos;
+
+  // signalled when io refused with -EAGAIN can be retried
+  int spaceAvailableFd{gobjfs::os::FD_INVALID};
+
+  ~IOExecServiceInt() {
+    if (spaceAvailableFd != gobjfs::os::FD_INVALID) {
+      close(spaceAvailableFd);
+    }
+  }
+
   // could use std::forward
   int callTranslator(const char *old_name, size_t len, char *new_name) {
     gobjfs::stats::Timer timer(true);
@@ -150,6 +191,42 @@ struct IOExecServiceInt {
     return s.str();
   }
 
+  std::string getFdCacheStats() const {
+
+    std::ostringstream s;
+
+    s << " fdCache=" << fdCache->getState() << std::endl;
+
+    return s.str();
+  }
+
+  std::string getReadAheadStats() const {
+
+    std::ostringstream s;
+
+    s << " readAhead=" << readAheadPool->getState() << std::endl;
+
+    return s.str();
+  }
+
+  std::string getBufferStats() const {
+
+    std::ostringstream s;
+
+    s << " bufferRegions=" << bufferRegistry.getState() << std::endl;
+
+    return s.str();
+  }
+
+  std::string getTenantQosStats() const {
+
+    std::ostringstream s;
+
+    s << " tenantQos=" << tenantQos.getState() << std::endl;
+
+    return s.str();
+  }
+
   int32_t getSlot(const char *fileName) {
     static std::hash<std::string> hasher;
     auto slot = hasher(fileName) % ioexecVec.size();
@@ -163,11 +240,69 @@ int32_t IOExecGetNumExecutors(IOExecServiceHandle serviceHandle) {
   return serviceHandle->ioexecVec.size();
 }
 
+int32_t IOExecGetNumThreads(IOExecServiceHandle serviceHandle) {
+  int32_t numThreads = 0;
+  for (auto &elem : serviceHandle->ioexecVec) {
+    numThreads += elem->getNumThreads();
+  }
+  return numThreads;
+}
+
+int32_t IOExecSetTenantLimit(IOExecServiceHandle serviceHandle,
+                             uint32_t tenant, uint64_t iops,
+                             uint64_t bytesPerSec, uint32_t burstMsec) {
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+  return serviceHandle->tenantQos.setLimit(tenant, iops, bytesPerSec,
+                                           burstMsec);
+}
+
+int32_t IOExecRegisterBuffer(IOExecServiceHandle serviceHandle, size_t size,
+                             void **addr) {
+  if (!serviceHandle || !serviceHandle->isValid() || !addr) {
+    LOG(ERROR) << "service handle or addr is invalid";
+    return -EINVAL;
+  }
+
+  std::unique_lock<std::mutex> lck(serviceHandle->bufferMutex);
+
+  const int32_t bufIndex = serviceHandle->bufferRegistry.add(size);
+  if (bufIndex < 0) {
+    return bufIndex;
+  }
+  auto region = serviceHandle->bufferRegistry.get(bufIndex);
+
+  int32_t numFixed = 0;
+  for (auto &elem : serviceHandle->ioexecVec) {
+    numFixed += elem->registerBuffer(bufIndex - 1, region->addr_,
+                                     region->size_);
+  }
+  LOG(INFO) << "buffer region=" << bufIndex << " pinned by " << numFixed
+            << " io contexts";
+
+  *addr = region->addr_;
+  return bufIndex;
+}
+
+int IOExecGetSpaceAvailableFd(IOExecServiceHandle serviceHandle) {
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+  return serviceHandle->spaceAvailableFd;
+}
+
 int32_t IOExecGetStats(IOExecServiceHandle serviceHandle, char *buf,
                        int32_t len) {
   decltype(len) curOffset = 0;
 
-  auto str = serviceHandle->getFileTranslatorStats();
+  auto str = serviceHandle->getFileTranslatorStats() +
+             serviceHandle->getFdCacheStats() +
+             serviceHandle->getReadAheadStats() +
+             serviceHandle->getBufferStats() +
+             serviceHandle->getTenantQosStats();
   uint32_t copyLen = str.size();
   if ((ssize_t)str.size() >= len - curOffset) {
     // truncate the string to be copied
@@ -182,8 +317,8 @@ int32_t IOExecGetStats(IOExecServiceHandle serviceHandle, char *buf,
       auto str = elem->getState();
       uint32_t copyLen = str.size();
       if ((ssize_t)str.size() >= len - curOffset) {
-        // truncate the string to be copied
-        copyLen = len;
+        // truncate the string to what is left of buffer
+        copyLen = len - curOffset;
       }
       strncpy(buf + curOffset, str.c_str(), copyLen);
       curOffset += copyLen;
@@ -197,10 +332,63 @@ int32_t IOExecGetStats(IOExecServiceHandle serviceHandle, char *buf,
   return curOffset;
 }
 
+int32_t IOExecSetTraceSampleRate(IOExecServiceHandle serviceHandle,
+                                 uint32_t sampleRate) {
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+  for (auto &elem : serviceHandle->ioexecVec) {
+    elem->setTraceSampleRate(sampleRate);
+  }
+  return 0;
+}
+
+int32_t IOExecDumpTrace(IOExecServiceHandle serviceHandle,
+                        const char *fileName) {
+  if (!serviceHandle || !serviceHandle->isValid() || !fileName) {
+    LOG(ERROR) << "service handle or file name is invalid";
+    return -EINVAL;
+  }
+
+  std::ofstream ofs(fileName, std::ios::out | std::ios::trunc);
+  if (!ofs) {
+    LOG(ERROR) << "failed to open trace file=" << fileName;
+    return -EIO;
+  }
+
+  size_t numTraced = 0;
+  ofs << "{\"traceEvents\":[";
+  for (size_t idx = 0; idx < serviceHandle->ioexecVec.size(); idx++) {
+    ofs << ((idx == 0) ? "" : ",");
+    numTraced += serviceHandle->ioexecVec[idx]->getTraceEvents(ofs);
+  }
+  ofs << "]}" << std::endl;
+
+  if (!ofs) {
+    LOG(ERROR) << "failed to write trace file=" << fileName;
+    return -EIO;
+  }
+  return numTraced;
+}
+
 static int32_t doCommonInit(IOExecServiceHandle handle) {
   int32_t ret = 0;
 
   do {
+    handle->fdCache.reset(new gobjfs::FdCache(
+        handle->ioConfig.fdCacheSize_, O_DIRECT | O_RDONLY));
+    handle->readAheadPool.reset(
+        new gobjfs::ReadAheadPool(handle->ioConfig.readAheadWindow_,
+                                  handle->ioConfig.readAheadMaxBytes_));
+
+    handle->spaceAvailableFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (handle->spaceAvailableFd < 0) {
+      ret = -errno;
+      LOG(ERROR) << "failed to create space eventfd errno=" << errno;
+      break;
+    }
+
     if (handle->ioConfig.cpuCores_.size()) {
       for (auto &elem : handle->ioConfig.cpuCores_) {
         const std::string name = "ioexecfile" + std::to_string(elem);
@@ -218,6 +406,23 @@ static int32_t doCommonInit(IOExecServiceHandle handle) {
     } else {
       ret = -EINVAL;
     }
+
+    if (ret == 0) {
+      std::vector<IOExecutor *> siblings;
+      for (auto &elem : handle->ioexecVec) {
+        siblings.push_back(elem.get());
+      }
+      for (auto &elem : handle->ioexecVec) {
+        elem->setSiblings(siblings);
+        elem->setTenantQos(&handle->tenantQos);
+        elem->setFdCache(handle->fdCache.get());
+        elem->setFileTranslator(
+            [handle](const char *oldName, size_t len, char *newName) {
+              return handle->callTranslator(oldName, len, newName);
+            });
+        elem->setSpaceAvailableFd(handle->spaceAvailableFd);
+      }
+    }
   } while (0);
 
   // google::FlushLogFiles(0); TODO logging
@@ -313,7 +518,14 @@ int32_t IOExecFileServiceDestroy(IOExecServiceHandle serviceHandle) {
 
 /* internal representation of EventFdHandle */
 struct IOExecEventFdInt {
+  // pipe on which each completion is written
   int fd[2]{-1, -1};
+  // or ring to which completions are posted; refcounted since
+  // pending jobs may post to it after the handle is closed
+  CompletionRing *ring{nullptr};
+  // or function called on completion
+  gIOCompletionCallback callback{nullptr};
+  void *callbackCtx{nullptr};
 
   IOExecEventFdInt(int in_fd[]) {
     fd[0] = in_fd[0];
@@ -322,9 +534,35 @@ struct IOExecEventFdInt {
     assert(fd[1] >= 0);
   }
 
+  IOExecEventFdInt(std::unique_ptr<CompletionRing> in_ring)
+      : ring(in_ring.release()) {
+    assert(ring);
+  }
+
+  IOExecEventFdInt(gIOCompletionCallback in_callback, void *in_ctx)
+      : callback(in_callback), callbackCtx(in_ctx) {
+    assert(callback);
+  }
+
   ~IOExecEventFdInt() {
-    close(fd[0]);
-    close(fd[1]);
+    if (ring) {
+      ring->close();
+    }
+    if (fd[0] != gobjfs::os::FD_INVALID) {
+      close(fd[0]);
+      close(fd[1]);
+    }
+  }
+
+  bool isValid() const {
+    return ring || callback || (fd[1] != gobjfs::os::FD_INVALID);
+  }
+
+  void setCompletion(FilerJob *job) {
+    job->completionFd_ = fd[1];
+    job->setCompletionRing(ring);
+    job->completionCallback_ = callback;
+    job->callbackCtx_ = callbackCtx;
   }
 };
 
@@ -361,6 +599,42 @@ IOExecEventFdHandle IOExecEventFdOpen(IOExecServiceHandle serviceHandle) {
   return eventFdPtr;
 }
 
+IOExecEventFdHandle IOExecEventFdOpenRing(IOExecServiceHandle serviceHandle,
+                                          size_t numEntries) {
+
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return nullptr;
+  }
+
+  std::unique_ptr<CompletionRing> ring(new CompletionRing);
+  int retcode = ring->init(numEntries);
+  if (retcode != 0) {
+    return nullptr;
+  }
+
+  LOG(INFO) << " created completion ring of size=" << ring->capacity()
+            << ":readFd=" << ring->getReadFd();
+  return new IOExecEventFdInt(std::move(ring));
+}
+
+IOExecEventFdHandle
+IOExecEventFdOpenCallback(IOExecServiceHandle serviceHandle,
+                          gIOCompletionCallback callback, void *ctx) {
+
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return nullptr;
+  }
+
+  if (!callback) {
+    LOG(ERROR) << "Rejecting null completion callback";
+    return nullptr;
+  }
+
+  return new IOExecEventFdInt(callback, ctx);
+}
+
 int32_t IOExecEventFdClose(IOExecEventFdHandle eventFdPtr) {
   delete eventFdPtr;
   return 0;
@@ -371,20 +645,62 @@ int IOExecEventFdGetReadFd(IOExecEventFdHandle eventFdPtr) {
     LOG(ERROR) << "Rejecting GetReadFd attempt with null eventHandle";
     return gobjfs::os::FD_INVALID;
   }
+  if (eventFdPtr->ring) {
+    return eventFdPtr->ring->getReadFd();
+  }
   return eventFdPtr->fd[0];
 }
 
+int32_t IOExecEventFdReap(IOExecEventFdHandle eventFdPtr,
+                          gIOStatusBatch *statusBatch, size_t maxCount) {
+  if (!eventFdPtr || eventFdPtr->callback || !eventFdPtr->isValid() ||
+      !statusBatch || (maxCount == 0)) {
+    LOG(ERROR) << "Rejecting reap with invalid args";
+    return -EINVAL;
+  }
+
+  size_t count = 0;
+  if (eventFdPtr->ring) {
+    count = eventFdPtr->ring->reap(statusBatch->array, maxCount);
+  } else {
+    // writes of one gIOStatus to a pipe are atomic, so a read
+    // returns whole statuses
+    ssize_t ret = 0;
+    do {
+      ret = read(eventFdPtr->fd[0], statusBatch->array,
+                 maxCount * sizeof(gIOStatus));
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0) {
+      ret = -errno;
+      LOG(ERROR) << "failed to read pipe=" << eventFdPtr->fd[0]
+                 << " errno=" << ret;
+      return ret;
+    }
+    count = ret / sizeof(gIOStatus);
+  }
+
+  statusBatch->count = count;
+  return count;
+}
+
 // =======================================================
 
+static constexpr mode_t FileOpenMode =
+    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+
 /* internal representation of FileHandle */
 struct IOExecFileInt {
   IOExecServiceHandle serviceHandle;
+  // FD_INVALID until async open succeeds
   int fd{gobjfs::os::FD_INVALID};
   CoreId core{CoreIdInvalid};
+  // set if reads through handle can be prefetched
+  std::shared_ptr<gobjfs::ReadAheadStream> readAhead;
 
   IOExecFileInt(IOExecServiceHandle serviceHandle, int fd, CoreId core)
       : serviceHandle(serviceHandle), fd(fd), core(core) {
-    assert(fd >= 0);
+    assert((fd >= 0) || (fd == gobjfs::os::FD_INVALID));
   }
 
   ~IOExecFileInt() {
@@ -397,6 +713,17 @@ struct IOExecFileInt {
   }
 };
 
+// O_DIRECT reads miss the page cache, and its read-ahead with it
+static void enableReadAhead(IOExecFileHandle fileHandle, int32_t flags) {
+  IOExecServiceHandle serviceHandle = fileHandle->serviceHandle;
+  if (serviceHandle->readAheadPool->maxBytes() && (flags & O_DIRECT) &&
+      ((flags & O_ACCMODE) != O_WRONLY)) {
+    fileHandle->readAhead = std::make_shared<gobjfs::ReadAheadStream>(
+        serviceHandle->readAheadPool.get(),
+        serviceHandle->ioexecVec[fileHandle->core].get());
+  }
+}
+
 IOExecFileHandle IOExecFileOpen(IOExecServiceHandle serviceHandle,
                                 const char *fileName, size_t fileNameLength,
                                 int32_t flags) {
@@ -422,7 +749,7 @@ IOExecFileHandle IOExecFileOpen(IOExecServiceHandle serviceHandle,
   // user must add O_DIRECT for aligned IO
   int newFlags = flags;
 
-  int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+  int mode = FileOpenMode;
 
   int fd = open(absFileName, newFlags, mode);
 
@@ -433,15 +760,114 @@ IOExecFileHandle IOExecFileOpen(IOExecServiceHandle serviceHandle,
   } else {
     CoreId core = serviceHandle->getSlot(fileName);
     newHandle = new IOExecFileInt(serviceHandle, fd, core);
+    enableReadAhead(newHandle, flags);
   }
   return newHandle;
 }
 
+int32_t IOExecFileOpenAsync(IOExecServiceHandle serviceHandle,
+                            const char *fileName, size_t fileNameLength,
+                            int32_t flags, gCompletionID completionId,
+                            IOExecEventFdHandle eventFdHandle,
+                            IOExecFileHandle *fileHandle) {
+
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
+    LOG(ERROR) << "Rejecting open with invalid eventfd";
+    return -EINVAL;
+  }
+
+  if (!fileHandle) {
+    LOG(ERROR) << "Rejecting open with null file handle";
+    return -EINVAL;
+  }
+
+  // same executor as IOExecFileOpen would pick
+  CoreId core = serviceHandle->getSlot(fileName);
+  auto &ioexecPtr = serviceHandle->ioexecVec[core];
+  auto job = ioexecPtr->allocJob(fileName, fileNameLength, FileOp::Open);
+  if (job == nullptr) {
+    return -ENOMEM;
+  }
+
+  // handle is given out before submit, since completion may arrive
+  // on another thread before submitTask returns
+  auto newHandle =
+      new IOExecFileInt(serviceHandle, gobjfs::os::FD_INVALID, core);
+  enableReadAhead(newHandle, flags);
+  *fileHandle = newHandle;
+
+  // translation and open() are done by the fdQueue worker
+  job->openFlags_ = flags;
+  job->openMode_ = FileOpenMode;
+  job->openedFd_ = &newHandle->fd;
+  job->completionId_ = completionId;
+  eventFdHandle->setCompletion(job);
+  job->canBeFreed_ = true; // free job after completion
+  int retcode = ioexecPtr->submitTask(job, true);
+  if (retcode != 0) {
+    LOG(WARNING) << "open job not submitted due to overflow";
+    FilerJobPool::release(job); // if not submitted
+    delete newHandle;
+    *fileHandle = nullptr;
+  }
+  return retcode;
+}
+
 int32_t IOExecFileClose(IOExecFileHandle fileHandle) {
   delete fileHandle;
   return 0;
 }
 
+int32_t IOExecFileCloseAsync(IOExecFileHandle fileHandle,
+                             gCompletionID completionId,
+                             IOExecEventFdHandle eventFdHandle) {
+
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
+    LOG(ERROR) << "Rejecting close with invalid eventfd";
+    return -EINVAL;
+  }
+
+  if (!fileHandle) {
+    LOG(ERROR) << "Rejecting close with null file handle";
+    return -EINVAL;
+  }
+
+  if (fileHandle->fd == gobjfs::os::FD_INVALID) {
+    LOG(ERROR) << "Rejecting async close of handle without open fd";
+    return -EBADF;
+  }
+
+  gobjfs::IOExecutorSPtr ioexecPtr;
+  try {
+    ioexecPtr = fileHandle->serviceHandle->ioexecVec.at(fileHandle->core);
+  } catch (const std::exception &e) {
+    LOG(ERROR) << "entry=" << fileHandle->core
+               << " doesnt exist in ioexec vector of size="
+               << fileHandle->serviceHandle->ioexecVec.size();
+    return -EINVAL;
+  }
+
+  auto job = ioexecPtr->allocJob(fileHandle->fd, FileOp::Close);
+  job->completionId_ = completionId;
+  eventFdHandle->setCompletion(job);
+  job->canBeFreed_ = true; // free job after completion
+  int retcode = ioexecPtr->submitTask(job, true);
+  if (retcode != 0) {
+    LOG(WARNING) << "close job not submitted due to overflow";
+    FilerJobPool::release(job); // if not submitted
+  } else {
+    // fd now belongs to the job
+    fileHandle->fd = gobjfs::os::FD_INVALID;
+    delete fileHandle;
+  }
+  return retcode;
+}
+
 int32_t IOExecFileTruncate(IOExecFileHandle fileHandle, size_t newSize) {
 
   if (!fileHandle) {
@@ -453,19 +879,69 @@ int32_t IOExecFileTruncate(IOExecFileHandle fileHandle, size_t newSize) {
   if (ret != 0) {
     ret = -errno;
     LOG(ERROR) << "truncate failed ret=" << errno;
+  } else if (fileHandle->readAhead) {
+    fileHandle->readAhead->invalidate(newSize, SIZE_MAX);
   }
 
   return ret;
 }
 
+int32_t IOExecFileGetNumaNode(IOExecFileHandle fileHandle) {
+
+  if (!fileHandle) {
+    LOG(ERROR) << "Rejecting numa node query with null file handle";
+    return -EINVAL;
+  }
+
+  auto &ioexecVec = fileHandle->serviceHandle->ioexecVec;
+  if ((size_t)fileHandle->core >= ioexecVec.size()) {
+    return gobjfs::os::NumaNodeInvalid;
+  }
+  return ioexecVec[fileHandle->core]->getNumaNode();
+}
+
+static bool isEmptyFragment(const gIOExecFragment &frag) {
+  return (frag.size == 0) || ((frag.bufIndex == 0) && (frag.addr == nullptr));
+}
+
+// @return buffer of a non-empty fragment, nullptr if it does not fit
+//   within its registered region
+static char *fragmentBuffer(IOExecServiceHandle serviceHandle,
+                            const gIOExecFragment &frag) {
+  if (frag.bufIndex == 0) {
+    return (char *)frag.addr;
+  }
+  // O_DIRECT io covers size rounded up to the sector
+  return serviceHandle->bufferRegistry.resolve(
+      frag.bufIndex, frag.bufOffset, RoundToNext512(frag.size));
+}
+
+// set up job for one fragment of a batch
+static FilerJob *allocFragmentJob(const gobjfs::IOExecutorSPtr &ioexecPtr,
+                                  int fd, FileOp optype, char *buffer,
+                                  const gIOExecFragment &frag,
+                                  gIOPriority priority, uint32_t tenant,
+                                  IOExecEventFdHandle eventFdHandle) {
+  auto job = ioexecPtr->allocJob(fd, optype);
+  job->setBuffer(frag.offset, buffer, frag.size);
+  job->completionId_ = frag.completionId;
+  eventFdHandle->setCompletion(job);
+  job->priority_ = priority;
+  job->tenant_ = tenant;
+  job->setTimeout(frag.timeoutMsec);
+  job->canBeFreed_ = true; // free job after completion
+  return job;
+}
+
 static int32_t IOExecFileOp(const char *name, FileOp optype,
-                            IOExecFileHandle fileHandle, bool closeFileHandle,
+                            IOExecFileHandle fileHandle,
+                            gobjfs::FdCache::Entry *fdEntry,
                             const gIOBatch *batch,
                             IOExecEventFdHandle eventFdHandle) {
 
   int retcode = 0;
 
-  if (!eventFdHandle || (eventFdHandle->fd[1] == gobjfs::os::FD_INVALID)) {
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
     LOG(ERROR) << "Rejecting " << name << " with invalid eventfd";
     return -EINVAL;
   }
@@ -475,8 +951,6 @@ static int32_t IOExecFileOp(const char *name, FileOp optype,
     return -EINVAL;
   }
 
-  int jobFd = eventFdHandle->fd[1];
-
   gobjfs::IOExecutorSPtr ioexecPtr;
   try {
     ioexecPtr = fileHandle->serviceHandle->ioexecVec.at(fileHandle->core);
@@ -491,70 +965,422 @@ static int32_t IOExecFileOp(const char *name, FileOp optype,
   // because the batch can be freed after submitTask
   // making any read of batch->count incorrect
   const decltype(batch->count) totalCount = batch->count;
+  const gIOPriority priority = batch->priority;
+  const uint32_t tenant = batch->tenant;
+  if (priority >= GIO_PRIO_COUNT) {
+    LOG(ERROR) << "Rejecting " << name << " with invalid priority="
+               << (int)priority;
+    return -EINVAL;
+  }
+
+  IOExecServiceHandle serviceHandle = fileHandle->serviceHandle;
+  gobjfs::ReadAheadStream *readAhead = fileHandle->readAhead.get();
+
+  int32_t numJobs = 0;
+  decltype(batch->count) lastIdx = 0;
   for (decltype(batch->count) idx = 0; idx < totalCount; idx++) {
     const gIOExecFragment &frag = batch->array[idx];
-    if ((frag.size == 0) || (frag.addr == nullptr)) {
+    if (isEmptyFragment(frag)) {
       continue;
     }
-    auto job = new FilerJob(fileHandle->fd, optype);
-    job->setBuffer(frag.offset, (char *)frag.addr, frag.size);
-    job->completionId_ = frag.completionId;
-    job->completionFd_ = jobFd;
-    job->canBeFreed_ = true; // free job after completion
-    job->closeFileHandle_ = closeFileHandle;
-    retcode = ioexecPtr->submitTask(job, /*blocking*/ false);
+    if (!fragmentBuffer(serviceHandle, frag)) {
+      LOG(ERROR) << "Rejecting " << name << " of fragment=" << idx
+                 << " outside buffer region=" << frag.bufIndex;
+      return -EINVAL;
+    }
+    numJobs++;
+    lastIdx = idx;
+  }
+  if (numJobs == 0) {
+    return 0;
+  }
+
+  if (readAhead && (optype == FileOp::Write)) {
+    readAhead->disable();
+  }
+  if (readAhead && readAhead->isDisabled()) {
+    readAhead = nullptr;
+  }
+
+  // queue the whole batch or none of it, so that caller
+  // can retry the batch when space fd is signalled
+  retcode = ioexecPtr->reserveSpace(priority, tenant, numJobs);
+  if (retcode != 0) {
+    VLOG(1) << "Refusing " << name << " of " << numJobs
+            << " fragments due to overflow";
+    return retcode;
+  }
+
+  // reads found in read-ahead windows complete without device io
+  // the rest are kept here, to be submitted in batch order
+  std::vector<FilerJob *> jobs;
+  std::vector<gobjfs::ReadAheadStream::Window *> windows;
+  if (readAhead) {
+    jobs.resize(lastIdx + 1, nullptr);
+    int32_t numServed = 0;
+    decltype(batch->count) lastDeviceIdx = 0;
+    for (decltype(batch->count) idx = 0; idx <= lastIdx; idx++) {
+      const gIOExecFragment &frag = batch->array[idx];
+      if (isEmptyFragment(frag)) {
+        continue;
+      }
+      auto job = allocFragmentJob(ioexecPtr, fileHandle->fd, optype,
+                                  fragmentBuffer(serviceHandle, frag), frag,
+                                  priority, tenant, eventFdHandle);
+      // before serve, after which batch may be freed
+      readAhead->onRead(fileHandle->fd, frag.offset, frag.size, windows);
+      if (readAhead->serve(job)) {
+        numServed++;
+      } else {
+        jobs[idx] = job;
+        lastDeviceIdx = idx;
+      }
+    }
+    ioexecPtr->unreserveSpace(priority, numServed);
+    numJobs -= numServed;
+    lastIdx = lastDeviceIdx;
+  }
+
+  for (decltype(batch->count) idx = 0; (numJobs > 0) && (idx <= lastIdx);
+       idx++) {
+    FilerJob *job = nullptr;
+    if (readAhead) {
+      job = jobs[idx];
+      if (!job) {
+        continue;
+      }
+    } else {
+      const gIOExecFragment &frag = batch->array[idx];
+      if (isEmptyFragment(frag)) {
+        continue;
+      }
+      job = allocFragmentJob(ioexecPtr, fileHandle->fd, optype,
+                             fragmentBuffer(serviceHandle, frag), frag,
+                             priority, tenant, eventFdHandle);
+    }
+    numJobs--;
+    if (fdEntry) {
+      // each job keeps the cached fd open until it is done
+      gobjfs::FdCache::hold(fdEntry);
+      job->fdEntry_ = fdEntry;
+    }
+    // let fragments queue up together, so that adjacent ones are merged
+    const bool moreToFollow = (idx < lastIdx);
+    retcode = ioexecPtr->submitTask(job, /*blocking*/ false, moreToFollow,
+                                    /*isReserved*/ true);
     if (retcode != 0) {
-      LOG(WARNING) << "job not submitted due to overflow";
-      delete job; // if not submitted
+      // only on shutdown or memory exhaustion
+      LOG(ERROR) << "job not submitted error=" << retcode;
+      if (job->fdEntry_) {
+        gobjfs::FdCache::release(job->fdEntry_);
+      }
+      FilerJobPool::release(job); // if not submitted
+      ioexecPtr->unreserveSpace(priority, numJobs);
+      // jobs held back by read-ahead are not submitted either
+      for (auto next = idx + 1; readAhead && (next <= lastIdx); next++) {
+        if (jobs[next]) {
+          FilerJobPool::release(jobs[next]);
+        }
+      }
+      break;
     }
   }
+
+  if (!windows.empty()) {
+    readAhead->issue(windows, tenant);
+  }
   return retcode;
 }
 
 int32_t IOExecFileWrite(IOExecFileHandle fileHandle, const gIOBatch *batch,
                         IOExecEventFdHandle eventFdHandle) {
 
-  bool closeFileHandle = false;
-  return IOExecFileOp("write", FileOp::Write, fileHandle, closeFileHandle,
-                      batch, eventFdHandle);
+  return IOExecFileOp("write", FileOp::Write, fileHandle, nullptr, batch,
+                      eventFdHandle);
 }
 
 int32_t IOExecFileRead(IOExecFileHandle fileHandle, const gIOBatch *batch,
                        IOExecEventFdHandle eventFdHandle) {
 
-  bool closeFileHandle = false;
-  return IOExecFileOp("read", FileOp::Read, fileHandle, closeFileHandle, batch,
+  return IOExecFileOp("read", FileOp::Read, fileHandle, nullptr, batch,
                       eventFdHandle);
 }
 
+int32_t IOExecFilePrefetch(IOExecFileHandle fileHandle, off_t offset,
+                           size_t size) {
+
+  if (!fileHandle) {
+    LOG(ERROR) << "Rejecting prefetch with null file handle";
+    return -EINVAL;
+  }
+
+  gobjfs::ReadAheadStream *readAhead = fileHandle->readAhead.get();
+  if (!readAhead) {
+    return -EOPNOTSUPP;
+  }
+
+  std::vector<gobjfs::ReadAheadStream::Window *> windows;
+  int32_t retcode = readAhead->prefetch(fileHandle->fd, offset, size, windows);
+  if (!windows.empty()) {
+    readAhead->issue(windows, /*tenant*/ 0);
+  }
+  return retcode;
+}
+
 int32_t IOExecFileRead(IOExecServiceHandle serviceHandle, const char *fileName,
                        size_t fileNameLength, const gIOBatch *batch,
                        IOExecEventFdHandle eventFdHandle) {
 
-  auto fileHandle =
-      IOExecFileOpen(serviceHandle, fileName, fileNameLength, O_DIRECT | O_RDONLY);
-  if (fileHandle == nullptr) {
-    return -EIO;
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
   }
 
-  bool closeFileHandle = true;
-  auto ret = IOExecFileOp("read", FileOp::Read, fileHandle, closeFileHandle,
-                          batch, eventFdHandle);
+  char absFileName[PATH_MAX];
 
-  // if request submitted successfully, 
-  //   reset fd here in fileHandle
-  //   because the fd will be closed after FilerJob::reset
-  // if not successful
-  //   then close fd with fileHandle now
-  if (ret == 0) {
-    fileHandle->fd = gobjfs::os::FD_INVALID;
-  } else {
-    assert(fileHandle->fd != gobjfs::os::FD_INVALID);
+  const int translateRet =
+      serviceHandle->callTranslator(fileName, fileNameLength, absFileName);
+  if (translateRet < 0) {
+    LOG(ERROR) << "file translation failed (" << translateRet << ") for fileName="
+               << string_to_hex(std::string(fileName, fileNameLength));
+    return -EIO;
+  }
+
+  auto fdEntry = serviceHandle->fdCache->acquire(absFileName);
+  if (fdEntry == nullptr) {
+    return -EIO;
   }
-  IOExecFileClose(fileHandle);
+
+  // jobs take their own reference on the cached fd
+  // which is closed after the last of them, if not kept in cache
+  IOExecFileInt fileHandle(serviceHandle, fdEntry->fd_,
+                           serviceHandle->getSlot(fileName));
+  auto ret = IOExecFileOp("read", FileOp::Read, &fileHandle, fdEntry, batch,
+                          eventFdHandle);
+
+  fileHandle.fd = gobjfs::os::FD_INVALID;
+  gobjfs::FdCache::release(fdEntry);
   return ret;
 }
 
+// fragment of IOExecFileReadMulti, resolved to its file and executor
+struct MultiReadFragment {
+  decltype(gIOBatch::count) idx;
+  char *buffer;
+  int fd;
+  CoreId core;
+  // reference taken if file was given by name
+  gobjfs::FdCache::Entry *fdEntry;
+};
+
+static void releaseFdEntries(std::vector<MultiReadFragment> &frags,
+                             size_t startIdx) {
+  for (size_t idx = startIdx; idx < frags.size(); idx++) {
+    if (frags[idx].fdEntry) {
+      gobjfs::FdCache::release(frags[idx].fdEntry);
+    }
+  }
+}
+
+int32_t IOExecFileReadMulti(IOExecServiceHandle serviceHandle,
+                            const gIOFileRef *files, const gIOBatch *batch,
+                            IOExecEventFdHandle eventFdHandle) {
+
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
+    LOG(ERROR) << "Rejecting read with invalid eventfd";
+    return -EINVAL;
+  }
+
+  if (!files || !batch) {
+    LOG(ERROR) << "Rejecting read with no files or batch";
+    return -EINVAL;
+  }
+
+  // batch can be freed after the last submitTask
+  const decltype(batch->count) totalCount = batch->count;
+  const gIOPriority priority = batch->priority;
+  const uint32_t tenant = batch->tenant;
+  if (priority >= GIO_PRIO_COUNT) {
+    LOG(ERROR) << "Rejecting read with invalid priority=" << (int)priority;
+    return -EINVAL;
+  }
+
+  const auto numExecutors = serviceHandle->ioexecVec.size();
+
+  std::vector<MultiReadFragment> frags;
+  frags.reserve(totalCount);
+
+  int32_t retcode = 0;
+  for (decltype(batch->count) idx = 0; idx < totalCount; idx++) {
+    const gIOExecFragment &frag = batch->array[idx];
+    if (isEmptyFragment(frag)) {
+      continue;
+    }
+    char *buffer = fragmentBuffer(serviceHandle, frag);
+    if (!buffer) {
+      LOG(ERROR) << "Rejecting read of fragment=" << idx
+                 << " outside buffer region=" << frag.bufIndex;
+      retcode = -EINVAL;
+      break;
+    }
+
+    const gIOFileRef &file = files[idx];
+    if (file.fileHandle) {
+      if ((size_t)file.fileHandle->core >= numExecutors) {
+        LOG(ERROR) << "Rejecting read of fragment=" << idx
+                   << " with invalid file handle";
+        retcode = -EINVAL;
+        break;
+      }
+      frags.push_back({idx, buffer, file.fileHandle->fd,
+                       file.fileHandle->core, nullptr});
+      continue;
+    }
+
+    if (!file.fileName) {
+      LOG(ERROR) << "Rejecting read of fragment=" << idx
+                 << " with neither file handle nor name";
+      retcode = -EINVAL;
+      break;
+    }
+
+    char absFileName[PATH_MAX];
+    const int translateRet = serviceHandle->callTranslator(
+        file.fileName, file.fileNameLength, absFileName);
+    if (translateRet < 0) {
+      LOG(ERROR) << "file translation failed (" << translateRet
+                 << ") for fileName="
+                 << string_to_hex(
+                        std::string(file.fileName, file.fileNameLength));
+      retcode = -EIO;
+      break;
+    }
+
+    auto fdEntry = serviceHandle->fdCache->acquire(absFileName);
+    if (fdEntry == nullptr) {
+      retcode = -EIO;
+      break;
+    }
+    const CoreId core = serviceHandle->getSlot(file.fileName);
+    frags.push_back({idx, buffer, fdEntry->fd_, core, fdEntry});
+  }
+
+  if ((retcode != 0) || frags.empty()) {
+    releaseFdEntries(frags, 0);
+    return retcode;
+  }
+
+  // group by executor, keeping order within a group
+  // so that adjacent fragments of a file can still be merged
+  std::stable_sort(frags.begin(), frags.end(),
+                   [](const MultiReadFragment &a, const MultiReadFragment &b) {
+                     return a.core < b.core;
+                   });
+
+  // [start, end) of each group in frags
+  std::vector<std::pair<size_t, size_t>> groups;
+  for (size_t idx = 0; idx < frags.size(); idx++) {
+    if (groups.empty() ||
+        (frags[idx].core != frags[groups.back().first].core)) {
+      groups.emplace_back(idx, idx);
+    }
+    groups.back().second = idx + 1;
+  }
+
+  // queue the whole batch or none of it, as IOExecFileRead does
+  for (size_t groupIdx = 0; groupIdx < groups.size(); groupIdx++) {
+    const auto &group = groups[groupIdx];
+    auto &ioexecPtr = serviceHandle->ioexecVec[frags[group.first].core];
+    retcode = ioexecPtr->reserveSpace(priority, tenant,
+                                      group.second - group.first);
+    if (retcode != 0) {
+      VLOG(1) << "Refusing read of " << frags.size()
+              << " fragments due to overflow";
+      for (size_t prevIdx = 0; prevIdx < groupIdx; prevIdx++) {
+        const auto &prev = groups[prevIdx];
+        serviceHandle->ioexecVec[frags[prev.first].core]->unreserveSpace(
+            priority, prev.second - prev.first);
+      }
+      releaseFdEntries(frags, 0);
+      return retcode;
+    }
+  }
+
+  // each group goes through one submission, like a single-file batch
+  for (size_t groupIdx = 0; groupIdx < groups.size(); groupIdx++) {
+    const auto &group = groups[groupIdx];
+    auto &ioexecPtr = serviceHandle->ioexecVec[frags[group.first].core];
+
+    for (size_t idx = group.first; idx < group.second; idx++) {
+      const MultiReadFragment &mfrag = frags[idx];
+      auto job = allocFragmentJob(ioexecPtr, mfrag.fd, FileOp::Read,
+                                  mfrag.buffer, batch->array[mfrag.idx],
+                                  priority, tenant, eventFdHandle);
+      // job takes over the reference on the cached fd
+      job->fdEntry_ = mfrag.fdEntry;
+      const bool moreToFollow = (idx + 1 < group.second);
+      retcode = ioexecPtr->submitTask(job, /*blocking*/ false, moreToFollow,
+                                      /*isReserved*/ true);
+      if (retcode != 0) {
+        // only on shutdown or memory exhaustion
+        LOG(ERROR) << "job not submitted error=" << retcode;
+        FilerJobPool::release(job); // if not submitted
+        releaseFdEntries(frags, idx);
+        ioexecPtr->unreserveSpace(priority, group.second - idx - 1);
+        for (size_t nextIdx = groupIdx + 1; nextIdx < groups.size();
+             nextIdx++) {
+          const auto &next = groups[nextIdx];
+          serviceHandle->ioexecVec[frags[next.first].core]->unreserveSpace(
+              priority, next.second - next.first);
+        }
+        return retcode;
+      }
+    }
+  }
+  return 0;
+}
+
+int32_t IOExecFileSync(IOExecFileHandle fileHandle, gCompletionID completionId,
+                       bool dataOnly, IOExecEventFdHandle eventFdHandle) {
+
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
+    LOG(ERROR) << "Rejecting sync with invalid eventfd";
+    return -EINVAL;
+  }
+
+  if (!fileHandle) {
+    LOG(ERROR) << "Rejecting sync with invalid file handle";
+    return -EINVAL;
+  }
+
+  gobjfs::IOExecutorSPtr ioexecPtr;
+  try {
+    ioexecPtr = fileHandle->serviceHandle->ioexecVec.at(fileHandle->core);
+  } catch (const std::exception &e) {
+    LOG(ERROR) << "entry=" << fileHandle->core
+               << " doesnt exist in ioexec vector of size="
+               << fileHandle->serviceHandle->ioexecVec.size();
+    return -EINVAL;
+  }
+
+  auto job = ioexecPtr->allocJob(fileHandle->fd, FileOp::Sync);
+  job->syncDataOnly_ = dataOnly;
+  job->completionId_ = completionId;
+  eventFdHandle->setCompletion(job);
+  job->canBeFreed_ = true; // free job after completion
+  int retcode = ioexecPtr->submitTask(job, /*blocking*/ false);
+  if (retcode != 0) {
+    LOG(WARNING) << "sync job not submitted due to overflow";
+    FilerJobPool::release(job); // if not submitted
+  }
+  return retcode;
+}
+
 int32_t IOExecFileDeleteSync(IOExecServiceHandle serviceHandle,
                              const char *fileName) {
   (void)serviceHandle;
@@ -574,6 +1400,8 @@ int32_t IOExecFileDeleteSync(IOExecServiceHandle serviceHandle,
   if (retcode != 0) {
     retcode = -errno;
     LOG(ERROR) << "failed to delete file=" << fileName << " errno=" << errno;
+  } else {
+    serviceHandle->fdCache->invalidate(absFileName);
   }
   return retcode;
 }
@@ -589,7 +1417,7 @@ int32_t IOExecFileDelete(IOExecServiceHandle serviceHandle,
     return -EINVAL;
   }
 
-  if (!eventFdHandle || (eventFdHandle->fd[1] == gobjfs::os::FD_INVALID)) {
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
     LOG(ERROR) << "Rejecting delete with invalid eventfd";
     return -EINVAL;
   }
@@ -604,18 +1432,98 @@ int32_t IOExecFileDelete(IOExecServiceHandle serviceHandle,
     return -EINVAL;
   }
 
-  auto job = new FilerJob(absFileName, FileOp::Delete);
+  auto &ioexecPtr = serviceHandle->ioexecVec[0];
+  auto job = ioexecPtr->allocJob(absFileName, FileOp::Delete);
+  if (job == nullptr) {
+    return -ENOMEM;
+  }
   job->completionId_ = completionId;
-  job->completionFd_ = eventFdHandle->fd[1];
+  eventFdHandle->setCompletion(job);
   job->canBeFreed_ = true; // free job after completion
-  int retcode = serviceHandle->ioexecVec[0]->submitTask(job, true);
+  int retcode = ioexecPtr->submitTask(job, true);
   if (retcode != 0) {
     LOG(WARNING) << "delete job not submitted due to overflow";
-    delete job; // if not submitted
+    FilerJobPool::release(job); // if not submitted
   }
   return retcode;
 }
 
+int32_t IOExecFilePut(IOExecServiceHandle serviceHandle, const char *fileName,
+                      size_t fileNameLength, int32_t flags,
+                      const gIOExecFragment *frag,
+                      IOExecEventFdHandle eventFdHandle) {
+
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+
+  if (!eventFdHandle || !eventFdHandle->isValid()) {
+    LOG(ERROR) << "Rejecting put with invalid eventfd";
+    return -EINVAL;
+  }
+
+  if (!frag) {
+    LOG(ERROR) << "Rejecting put with null fragment";
+    return -EINVAL;
+  }
+
+  // empty fragment creates an empty file
+  char *buffer = nullptr;
+  if (!isEmptyFragment(*frag)) {
+    buffer = fragmentBuffer(serviceHandle, *frag);
+    if (buffer == nullptr) {
+      LOG(ERROR) << "Rejecting put with fragment outside region="
+                 << frag->bufIndex;
+      return -EINVAL;
+    }
+  }
+
+  CoreId core = serviceHandle->getSlot(fileName);
+  auto &ioexecPtr = serviceHandle->ioexecVec[core];
+  auto job = ioexecPtr->allocJob(fileName, fileNameLength, FileOp::Put);
+  if (job == nullptr) {
+    return -ENOMEM;
+  }
+
+  job->openFlags_ = flags;
+  job->openMode_ = FileOpenMode;
+  if (buffer) {
+    job->setBuffer(frag->offset, buffer, frag->size);
+  }
+  job->completionId_ = frag->completionId;
+  eventFdHandle->setCompletion(job);
+  job->canBeFreed_ = true; // free job after completion
+  int retcode = ioexecPtr->submitTask(job, true);
+  if (retcode != 0) {
+    LOG(WARNING) << "put job not submitted due to overflow";
+    FilerJobPool::release(job); // if not submitted
+  }
+  return retcode;
+}
+
+int32_t IOExecFileCancel(IOExecServiceHandle serviceHandle,
+                         gCompletionID completionId) {
+
+  if (!serviceHandle || !serviceHandle->isValid()) {
+    LOG(ERROR) << "service handle is invalid";
+    return -EINVAL;
+  }
+
+  // jobs may have been stolen by another executor, so ask all
+  int32_t numCancelled = 0;
+  int32_t retcode = -ENOENT;
+  for (auto &elem : serviceHandle->ioexecVec) {
+    int32_t ret = elem->cancelTask(completionId);
+    if (ret > 0) {
+      numCancelled += ret;
+    } else if (ret != -ENOENT) {
+      retcode = ret;
+    }
+  }
+  return numCancelled ? numCancelled : retcode;
+}
+
 // ============================================
 
 EXTERNC {
@@ -649,6 +1557,45 @@ EXTERNC {
                           (IOExecEventFdHandle)eventFd);
   }
 
+  int32_t gobjfs_ioexecfile_file_read_multi(service_handle_t service_handle,
+                                            const gIOFileRef *files,
+                                            batch_t * batchp,
+                                            event_t eventFd) {
+    return IOExecFileReadMulti((IOExecServiceHandle)service_handle, files,
+                               (gIOBatch *)batchp,
+                               (IOExecEventFdHandle)eventFd);
+  }
+
+  int32_t gobjfs_ioexecfile_file_open_async(service_handle_t service_handle,
+                                            const char *name, size_t len,
+                                            int flags, completion_id_t cid,
+                                            event_t eventFd,
+                                            handle_t *handlep) {
+    return IOExecFileOpenAsync(service_handle, name, len, flags, cid,
+                               (IOExecEventFdHandle)eventFd,
+                               (IOExecFileHandle *)handlep);
+  }
+
+  int32_t gobjfs_ioexecfile_file_close_async(handle_t handle,
+                                             completion_id_t cid,
+                                             event_t eventFd) {
+    return IOExecFileCloseAsync((IOExecFileHandle)handle, cid,
+                                (IOExecEventFdHandle)eventFd);
+  }
+
+  int32_t gobjfs_ioexecfile_file_put(service_handle_t service_handle,
+                                     const char *name, size_t len, int flags,
+                                     const gIOExecFragment *frag,
+                                     event_t eventFd) {
+    return IOExecFilePut(service_handle, name, len, flags, frag,
+                         (IOExecEventFdHandle)eventFd);
+  }
+
+  int32_t gobjfs_ioexecfile_file_prefetch(handle_t handle, off_t offset,
+                                          size_t size) {
+    return IOExecFilePrefetch((IOExecFileHandle)handle, offset, size);
+  }
+
   int32_t gobjfs_ioexecfile_file_delete(service_handle_t service_handle,
                                         const char *name, completion_id_t cid,
                                         event_t eventFd) {
@@ -656,10 +1603,20 @@ EXTERNC {
                             (IOExecEventFdHandle)eventFd);
   }
 
+  int32_t gobjfs_ioexecfile_file_sync(handle_t handle, completion_id_t cid,
+                                      int data_only, event_t eventFd) {
+    return IOExecFileSync((IOExecFileHandle)handle, cid, (data_only != 0),
+                          (IOExecEventFdHandle)eventFd);
+  }
+
   int32_t gobjfs_ioexecfile_file_truncate(handle_t handle, size_t new_size) {
     return IOExecFileTruncate(handle, new_size);
   }
 
+  int32_t gobjfs_ioexecfile_file_get_numa_node(handle_t handle) {
+    return IOExecFileGetNumaNode((IOExecFileHandle)handle);
+  }
+
   int32_t gobjfs_ioexecfile_file_close(handle_t handle) {
     return IOExecFileClose((IOExecFileHandle)handle);
   }
@@ -677,6 +1634,24 @@ EXTERNC {
     return IOExecEventFdGetReadFd((IOExecEventFdHandle)eventFd);
   }
 
+  event_t gobjfs_ioexecfile_event_callback_open(
+      service_handle_t service_handle, gIOCompletionCallback callback,
+      void *ctx) {
+    return IOExecEventFdOpenCallback(service_handle, callback, ctx);
+  }
+
+  event_t gobjfs_ioexecfile_event_ring_open(service_handle_t service_handle,
+                                            size_t num_entries) {
+    return IOExecEventFdOpenRing(service_handle, num_entries);
+  }
+
+  int32_t gobjfs_ioexecfile_event_reap(event_t eventFd,
+                                       gIOStatusBatch *status_batch,
+                                       size_t max_count) {
+    return IOExecEventFdReap((IOExecEventFdHandle)eventFd, status_batch,
+                             max_count);
+  }
+
   batch_t *gobjfs_batch_alloc(int n) { return gIOBatchAlloc(n); }
 
   void gobjfs_debug_fragment(const void *p) {
@@ -700,4 +1675,31 @@ EXTERNC {
                                              char *buffer, int32_t len) {
     return IOExecGetStats(service_handle, buffer, len);
   }
+
+  int32_t gobjfs_ioexecfile_service_register_buffer(
+      service_handle_t service_handle, size_t size, void **addr) {
+    return IOExecRegisterBuffer((IOExecServiceHandle)service_handle, size,
+                                addr);
+  }
+
+  int gobjfs_ioexecfile_service_get_space_fd(service_handle_t service_handle) {
+    return IOExecGetSpaceAvailableFd(service_handle);
+  }
+
+  int32_t gobjfs_ioexecfile_service_set_tenant_limit(
+      service_handle_t service_handle, uint32_t tenant, uint64_t iops,
+      uint64_t bytes_per_sec, uint32_t burst_msec) {
+    return IOExecSetTenantLimit(service_handle, tenant, iops, bytes_per_sec,
+                                burst_msec);
+  }
+
+  int32_t gobjfs_ioexecfile_service_set_trace_rate(
+      service_handle_t service_handle, uint32_t sample_rate) {
+    return IOExecSetTraceSampleRate(service_handle, sample_rate);
+  }
+
+  int32_t gobjfs_ioexecfile_service_dump_trace(service_handle_t service_handle,
+                                               const char *file_name) {
+    return IOExecDumpTrace(service_handle, file_name);
+  }
 }
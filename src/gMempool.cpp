@@ -20,7 +20,9 @@ but WITHOUT ANY WARRANTY of any kind.
 #include <gMempool.h>
 #include <string.h>
 #include <gobjfs_log.h>
+#include <sstream>
 #include <util/os_utils.h>
+#include <vector>
 
 using gobjfs::Mempool;
 using gobjfs::MempoolFactory;
@@ -31,13 +33,30 @@ using gobjfs::os::RoundToNext512;
 // Keep a std::map<pool name, MemPool>
 // Or pass back a handle in gMempool_init
 static MempoolSPtr pool;
+// one per NUMA node, if there is more than one node
+// they keep their memory until destroyed, so they are reused by a
+// repeated gMempool_init, or kept aside if the alignment changed
+static std::vector<MempoolSPtr> nodePools;
+static std::vector<MempoolSPtr> retiredNodePools;
 
 int gMempool_init(size_t alignSize) {
   pool = MempoolFactory::createAlignedMempool("aligned", alignSize);
-  if (pool.get())
-    return 0;
-  LOG(ERROR) << "failed to allocate Mempool";
-  return -1;
+  if (!pool.get()) {
+    LOG(ERROR) << "failed to allocate Mempool";
+    return -1;
+  }
+  if (!nodePools.empty() && (nodePools[0]->allocSize() != alignSize)) {
+    retiredNodePools.insert(retiredNodePools.end(), nodePools.begin(),
+                            nodePools.end());
+    nodePools.clear();
+  }
+  const int32_t numNodes = gobjfs::os::NumaNumNodes();
+  for (int32_t node = nodePools.size(); (numNodes > 1) && (node < numNodes);
+       node++) {
+    nodePools.push_back(MempoolFactory::createAlignedMempool(
+        "aligned" + std::to_string(node), alignSize, node));
+  }
+  return 0;
 }
 
 void *gMempool_alloc(size_t size) {
@@ -48,10 +67,36 @@ void *gMempool_alloc(size_t size) {
   return pool->Alloc(allocSize);
 }
 
+void *gMempool_alloc_node(size_t size, int node) {
+  if (size == 0)
+    return nullptr;
+  LOG_IF(FATAL, pool == nullptr) << "call to gMempool_init is missing";
+  if (node < 0) {
+    node = gobjfs::os::NumaNodeOfCore(gobjfs::os::GetCpuCore());
+  }
+  const size_t allocSize = RoundToNext512(size);
+  if ((node < 0) || ((size_t)node >= nodePools.size())) {
+    // single node, or node unknown
+    return pool->Alloc(allocSize);
+  }
+  return nodePools[node]->Alloc(allocSize);
+}
+
+// node pools carve buffers out of their own memory; the rest are
+// from the heap, so it does not matter which pool frees them.
+// Owns only reads the arena table of a pool, without locking
 void gMempool_free(void *ptr) {
   if (nullptr == ptr)
     return;
   LOG_IF(FATAL, pool == nullptr) << "call to gMempool_init is missing";
+  for (auto pools : {&nodePools, &retiredNodePools}) {
+    for (auto &nodePool : *pools) {
+      if (nodePool->Owns(ptr)) {
+        nodePool->Free(ptr);
+        return;
+      }
+    }
+  }
   pool->Free(ptr);
 }
 
@@ -59,6 +104,11 @@ void gMempool_getStats(char *buffer, size_t len) {
   if ((nullptr == buffer) || (len == 0))
     return;
   LOG_IF(FATAL, pool == nullptr) << "call to gMempool_init is missing";
-  const auto str = pool->GetStats();
+  std::ostringstream os;
+  os << pool->GetStats();
+  for (auto &nodePool : nodePools) {
+    os << nodePool->GetStats();
+  }
+  const auto str = os.str();
   strncpy(buffer, str.data(), len);
 }
@@ -16,6 +16,9 @@ Open vStorage is distributed in the hope that it will be useful,
 but WITHOUT ANY WARRANTY of any kind.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
 #include <unistd.h>
 
 #include <networkxio/gobjfs_client_common.h>
@@ -32,6 +35,10 @@ namespace gobjfs {
 namespace xio {
 
 static constexpr int XIO_COMPLETION_DEFAULT_MAX_EVENTS = 100;
+// completions reaped per wakeup of completion thread
+static constexpr size_t XIO_COMPLETION_MAX_STATUS = 256;
+// read completions pending on completion ring
+static constexpr size_t XIO_COMPLETION_RING_SIZE = 4096;
 
 static inline void pack_msg(NetworkXioRequest *req) {
   NetworkXioMsg o_msg(req->op);
@@ -46,11 +53,17 @@ NetworkXioIOHandler::NetworkXioIOHandler(IOExecServiceHandle serviceHandle,
     : serviceHandle_(serviceHandle), wq_(wq) {
   try {
 
-    eventHandle_ = IOExecEventFdOpen(serviceHandle_);
+    eventHandle_ =
+        IOExecEventFdOpenRing(serviceHandle_, XIO_COMPLETION_RING_SIZE);
     if (eventHandle_ == nullptr) {
       throw std::runtime_error("failed to open event handle");
     }
 
+    statusBatch_ = gIOStatusBatchAlloc(XIO_COMPLETION_MAX_STATUS);
+    if (statusBatch_ == nullptr) {
+      throw std::runtime_error("failed to alloc status batch");
+    }
+
     auto efd = IOExecEventFdGetReadFd(eventHandle_);
     if (efd == -1) {
       throw std::runtime_error("failed to get read fd");
@@ -83,6 +96,15 @@ NetworkXioIOHandler::NetworkXioIOHandler(IOExecServiceHandle serviceHandle,
 }
 
 NetworkXioIOHandler::~NetworkXioIOHandler() {
+  {
+    // jobs of pending reads still post to the ring of eventHandle_
+    std::unique_lock<std::mutex> lck(pendingMutex_);
+    while (!pendingDone_.wait_for(lck, std::chrono::seconds(1),
+                                  [this] { return numPendingReads_ == 0; })) {
+      GLOG_INFO("waiting for " << numPendingReads_ << " reads to complete");
+    }
+  }
+
   try {
     int err = ioCompletionThreadShutdown.send();
     if (err != 0) {
@@ -102,6 +124,9 @@ NetworkXioIOHandler::~NetworkXioIOHandler() {
     eventHandle_ = nullptr;
   }
 
+  gIOStatusBatchFree(statusBatch_);
+  statusBatch_ = nullptr;
+
   if (epollfd != -1) {
     close(epollfd);
     epollfd = -1;
@@ -146,67 +171,83 @@ int NetworkXioIOHandler::gxio_completion_handler(int epollfd, int efd) {
         continue;
       }
 
-      gIOStatus iostatus;
-      int ret = read(efd, &iostatus, sizeof(iostatus));
-
-      if (ret != sizeof(iostatus)) {
-        GLOG_ERROR("Partial read detected.  Actual read=" << ret << " Expected=" << sizeof(iostatus));
+      // drain all completions posted since last wakeup
+      int32_t numStatus = IOExecEventFdReap(eventHandle_, statusBatch_,
+                                            XIO_COMPLETION_MAX_STATUS);
+      if (numStatus < 0) {
+        GLOG_ERROR("failed to reap completions err=" << numStatus);
         continue;
       }
 
-      GLOG_DEBUG("Recieved event"
-                 << " completionId: " << (void *)iostatus.completionId
-                 << " status: " << iostatus.errorCode);
-
-      gIOBatch *batch = reinterpret_cast<gIOBatch *>(iostatus.completionId);
-      assert(batch != nullptr);
-
-      NetworkXioRequest *pXioReq =
-          static_cast<NetworkXioRequest *>(batch->opaque);
-      assert(pXioReq != nullptr);
-
-      gIOExecFragment &frag = batch->array[0];
-      // reset addr otherwise BatchFree will free it
-      // need to introduce ownership indicator
-      frag.addr = nullptr;
-      gIOBatchFree(batch);
-
-      switch (pXioReq->op) {
-
-      case NetworkXioMsgOpcode::ReadRsp: {
-
-        if (iostatus.errorCode == 0) {
-          // read must return the size which was read
-          pXioReq->retval = pXioReq->size;
-          pXioReq->errval = 0;
-          GLOG_DEBUG(" Read completed with completion ID"
-                     << iostatus.completionId);
-        } else {
-          pXioReq->retval = -1;
-          pXioReq->errval = iostatus.errorCode;
-          GLOG_ERROR("Read completion error " << iostatus.errorCode
-                                              << " For completion ID "
-                                              << iostatus.completionId);
+      for (int32_t idx = 0; idx < numStatus; idx++) {
+        const gIOStatus &iostatus = statusBatch_->array[idx];
+
+        GLOG_DEBUG("Recieved event"
+                   << " completionId: " << (void *)iostatus.completionId
+                   << " status: " << iostatus.errorCode);
+
+        gIOBatch *batch = reinterpret_cast<gIOBatch *>(iostatus.completionId);
+        assert(batch != nullptr);
+
+        NetworkXioRequest *pXioReq =
+            static_cast<NetworkXioRequest *>(batch->opaque);
+        assert(pXioReq != nullptr);
+
+        gIOExecFragment &frag = batch->array[0];
+        // reset addr otherwise BatchFree will free it
+        // need to introduce ownership indicator
+        frag.addr = nullptr;
+        gIOBatchFree(batch);
+
+        switch (pXioReq->op) {
+
+        case NetworkXioMsgOpcode::ReadRsp: {
+
+          if (iostatus.errorCode == 0) {
+            // read must return the size which was read
+            pXioReq->retval = pXioReq->size;
+            pXioReq->errval = 0;
+            GLOG_DEBUG(" Read completed with completion ID"
+                       << iostatus.completionId);
+          } else {
+            pXioReq->retval = -1;
+            pXioReq->errval = iostatus.errorCode;
+            GLOG_ERROR("Read completion error " << iostatus.errorCode
+                                                << " For completion ID "
+                                                << iostatus.completionId);
+          }
+
+          pack_msg(pXioReq);
+
+          NetworkXioWorkQueue *pWorkQueue =
+              reinterpret_cast<NetworkXioWorkQueue *>(pXioReq->req_wq);
+          pWorkQueue->worker_bottom_half(pWorkQueue, pXioReq);
+        } break;
+
+        default: {
+          GLOG_ERROR("Got an event for non-read operation "
+                     << (int)pXioReq->op);
+        }
         }
-
-        pack_msg(pXioReq);
-
-        NetworkXioWorkQueue *pWorkQueue =
-            reinterpret_cast<NetworkXioWorkQueue *>(pXioReq->req_wq);
-        pWorkQueue->worker_bottom_half(pWorkQueue, pXioReq);
-      } break;
-
-      default: {
-        GLOG_ERROR("Got an event for non-read operation "
-                   << (int)pXioReq->op);
-      }
       }
+      read_done(numStatus);
     }
   }
 
   return 0;
 }
 
+void NetworkXioIOHandler::read_done(int32_t count) {
+  if (count == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lck(pendingMutex_);
+  numPendingReads_ -= count;
+  if (numPendingReads_ == 0) {
+    pendingDone_.notify_all();
+  }
+}
+
 void NetworkXioIOHandler::handle_close(NetworkXioRequest *req) {
   req->op = NetworkXioMsgOpcode::CloseRsp;
   if (!serviceHandle_) {
@@ -222,7 +263,7 @@ void NetworkXioIOHandler::handle_close(NetworkXioRequest *req) {
 
 int NetworkXioIOHandler::handle_read(NetworkXioRequest *req,
                                      const std::string &filename, size_t size,
-                                     off_t offset) {
+                                     off_t offset, int64_t timeoutMsec) {
   int ret = 0;
   req->op = NetworkXioMsgOpcode::ReadRsp;
   req->req_wq = (void *)this->wq_.get();
@@ -280,11 +321,18 @@ int NetworkXioIOHandler::handle_read(NetworkXioRequest *req,
     frag.addr = reinterpret_cast<caddr_t>(req->reg_mem.addr);
     frag.size = size;
     frag.completionId = reinterpret_cast<uint64_t>(batch);
+    frag.timeoutMsec = static_cast<uint32_t>(
+        std::min<int64_t>(std::max<int64_t>(timeoutMsec, 0), UINT32_MAX));
 
+    {
+      std::unique_lock<std::mutex> lck(pendingMutex_);
+      numPendingReads_++;
+    }
     ret = IOExecFileRead(serviceHandle_, filename.c_str(), filename.size(),
                          batch, eventHandle_);
 
     if (ret != 0) {
+      read_done(1);
       GLOG_ERROR("IOExecFileRead failed with error " << ret);
       req->retval = -1;
       req->errval = EIO;
@@ -348,7 +396,8 @@ bool NetworkXioIOHandler::process_request(NetworkXioRequest *req) {
     }
     case NetworkXioMsgOpcode::ReadReq: {
       GLOG_DEBUG(" Command ReadReq");
-      auto ret = handle_read(req, i_msg.filename_, i_msg.size(), i_msg.offset());
+      auto ret = handle_read(req, i_msg.filename_, i_msg.size(),
+                             i_msg.offset(), i_msg.timeout());
       if (ret == 0) {
         finishNow = false;
       }
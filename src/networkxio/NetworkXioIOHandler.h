@@ -26,6 +26,8 @@ but WITHOUT ANY WARRANTY of any kind.
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <iostream>
+#include <condition_variable>
+#include <mutex>
 #include <assert.h>
 
 #include "gIOExecFile.h"
@@ -56,8 +58,13 @@ private:
 
   void handle_close(NetworkXioRequest *req);
 
+  // @param timeoutMsec fail read with ETIMEDOUT if not done in time
+  //        zero means no timeout
   int handle_read(NetworkXioRequest *req, const std::string &filename,
-                  size_t size, off_t offset);
+                  size_t size, off_t offset, int64_t timeoutMsec);
+
+  // @param count reads whose completion was reaped
+  void read_done(int32_t count);
 
   void handle_error(NetworkXioRequest *req, int errval);
 
@@ -68,6 +75,14 @@ private:
   IOExecServiceHandle serviceHandle_{nullptr};
 
   IOExecEventFdHandle eventHandle_{nullptr};
+  // completions reaped from eventHandle_
+  gIOStatusBatch *statusBatch_{nullptr};
+
+  // reads submitted on eventHandle_ whose completion has not been
+  // reaped; the ring is closed only after they are done
+  int32_t numPendingReads_{0};
+  std::mutex pendingMutex_;
+  std::condition_variable pendingDone_;
 
   NetworkXioWorkQueuePtr wq_;
 
@@ -41,7 +41,7 @@ public:
   ssize_t retval_{0};
   int errval_{0};
   uintptr_t opaque_{0};
-  int64_t timeout_{0};
+  int64_t timeout_{0}; // milliseconds; zero means no timeout
 
 public:
   const NetworkXioMsgOpcode &opcode() const { return opcode_; }
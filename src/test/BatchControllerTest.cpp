@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "../BatchController.h"
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using gobjfs::BatchController;
+
+static void waitForUpdateInterval() {
+  std::this_thread::sleep_for(
+      std::chrono::microseconds(2 * BatchController::UpdateIntervalUsec));
+}
+
+TEST(BatchControllerTest, LowLoadSubmitsImmediately) {
+  BatchController ctrl;
+  ctrl.init(1000, 16);
+
+  ctrl.recordArrival();
+  ctrl.recordCompletion(100 * 1000);
+
+  waitForUpdateInterval();
+  ctrl.update();
+
+  EXPECT_EQ(ctrl.batchSize(), 1);
+  EXPECT_EQ(ctrl.waitWindowUsec(), 0);
+}
+
+TEST(BatchControllerTest, HighLoadBatchesUpToMax) {
+  BatchController ctrl;
+  ctrl.init(1000, 16);
+
+  ctrl.recordCompletion(100 * 1000);
+  for (int i = 0; i < 100000; i++) {
+    ctrl.recordArrival();
+  }
+
+  waitForUpdateInterval();
+  ctrl.update();
+
+  EXPECT_EQ(ctrl.batchSize(), 16);
+  EXPECT_GT(ctrl.waitWindowUsec(), 0);
+  EXPECT_LE(ctrl.waitWindowUsec(), 900);
+}
+
+TEST(BatchControllerTest, NoWaitIfDeviceSlowerThanTarget) {
+  BatchController ctrl;
+  ctrl.init(1000, 16);
+
+  // completion latency alone exceeds the target
+  ctrl.recordCompletion(2000 * 1000);
+  for (int i = 0; i < 100000; i++) {
+    ctrl.recordArrival();
+  }
+
+  waitForUpdateInterval();
+  ctrl.update();
+
+  EXPECT_EQ(ctrl.batchSize(), 1);
+  EXPECT_EQ(ctrl.waitWindowUsec(), 0);
+}
@@ -0,0 +1,59 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "../BufferRegistry.h"
+#include <gtest/gtest.h>
+
+#include <string>
+
+using gobjfs::BufferRegistry;
+
+TEST(BufferRegistryTest, AddAndResolve) {
+  BufferRegistry registry;
+  EXPECT_EQ(registry.resolve(0, 0, 4096), nullptr);
+  EXPECT_EQ(registry.resolve(1, 0, 4096), nullptr);
+  EXPECT_EQ(registry.add(0), -EINVAL);
+
+  const int32_t first = registry.add(4096);
+  ASSERT_EQ(first, 1);
+  auto region = registry.get(first);
+  ASSERT_NE(region, nullptr);
+  EXPECT_EQ(region->size_, BufferRegistry::RegionAlign);
+
+  // pre-faulted and writable end to end
+  region->addr_[0] = 'a';
+  region->addr_[region->size_ - 1] = 'z';
+
+  EXPECT_EQ(registry.resolve(first, 0, region->size_), region->addr_);
+  EXPECT_EQ(registry.resolve(first, 8192, 4096), region->addr_ + 8192);
+  EXPECT_EQ(registry.resolve(first, region->size_ - 4096, 8192), nullptr);
+  EXPECT_EQ(registry.resolve(first, region->size_ + 4096, 0), nullptr);
+
+  const int32_t second =
+      registry.add(BufferRegistry::RegionAlign + 1);
+  ASSERT_EQ(second, 2);
+  EXPECT_EQ(registry.get(second)->size_, 2 * BufferRegistry::RegionAlign);
+  EXPECT_EQ(registry.size(), 2);
+
+  const std::string state = registry.getState();
+  EXPECT_NE(state.find("\"numRegions\":2,"), std::string::npos);
+  EXPECT_NE(state.find("\"totalSize\":" +
+                       std::to_string(3 * BufferRegistry::RegionAlign)),
+            std::string::npos);
+}
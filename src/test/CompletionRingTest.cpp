@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "../CompletionRing.h"
+#include <gtest/gtest.h>
+
+#include <sys/eventfd.h>
+#include <thread>
+#include <vector>
+
+using gobjfs::CompletionRing;
+
+static gIOStatus makeStatus(gCompletionID id) {
+  gIOStatus status;
+  status.completionId = id;
+  status.errorCode = -(int32_t)id;
+  status.reserved = 0;
+  return status;
+}
+
+TEST(CompletionRingTest, DoorbellOnlyWhenEmpty) {
+  CompletionRing ring;
+  ASSERT_EQ(ring.init(8), 0);
+
+  for (gCompletionID id = 1; id <= 5; id++) {
+    ring.push(makeStatus(id));
+  }
+
+  // one ring for five completions
+  eventfd_t val = 0;
+  EXPECT_EQ(eventfd_read(ring.getReadFd(), &val), 0);
+  EXPECT_EQ(val, 1);
+
+  gIOStatus array[8];
+  EXPECT_EQ(ring.reap(array, 8), 5);
+  for (size_t idx = 0; idx < 5; idx++) {
+    EXPECT_EQ(array[idx].completionId, idx + 1);
+    EXPECT_EQ(array[idx].errorCode, -(int32_t)(idx + 1));
+  }
+
+  // reap emptied the ring, so the next completion rings again
+  EXPECT_NE(eventfd_read(ring.getReadFd(), &val), 0);
+  ring.push(makeStatus(6));
+  EXPECT_EQ(eventfd_read(ring.getReadFd(), &val), 0);
+  EXPECT_EQ(ring.reap(array, 8), 1);
+  EXPECT_EQ(array[0].completionId, 6);
+}
+
+TEST(CompletionRingTest, PartialReapLeavesDoorbell) {
+  CompletionRing ring;
+  ASSERT_EQ(ring.init(8), 0);
+
+  for (gCompletionID id = 1; id <= 6; id++) {
+    ring.push(makeStatus(id));
+  }
+
+  gIOStatus array[4];
+  EXPECT_EQ(ring.reap(array, 4), 4);
+  // entries remain, so fd stays readable
+  eventfd_t val = 0;
+  EXPECT_EQ(eventfd_read(ring.getReadFd(), &val), 0);
+  EXPECT_EQ(ring.reap(array, 4), 2);
+  EXPECT_EQ(array[0].completionId, 5);
+  EXPECT_EQ(array[1].completionId, 6);
+}
+
+TEST(CompletionRingTest, MultipleProducers) {
+  CompletionRing ring;
+  // smaller than total, so producers wait for consumer
+  ASSERT_EQ(ring.init(64), 0);
+
+  const size_t numThreads = 4;
+  const size_t numPerThread = 10000;
+
+  std::vector<std::thread> producers;
+  for (size_t t = 0; t < numThreads; t++) {
+    producers.emplace_back([&ring, t, numPerThread]() {
+      for (size_t idx = 0; idx < numPerThread; idx++) {
+        ring.push(makeStatus(t * numPerThread + idx + 1));
+      }
+    });
+  }
+
+  std::vector<bool> seen(numThreads * numPerThread + 1, false);
+  std::vector<gCompletionID> lastFromThread(numThreads, 0);
+  size_t numReaped = 0;
+  gIOStatus array[32];
+  while (numReaped < numThreads * numPerThread) {
+    size_t count = ring.reap(array, 32);
+    for (size_t idx = 0; idx < count; idx++) {
+      const gCompletionID id = array[idx].completionId;
+      ASSERT_FALSE(seen[id]);
+      seen[id] = true;
+      // each producer's completions arrive in order
+      const size_t t = (id - 1) / numPerThread;
+      EXPECT_GT(id, lastFromThread[t]);
+      lastFromThread[t] = id;
+    }
+    numReaped += count;
+  }
+
+  for (auto &thr : producers) {
+    thr.join();
+  }
+  EXPECT_EQ(ring.reap(array, 32), 0);
+}
+
+TEST(CompletionRingTest, CloseWithPendingProducer) {
+  CompletionRing *ring = new CompletionRing;
+  ASSERT_EQ(ring->init(2), 0);
+
+  // reference of a job which is still pending
+  ring->acquire();
+
+  ring->push(makeStatus(1));
+  ring->push(makeStatus(2));
+
+  // ring is full, so producer waits until consumer goes away
+  std::thread producer([ring]() {
+    ring->push(makeStatus(3));
+    ring->release();
+  });
+
+  ring->close();
+  producer.join();
+}
@@ -0,0 +1,127 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "../DeficitRoundRobin.h"
+#include <gcommon.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using gobjfs::DeficitRoundRobin;
+
+static const std::vector<uint32_t> Weights{16, 4, 1};
+
+// number of jobs queued in each class
+struct Backlog {
+  std::vector<size_t> numQueued = std::vector<size_t>(GIO_PRIO_COUNT, 0);
+
+  int32_t next(DeficitRoundRobin &drr) {
+    return drr.next([this](size_t priority) {
+      if (numQueued[priority] == 0) {
+        return false;
+      }
+      numQueued[priority]--;
+      return true;
+    });
+  }
+};
+
+TEST(DeficitRoundRobinTest, EmptyClassesGiveNothing) {
+  DeficitRoundRobin drr;
+  drr.init(Weights);
+
+  Backlog backlog;
+  EXPECT_EQ(backlog.next(drr), -1);
+}
+
+TEST(DeficitRoundRobinTest, BacklogServedInRatioOfWeights) {
+  DeficitRoundRobin drr;
+  drr.init(Weights);
+
+  Backlog backlog;
+  for (auto &numQueued : backlog.numQueued) {
+    numQueued = 1000;
+  }
+
+  // each round serves a class for its weight before passing the turn
+  std::vector<int32_t> expected;
+  for (int32_t priority = 0; priority < GIO_PRIO_COUNT; priority++) {
+    expected.insert(expected.end(), Weights[priority], priority);
+  }
+  static constexpr size_t NumRounds = 10;
+  std::vector<size_t> numServed(GIO_PRIO_COUNT, 0);
+  for (size_t round = 0; round < NumRounds; round++) {
+    for (auto priority : expected) {
+      EXPECT_EQ(backlog.next(drr), priority);
+      numServed[priority]++;
+    }
+  }
+  for (size_t priority = 0; priority < GIO_PRIO_COUNT; priority++) {
+    EXPECT_EQ(numServed[priority], NumRounds * Weights[priority]);
+  }
+}
+
+TEST(DeficitRoundRobinTest, ForegroundGoesAheadOfBackgroundBacklog) {
+  DeficitRoundRobin drr;
+  drr.init(Weights);
+
+  Backlog backlog;
+  backlog.numQueued[GIO_PRIO_BACKGROUND] = 100;
+  for (int idx = 0; idx < 10; idx++) {
+    EXPECT_EQ(backlog.next(drr), GIO_PRIO_BACKGROUND);
+  }
+
+  // foreground waits for at most the credit background has left
+  static constexpr size_t NumForeground = 8;
+  backlog.numQueued[GIO_PRIO_FOREGROUND] = NumForeground;
+  size_t numBackgroundAhead = 0;
+  int32_t priority;
+  while ((priority = backlog.next(drr)) == GIO_PRIO_BACKGROUND) {
+    numBackgroundAhead++;
+  }
+  EXPECT_LT(numBackgroundAhead, Weights[GIO_PRIO_BACKGROUND]);
+
+  // and then goes through without being interleaved
+  EXPECT_EQ(priority, GIO_PRIO_FOREGROUND);
+  for (size_t idx = 1; idx < NumForeground; idx++) {
+    EXPECT_EQ(backlog.next(drr), GIO_PRIO_FOREGROUND);
+  }
+  EXPECT_EQ(backlog.next(drr), GIO_PRIO_BACKGROUND);
+}
+
+TEST(DeficitRoundRobinTest, IdleClassDoesNotSaveCredit) {
+  DeficitRoundRobin drr;
+  drr.init(Weights);
+
+  // foreground is passed over many times while only scrub has jobs
+  Backlog backlog;
+  backlog.numQueued[GIO_PRIO_SCRUB] = 100;
+  for (int idx = 0; idx < 50; idx++) {
+    EXPECT_EQ(backlog.next(drr), GIO_PRIO_SCRUB);
+  }
+
+  backlog.numQueued[GIO_PRIO_FOREGROUND] = 100;
+  backlog.numQueued[GIO_PRIO_BACKGROUND] = 100;
+  size_t numForegroundInRow = 0;
+  int32_t priority;
+  while ((priority = backlog.next(drr)) == GIO_PRIO_FOREGROUND) {
+    numForegroundInRow++;
+  }
+  EXPECT_EQ(numForegroundInRow, Weights[GIO_PRIO_FOREGROUND]);
+  EXPECT_EQ(priority, GIO_PRIO_BACKGROUND);
+}
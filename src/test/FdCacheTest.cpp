@@ -0,0 +1,137 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "../FdCache.h"
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using gobjfs::FdCache;
+
+class FdCacheTest : public testing::Test {
+public:
+  std::vector<std::string> fileNames;
+
+  virtual void SetUp() override {
+    for (size_t idx = 0; idx < 4; idx++) {
+      fileNames.push_back("/tmp/fdcache_" + std::to_string(getpid()) + "_" +
+                          std::to_string(idx));
+      int fd = ::open(fileNames.back().c_str(), O_CREAT | O_RDWR, S_IRWXU);
+      ASSERT_GE(fd, 0);
+      ::close(fd);
+    }
+  }
+
+  virtual void TearDown() override {
+    for (auto &name : fileNames) {
+      ::unlink(name.c_str());
+    }
+  }
+};
+
+static bool isOpen(int fd) { return (fcntl(fd, F_GETFD) != -1); }
+
+TEST_F(FdCacheTest, HitAfterMiss) {
+  FdCache cache(16, O_RDONLY);
+
+  auto entry = cache.acquire(fileNames[0]);
+  ASSERT_NE(entry, nullptr);
+  const int fd = entry->fd_;
+  FdCache::release(entry);
+  // kept open after last user is gone
+  EXPECT_TRUE(isOpen(fd));
+
+  auto again = cache.acquire(fileNames[0]);
+  ASSERT_EQ(again, entry);
+  FdCache::release(again);
+
+  EXPECT_EQ(cache.acquire(fileNames[0] + "_missing"), nullptr);
+  EXPECT_EQ(errno, ENOENT);
+
+  const std::string state = cache.getState();
+  EXPECT_NE(state.find("\"numCached\":1,"), std::string::npos);
+  EXPECT_NE(state.find("\"numHits\":1,"), std::string::npos);
+  EXPECT_NE(state.find("\"numMisses\":2,"), std::string::npos);
+}
+
+TEST_F(FdCacheTest, EvictedEntryStaysOpenWhileInUse) {
+  // one shard holding a single fd
+  FdCache cache(1, O_RDONLY);
+
+  auto first = cache.acquire(fileNames[0]);
+  ASSERT_NE(first, nullptr);
+  FdCache::hold(first);
+  FdCache::release(first);
+
+  auto second = cache.acquire(fileNames[1]);
+  ASSERT_NE(second, nullptr);
+  EXPECT_TRUE(isOpen(first->fd_));
+
+  const int fd = first->fd_;
+  FdCache::release(first);
+  EXPECT_FALSE(isOpen(fd));
+
+  FdCache::release(second);
+  EXPECT_TRUE(isOpen(second->fd_));
+  EXPECT_NE(cache.getState().find("\"numEvictions\":1,"),
+            std::string::npos);
+}
+
+TEST_F(FdCacheTest, InvalidateAfterDelete) {
+  FdCache cache(16, O_RDONLY);
+
+  auto entry = cache.acquire(fileNames[0]);
+  ASSERT_NE(entry, nullptr);
+  const int fd = entry->fd_;
+
+  ::unlink(fileNames[0].c_str());
+  cache.invalidate(fileNames[0]);
+  // job in flight can still use the fd of the deleted file
+  EXPECT_TRUE(isOpen(fd));
+  FdCache::release(entry);
+  EXPECT_FALSE(isOpen(fd));
+
+  EXPECT_EQ(cache.acquire(fileNames[0]), nullptr);
+
+  auto other = cache.acquire(fileNames[1]);
+  ASSERT_NE(other, nullptr);
+  const int otherFd = other->fd_;
+  FdCache::release(other);
+  cache.invalidate(fileNames[1]);
+  EXPECT_FALSE(isOpen(otherFd));
+}
+
+TEST_F(FdCacheTest, ZeroCapacityClosesAfterUse) {
+  FdCache cache(0, O_RDONLY);
+
+  auto entry = cache.acquire(fileNames[0]);
+  ASSERT_NE(entry, nullptr);
+  FdCache::hold(entry);
+  const int fd = entry->fd_;
+
+  FdCache::release(entry);
+  EXPECT_TRUE(isOpen(fd));
+  FdCache::release(entry);
+  EXPECT_FALSE(isOpen(fd));
+
+  EXPECT_NE(cache.getState().find("\"numCached\":0,"), std::string::npos);
+}
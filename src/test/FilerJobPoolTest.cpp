@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "../FilerJobPool.h"
+#include <gtest/gtest.h>
+
+#include <limits.h>
+#include <string.h>
+#include <string>
+
+using gobjfs::FileOp;
+using gobjfs::FilerJob;
+using gobjfs::FilerJobPool;
+using gobjfs::JobState;
+
+TEST(FilerJobPoolTest, ReusesReleasedJob) {
+  FilerJobPool pool(2);
+
+  FilerJob *job = pool.alloc(10, FileOp::Read);
+  EXPECT_TRUE(pool.isFromSlab(job));
+
+  // dirty the job the way an io would
+  job->setBuffer(4096, nullptr, 512);
+  job->completionId_ = 5;
+  job->retcode_ = 0;
+  job->setTimeout(100);
+  job->iovec_.push_back({nullptr, 512});
+  EXPECT_TRUE(job->claim());
+  FilerJobPool::release(job);
+
+  FilerJob *job1 = pool.alloc(11, FileOp::Write);
+  FilerJob *job2 = pool.alloc(12, FileOp::Write);
+  EXPECT_TRUE(job1 == job || job2 == job);
+
+  EXPECT_EQ(job->offset_, 0);
+  EXPECT_EQ(job->completionId_, 0);
+  EXPECT_EQ(job->retcode_, -EDOM);
+  EXPECT_FALSE(job->hasDeadline());
+  EXPECT_TRUE(job->iovec_.empty());
+  EXPECT_EQ(job->state_, JobState::Queued);
+  EXPECT_EQ(job->waitTime(), 0);
+
+  FilerJobPool::release(job1);
+  FilerJobPool::release(job2);
+}
+
+TEST(FilerJobPoolTest, FallsBackToHeapWhenEmpty) {
+  FilerJobPool pool(1);
+
+  FilerJob *job1 = pool.alloc(10, FileOp::Read);
+  FilerJob *job2 = pool.alloc(10, FileOp::Read);
+  ASSERT_NE(job2, nullptr);
+  EXPECT_TRUE(pool.isFromSlab(job1));
+  EXPECT_FALSE(pool.isFromSlab(job2));
+
+  FilerJobPool::release(job2);
+  FilerJobPool::release(job1);
+
+  // released job goes back to slab, heap job is freed
+  FilerJob *job3 = pool.alloc(10, FileOp::Read);
+  EXPECT_EQ(job3, job1);
+  FilerJobPool::release(job3);
+}
+
+TEST(FilerJobPoolTest, CopiesFileName) {
+  FilerJobPool pool(1);
+
+  char name[] = "/tmp/filerjobpool_test";
+  FilerJob *job = pool.alloc(name, FileOp::Delete);
+  ASSERT_NE(job, nullptr);
+  name[0] = 'x';
+  EXPECT_STREQ(job->fileName_, "/tmp/filerjobpool_test");
+  FilerJobPool::release(job);
+
+  const std::string longName(PATH_MAX, 'a');
+  EXPECT_EQ(pool.alloc(longName.c_str(), FileOp::Delete), nullptr);
+}
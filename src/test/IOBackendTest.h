@@ -0,0 +1,173 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#pragma once
+
+#include <gIOExecFile.h>
+#include <gMempool.h>
+#include <gtest/gtest.h>
+
+#include <util/os_utils.h>
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * run the same io sequences on every kernel backend, completion
+ * mode and thread model supported by IOExecutor
+ * test param is appended to the [ioexec] section of config
+ * Each test file derives its own fixture from this one, so that its
+ * tests are only instantiated with the configs which matter to them
+ */
+class IOBackendTest : public testing::TestWithParam<const char *> {
+
+  int configFileFd{-1};
+
+public:
+  char configFile[512];
+
+  IOExecServiceHandle serviceHandle{nullptr};
+  IOExecEventFdHandle evHandle{nullptr};
+  int readFd{gobjfs::os::FD_INVALID};
+
+  std::string testFileName;
+
+  virtual void SetUp() override {
+    strcpy(configFile, "ioexecbackendtestXXXXXX");
+
+    configFileFd = mkstemp(configFile);
+
+    const std::string configContents = std::string("[ioexec]\n"
+                                                   "ctx_queue_depth=200\n"
+                                                   "cpu_core=0\n") +
+                                       GetParam() + "\n";
+
+    ssize_t writeSz =
+        write(configFileFd, configContents.c_str(), configContents.size());
+
+    EXPECT_EQ(writeSz, configContents.size());
+
+    gMempool_init(512);
+
+    serviceHandle = IOExecFileServiceInit(configFile, nullptr, true);
+    ASSERT_NE(serviceHandle, nullptr);
+
+    evHandle = IOExecEventFdOpen(serviceHandle);
+    ASSERT_NE(evHandle, nullptr);
+
+    readFd = IOExecEventFdGetReadFd(evHandle);
+    EXPECT_NE(readFd, gobjfs::os::FD_INVALID);
+
+    testFileName = "/tmp/iobackend_" + std::to_string(getpid());
+  }
+
+  virtual void TearDown() override {
+    IOExecEventFdClose(evHandle);
+
+    if (serviceHandle) {
+      IOExecFileServiceDestroy(serviceHandle);
+    }
+
+    close(configFileFd);
+    int ret = ::unlink(configFile);
+    assert(ret == 0);
+    (void)ret;
+
+    ::unlink(testFileName.c_str());
+  }
+};
+
+static constexpr size_t NumBlocks = 10;
+static constexpr size_t BlockSize = 4096;
+
+// io may finish before it can be failed, but every fragment
+// must complete exactly once with either success or the given error
+inline void checkCompletions(int readFd, size_t numFrags, int allowedError) {
+  std::vector<int> numSeen(numFrags + 1, 0);
+  for (size_t idx = 0; idx < numFrags; idx++) {
+    gIOStatus ioStatus;
+    auto ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_TRUE((ioStatus.errorCode == 0) ||
+                (ioStatus.errorCode == allowedError))
+        << " got error=" << ioStatus.errorCode;
+    ASSERT_LE(ioStatus.completionId, numFrags);
+    numSeen[ioStatus.completionId]++;
+  }
+  for (size_t idx = 1; idx <= numFrags; idx++) {
+    EXPECT_EQ(numSeen[idx], 1) << " for completionId=" << idx;
+  }
+}
+
+// value of key in stats of each IOExecutor, in order of executors
+inline std::vector<int64_t> getExecutorStats(IOExecServiceHandle handle,
+                                             const char *key) {
+  const size_t len = 256 * 1024;
+  std::unique_ptr<char[]> stats(new char[len]);
+  auto statsLen = IOExecGetStats(handle, stats.get(), len - 1);
+  stats[statsLen] = 0;
+
+  std::vector<int64_t> values;
+  const char *executorKey = "{\"core\":";
+  for (char *pos = strstr(stats.get(), executorKey); pos;) {
+    char *next = strstr(pos + 1, executorKey);
+    char *found = strstr(pos, key);
+    values.push_back((found && (!next || found < next))
+                         ? atoll(found + strlen(key))
+                         : -1);
+    pos = next;
+  }
+  return values;
+}
+
+// collects completions delivered by callback
+struct CallbackCollector {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<gIOStatus> statusVec;
+  std::vector<std::thread::id> threadVec;
+  useconds_t delayUsec{0};
+
+  static void callback(gCompletionID completionId, int32_t errorCode,
+                       void *ctx) {
+    auto self = static_cast<CallbackCollector *>(ctx);
+    if (self->delayUsec) {
+      usleep(self->delayUsec);
+    }
+    std::unique_lock<std::mutex> lck(self->mutex);
+    self->statusVec.push_back({completionId, errorCode, 0});
+    self->threadVec.push_back(std::this_thread::get_id());
+    self->cond.notify_one();
+  }
+
+  void waitFor(size_t numStatus) {
+    std::unique_lock<std::mutex> lck(mutex);
+    EXPECT_TRUE(cond.wait_for(lck, std::chrono::seconds(10), [&]() {
+      return statusVec.size() >= numStatus;
+    }));
+  }
+};
@@ -0,0 +1,145 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+
+#include "../FilerJob.h"
+#include "../JobTracer.h"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using gobjfs::FileOp;
+using gobjfs::JobTrace;
+using gobjfs::JobTracer;
+using gobjfs::TraceStage;
+
+static size_t countOf(const std::string &str, const std::string &pattern) {
+  size_t count = 0;
+  for (size_t pos = str.find(pattern); pos != std::string::npos;
+       pos = str.find(pattern, pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+TEST(JobTracerTest, SampleRate) {
+  JobTracer tracer;
+  tracer.init(0, 16, 1, "test");
+  EXPECT_FALSE(tracer.isEnabled());
+  EXPECT_EQ(tracer.sample(), nullptr);
+
+  tracer.setSampleRate(4);
+  int numSampled = 0;
+  for (int idx = 0; idx < 40; idx++) {
+    JobTrace *trace = tracer.sample();
+    if (trace) {
+      numSampled++;
+      trace->release();
+    }
+  }
+  EXPECT_EQ(numSampled, 10);
+  EXPECT_EQ(tracer.numPublished(), 10);
+}
+
+TEST(JobTracerTest, PublishedOnLastRelease) {
+  JobTracer tracer;
+  tracer.init(1, 16, 1, "test");
+
+  JobTrace *trace = tracer.sample();
+  ASSERT_NE(trace, nullptr);
+  trace->hold();
+  trace->release();
+  EXPECT_EQ(tracer.numPublished(), 0);
+  trace->release();
+  EXPECT_EQ(tracer.numPublished(), 1);
+}
+
+TEST(JobTracerTest, ChromeTraceEvents) {
+  JobTracer tracer;
+  tracer.init(1, 16, 3, "ioexec3");
+
+  JobTrace *trace = tracer.sample();
+  ASSERT_NE(trace, nullptr);
+  trace->op_ = (int32_t)FileOp::Read;
+  trace->completionId_ = 77;
+  trace->size_ = 4096;
+  for (int stage = 0; stage < (int)TraceStage::Count; stage++) {
+    trace->stamp((TraceStage)stage, 1000 * (stage + 1));
+  }
+  trace->release();
+
+  std::ostringstream os;
+  EXPECT_EQ(tracer.getTraceEvents(os), 1);
+  const std::string events = os.str();
+
+  EXPECT_NE(events.find("\"process_name\""), std::string::npos);
+  EXPECT_NE(events.find("\"ioexec3\""), std::string::npos);
+  EXPECT_NE(events.find("\"completionId\":77"), std::string::npos);
+  // job plus five stage intervals
+  EXPECT_EQ(countOf(events, "\"ph\":\"b\""), 6);
+  EXPECT_EQ(countOf(events, "\"ph\":\"e\""), 6);
+  for (auto name : {"queued", "io_submit", "device", "reap", "complete"}) {
+    EXPECT_EQ(countOf(events, std::string("\"") + name + "\""), 2) << name;
+  }
+  EXPECT_NE(events.find("\"ts\":1.000"), std::string::npos);
+  EXPECT_NE(events.find("\"ts\":6.000"), std::string::npos);
+}
+
+TEST(JobTracerTest, LateSubmitStampIsDropped) {
+  JobTracer tracer;
+  tracer.init(1, 16, 1, "test");
+
+  JobTrace *trace = tracer.sample();
+  ASSERT_NE(trace, nullptr);
+  trace->stamp(TraceStage::Submit, 1000);
+  trace->stamp(TraceStage::Dequeue, 2000);
+  // submitter stamped it after the job had completed
+  trace->stamp(TraceStage::Submitted, 9000);
+  trace->stamp(TraceStage::Wakeup, 3000);
+  trace->stamp(TraceStage::Reaped, 4000);
+  trace->stamp(TraceStage::Done, 5000);
+  trace->release();
+
+  std::ostringstream os;
+  EXPECT_EQ(tracer.getTraceEvents(os), 1);
+  const std::string events = os.str();
+  EXPECT_EQ(countOf(events, "\"io_submit\""), 0);
+  EXPECT_EQ(countOf(events, "\"device\""), 2);
+  EXPECT_EQ(events.find("\"ts\":9.000"), std::string::npos);
+}
+
+TEST(JobTracerTest, RingKeepsMostRecent) {
+  JobTracer tracer;
+  tracer.init(1, 4, 1, "test");
+
+  for (int idx = 0; idx < 10; idx++) {
+    JobTrace *trace = tracer.sample();
+    trace->completionId_ = idx;
+    trace->stamp(TraceStage::Submit, 1000);
+    trace->release();
+  }
+
+  std::ostringstream os;
+  EXPECT_EQ(tracer.getTraceEvents(os), 4);
+  const std::string events = os.str();
+  EXPECT_EQ(events.find("\"completionId\":5,"), std::string::npos);
+  for (int idx = 6; idx < 10; idx++) {
+    EXPECT_NE(events.find("\"completionId\":" + std::to_string(idx) + ","),
+              std::string::npos);
+  }
+}
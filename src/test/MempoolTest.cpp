@@ -62,6 +62,37 @@ TEST(MempoolTest, CheckStats) {
   }
 }
 
+TEST(MempoolTest, NodePool) {
+  MempoolSPtr m =
+      MempoolFactory::createAlignedMempool("aligned0", DirectIOSize, 0);
+
+  void *small = m->Alloc(100);
+  void *large = m->Alloc(1 << 20);
+  EXPECT_TRUE(IsDirectIOAligned((uint64_t)small));
+  EXPECT_TRUE(IsDirectIOAligned((uint64_t)large));
+  EXPECT_TRUE(m->Owns(small));
+  EXPECT_TRUE(m->Owns(large));
+  memset(small, 0, 100);
+  memset(large, 0, 1 << 20);
+
+  // freed buffer is reused for a request of the same size
+  m->Free(large);
+  void *again = m->Alloc(1 << 20);
+  EXPECT_EQ(again, large);
+  m->Free(again);
+  m->Free(small);
+
+  // only node 0 exists on every machine
+  auto s = m->GetStats();
+  EXPECT_NE(s.find("num alloc=3:num failed=0:num reused=1:num free=3:"
+                   "node=0:num cross node=0"),
+            std::string::npos)
+      << s;
+
+  int stackVar = 0;
+  EXPECT_FALSE(m->Owns(&stackVar));
+}
+
 TEST(gMempoolTest, CheckAlignment) {
   gMempool_init(DirectIOSize);
 
@@ -72,6 +103,21 @@ TEST(gMempoolTest, CheckAlignment) {
   gMempool_free(p);
 }
 
+TEST(gMempoolTest, AllocOnNode) {
+  gMempool_init(DirectIOSize);
+
+  // -1 picks the node of the calling thread, and an unknown node
+  // falls back to the default pool
+  for (int node : {-1, 0, 1 << 20}) {
+    void *p = gMempool_alloc_node(8192, node);
+    EXPECT_NE(p, nullptr);
+    EXPECT_TRUE(IsDirectIOAligned((uint64_t)p));
+    memset(p, 0, 8192);
+    gMempool_free(p);
+  }
+  EXPECT_EQ(gMempool_alloc_node(0, 0), nullptr);
+}
+
 TEST(gMempoolTest, CheckStats) {
   gMempool_init(DirectIOSize);
 
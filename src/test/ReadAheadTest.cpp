@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+
+#include "../ReadAhead.h"
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+using gobjfs::ReadAheadPool;
+
+TEST(ReadAheadPoolTest, CapIsEnforced) {
+  ReadAheadPool pool(8192, 16384);
+
+  char *first = pool.allocBuffer(8192);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ((uintptr_t)first % 512, 0);
+  char *second = pool.allocBuffer(8192);
+  ASSERT_NE(second, nullptr);
+
+  EXPECT_EQ(pool.allocBuffer(512), nullptr);
+  EXPECT_EQ(pool.numOverCap_, 1);
+
+  // freed memory can be used again
+  pool.freeBuffer(first, 8192);
+  char *third = pool.allocBuffer(4096);
+  EXPECT_NE(third, nullptr);
+
+  pool.freeBuffer(second, 8192);
+  pool.freeBuffer(third, 4096);
+  EXPECT_NE(pool.getState().find("\"bytesInUse\":0,"), std::string::npos);
+}
+
+TEST(ReadAheadPoolTest, WindowIsSectorAligned) {
+  ReadAheadPool pool(1000, 1 << 20);
+  EXPECT_EQ(pool.windowSize(), 1024);
+
+  ReadAheadPool disabled(4096, 0);
+  EXPECT_EQ(disabled.maxBytes(), 0);
+  EXPECT_EQ(disabled.allocBuffer(512), nullptr);
+}
+
+TEST(ReadAheadPoolTest, StateIsJson) {
+  ReadAheadPool pool(4096, 8192);
+  pool.numHits_ = 3;
+  pool.wastedBytes_ = 512;
+
+  const std::string state = pool.getState();
+  EXPECT_EQ(state.front(), '{');
+  EXPECT_EQ(state.back(), '}');
+  EXPECT_NE(state.find("\"numHits\":3,"), std::string::npos);
+  EXPECT_NE(state.find("\"wastedBytes\":512}"), std::string::npos);
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+
+#include "../TenantQos.h"
+#include <gtest/gtest.h>
+
+using gobjfs::TenantQos;
+
+static const TenantQos::Clock::time_point start = TenantQos::Clock::now();
+
+static TenantQos::Clock::time_point afterUsec(int64_t usec) {
+  return start + std::chrono::microseconds(usec);
+}
+
+TEST(TenantQosTest, UnlimitedTenantIsAdmitted) {
+  TenantQos qos;
+  EXPECT_FALSE(qos.isLimited(1));
+  EXPECT_EQ(qos.admit(1, 1 << 20, afterUsec(0)), 0);
+
+  qos.setLimit(2, 10, 0, 0);
+  EXPECT_FALSE(qos.isLimited(1));
+  EXPECT_TRUE(qos.isLimited(2));
+  EXPECT_EQ(qos.admit(1, 1 << 20, afterUsec(0)), 0);
+}
+
+TEST(TenantQosTest, IopsLimitWithBurst) {
+  TenantQos qos;
+  // 1000 iops, and 10 msec worth of burst
+  qos.setLimit(1, 1000, 0, 10);
+
+  const auto now = TenantQos::Clock::now();
+  int numAdmitted = 0;
+  while (qos.admit(1, 4096, now) == 0) {
+    numAdmitted++;
+  }
+  // burst, plus the one which took the bucket into debt
+  EXPECT_EQ(numAdmitted, 11);
+
+  // one request every msec after that
+  const int64_t waitUsec = qos.admit(1, 4096, now);
+  EXPECT_GT(waitUsec, 0);
+  EXPECT_LE(waitUsec, 1001);
+  EXPECT_EQ(qos.admit(1, 4096, now + std::chrono::microseconds(waitUsec)),
+            0);
+}
+
+TEST(TenantQosTest, LargeRequestPaysDebt) {
+  TenantQos qos;
+  // 1MB/sec without burst
+  qos.setLimit(1, 0, 1 << 20, 0);
+
+  const auto now = TenantQos::Clock::now();
+  EXPECT_EQ(qos.admit(1, 1 << 20, now), 0);
+
+  // next one waits about a second for the first to be paid for
+  const int64_t waitUsec = qos.admit(1, 4096, now);
+  EXPECT_GT(waitUsec, 900 * 1000);
+  EXPECT_LE(waitUsec, 1100 * 1000);
+}
+
+TEST(TenantQosTest, LimitChangedAtRuntime) {
+  TenantQos qos;
+  qos.setLimit(1, 1, 0, 0);
+
+  const auto now = TenantQos::Clock::now();
+  EXPECT_EQ(qos.admit(1, 0, now), 0);
+  EXPECT_GT(qos.admit(1, 0, now), 0);
+
+  // removing the limit admits right away
+  qos.setLimit(1, 0, 0, 0);
+  EXPECT_FALSE(qos.isLimited(1));
+  EXPECT_EQ(qos.admit(1, 0, now), 0);
+
+  qos.recordDelay(1, 100);
+  qos.setLimit(1, 1, 0, 0);
+  qos.recordDelay(1, 100);
+  auto state = qos.getState();
+  EXPECT_NE(state.find("\"tenant\":1,"), std::string::npos);
+  EXPECT_NE(state.find("\"numDelayed\":1,"), std::string::npos);
+}
@@ -0,0 +1,882 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "IOBackendTest.h"
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+TEST_P(IOBackendTest, WriteThenRead) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    EXPECT_EQ(memcmp(readBatch->array[idx].addr, writeBatch->array[idx].addr,
+                     BlockSize),
+              0);
+  }
+
+  gIOBatchFree(writeBatch);
+  gIOBatchFree(readBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOBackendTest, ReadPastEnd) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  const size_t fileBlocks = NumBlocks / 2;
+  auto ret = IOExecFileTruncate(fileHandle, fileBlocks * BlockSize);
+  EXPECT_EQ(ret, 0);
+
+  // adjacent reads can get merged into one io which ends short
+  // only the blocks past the end of file must fail
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    if (ioStatus.completionId <= fileBlocks) {
+      EXPECT_EQ(ioStatus.errorCode, 0);
+    } else {
+      EXPECT_EQ(ioStatus.errorCode, -EIO);
+    }
+  }
+
+  gIOBatchFree(readBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOBackendTest, SyncAfterWrite) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  // syncs submitted back to back may share one kernel call
+  // but each must complete
+  static constexpr size_t NumSyncs = 8;
+  for (size_t idx = 0; idx < NumSyncs; idx++) {
+    ret = IOExecFileSync(fileHandle, idx + 1, /*dataOnly*/ (idx % 2),
+                         evHandle);
+    EXPECT_EQ(ret, 0);
+  }
+
+  std::vector<int> numSeen(NumSyncs + 1, 0);
+  for (size_t idx = 0; idx < NumSyncs; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    ASSERT_LE(ioStatus.completionId, NumSyncs);
+    numSeen[ioStatus.completionId]++;
+  }
+  for (size_t idx = 1; idx <= NumSyncs; idx++) {
+    EXPECT_EQ(numSeen[idx], 1) << " for completionId=" << idx;
+  }
+
+  gIOBatchFree(writeBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOBackendTest, NonAlignedWrite) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeOne = [&](off_t offset, size_t size, char fillChar) {
+    auto batch = gIOBatchAlloc(1);
+    gIOExecFragment &frag = batch->array[0];
+    frag.offset = offset;
+    frag.size = size;
+    frag.addr = (char *)gMempool_alloc(size);
+    memset(frag.addr, fillChar, size);
+    frag.completionId = offset + 1;
+
+    auto ret = IOExecFileWrite(fileHandle, batch, evHandle);
+    EXPECT_EQ(ret, 0);
+
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    EXPECT_EQ(ioStatus.completionId, offset + 1);
+    gIOBatchFree(batch);
+  };
+
+  // read back through page cache
+  int verifyFd = ::open(testFileName.c_str(), O_RDONLY);
+  ASSERT_GE(verifyFd, 0);
+  auto verify = [&](off_t offset, size_t size, char fillChar) {
+    std::unique_ptr<char[]> buf(new char[size]);
+    ASSERT_EQ(::pread(verifyFd, buf.get(), size, offset), (ssize_t)size);
+    for (size_t idx = 0; idx < size; idx++) {
+      ASSERT_EQ(buf[idx], fillChar) << " at offset=" << offset + idx;
+    }
+  };
+  auto fileSize = [&]() {
+    struct stat statBuf;
+    EXPECT_EQ(::fstat(verifyFd, &statBuf), 0);
+    return statBuf.st_size;
+  };
+
+  writeOne(0, 4 * BlockSize, 'x');
+
+  // rest of the last block must survive
+  writeOne(0, 1000, 'y');
+  verify(0, 1000, 'y');
+  verify(1000, 4 * BlockSize - 1000, 'x');
+  EXPECT_EQ(fileSize(), 4 * BlockSize);
+
+  // padding past end of file is cut
+  writeOne(4 * BlockSize, 700, 'z');
+  verify(4 * BlockSize, 700, 'z');
+  EXPECT_EQ(fileSize(), 4 * BlockSize + 700);
+
+  // aligned part and tail written as one io
+  writeOne(0, 20000, 'w');
+  verify(0, 20000, 'w');
+  EXPECT_EQ(fileSize(), 20000);
+
+  // cutting the padding must not cut a write past it which
+  // was submitted right after
+  static constexpr size_t NumRounds = 50;
+  auto tailBatch = gIOBatchAlloc(1);
+  auto pastBatch = gIOBatchAlloc(1);
+  tailBatch->array[0].size = 700;
+  tailBatch->array[0].addr = (char *)gMempool_alloc(BlockSize);
+  memset(tailBatch->array[0].addr, 't', BlockSize);
+  pastBatch->array[0].size = BlockSize;
+  pastBatch->array[0].addr = (char *)gMempool_alloc(BlockSize);
+  memset(pastBatch->array[0].addr, 'p', BlockSize);
+  for (size_t round = 0; round < NumRounds; round++) {
+    const off_t base = (off_t)(round + 1) * 8 * BlockSize;
+    tailBatch->array[0].offset = base;
+    tailBatch->array[0].completionId = 1;
+    pastBatch->array[0].offset = base + BlockSize;
+    pastBatch->array[0].completionId = 2;
+
+    auto ret = IOExecFileWrite(fileHandle, tailBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+    ret = IOExecFileWrite(fileHandle, pastBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+    checkCompletions(readFd, 2, 0);
+
+    ASSERT_EQ(fileSize(), base + 2 * BlockSize) << " in round=" << round;
+    verify(base, 700, 't');
+    verify(base + BlockSize, BlockSize, 'p');
+  }
+  gIOBatchFree(tailBatch);
+  gIOBatchFree(pastBatch);
+
+  ::close(verifyFd);
+  IOExecFileClose(fileHandle);
+}
+
+// destroy must wait for the padding of writes in flight to be cut
+TEST_P(IOBackendTest, DestroyDuringNonAlignedWrite) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  static constexpr size_t NumWrites = 32;
+  static constexpr size_t TailSize = 700;
+  std::vector<gIOBatch *> batches;
+  for (size_t idx = 0; idx < NumWrites; idx++) {
+    auto batch = gIOBatchAlloc(1);
+    gIOExecFragment &frag = batch->array[0];
+    frag.offset = idx * 2 * BlockSize;
+    frag.size = TailSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'd', BlockSize);
+    frag.completionId = idx + 1;
+    auto ret = IOExecFileWrite(fileHandle, batch, evHandle);
+    EXPECT_EQ(ret, 0);
+    batches.push_back(batch);
+  }
+
+  auto ret = IOExecFileServiceDestroy(serviceHandle);
+  EXPECT_EQ(ret, 0);
+  serviceHandle = nullptr;
+
+  checkCompletions(readFd, NumWrites, 0);
+
+  struct stat statBuf;
+  ret = ::stat(testFileName.c_str(), &statBuf);
+  ASSERT_EQ(ret, 0);
+  EXPECT_EQ(statBuf.st_size, (NumWrites - 1) * 2 * BlockSize + TailSize);
+
+  for (auto batch : batches) {
+    gIOBatchFree(batch);
+  }
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOBackendTest, DeleteBurst) {
+
+  static constexpr size_t NumFiles = 64;
+
+  std::vector<std::string> fileNames;
+  for (size_t idx = 0; idx < NumFiles; idx++) {
+    fileNames.push_back(testFileName + "_" + std::to_string(idx));
+    int fd = ::open(fileNames.back().c_str(), O_CREAT | O_RDWR, S_IRWXU);
+    ASSERT_GE(fd, 0);
+    ::close(fd);
+  }
+
+  for (size_t idx = 0; idx < NumFiles; idx++) {
+    auto ret = IOExecFileDelete(serviceHandle, fileNames[idx].c_str(),
+                                idx + 1, evHandle);
+    EXPECT_EQ(ret, 0);
+  }
+
+  std::vector<int> numSeen(NumFiles + 1, 0);
+  for (size_t idx = 0; idx < NumFiles; idx++) {
+    gIOStatus ioStatus;
+    auto ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    ASSERT_LE(ioStatus.completionId, NumFiles);
+    numSeen[ioStatus.completionId]++;
+  }
+
+  for (size_t idx = 0; idx < NumFiles; idx++) {
+    EXPECT_EQ(numSeen[idx + 1], 1) << " for completionId=" << idx + 1;
+    EXPECT_NE(::access(fileNames[idx].c_str(), F_OK), 0);
+  }
+
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+  stats[statsLen] = 0;
+  EXPECT_NE(strstr(stats.get(), "\"fdQueue\":[{"), nullptr);
+}
+
+TEST_P(IOBackendTest, ConcurrentSubmitters) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  // each thread writes its own blocks, one request at a time, so
+  // that requests of different threads are queued concurrently
+  static constexpr size_t NumThreads = 8;
+  static constexpr size_t NumWritesPerThread = 200;
+
+  auto writer = [&](size_t threadIdx) {
+    auto threadEvHandle = IOExecEventFdOpen(serviceHandle);
+    ASSERT_NE(threadEvHandle, nullptr);
+    const int threadReadFd = IOExecEventFdGetReadFd(threadEvHandle);
+
+    auto batch = gIOBatchAlloc(1);
+    gIOExecFragment &frag = batch->array[0];
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + threadIdx, BlockSize);
+
+    for (size_t idx = 0; idx < NumWritesPerThread; idx++) {
+      frag.offset = (threadIdx * NumWritesPerThread + idx) * BlockSize;
+      frag.completionId = idx + 1;
+
+      int32_t ret = IOExecFileWrite(fileHandle, batch, threadEvHandle);
+      if (ret == -EAGAIN) {
+        usleep(100);
+        idx--;
+        continue;
+      }
+      EXPECT_EQ(ret, 0);
+
+      gIOStatus ioStatus;
+      ret = ::read(threadReadFd, &ioStatus, sizeof(ioStatus));
+      EXPECT_EQ(ret, sizeof(ioStatus));
+      EXPECT_EQ(ioStatus.errorCode, 0);
+      EXPECT_EQ(ioStatus.completionId, idx + 1);
+    }
+
+    gIOBatchFree(batch);
+    IOExecEventFdClose(threadEvHandle);
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t idx = 0; idx < NumThreads; idx++) {
+    threads.emplace_back(writer, idx);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  char buf[BlockSize] __attribute__((aligned(BlockSize)));
+  int fd = ::open(testFileName.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  for (size_t threadIdx = 0; threadIdx < NumThreads; threadIdx++) {
+    const off_t offset = threadIdx * NumWritesPerThread * BlockSize;
+    EXPECT_EQ(::pread(fd, buf, BlockSize, offset), BlockSize);
+    EXPECT_EQ(buf[0], (char)('a' + threadIdx));
+  }
+  ::close(fd);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOBackendTest, ReadByName) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+  IOExecFileClose(fileHandle);
+
+  // all fragments of a batch share one fd, held until each is done
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  for (int iter = 0; iter < 3; iter++) {
+    for (size_t idx = 0; idx < NumBlocks; idx++) {
+      memset(readBatch->array[idx].addr, 0, BlockSize);
+    }
+    ret = IOExecFileRead(serviceHandle, testFileName.c_str(),
+                         testFileName.size(), readBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+
+    for (size_t idx = 0; idx < NumBlocks; idx++) {
+      gIOStatus ioStatus;
+      ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+      EXPECT_EQ(ret, sizeof(ioStatus));
+      EXPECT_EQ(ioStatus.errorCode, 0);
+    }
+
+    for (size_t idx = 0; idx < NumBlocks; idx++) {
+      EXPECT_EQ(memcmp(readBatch->array[idx].addr,
+                       writeBatch->array[idx].addr, BlockSize),
+                0);
+    }
+  }
+
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+  stats[statsLen] = 0;
+  EXPECT_NE(strstr(stats.get(), "fdCache={\"capacity\":"), nullptr);
+  if (strstr(stats.get(), "\"capacity\":0,") == nullptr) {
+    EXPECT_NE(strstr(stats.get(), "\"numHits\":2,"), nullptr);
+  }
+
+  // deleted file is no longer readable through a cached fd
+  ret = IOExecFileDeleteSync(serviceHandle, testFileName.c_str());
+  EXPECT_EQ(ret, 0);
+  ret = IOExecFileRead(serviceHandle, testFileName.c_str(),
+                       testFileName.size(), readBatch, evHandle);
+  EXPECT_EQ(ret, -EIO);
+
+  gIOBatchFree(writeBatch);
+  gIOBatchFree(readBatch);
+}
+
+TEST_P(IOBackendTest, AsyncOpenPutClose) {
+
+  const size_t objectSize = NumBlocks * BlockSize;
+  gIOExecFragment putFrag;
+  memset(&putFrag, 0, sizeof(putFrag));
+  putFrag.size = objectSize;
+  putFrag.addr = (char *)gMempool_alloc(objectSize);
+  memset(putFrag.addr, 'p', objectSize);
+  putFrag.completionId = 1;
+
+  auto ret = IOExecFilePut(serviceHandle, testFileName.c_str(),
+                           testFileName.size(),
+                           O_DIRECT | O_CREAT | O_WRONLY | O_TRUNC, &putFrag,
+                           evHandle);
+  EXPECT_EQ(ret, 0);
+
+  gIOStatus ioStatus;
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.completionId, 1);
+  EXPECT_EQ(ioStatus.errorCode, 0);
+
+  IOExecFileHandle fileHandle{nullptr};
+  ret = IOExecFileOpenAsync(serviceHandle, testFileName.c_str(),
+                            testFileName.size(), O_DIRECT | O_RDONLY, 2,
+                            evHandle, &fileHandle);
+  EXPECT_EQ(ret, 0);
+  ASSERT_NE(fileHandle, nullptr);
+
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.completionId, 2);
+  EXPECT_EQ(ioStatus.errorCode, 0);
+
+  auto readBatch = gIOBatchAlloc(1);
+  gIOExecFragment &frag = readBatch->array[0];
+  frag.size = objectSize;
+  frag.addr = (char *)gMempool_alloc(objectSize);
+  frag.completionId = 3;
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.errorCode, 0);
+  EXPECT_EQ(memcmp(frag.addr, putFrag.addr, objectSize), 0);
+
+  ret = IOExecFileCloseAsync(fileHandle, 4, evHandle);
+  EXPECT_EQ(ret, 0);
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.completionId, 4);
+  EXPECT_EQ(ioStatus.errorCode, 0);
+
+  // failed open still hands out a handle, which cannot do async close
+  const std::string missingName = testFileName + "_missing";
+  ret = IOExecFileOpenAsync(serviceHandle, missingName.c_str(),
+                            missingName.size(), O_RDONLY, 5, evHandle,
+                            &fileHandle);
+  EXPECT_EQ(ret, 0);
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.errorCode, -ENOENT);
+  EXPECT_EQ(IOExecFileCloseAsync(fileHandle, 6, evHandle), -EBADF);
+  IOExecFileClose(fileHandle);
+
+  // put with O_DIRECT can write any size, since its tail is past EOF
+  const size_t tailSize = BlockSize + 100;
+  putFrag.size = tailSize;
+  putFrag.completionId = 7;
+  ret = IOExecFilePut(serviceHandle, testFileName.c_str(),
+                      testFileName.size(),
+                      O_DIRECT | O_CREAT | O_WRONLY | O_TRUNC, &putFrag,
+                      evHandle);
+  EXPECT_EQ(ret, 0);
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.errorCode, 0);
+  EXPECT_EQ(ioStatus.completionId, 7);
+
+  struct stat statBuf;
+  ret = ::stat(testFileName.c_str(), &statBuf);
+  EXPECT_EQ(ret, 0);
+  EXPECT_EQ(statBuf.st_size, tailSize);
+
+  std::string content(tailSize, '\0');
+  int fd = ::open(testFileName.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(::pread(fd, &content[0], tailSize, 0), (ssize_t)tailSize);
+  ::close(fd);
+  EXPECT_EQ(content, std::string(tailSize, 'p'));
+
+  gMempool_free(putFrag.addr);
+  gIOBatchFree(readBatch);
+}
+
+// destroy must wait for Puts in flight, whose write and close
+// are queued by other steps of the Put
+TEST_P(IOBackendTest, DestroyDuringPut) {
+
+  const size_t tailSize = BlockSize + 100;
+  char *putBuf = (char *)gMempool_alloc(2 * BlockSize);
+  memset(putBuf, 'p', 2 * BlockSize);
+
+  gIOExecFragment putFrag;
+  memset(&putFrag, 0, sizeof(putFrag));
+  putFrag.size = tailSize;
+  putFrag.addr = putBuf;
+
+  static constexpr size_t NumPuts = 32;
+  std::vector<std::string> fileNames;
+  for (size_t idx = 0; idx < NumPuts; idx++) {
+    fileNames.push_back(testFileName + "_" + std::to_string(idx));
+  }
+
+  // a Put is submitted once, whether or not its write is
+  putFrag.completionId = 1;
+  auto ret = IOExecFilePut(serviceHandle, fileNames[0].c_str(),
+                           fileNames[0].size(),
+                           O_DIRECT | O_CREAT | O_WRONLY | O_TRUNC, &putFrag,
+                           evHandle);
+  EXPECT_EQ(ret, 0);
+  checkCompletions(readFd, 1, 0);
+  // submitter thread counts the io after io_submit returns, which
+  // can be after its completion was posted
+  auto numQueued = getExecutorStats(serviceHandle, "\"numQueued\":");
+  auto numSubmitted = getExecutorStats(serviceHandle, "\"numSubmitted\":");
+  for (int numTries = 0; (numTries < 100) && (numQueued != numSubmitted);
+       numTries++) {
+    usleep(1000);
+    numSubmitted = getExecutorStats(serviceHandle, "\"numSubmitted\":");
+  }
+  EXPECT_EQ(numQueued, numSubmitted);
+
+  for (size_t idx = 0; idx < NumPuts; idx++) {
+    putFrag.completionId = idx + 1;
+    ret = IOExecFilePut(serviceHandle, fileNames[idx].c_str(),
+                        fileNames[idx].size(),
+                        O_DIRECT | O_CREAT | O_WRONLY | O_TRUNC, &putFrag,
+                        evHandle);
+    EXPECT_EQ(ret, 0);
+  }
+
+  ret = IOExecFileServiceDestroy(serviceHandle);
+  EXPECT_EQ(ret, 0);
+  serviceHandle = nullptr;
+
+  checkCompletions(readFd, NumPuts, 0);
+
+  for (auto &fileName : fileNames) {
+    struct stat statBuf;
+    ret = ::stat(fileName.c_str(), &statBuf);
+    EXPECT_EQ(ret, 0);
+    EXPECT_EQ(statBuf.st_size, tailSize) << " for file=" << fileName;
+    ::unlink(fileName.c_str());
+  }
+
+  gMempool_free(putBuf);
+}
+
+TEST_P(IOBackendTest, ReadMulti) {
+
+  static constexpr size_t NumFiles = 4;
+
+  std::vector<std::string> fileNames;
+  std::vector<IOExecFileHandle> fileHandles;
+  for (size_t fileIdx = 0; fileIdx < NumFiles; fileIdx++) {
+    fileNames.push_back(testFileName + "_" + std::to_string(fileIdx));
+    auto fileHandle = IOExecFileOpen(serviceHandle, fileNames.back().c_str(),
+                                     fileNames.back().size(),
+                                     O_DIRECT | O_CREAT | O_RDWR);
+    ASSERT_NE(fileHandle, nullptr);
+    fileHandles.push_back(fileHandle);
+
+    auto writeBatch = gIOBatchAlloc(NumBlocks);
+    for (size_t idx = 0; idx < NumBlocks; idx++) {
+      gIOExecFragment &frag = writeBatch->array[idx];
+      frag.offset = idx * BlockSize;
+      frag.size = BlockSize;
+      frag.addr = (char *)gMempool_alloc(BlockSize);
+      memset(frag.addr, 'a' + fileIdx * NumBlocks + idx, BlockSize);
+      frag.completionId = idx + 1;
+    }
+    auto ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+    for (size_t idx = 0; idx < NumBlocks; idx++) {
+      gIOStatus ioStatus;
+      ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+      EXPECT_EQ(ret, sizeof(ioStatus));
+      EXPECT_EQ(ioStatus.errorCode, 0);
+    }
+    gIOBatchFree(writeBatch);
+  }
+
+  // two blocks from each file, half by handle and half by name
+  const size_t numFrags = NumFiles * 2;
+  auto readBatch = gIOBatchAlloc(numFrags);
+  std::vector<gIOFileRef> files(numFrags);
+  for (size_t idx = 0; idx < numFrags; idx++) {
+    const size_t fileIdx = idx % NumFiles;
+    const size_t blockIdx = idx / NumFiles;
+    if (idx % 2) {
+      files[idx] = {fileHandles[fileIdx], nullptr, 0};
+    } else {
+      files[idx] = {nullptr, fileNames[fileIdx].c_str(),
+                    fileNames[fileIdx].size()};
+    }
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = blockIdx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  auto ret = IOExecFileReadMulti(serviceHandle, files.data(), readBatch,
+                                 evHandle);
+  EXPECT_EQ(ret, 0);
+
+  std::vector<int> numSeen(numFrags + 1, 0);
+  for (size_t idx = 0; idx < numFrags; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    ASSERT_LE(ioStatus.completionId, numFrags);
+    numSeen[ioStatus.completionId]++;
+  }
+
+  for (size_t idx = 0; idx < numFrags; idx++) {
+    EXPECT_EQ(numSeen[idx + 1], 1) << " for completionId=" << idx + 1;
+    const char expected = 'a' + (idx % NumFiles) * NumBlocks + idx / NumFiles;
+    const char *buf = (const char *)readBatch->array[idx].addr;
+    EXPECT_EQ(buf[0], expected) << " for fragment=" << idx;
+    EXPECT_EQ(buf[BlockSize - 1], expected) << " for fragment=" << idx;
+  }
+
+  // nothing is queued if any file cannot be opened
+  const std::string missingName = testFileName + "_missing";
+  files[numFrags - 1] = {nullptr, missingName.c_str(), missingName.size()};
+  ret = IOExecFileReadMulti(serviceHandle, files.data(), readBatch, evHandle);
+  EXPECT_EQ(ret, -EIO);
+
+  struct pollfd pfd = {readFd, POLLIN, 0};
+  EXPECT_EQ(::poll(&pfd, 1, 10), 0);
+
+  gIOBatchFree(readBatch);
+
+  for (size_t fileIdx = 0; fileIdx < NumFiles; fileIdx++) {
+    IOExecFileClose(fileHandles[fileIdx]);
+    ::unlink(fileNames[fileIdx].c_str());
+  }
+}
+
+TEST_P(IOBackendTest, RegisteredBuffer) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  void *regionAddr = nullptr;
+  const int32_t bufIndex =
+      IOExecRegisterBuffer(serviceHandle, BlockSize, &regionAddr);
+  ASSERT_GT(bufIndex, 0);
+  ASSERT_NE(regionAddr, nullptr);
+  char *region = static_cast<char *>(regionAddr);
+
+  // blocks are not adjacent in the file, so they are not merged
+  // into vectored io, which cannot use a fixed buffer
+  const size_t readOffset = 1 << 20;
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    memset(region + idx * BlockSize, 'a' + idx, BlockSize);
+
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * 2 * BlockSize;
+    frag.size = BlockSize;
+    frag.bufIndex = bufIndex;
+    frag.bufOffset = idx * BlockSize;
+    frag.completionId = idx + 1;
+
+    readBatch->array[idx] = frag;
+    readBatch->array[idx].bufOffset = readOffset + idx * BlockSize;
+  }
+
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  EXPECT_EQ(memcmp(region, region + readOffset, NumBlocks * BlockSize), 0);
+
+  // fragment which runs past the end of its region is refused
+  readBatch->array[0].bufOffset = (2 << 20) - BlockSize / 2;
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, -EINVAL);
+
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+  stats[statsLen] = 0;
+  EXPECT_NE(strstr(stats.get(), "bufferRegions={\"numRegions\":1,"),
+            nullptr);
+  if (strstr(stats.get(), "\"backend\":\"io_uring\"")) {
+    uint64_t numFixedIO = 0;
+    const char *key = "\"numFixedIO\":";
+    for (const char *pos = strstr(stats.get(), key); pos;
+         pos = strstr(pos + 1, key)) {
+      numFixedIO += strtoull(pos + strlen(key), nullptr, 10);
+    }
+    EXPECT_EQ(numFixedIO, 2 * NumBlocks);
+  }
+
+  // frees neither fragment buffers nor the region
+  gIOBatchFree(writeBatch);
+  gIOBatchFree(readBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+INSTANTIATE_TEST_CASE_P(AllBackends, IOBackendTest,
+                        testing::Values("backend=libaio", "backend=io_uring"));
+
+INSTANTIATE_TEST_CASE_P(PollMode, IOBackendTest,
+                        testing::Values("backend=libaio\n"
+                                        "completion_mode=poll",
+                                        "backend=io_uring\n"
+                                        "completion_mode=poll\n"
+                                        "poll_spin_usec=0"));
+
+INSTANTIATE_TEST_CASE_P(MultipleCtx, IOBackendTest,
+                        testing::Values("num_ctx=3",
+                                        "backend=io_uring\n"
+                                        "num_ctx=2\n"
+                                        "completion_mode=poll"));
+
+// with one executor, reads are queued apart but never stolen
+INSTANTIATE_TEST_CASE_P(WorkStealing, IOBackendTest,
+                        testing::Values("cpu_core=0\n"
+                                        "work_stealing=true",
+                                        "work_stealing=true"));
+
+INSTANTIATE_TEST_CASE_P(NoMerge, IOBackendTest,
+                        testing::Values("max_merge_jobs=1"));
+
+INSTANTIATE_TEST_CASE_P(FdQueuePool, IOBackendTest,
+                        testing::Values("fdqueue_threads=4"));
+
+// no_submitter_thread defaults to true, so run everything with one
+INSTANTIATE_TEST_CASE_P(SubmitterThread, IOBackendTest,
+                        testing::Values("no_submitter_thread=false",
+                                        "backend=io_uring\n"
+                                        "no_submitter_thread=false",
+                                        "no_submitter_thread=false\n"
+                                        "num_ctx=2"));
+
+INSTANTIATE_TEST_CASE_P(RunToCompletion, IOBackendTest,
+                        testing::Values("run_to_completion=true",
+                                        "backend=io_uring\n"
+                                        "run_to_completion=true\n"
+                                        "num_ctx=2\n"
+                                        "fdqueue_threads=4"));
+
+INSTANTIATE_TEST_CASE_P(FdCache, IOBackendTest,
+                        testing::Values("fd_cache_size=64",
+                                        "run_to_completion=true\n"
+                                        "fd_cache_size=1"));
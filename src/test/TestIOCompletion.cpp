@@ -0,0 +1,272 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "IOBackendTest.h"
+
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+
+/*
+ * how completions reach the caller: eventfd, completion ring,
+ * callback, and the trace of each io through its stages
+ */
+class IOCompletionTest : public IOBackendTest {};
+
+// wait for readable fd, then reap until numFrags completions are seen
+static void reapCompletions(IOExecEventFdHandle handle, size_t numFrags) {
+  const int fd = IOExecEventFdGetReadFd(handle);
+  auto statusBatch = gIOStatusBatchAlloc(4);
+  std::vector<int> numSeen(numFrags + 1, 0);
+
+  size_t numReaped = 0;
+  while (numReaped < numFrags) {
+    pollfd pfd{fd, POLLIN, 0};
+    ASSERT_EQ(::poll(&pfd, 1, 10000), 1);
+
+    auto ret = IOExecEventFdReap(handle, statusBatch, 4);
+    ASSERT_GE(ret, 0);
+    EXPECT_EQ(statusBatch->count, ret);
+    for (int32_t idx = 0; idx < ret; idx++) {
+      const gIOStatus &ioStatus = statusBatch->array[idx];
+      EXPECT_EQ(ioStatus.errorCode, 0);
+      ASSERT_LE(ioStatus.completionId, numFrags);
+      numSeen[ioStatus.completionId]++;
+    }
+    numReaped += ret;
+  }
+  for (size_t idx = 1; idx <= numFrags; idx++) {
+    EXPECT_EQ(numSeen[idx], 1) << " for completionId=" << idx;
+  }
+  gIOStatusBatchFree(statusBatch);
+}
+
+TEST_P(IOCompletionTest, ReapFromRing) {
+
+  auto ringHandle = IOExecEventFdOpenRing(serviceHandle, 4);
+  ASSERT_NE(ringHandle, nullptr);
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  // ring is smaller than batch, so completions wait for the reaper
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, ringHandle);
+  EXPECT_EQ(ret, 0);
+  reapCompletions(ringHandle, NumBlocks);
+
+  // reap works on a pipe handle as well
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  reapCompletions(evHandle, NumBlocks);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    EXPECT_EQ(memcmp(readBatch->array[idx].addr, writeBatch->array[idx].addr,
+                     BlockSize),
+              0);
+  }
+
+  gIOBatchFree(writeBatch);
+  gIOBatchFree(readBatch);
+
+  IOExecFileClose(fileHandle);
+  IOExecEventFdClose(ringHandle);
+}
+
+TEST_P(IOCompletionTest, CompletionCallback) {
+
+  CallbackCollector collector;
+  auto cbHandle = IOExecEventFdOpenCallback(
+      serviceHandle, &CallbackCollector::callback, &collector);
+  ASSERT_NE(cbHandle, nullptr);
+  EXPECT_EQ(IOExecEventFdGetReadFd(cbHandle), gobjfs::os::FD_INVALID);
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, cbHandle);
+  EXPECT_EQ(ret, 0);
+  collector.waitFor(NumBlocks);
+
+  std::vector<int> numSeen(NumBlocks + 1, 0);
+  {
+    std::unique_lock<std::mutex> lck(collector.mutex);
+    EXPECT_EQ(collector.statusVec.size(), NumBlocks);
+    for (auto &status : collector.statusVec) {
+      EXPECT_EQ(status.errorCode, 0);
+      ASSERT_LE(status.completionId, NumBlocks);
+      numSeen[status.completionId]++;
+    }
+    collector.statusVec.clear();
+  }
+  for (size_t idx = 1; idx <= NumBlocks; idx++) {
+    EXPECT_EQ(numSeen[idx], 1) << " for completionId=" << idx;
+  }
+
+  // callbacks longer than budget are counted
+  collector.delayUsec = 2000;
+  ret = IOExecFileWrite(fileHandle, writeBatch, cbHandle);
+  EXPECT_EQ(ret, 0);
+  collector.waitFor(NumBlocks);
+
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  bool found = false;
+  for (int retry = 0; !found && (retry < 100); retry++) {
+    auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+    stats[statsLen] = 0;
+    // any executor may have run the callbacks
+    const char *key = "\"numSlowCallbacks\":";
+    for (char *pos = strstr(stats.get(), key); pos && !found;
+         pos = strstr(pos + 1, key)) {
+      found = (atoi(pos + strlen(key)) > 0);
+    }
+    usleep(1000);
+  }
+  EXPECT_TRUE(found);
+
+  gIOBatchFree(writeBatch);
+
+  IOExecFileClose(fileHandle);
+  IOExecEventFdClose(cbHandle);
+}
+
+TEST_P(IOCompletionTest, TraceDump) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto ret = IOExecSetTraceSampleRate(serviceHandle, 1);
+  EXPECT_EQ(ret, 0);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  // completion is posted before the trace is let go
+  std::string traceFileName = testFileName + ".trace";
+  for (int numTries = 0; numTries < 100; numTries++) {
+    ret = IOExecDumpTrace(serviceHandle, traceFileName.c_str());
+    if (ret == (int32_t)NumBlocks) {
+      break;
+    }
+    usleep(1000);
+  }
+  EXPECT_EQ(ret, NumBlocks);
+
+  std::ifstream ifs(traceFileName);
+  std::stringstream contents;
+  contents << ifs.rdbuf();
+  const std::string trace = contents.str();
+  ::unlink(traceFileName.c_str());
+
+  EXPECT_EQ(trace.find("{\"traceEvents\":["), 0);
+  EXPECT_NE(trace.find("\"name\":\"Write\",\"ph\":\"b\""),
+            std::string::npos);
+  EXPECT_NE(trace.find("\"completionId\":10,"), std::string::npos);
+  EXPECT_NE(trace.find("\"queued\""), std::string::npos);
+  EXPECT_NE(trace.find("\"device\""), std::string::npos);
+  EXPECT_NE(trace.find("\"complete\""), std::string::npos);
+
+  IOExecSetTraceSampleRate(serviceHandle, 0);
+
+  gIOBatchFree(writeBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+INSTANTIATE_TEST_CASE_P(AllBackends, IOCompletionTest,
+                        testing::Values("backend=libaio", "backend=io_uring"));
+
+INSTANTIATE_TEST_CASE_P(PollMode, IOCompletionTest,
+                        testing::Values("backend=libaio\n"
+                                        "completion_mode=poll",
+                                        "backend=io_uring\n"
+                                        "completion_mode=poll\n"
+                                        "poll_spin_usec=0"));
+
+INSTANTIATE_TEST_CASE_P(MultipleCtx, IOCompletionTest,
+                        testing::Values("num_ctx=3",
+                                        "backend=io_uring\n"
+                                        "num_ctx=2\n"
+                                        "completion_mode=poll"));
+
+// no_submitter_thread defaults to true, so run everything with one
+INSTANTIATE_TEST_CASE_P(SubmitterThread, IOCompletionTest,
+                        testing::Values("no_submitter_thread=false",
+                                        "backend=io_uring\n"
+                                        "no_submitter_thread=false",
+                                        "no_submitter_thread=false\n"
+                                        "num_ctx=2"));
+
+INSTANTIATE_TEST_CASE_P(RunToCompletion, IOCompletionTest,
+                        testing::Values("run_to_completion=true",
+                                        "backend=io_uring\n"
+                                        "run_to_completion=true\n"
+                                        "num_ctx=2\n"
+                                        "fdqueue_threads=4"));
@@ -0,0 +1,168 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "IOBackendTest.h"
+
+/*
+ * reads of O_DIRECT handles served from read-ahead windows
+ * without read-ahead configured, reads go to the device as usual
+ */
+class IOReadAheadTest : public IOBackendTest {};
+
+// @return value of counter in readAhead stats, -1 if not found
+static int64_t readAheadCounter(IOExecServiceHandle serviceHandle,
+                                const char *counter) {
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+  stats[statsLen] = 0;
+  const char *readAhead = strstr(stats.get(), "readAhead={");
+  if (!readAhead) {
+    return -1;
+  }
+  const std::string key = std::string("\"") + counter + "\":";
+  const char *value = strstr(readAhead, key.c_str());
+  return value ? atoll(value + key.size()) : -1;
+}
+
+TEST_P(IOReadAheadTest, ReadAhead) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+  auto ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  checkCompletions(readFd, NumBlocks, 0);
+  IOExecFileClose(fileHandle);
+
+  fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_RDONLY);
+  ASSERT_NE(fileHandle, nullptr);
+  const bool hasReadAhead = (readAheadCounter(serviceHandle, "maxBytes") > 0);
+
+  // scan one block at a time, waiting for each
+  auto readBatch = gIOBatchAlloc(1);
+  gIOExecFragment &frag = readBatch->array[0];
+  frag.size = BlockSize;
+  frag.addr = (char *)gMempool_alloc(BlockSize);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    frag.offset = idx * BlockSize;
+    frag.completionId = idx + 1;
+    memset(frag.addr, 0, BlockSize);
+    ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.completionId, idx + 1);
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    EXPECT_EQ(memcmp(frag.addr, writeBatch->array[idx].addr, BlockSize), 0);
+  }
+
+  if (hasReadAhead) {
+    // blocks after the first few come from windows
+    EXPECT_GT(readAheadCounter(serviceHandle, "numHits") +
+                  readAheadCounter(serviceHandle, "numWaits"),
+              0);
+    EXPECT_EQ(readAheadCounter(serviceHandle, "numFailed"), 0);
+  }
+  IOExecFileClose(fileHandle);
+
+  // prefetch hint, then a read from the middle of it
+  fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+  ret = IOExecFilePrefetch(fileHandle, 0, NumBlocks * BlockSize);
+  EXPECT_EQ(ret, hasReadAhead ? 0 : -EOPNOTSUPP);
+
+  frag.offset = 3 * BlockSize;
+  frag.completionId = 100;
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  gIOStatus ioStatus;
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.errorCode, 0);
+  EXPECT_EQ(memcmp(frag.addr, writeBatch->array[3].addr, BlockSize), 0);
+
+  // a read served from a window completes on the completion thread,
+  // not inside the read call
+  CallbackCollector collector;
+  auto cbHandle = IOExecEventFdOpenCallback(
+      serviceHandle, &CallbackCollector::callback, &collector);
+  ASSERT_NE(cbHandle, nullptr);
+  frag.offset = 4 * BlockSize;
+  frag.completionId = 101;
+  ret = IOExecFileRead(fileHandle, readBatch, cbHandle);
+  EXPECT_EQ(ret, 0);
+  collector.waitFor(1);
+  {
+    std::unique_lock<std::mutex> lck(collector.mutex);
+    ASSERT_EQ(collector.statusVec.size(), 1);
+    EXPECT_EQ(collector.statusVec[0].errorCode, 0);
+    EXPECT_NE(collector.threadVec[0], std::this_thread::get_id());
+  }
+  EXPECT_EQ(memcmp(frag.addr, writeBatch->array[4].addr, BlockSize), 0);
+  IOExecEventFdClose(cbHandle);
+  frag.offset = 3 * BlockSize;
+
+  // once written through, handle prefetches no more
+  memset(writeBatch->array[3].addr, 'z', BlockSize);
+  ret = IOExecFileWrite(fileHandle, writeBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  checkCompletions(readFd, NumBlocks, 0);
+  EXPECT_EQ(IOExecFilePrefetch(fileHandle, 0, BlockSize), -EOPNOTSUPP);
+
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.errorCode, 0);
+  EXPECT_EQ(memcmp(frag.addr, writeBatch->array[3].addr, BlockSize), 0);
+
+  IOExecFileClose(fileHandle);
+  gIOBatchFree(writeBatch);
+  gIOBatchFree(readBatch);
+}
+
+INSTANTIATE_TEST_CASE_P(NoReadAhead, IOReadAheadTest,
+                        testing::Values("backend=libaio", "backend=io_uring"));
+
+INSTANTIATE_TEST_CASE_P(ReadAhead, IOReadAheadTest,
+                        testing::Values("readahead_max_bytes=1048576\n"
+                                        "readahead_window=16384",
+                                        "backend=io_uring\n"
+                                        "readahead_max_bytes=65536\n"
+                                        "readahead_window=8192",
+                                        "run_to_completion=true\n"
+                                        "readahead_max_bytes=1048576\n"
+                                        "readahead_window=16384"));
@@ -0,0 +1,724 @@
+/*
+Copyright (C) 2016 iNuron NV
+
+This file is part of Open vStorage Open Source Edition (OSE), as available from
+
+
+    http://www.openvstorage.org and
+    http://www.openvstorage.com.
+
+This file is free software; you can redistribute it and/or modify it
+under the terms of the GNU Affero General Public License v3 (GNU AGPLv3)
+as published by the Free Software Foundation, in version 3 as it comes
+in the <LICENSE.txt> file of the Open vStorage OSE distribution.
+
+Open vStorage is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY of any kind.
+*/
+
+#include "IOBackendTest.h"
+
+#include <util/Timer.h>
+
+#include <atomic>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <sys/stat.h>
+
+/*
+ * how queued io is ordered, limited and held back: priority classes,
+ * deadlines, tenant limits, queue space and work stealing
+ */
+class IOSchedulingTest : public IOBackendTest {};
+
+// time at which job with completionId was added to ("b") or taken
+// from ("e") request queue, from a trace dumped by IOExecDumpTrace
+// @return negative if not found
+static double getQueuedTime(const std::string &trace,
+                            gCompletionID completionId,
+                            const char *phase = "e") {
+  const std::string idKey =
+      "\"completionId\":" + std::to_string(completionId) + ",";
+  const size_t argsPos = trace.find(idKey);
+  if (argsPos == std::string::npos) {
+    return -1;
+  }
+  // events of one job share its "id"
+  const size_t idPos = trace.rfind("\"id\":\"", argsPos);
+  const size_t idEnd = trace.find('"', idPos + 6);
+  const std::string jobId = trace.substr(idPos, idEnd - idPos + 1);
+
+  const size_t queuedPos =
+      trace.find(std::string("\"name\":\"queued\",\"ph\":\"") + phase +
+                 "\",\"cat\":\"job\"," + jobId);
+  if (queuedPos == std::string::npos) {
+    return -1;
+  }
+  const size_t tsPos = trace.find("\"ts\":", queuedPos);
+  return atof(trace.c_str() + tsPos + 5);
+}
+
+TEST_P(IOSchedulingTest, PriorityClasses) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto badBatch = gIOBatchAlloc(1);
+  badBatch->priority = GIO_PRIO_COUNT;
+  badBatch->array[0].size = BlockSize;
+  badBatch->array[0].addr = (char *)gMempool_alloc(BlockSize);
+  badBatch->array[0].completionId = 1;
+  auto ret = IOExecFileWrite(fileHandle, badBatch, evHandle);
+  EXPECT_EQ(ret, -EINVAL);
+  gIOBatchFree(badBatch);
+
+  auto writeBatch = gIOBatchAlloc(NumBlocks);
+  EXPECT_EQ(writeBatch->priority, GIO_PRIO_FOREGROUND);
+  writeBatch->priority = GIO_PRIO_BACKGROUND;
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = writeBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  readBatch->priority = GIO_PRIO_SCRUB;
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+  }
+
+  for (auto batch : {writeBatch, readBatch}) {
+    ret = (batch == writeBatch) ? IOExecFileWrite(fileHandle, batch, evHandle)
+                                : IOExecFileRead(fileHandle, batch, evHandle);
+    EXPECT_EQ(ret, 0);
+
+    for (size_t idx = 0; idx < NumBlocks; idx++) {
+      gIOStatus ioStatus;
+      ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+      EXPECT_EQ(ret, sizeof(ioStatus));
+      EXPECT_EQ(ioStatus.errorCode, 0);
+    }
+  }
+
+  // completions are counted under the class of the request
+  // stats are updated after the completion is sent, so allow a retry
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  for (int retry = 0; retry < 100; retry++) {
+    auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+    stats[statsLen] = 0;
+    if (strstr(stats.get(), "\"scrub\":{\"numOps\":10,")) {
+      break;
+    }
+    usleep(1000);
+  }
+  EXPECT_NE(strstr(stats.get(), "\"background\":{\"numOps\":10,"), nullptr);
+  EXPECT_NE(strstr(stats.get(), "\"scrub\":{\"numOps\":10,"), nullptr);
+
+  gIOBatchFree(writeBatch);
+  gIOBatchFree(readBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOSchedulingTest, DeadlineAndCancel) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  auto ret = IOExecFileTruncate(fileHandle, NumBlocks * BlockSize);
+  EXPECT_EQ(ret, 0);
+
+  EXPECT_EQ(IOExecFileCancel(serviceHandle, 1), -ENOENT);
+
+  auto readBatch = gIOBatchAlloc(NumBlocks);
+  EXPECT_EQ(readBatch->array[0].timeoutMsec, 0);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOExecFragment &frag = readBatch->array[idx];
+    frag.offset = idx * BlockSize;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    frag.completionId = idx + 1;
+    frag.timeoutMsec = 1;
+  }
+
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  checkCompletions(readFd, NumBlocks, -ETIMEDOUT);
+
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    readBatch->array[idx].timeoutMsec = 0;
+  }
+  ret = IOExecFileRead(fileHandle, readBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    // result depends on whether io is queued, in flight or done
+    // and whether kernel can cancel io in flight
+    (void)IOExecFileCancel(serviceHandle, idx + 1);
+  }
+  checkCompletions(readFd, NumBlocks, -ECANCELED);
+
+  // nothing left to cancel once all have completed
+  EXPECT_EQ(IOExecFileCancel(serviceHandle, 1), -ENOENT);
+
+  gIOBatchFree(readBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOSchedulingTest, TenantLimit) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  // 100 iops without burst : a write every 10 msec
+  static constexpr uint32_t LimitedTenant = 7;
+  auto ret = IOExecSetTenantLimit(serviceHandle, LimitedTenant, 100, 0, 0);
+  EXPECT_EQ(ret, 0);
+
+  auto limitedBatch = gIOBatchAlloc(NumBlocks);
+  auto otherBatch = gIOBatchAlloc(NumBlocks);
+  limitedBatch->tenant = LimitedTenant;
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    for (auto batch : {limitedBatch, otherBatch}) {
+      gIOExecFragment &frag = batch->array[idx];
+      frag.offset = idx * BlockSize;
+      frag.size = BlockSize;
+      frag.addr = (char *)gMempool_alloc(BlockSize);
+      memset(frag.addr, 'a' + idx, BlockSize);
+      frag.completionId = idx + 1 + ((batch == limitedBatch) ? 0 : 100);
+    }
+  }
+
+  gobjfs::stats::Timer timer(true);
+
+  ret = IOExecFileWrite(fileHandle, limitedBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  ret = IOExecFileWrite(fileHandle, otherBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+
+  // other tenant is not held up behind the limited one
+  size_t numOtherDone = 0;
+  for (size_t idx = 0; idx < 2 * NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    if (ioStatus.completionId > 100) {
+      numOtherDone++;
+    } else if (ioStatus.completionId == NumBlocks) {
+      EXPECT_EQ(numOtherDone, NumBlocks);
+    }
+  }
+  EXPECT_GE(timer.elapsedMilliseconds(), (NumBlocks - 1) * 10);
+
+  // held back jobs can be cancelled
+  limitedBatch->array[0].completionId = 1000;
+  for (size_t idx = 1; idx < NumBlocks; idx++) {
+    limitedBatch->array[idx].completionId = 1001;
+  }
+  ret = IOExecFileWrite(fileHandle, limitedBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  ret = IOExecFileCancel(serviceHandle, 1001);
+  EXPECT_GT(ret, 0);
+
+  size_t numCancelled = 0;
+  for (size_t idx = 0; idx < NumBlocks; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    if (ioStatus.errorCode == -ECANCELED) {
+      numCancelled++;
+    } else {
+      EXPECT_EQ(ioStatus.errorCode, 0);
+    }
+  }
+  EXPECT_GT(numCancelled, 0);
+
+  const size_t len = 65536;
+  std::unique_ptr<char[]> stats(new char[len]);
+  auto statsLen = IOExecGetStats(serviceHandle, stats.get(), len - 1);
+  stats[statsLen] = 0;
+  EXPECT_NE(strstr(stats.get(), "\"tenant\":7,"), nullptr);
+
+  gIOBatchFree(limitedBatch);
+  gIOBatchFree(otherBatch);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOSchedulingTest, RetryWhenSpaceAvailable) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  const int spaceFd = IOExecGetSpaceAvailableFd(serviceHandle);
+  ASSERT_GE(spaceFd, 0);
+
+  // a write every msec keeps a backlog of held back writes
+  static constexpr uint32_t LimitedTenant = 3;
+  auto ret = IOExecSetTenantLimit(serviceHandle, LimitedTenant, 1000, 0, 0);
+  EXPECT_EQ(ret, 0);
+
+  // first batch fills the backlog; second does not fit
+  static constexpr size_t BatchSizes[] = {60, 5};
+  gIOBatch *batches[2];
+  size_t numFragments = 0;
+  for (size_t batchIdx = 0; batchIdx < 2; batchIdx++) {
+    auto batch = batches[batchIdx] = gIOBatchAlloc(BatchSizes[batchIdx]);
+    batch->tenant = LimitedTenant;
+    for (size_t idx = 0; idx < batch->count; idx++) {
+      gIOExecFragment &frag = batch->array[idx];
+      frag.offset = numFragments * BlockSize;
+      frag.size = BlockSize;
+      frag.addr = (char *)gMempool_alloc(BlockSize);
+      memset(frag.addr, 'a', BlockSize);
+      frag.completionId = ++numFragments;
+    }
+  }
+
+  ret = IOExecFileWrite(fileHandle, batches[0], evHandle);
+  EXPECT_EQ(ret, 0);
+  ret = IOExecFileWrite(fileHandle, batches[1], evHandle);
+  EXPECT_EQ(ret, -EAGAIN);
+
+  // retry once told there is space, instead of spinning
+  pollfd pfd{spaceFd, POLLIN, 0};
+  ret = poll(&pfd, 1, 10 * 1000);
+  EXPECT_EQ(ret, 1);
+  uint64_t counter = 0;
+  EXPECT_EQ(::read(spaceFd, &counter, sizeof(counter)), sizeof(counter));
+  EXPECT_GE(counter, 1);
+
+  ret = IOExecFileWrite(fileHandle, batches[1], evHandle);
+  EXPECT_EQ(ret, 0);
+
+  // refused batch was not partly queued
+  std::vector<int> numSeen(numFragments + 1, 0);
+  for (size_t idx = 0; idx < numFragments; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+    ASSERT_LE(ioStatus.completionId, numFragments);
+    numSeen[ioStatus.completionId]++;
+  }
+  for (size_t idx = 1; idx <= numFragments; idx++) {
+    EXPECT_EQ(numSeen[idx], 1) << " for completionId=" << idx;
+  }
+
+  gIOBatchFree(batches[0]);
+  gIOBatchFree(batches[1]);
+
+  IOExecFileClose(fileHandle);
+}
+
+TEST_P(IOSchedulingTest, ReleasedJobsFitRequestQueue) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  // maxRequestQueueSize for ctx_queue_depth=200
+  static constexpr int64_t MaxQueued = 40;
+  // each batch fits the request queue, all of them together do not
+  static constexpr size_t NumTenants = 4;
+  static constexpr size_t NumPerTenant = MaxQueued / 2;
+
+  // 10 iops without burst : all but the first write of each tenant
+  // are held back
+  for (uint32_t tenant = 1; tenant <= NumTenants; tenant++) {
+    auto ret = IOExecSetTenantLimit(serviceHandle, tenant, 10, 0, 0);
+    EXPECT_EQ(ret, 0);
+  }
+
+  std::vector<gIOBatch *> batches;
+  for (uint32_t tenant = 1; tenant <= NumTenants; tenant++) {
+    auto batch = gIOBatchAlloc(NumPerTenant);
+    batch->tenant = tenant;
+    for (size_t idx = 0; idx < NumPerTenant; idx++) {
+      gIOExecFragment &frag = batch->array[idx];
+      frag.offset = ((tenant - 1) * NumPerTenant + idx) * BlockSize;
+      frag.size = BlockSize;
+      frag.addr = (char *)gMempool_alloc(BlockSize);
+      memset(frag.addr, 'a' + tenant, BlockSize);
+      frag.completionId = (tenant - 1) * NumPerTenant + idx + 1;
+    }
+    auto ret = IOExecFileWrite(fileHandle, batch, evHandle);
+    EXPECT_EQ(ret, 0);
+    batches.push_back(batch);
+  }
+
+  // once the limits are lifted, the backlogs of all tenants are
+  // admitted together, but only as many as fit are queued at once
+  for (uint32_t tenant = 1; tenant <= NumTenants; tenant++) {
+    auto ret = IOExecSetTenantLimit(serviceHandle, tenant, 0, 0, 0);
+    EXPECT_EQ(ret, 0);
+  }
+
+  checkCompletions(readFd, NumTenants * NumPerTenant, 0);
+
+  for (auto maxQueued :
+       getExecutorStats(serviceHandle, "\"maxRequestQueueSize\":")) {
+    EXPECT_LE(maxQueued, MaxQueued + 1);
+  }
+
+  for (auto batch : batches) {
+    gIOBatchFree(batch);
+  }
+
+  IOExecFileClose(fileHandle);
+}
+
+/*
+ * a read queued while writes of the same priority class keep
+ * arriving is taken for submission after at most the writes
+ * which were queued ahead of it
+ */
+TEST_P(IOSchedulingTest, ReadNotStarvedByWrites) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  // large enough that the ctx fills up and writes wait in queue
+  static constexpr size_t WriteSize = 262144;
+  static constexpr size_t NumWrites = 2000;
+  // maxRequestQueueSize for ctx_queue_depth=200
+  static constexpr int32_t MaxQueued = 40;
+  static constexpr gCompletionID ReadId = 1;
+
+  auto ret = IOExecSetTraceSampleRate(serviceHandle, 1);
+  EXPECT_EQ(ret, 0);
+
+  // writes go to the same block, so that they are not merged
+  char *writeBuf = (char *)gMempool_alloc(WriteSize);
+  memset(writeBuf, 'w', WriteSize);
+  std::atomic<size_t> numSubmitted{0};
+  std::thread writer([&]() {
+    auto batch = gIOBatchAlloc(1);
+    gIOExecFragment &frag = batch->array[0];
+    frag.offset = 0;
+    frag.size = WriteSize;
+    frag.addr = writeBuf;
+    for (size_t idx = 0; idx < NumWrites; idx++) {
+      frag.completionId = 100 + idx;
+      int32_t writeRet = 0;
+      while ((writeRet = IOExecFileWrite(fileHandle, batch, evHandle)) ==
+             -EAGAIN) {
+        std::this_thread::yield();
+      }
+      EXPECT_EQ(writeRet, 0);
+      numSubmitted++;
+    }
+    frag.addr = nullptr;
+    gIOBatchFree(batch);
+  });
+
+  while (numSubmitted < NumWrites / 4) {
+    std::this_thread::yield();
+  }
+
+  char *readBuf = (char *)gMempool_alloc(BlockSize);
+  auto readBatch = gIOBatchAlloc(1);
+  readBatch->array[0].offset = 0;
+  readBatch->array[0].size = BlockSize;
+  readBatch->array[0].addr = readBuf;
+  readBatch->array[0].completionId = ReadId;
+  while ((ret = IOExecFileRead(fileHandle, readBatch, evHandle)) == -EAGAIN) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(ret, 0);
+
+  writer.join();
+
+  for (size_t idx = 0; idx < NumWrites + 1; idx++) {
+    gIOStatus ioStatus;
+    ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+    EXPECT_EQ(ret, sizeof(ioStatus));
+    EXPECT_EQ(ioStatus.errorCode, 0);
+  }
+
+  // completion is posted before the trace is let go
+  std::string traceFileName = testFileName + ".trace";
+  std::string trace;
+  for (int numTries = 0; numTries < 100; numTries++) {
+    ret = IOExecDumpTrace(serviceHandle, traceFileName.c_str());
+    if (ret == (int32_t)NumWrites + 1) {
+      break;
+    }
+    usleep(1000);
+  }
+  EXPECT_EQ(ret, NumWrites + 1);
+  {
+    std::ifstream ifs(traceFileName);
+    std::stringstream contents;
+    contents << ifs.rdbuf();
+    trace = contents.str();
+  }
+  ::unlink(traceFileName.c_str());
+  IOExecSetTraceSampleRate(serviceHandle, 0);
+
+  const double queuedTime = getQueuedTime(trace, ReadId, "b");
+  const double dequeueTime = getQueuedTime(trace, ReadId, "e");
+  ASSERT_GE(queuedTime, 0);
+  ASSERT_GE(dequeueTime, queuedTime);
+
+  // writes taken from the queue while the read waited in it
+  int32_t numTakenAhead = 0;
+  const std::string dequeueKey =
+      "\"name\":\"queued\",\"ph\":\"e\"";
+  for (size_t pos = trace.find(dequeueKey); pos != std::string::npos;
+       pos = trace.find(dequeueKey, pos + 1)) {
+    const size_t tsPos = trace.find("\"ts\":", pos);
+    const double ts = atof(trace.c_str() + tsPos + 5);
+    if ((ts > queuedTime) && (ts < dequeueTime)) {
+      numTakenAhead++;
+    }
+  }
+  EXPECT_LE(numTakenAhead, MaxQueued);
+
+  gIOBatchFree(readBatch);
+  gMempool_free(writeBuf);
+
+  IOExecFileClose(fileHandle);
+}
+
+/*
+ * reads of one file flood the IOExecutor which owns it, so that an
+ * idle sibling takes some of them; writes to the file stay with the owner
+ */
+class WorkStealingTest : public IOBackendTest {};
+
+TEST_P(WorkStealingTest, StealsOnlyReads) {
+
+  auto fileHandle =
+      IOExecFileOpen(serviceHandle, testFileName.c_str(), testFileName.size(),
+                     O_DIRECT | O_CREAT | O_RDWR);
+  ASSERT_NE(fileHandle, nullptr);
+
+  // reads keep the ctx of the owner full, and the rest wait in queue
+  static constexpr size_t ReadSize = 262144;
+  static constexpr size_t NumReads = 2000;
+  static constexpr size_t NumWrites = 8;
+  static constexpr size_t NumRounds = 20;
+  // block past the range which is read
+  const off_t writeOffset = ReadSize;
+
+  char *readBuf = (char *)gMempool_alloc(ReadSize);
+  memset(readBuf, 'r', ReadSize);
+  auto setupBatch = gIOBatchAlloc(1);
+  setupBatch->array[0].offset = 0;
+  setupBatch->array[0].size = ReadSize;
+  setupBatch->array[0].addr = readBuf;
+  setupBatch->array[0].completionId = 1;
+  auto ret = IOExecFileWrite(fileHandle, setupBatch, evHandle);
+  EXPECT_EQ(ret, 0);
+  gIOStatus ioStatus;
+  ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+  EXPECT_EQ(ret, sizeof(ioStatus));
+  EXPECT_EQ(ioStatus.errorCode, 0);
+  setupBatch->array[0].addr = nullptr;
+  gIOBatchFree(setupBatch);
+
+  // all reads go into the same buffer; only the stats are checked
+  auto floodBatch = gIOBatchAlloc(NumReads);
+  for (size_t idx = 0; idx < NumReads; idx++) {
+    gIOExecFragment &frag = floodBatch->array[idx];
+    frag.offset = 0;
+    frag.size = ReadSize;
+    frag.addr = readBuf;
+    frag.completionId = 100000 + idx;
+  }
+
+  // other class, so that its queue has space while reads are queued
+  // writes to the same block must be submitted in the order given
+  std::vector<gIOBatch *> writeBatches;
+  for (size_t idx = 0; idx < NumWrites; idx++) {
+    auto batch = gIOBatchAlloc(1);
+    batch->priority = GIO_PRIO_BACKGROUND;
+    gIOExecFragment &frag = batch->array[0];
+    frag.offset = writeOffset;
+    frag.size = BlockSize;
+    frag.addr = (char *)gMempool_alloc(BlockSize);
+    memset(frag.addr, 'a' + idx, BlockSize);
+    writeBatches.push_back(batch);
+  }
+
+  // submitted after the flood, when it finds the owner overloaded
+  // it offers the queued reads to the sibling
+  auto triggerBatch = gIOBatchAlloc(1);
+  triggerBatch->priority = GIO_PRIO_BACKGROUND;
+  triggerBatch->array[0].offset = 0;
+  triggerBatch->array[0].size = BlockSize;
+  triggerBatch->array[0].addr = readBuf;
+  triggerBatch->array[0].completionId = 2;
+
+  // submit order of writes is checked in the trace
+  ret = IOExecSetTraceSampleRate(serviceHandle, 1);
+  EXPECT_EQ(ret, 0);
+
+  int64_t numStolen = 0;
+  gCompletionID firstWriteId = 0;
+  for (size_t round = 0; (round < NumRounds) && (numStolen == 0); round++) {
+    ret = IOExecFileRead(fileHandle, floodBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+    ret = IOExecFileRead(fileHandle, triggerBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+    firstWriteId = 1000 * (round + 1);
+    for (size_t idx = 0; idx < NumWrites; idx++) {
+      writeBatches[idx]->array[0].completionId = firstWriteId + idx;
+      ret = IOExecFileWrite(fileHandle, writeBatches[idx], evHandle);
+      EXPECT_EQ(ret, 0);
+    }
+    ret = IOExecFileRead(fileHandle, triggerBatch, evHandle);
+    EXPECT_EQ(ret, 0);
+
+    for (size_t idx = 0; idx < NumReads + NumWrites + 2; idx++) {
+      ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
+      EXPECT_EQ(ret, sizeof(ioStatus));
+      EXPECT_EQ(ioStatus.errorCode, 0);
+    }
+
+    auto stolen = getExecutorStats(serviceHandle, "\"numStolen\":");
+    ASSERT_EQ(stolen.size(), 2);
+    numStolen = stolen[0] + stolen[1];
+  }
+
+  // read stats are updated after the completion is sent
+  std::vector<int64_t> stolen, stolenFrom, reads, writes;
+  size_t sibling = 0;
+  for (int numTries = 0; numTries < 100; numTries++) {
+    stolen = getExecutorStats(serviceHandle, "\"numStolen\":");
+    stolenFrom = getExecutorStats(serviceHandle, "\"numStolenFrom\":");
+    reads = getExecutorStats(serviceHandle, "\"read\": {\"numOps\":");
+    writes = getExecutorStats(serviceHandle, "\"write\": {\"numOps\":");
+    ASSERT_EQ(stolen.size(), 2);
+    sibling = (stolen[0] > 0) ? 0 : 1;
+    if (reads[sibling] == stolen[sibling]) {
+      break;
+    }
+    usleep(1000);
+  }
+
+  // owner of the file only gives, sibling only takes
+  const size_t owner = 1 - sibling;
+  EXPECT_GT(stolen[sibling], 0);
+  EXPECT_EQ(stolenFrom[owner], stolen[sibling]);
+  EXPECT_EQ(stolen[owner], 0);
+
+  // sibling owns no file, so all it ran were the stolen jobs,
+  // and those were reads
+  EXPECT_EQ(reads[sibling], stolen[sibling]);
+  EXPECT_EQ(writes[sibling], 0);
+  EXPECT_GT(writes[owner], 0);
+
+  // writes of the round in which reads were stolen went to
+  // the device in the order in which they were given
+  // completion is posted before the trace is let go
+  std::string traceFileName = testFileName + ".trace";
+  std::vector<double> dequeueTimes;
+  for (int numTries = 0; numTries < 100; numTries++) {
+    ret = IOExecDumpTrace(serviceHandle, traceFileName.c_str());
+    EXPECT_GT(ret, 0);
+    std::ifstream ifs(traceFileName);
+    std::stringstream contents;
+    contents << ifs.rdbuf();
+    const std::string trace = contents.str();
+
+    dequeueTimes.clear();
+    for (size_t idx = 0; idx < NumWrites; idx++) {
+      const double ts = getQueuedTime(trace, firstWriteId + idx);
+      if (ts < 0) {
+        break;
+      }
+      dequeueTimes.push_back(ts);
+    }
+    if (dequeueTimes.size() == NumWrites) {
+      break;
+    }
+    usleep(1000);
+  }
+  ::unlink(traceFileName.c_str());
+  IOExecSetTraceSampleRate(serviceHandle, 0);
+
+  ASSERT_EQ(dequeueTimes.size(), NumWrites);
+  for (size_t idx = 1; idx < NumWrites; idx++) {
+    EXPECT_LE(dequeueTimes[idx - 1], dequeueTimes[idx]) << "write " << idx;
+  }
+
+  for (auto batch : writeBatches) {
+    gIOBatchFree(batch);
+  }
+  for (size_t idx = 0; idx < NumReads; idx++) {
+    floodBatch->array[idx].addr = nullptr;
+  }
+  gIOBatchFree(floodBatch);
+  triggerBatch->array[0].addr = nullptr;
+  gIOBatchFree(triggerBatch);
+  gMempool_free(readBuf);
+
+  IOExecFileClose(fileHandle);
+}
+
+INSTANTIATE_TEST_CASE_P(AllBackends, IOSchedulingTest,
+                        testing::Values("backend=libaio", "backend=io_uring"));
+
+INSTANTIATE_TEST_CASE_P(PollMode, IOSchedulingTest,
+                        testing::Values("backend=libaio\n"
+                                        "completion_mode=poll",
+                                        "backend=io_uring\n"
+                                        "completion_mode=poll\n"
+                                        "poll_spin_usec=0"));
+
+INSTANTIATE_TEST_CASE_P(MultipleCtx, IOSchedulingTest,
+                        testing::Values("num_ctx=3",
+                                        "backend=io_uring\n"
+                                        "num_ctx=2\n"
+                                        "completion_mode=poll"));
+
+// with one executor, reads are queued apart but never stolen
+INSTANTIATE_TEST_CASE_P(WorkStealing, IOSchedulingTest,
+                        testing::Values("cpu_core=0\n"
+                                        "work_stealing=true",
+                                        "work_stealing=true"));
+
+// no_submitter_thread defaults to true, so run everything with one
+INSTANTIATE_TEST_CASE_P(SubmitterThread, IOSchedulingTest,
+                        testing::Values("no_submitter_thread=false",
+                                        "backend=io_uring\n"
+                                        "no_submitter_thread=false",
+                                        "no_submitter_thread=false\n"
+                                        "num_ctx=2"));
+
+INSTANTIATE_TEST_CASE_P(RunToCompletion, IOSchedulingTest,
+                        testing::Values("run_to_completion=true",
+                                        "backend=io_uring\n"
+                                        "run_to_completion=true\n"
+                                        "num_ctx=2\n"
+                                        "fdqueue_threads=4"));
+
+INSTANTIATE_TEST_CASE_P(WorkStealing, WorkStealingTest,
+                        testing::Values("cpu_core=0\n"
+                                        "work_stealing=true",
+                                        "backend=io_uring\n"
+                                        "cpu_core=0\n"
+                                        "work_stealing=true"));
@@ -26,6 +26,7 @@ but WITHOUT ANY WARRANTY of any kind.
 #include <gtest/gtest.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <future>
 #include <thread>
@@ -35,7 +36,11 @@ using namespace gobjfs::xio;
 static int fileTranslator(const char *old_name, size_t old_length,
                           char *new_name);
 
-class IOExecFileTest : public testing::Test {
+/*
+ * test param is appended to the [ioexec] section of config,
+ * so that non-aligned writes run on every kernel backend
+ */
+class IOExecFileTest : public testing::TestWithParam<const char *> {
 
   int configFileFd{-1};
 
@@ -59,14 +64,15 @@ public:
 
     configFileFd = mkstemp(configFile);
 
-    const char *configContents = "[ioexec]\n"
-                                 "ctx_queue_depth=200\n"
-                                 "cpu_core=0\n";
+    const std::string configContents = std::string("[ioexec]\n"
+                                                   "ctx_queue_depth=200\n"
+                                                   "cpu_core=0\n") +
+                                       GetParam() + "\n";
 
     ssize_t writeSz =
-        write(configFileFd, configContents, strlen(configContents));
+        write(configFileFd, configContents.c_str(), configContents.size());
 
-    EXPECT_EQ(writeSz, strlen(configContents));
+    EXPECT_EQ(writeSz, configContents.size());
   }
 
   void deleteConfigFile() {
@@ -130,7 +136,7 @@ int fileTranslator(const char *old_name, size_t old_length, char *new_name) {
 }
 
 // Nonaligned write succeeds with files opened with O_DIRECT
-TEST_F(IOExecFileTest, NonAlignedWriteWithoutDirectIO) {
+TEST_P(IOExecFileTest, NonAlignedWriteWithoutDirectIO) {
 
   ssize_t ret = 0;
   char fillChar = 'a' + (getpid() % 26);
@@ -200,8 +206,9 @@ TEST_F(IOExecFileTest, NonAlignedWriteWithoutDirectIO) {
   ASSERT_EQ(ret, 0);
 }
 
-// Nonaligned write fails with files opened with O_DIRECT
-TEST_F(IOExecFileTest, NonAlignedWriteWithDirectIO) {
+// Nonaligned write to the end of a write-only O_DIRECT file
+// pads the last block with zeroes, since it cannot be read
+TEST_P(IOExecFileTest, NonAlignedWriteWithDirectIO) {
 
   auto fileHandle =
       IOExecFileOpen(serviceHandle, testDataFileName.c_str(),
@@ -222,13 +229,30 @@ TEST_F(IOExecFileTest, NonAlignedWriteWithDirectIO) {
   gIOStatus ioStatus;
   ret = ::read(readFd, &ioStatus, sizeof(ioStatus));
   EXPECT_EQ(ret, sizeof(ioStatus));
-  EXPECT_EQ(ioStatus.errorCode, -EINVAL);
+  EXPECT_EQ(ioStatus.errorCode, 0);
   EXPECT_EQ(ioStatus.completionId, reinterpret_cast<uint64_t>(batch));
 
-  gIOBatchFree(batch);
-
   IOExecFileClose(fileHandle);
 
+  // padding was truncated
+  struct stat statBuf;
+  ret = ::stat(testDataFileFullName.c_str(), &statBuf);
+  ASSERT_EQ(ret, 0);
+  EXPECT_EQ(statBuf.st_size, bufSize);
+
+  std::string readBuf(bufSize, '\0');
+  int fd = ::open(testDataFileFullName.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ret = ::pread(fd, &readBuf[0], bufSize, 0);
+  EXPECT_EQ(ret, bufSize);
+  ::close(fd);
+  EXPECT_EQ(readBuf, std::string(bufSize, 'a'));
+
+  gIOBatchFree(batch);
+
   ret = ::unlink(testDataFileFullName.c_str());
   ASSERT_EQ(ret, 0);
 }
+
+INSTANTIATE_TEST_CASE_P(AllBackends, IOExecFileTest,
+                        testing::Values("backend=libaio", "backend=io_uring"));
@@ -31,7 +31,9 @@ namespace os {
 int32_t TimerNotifier::init(int epollFD, int timeoutSec, int timeoutNanosec) {
   int ret = 0;
 
-  fd_ = timerfd_create(CLOCK_MONOTONIC, 0);
+  // nonblocking, because a timer rearmed by another thread between
+  // epoll_wait() and recv() has nothing left to read
+  fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
   if (fd_ < 0) {
     fd_ = -1;
     ret = -errno;
@@ -39,17 +41,19 @@ int32_t TimerNotifier::init(int epollFD, int timeoutSec, int timeoutNanosec) {
     return ret;
   }
 
-  struct itimerspec new_value;
-  new_value.it_value.tv_sec = 60;
-  new_value.it_value.tv_nsec = 0;
-  new_value.it_interval.tv_sec = timeoutSec;
-  new_value.it_interval.tv_nsec = timeoutNanosec;
+  if (timeoutSec || timeoutNanosec) {
+    struct itimerspec new_value;
+    new_value.it_value.tv_sec = 60;
+    new_value.it_value.tv_nsec = 0;
+    new_value.it_interval.tv_sec = timeoutSec;
+    new_value.it_interval.tv_nsec = timeoutNanosec;
 
-  ret = timerfd_settime(fd_, 0, &new_value, NULL);
-  if (ret < 0) {
-    ret = -errno;
-    LOG(ERROR) << "Failed to set time timerfd errno=" << ret;
-    return ret;
+    ret = timerfd_settime(fd_, 0, &new_value, NULL);
+    if (ret < 0) {
+      ret = -errno;
+      LOG(ERROR) << "Failed to set time timerfd errno=" << ret;
+      return ret;
+    }
   }
 
   epoll_event epollEvent;
@@ -68,6 +72,22 @@ int32_t TimerNotifier::init(int epollFD, int timeoutSec, int timeoutNanosec) {
   return ret;
 }
 
+int32_t TimerNotifier::arm(int64_t timeoutUsec) {
+  struct itimerspec new_value;
+  bzero(&new_value, sizeof(new_value));
+  // zero it_value would disarm the timer
+  timeoutUsec = (timeoutUsec > 0) ? timeoutUsec : 1;
+  new_value.it_value.tv_sec = timeoutUsec / 1000000;
+  new_value.it_value.tv_nsec = (timeoutUsec % 1000000) * 1000;
+
+  int ret = timerfd_settime(fd_, 0, &new_value, NULL);
+  if (ret < 0) {
+    ret = -errno;
+    LOG(ERROR) << "Failed to arm timerfd=" << fd_ << " errno=" << ret;
+  }
+  return ret;
+}
+
 int32_t TimerNotifier::recv() {
   int ret = 0;
   uint64_t count = 0;
@@ -78,6 +98,11 @@ int32_t TimerNotifier::recv() {
 
     count = 0;
 
+    if ((readSize == -1) && (errno == EAGAIN)) {
+      // expiry was cleared by arm()
+      return 0;
+    }
+
     if (readSize == -1)
       ret = -errno;
     else
@@ -31,8 +31,12 @@ class TimerNotifier {
   int fd_ = -1;
 
 public:
+  // zero timeout creates timer which only fires after arm()
   int32_t init(int epollFD, int timeoutSec, int timeoutNanosec);
 
+  // fire once after timeoutUsec
+  int32_t arm(int64_t timeoutUsec);
+
   int32_t send();
 
   int32_t recv();
@@ -19,10 +19,14 @@ but WITHOUT ANY WARRANTY of any kind.
 #include <gobjfs_log.h>
 #include <util/os_utils.h>
 
-#include <errno.h>        // errno
-#include <sched.h>        // sched_getscheduler
-#include <sys/resource.h> //getrlimit
-#include <sys/time.h>     //getrlimit
+#include <algorithm>
+#include <errno.h>           // errno
+#include <fstream>           // ifstream
+#include <linux/mempolicy.h> // MPOL_PREFERRED
+#include <sched.h>           // sched_getscheduler
+#include <sys/resource.h>    //getrlimit
+#include <sys/time.h>        //getrlimit
+#include <vector>
 
 namespace gobjfs {
 namespace os {
@@ -36,6 +40,118 @@ void BindThreadToCore(CoreId cpu_id) {
   LOG(INFO) << "bound thread=" << gettid() << " to core=" << cpu_id;
 }
 
+namespace {
+
+// parse list like "0-3,8,10-11" as found in sysfs
+std::vector<int32_t> ParseCpuList(const std::string &list) {
+  std::vector<int32_t> ids;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const std::string range = list.substr(pos, end - pos);
+    const size_t dash = range.find('-');
+    try {
+      const int32_t first = std::stoi(range.substr(0, dash));
+      const int32_t last = (dash == std::string::npos)
+                               ? first
+                               : std::stoi(range.substr(dash + 1));
+      for (int32_t id = first; id <= last; id++) {
+        ids.push_back(id);
+      }
+    } catch (const std::exception &e) {
+      // trailing newline or empty list
+    }
+    pos = end + 1;
+  }
+  return ids;
+}
+
+struct NumaTopology {
+  int32_t numNodes_{1};
+  std::vector<int32_t> nodeOfCore_; // indexed by core
+
+  NumaTopology() {
+    const std::string nodeDir = "/sys/devices/system/node/";
+
+    std::ifstream onlineFile(nodeDir + "online");
+    std::string online;
+    std::getline(onlineFile, online);
+    const std::vector<int32_t> nodes = ParseCpuList(online);
+
+    for (auto node : nodes) {
+      std::ifstream cpuFile(nodeDir + "node" + std::to_string(node) +
+                            "/cpulist");
+      std::string cpus;
+      std::getline(cpuFile, cpus);
+      for (auto core : ParseCpuList(cpus)) {
+        if ((size_t)core >= nodeOfCore_.size()) {
+          nodeOfCore_.resize(core + 1, NumaNodeInvalid);
+        }
+        nodeOfCore_[core] = node;
+      }
+      numNodes_ = std::max(numNodes_, node + 1);
+    }
+
+    LOG(INFO) << "numa nodes=" << numNodes_
+              << " cores with known node=" << nodeOfCore_.size();
+  }
+};
+
+const NumaTopology &GetNumaTopology() {
+  static NumaTopology topology;
+  return topology;
+}
+}
+
+int32_t NumaNumNodes() { return GetNumaTopology().numNodes_; }
+
+int32_t NumaNodeOfCore(CoreId core) {
+  const NumaTopology &topology = GetNumaTopology();
+  if ((core < 0) || ((size_t)core >= topology.nodeOfCore_.size())) {
+    return NumaNodeInvalid;
+  }
+  return topology.nodeOfCore_[core];
+}
+
+// nodes beyond one word of node mask are not supported
+static bool IsValidNode(int32_t node) {
+  return (node >= 0) && (node < (int32_t)(sizeof(unsigned long) * 8));
+}
+
+int32_t SetThreadMemoryNode(int32_t node) {
+  long ret = 0;
+  if (node == NumaNodeInvalid) {
+    ret = syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+  } else if (!IsValidNode(node)) {
+    return -EINVAL;
+  } else {
+    unsigned long nodeMask = (1UL << node);
+    ret = syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask,
+                  sizeof(nodeMask) * 8);
+  }
+  return (ret == 0) ? 0 : -errno;
+}
+
+int32_t BindMemoryToNode(void *addr, size_t len, int32_t node) {
+  if (!IsValidNode(node)) {
+    return -EINVAL;
+  }
+  unsigned long nodeMask = (1UL << node);
+  long ret = syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &nodeMask,
+                     sizeof(nodeMask) * 8, 0);
+  return (ret == 0) ? 0 : -errno;
+}
+
+int32_t NumaNodeOfAddress(const void *addr) {
+  int node = NumaNodeInvalid;
+  long ret = syscall(SYS_get_mempolicy, &node, nullptr, 0, addr,
+                     MPOL_F_NODE | MPOL_F_ADDR);
+  return (ret == 0) ? node : -errno;
+}
+
 // to set realtime priorities
 // add rtprio to /etc/security/limits.conf
 // add pam_limits.so to /etc/pam.d/common-* files
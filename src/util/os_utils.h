@@ -65,5 +65,54 @@ inline CoreId GetCpuCore() {
   thread_local CoreId thisCore_ = sched_getcpu();
   return (thisCore_ >= 0) ? thisCore_ : 0;
 }
+
+// NUMA topology is read from sysfs once; machines without
+// NUMA support appear as a single node 0
+static constexpr int32_t NumaNodeInvalid = -1;
+
+int32_t NumaNumNodes();
+
+// @return node to which core belongs, NumaNodeInvalid if unknown
+int32_t NumaNodeOfCore(CoreId core);
+
+/**
+ * pages which this thread faults in from now on are taken from
+ * node if it has free memory
+ * @param node NumaNodeInvalid restores the default policy
+ * @return 0 on success, else negative errno
+ */
+int32_t SetThreadMemoryNode(int32_t node);
+
+/**
+ * prefer node for pages in range, which must be page aligned
+ * only affects pages not yet faulted in
+ * @return 0 on success, else negative errno
+ */
+int32_t BindMemoryToNode(void *addr, size_t len, int32_t node);
+
+/**
+ * node on which the page containing addr is, which is faulted in
+ * if it was not yet
+ * @return node, else negative errno
+ */
+int32_t NumaNodeOfAddress(const void *addr);
+
+/**
+ * allocations done by this thread within the scope
+ * prefer node; default policy is restored at the end
+ */
+class ScopedMemoryNode {
+  bool isSet_{false};
+
+public:
+  explicit ScopedMemoryNode(int32_t node) {
+    isSet_ = (node != NumaNodeInvalid) && (SetThreadMemoryNode(node) == 0);
+  }
+  ~ScopedMemoryNode() {
+    if (isSet_) {
+      SetThreadMemoryNode(NumaNodeInvalid);
+    }
+  }
+};
 }
 } // namespace
@@ -6,10 +6,16 @@
 #include <sys/epoll.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 using gobjfs::os::IsFdOpen;
 using gobjfs::os::RoundToNext512;
 using gobjfs::os::IsDirectIOAligned;
+using gobjfs::os::NumaNodeInvalid;
+using gobjfs::os::NumaNodeOfAddress;
+using gobjfs::os::NumaNodeOfCore;
+using gobjfs::os::NumaNumNodes;
+using gobjfs::os::SetThreadMemoryNode;
 
 TEST(OSUtils, epollIsOpen) {
   int fd = epoll_create1(0);
@@ -80,3 +86,39 @@ TEST(OSUtils, RoundToNext512) {
     EXPECT_EQ(newVal, 1024);
   }
 }
+
+TEST(OSUtils, NumaTopology) {
+
+  const int32_t numNodes = NumaNumNodes();
+  EXPECT_GE(numNodes, 1);
+
+  // core 0 always exists, but sysfs may not describe it
+  const int32_t node = NumaNodeOfCore(0);
+  EXPECT_TRUE((node == NumaNodeInvalid) || (node < numNodes));
+
+  EXPECT_EQ(NumaNodeOfCore(-1), NumaNodeInvalid);
+  EXPECT_EQ(NumaNodeOfCore(INT16_MAX), NumaNodeInvalid);
+}
+
+TEST(OSUtils, SetThreadMemoryNode) {
+
+  // may be refused inside a container
+  int32_t ret = SetThreadMemoryNode(0);
+  EXPECT_TRUE((ret == 0) || (ret == -EPERM) || (ret == -ENOSYS));
+
+  ret = SetThreadMemoryNode(NumaNodeInvalid);
+  EXPECT_TRUE((ret == 0) || (ret == -EPERM) || (ret == -ENOSYS));
+
+  EXPECT_EQ(SetThreadMemoryNode(1 << 20), -EINVAL);
+}
+
+TEST(OSUtils, NumaNodeOfAddress) {
+
+  std::vector<char> buf(8192);
+  const int32_t node = NumaNodeOfAddress(buf.data());
+  // kernel may be built without NUMA support
+  EXPECT_TRUE(((node >= 0) && (node < NumaNumNodes())) ||
+              (node == -ENOSYS) || (node == -EPERM));
+
+  EXPECT_LT(NumaNodeOfAddress(nullptr), 0);
+}